@@ -18,7 +18,9 @@ CHttpPoller::CHttpPoller(const int ID, const std::string& username, const std::s
 m_username(CURLEncode::URLEncode(username)),
 m_password(CURLEncode::URLEncode(password)),
 m_url(url),
-m_refresh(refresh)
+m_refresh(refresh),
+m_bRequestActive(false),
+m_bHaveResponse(false)
 {
 	// extract the data
 	std::vector<std::string> strextra;
@@ -76,6 +78,12 @@ bool CHttpPoller::StopHardware()
 		m_thread->join();
 		m_thread.reset();
 	}
+	{
+		//the completion of a running request still uses this object
+		std::unique_lock<std::mutex> lock(m_responseMutex);
+		m_responseCond.wait(lock, [this] { return !m_bRequestActive; });
+		m_bHaveResponse = false;
+	}
     m_bIsStarted=false;
     return true;
 }
@@ -93,6 +101,7 @@ void CHttpPoller::Do_Work()
 		if (sec_counter % m_refresh == 0) {
 			GetScript();
 		}
+		ProcessResponse();
 	}
 	_log.Log(LOG_STATUS,"Http: Worker stopped...");
 }
@@ -101,7 +110,6 @@ void CHttpPoller::GetScript()
 {
 	std::string sURL(m_url);
 	std::vector<std::string> ExtraHeaders;
-	std::string sResult;
 
 	if (m_contenttype.length() > 0) {
 		ExtraHeaders.push_back("Content-type: " + m_contenttype);
@@ -133,20 +141,48 @@ void CHttpPoller::GetScript()
 		ExtraHeaders.push_back("Authorization:Basic " + encodedAuth);
 	}
 
-	if (m_method == 0) {
-		if (!HTTPClient::GET(sURL, ExtraHeaders, sResult))
-		{
-			std::string err = "Http: Error getting data from url \"" + sURL + "\"";
-			_log.Log(LOG_ERROR, err);
-			return;
-		}
+	HTTPClient::_eHTTPmethod method;
+	if (m_method == 0)
+		method = HTTPClient::HTTP_METHOD_GET;
+	else if (m_method == 1)
+		method = HTTPClient::HTTP_METHOD_POST;
+	else
+		return;
+
+	{
+		std::lock_guard<std::mutex> l(m_responseMutex);
+		if (m_bRequestActive)
+			return; //previous one is still running
+		m_bRequestActive = true;
 	}
-	if (m_method == 1) {
-		if (!HTTPClient::POST(sURL, m_postdata, ExtraHeaders, sResult)) {
-			std::string err = "Http: Error getting data from url \"" + sURL + "\"";
-			_log.Log(LOG_ERROR, err);
+	//the worker does not wait for the server, the response is processed by ProcessResponse
+	HTTPClient::Request(method, sURL, (method == HTTPClient::HTTP_METHOD_POST) ? m_postdata : "", ExtraHeaders,
+		[this, sURL](const bool bOK, const std::vector<unsigned char> &response, const std::vector<std::string> &/*vHeaderData*/) {
+			std::lock_guard<std::mutex> l(m_responseMutex);
+			if ((bOK) && (!response.empty()))
+			{
+				m_response.assign(response.begin(), response.end());
+				m_bHaveResponse = true;
+			}
+			else
+			{
+				std::string err = "Http: Error getting data from url \"" + sURL + "\"";
+				_log.Log(LOG_ERROR, err);
+			}
+			m_bRequestActive = false;
+			m_responseCond.notify_all();
+		});
+}
+
+void CHttpPoller::ProcessResponse()
+{
+	std::string sResult;
+	{
+		std::lock_guard<std::mutex> l(m_responseMutex);
+		if (!m_bHaveResponse)
 			return;
-		}
+		sResult.swap(m_response);
+		m_bHaveResponse = false;
 	}
 
 	// Got some data, send them to the lua parsers for processing
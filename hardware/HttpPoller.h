@@ -1,6 +1,8 @@
 #pragma once
 
 #include "DomoticzHardware.h"
+#include <condition_variable>
+#include <mutex>
 
 namespace Json
 {
@@ -19,6 +21,7 @@ private:
 	bool StopHardware() override;
 	void Do_Work();
 	void GetScript();
+	void ProcessResponse();
 private:
 	std::string m_username;
 	std::string m_password;
@@ -30,5 +33,12 @@ private:
 	unsigned short m_method;
 	unsigned short m_refresh;
 	std::shared_ptr<std::thread> m_thread;
+
+	//the request runs on the HTTP client thread, the worker runs the script on the response
+	std::mutex m_responseMutex;
+	std::condition_variable m_responseCond;
+	bool m_bRequestActive;
+	bool m_bHaveResponse;
+	std::string m_response;
 };
 
@@ -696,27 +696,24 @@ void MQTT::SendDeviceInfo(const int HwdID, const uint64_t DeviceRowIdx, const st
 		return;
 	}
 
-	std::vector<std::vector<std::string> > result;
-	result = m_sql.safe_query("SELECT HardwareID, DeviceID, Unit, Name, [Type], SubType, nValue, sValue, SwitchType, SignalLevel, BatteryLevel, Options, Description, LastLevel, Color FROM DeviceStatus WHERE (HardwareID==%d) AND (ID==%" PRIu64 ")", HwdID, DeviceRowIdx);
-	if (!result.empty())
+	_tDeviceStatusRow devRow;
+	if ((m_sql.GetDeviceStatusRow(DeviceRowIdx, devRow)) && (devRow.HardwareID == HwdID))
 	{
-		int iIndex = 0;
-		std::vector<std::string> sd = result[0];
-		std::string hwid = sd[iIndex++];
-		std::string did = sd[iIndex++];
-		int dunit = atoi(sd[iIndex++].c_str());
-		std::string name = sd[iIndex++];
-		int dType = atoi(sd[iIndex++].c_str());
-		int dSubType = atoi(sd[iIndex++].c_str());
-		int nvalue = atoi(sd[iIndex++].c_str());
-		std::string svalue = sd[iIndex++];
-		_eSwitchType switchType = (_eSwitchType)atoi(sd[iIndex++].c_str());
-		int RSSI = atoi(sd[iIndex++].c_str());
-		int BatteryLevel = atoi(sd[iIndex++].c_str());
-		std::map<std::string, std::string> options = m_sql.BuildDeviceOptions(sd[iIndex++]);
-		std::string description = sd[iIndex++];
-		int LastLevel = atoi(sd[iIndex++].c_str());
-		std::string sColor = sd[iIndex++];
+		std::string hwid = std::to_string(devRow.HardwareID);
+		std::string did = devRow.DeviceID;
+		int dunit = devRow.Unit;
+		std::string name = devRow.Name;
+		int dType = devRow.Type;
+		int dSubType = devRow.SubType;
+		int nvalue = devRow.nValue;
+		std::string svalue = devRow.sValue;
+		_eSwitchType switchType = (_eSwitchType)devRow.SwitchType;
+		int RSSI = devRow.SignalLevel;
+		int BatteryLevel = devRow.BatteryLevel;
+		std::map<std::string, std::string> options = m_sql.BuildDeviceOptions(devRow.Options);
+		std::string description = devRow.Description;
+		int LastLevel = devRow.LastLevel;
+		std::string sColor = devRow.Color;
 
 		Json::Value root;
 
@@ -776,10 +773,11 @@ void MQTT::SendDeviceInfo(const int HwdID, const uint64_t DeviceRowIdx, const st
 		}
 
 		if (m_publish_topics & PT_floor_room) {
+			std::vector<std::vector<std::string> > result;
 			result = m_sql.safe_query("SELECT F.Name, P.Name, M.DeviceRowID FROM Plans as P, Floorplans as F, DeviceToPlansMap as M WHERE P.FloorplanID=F.ID and M.PlanID=P.ID and M.DeviceRowID=='%" PRIu64 "'", DeviceRowIdx);
 			for (size_t i = 0; i < result.size(); i++)
 			{
-				sd = result[i];
+				std::vector<std::string> sd = result[i];
 				std::string floor = sd[0];
 				std::string room = sd[1];
 				std::stringstream topic;
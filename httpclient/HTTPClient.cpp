@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "HTTPClient.h"
+#include "HTTPEngine.h"
 #include <curl/curl.h>
 #include "../main/Logger.h"
 
@@ -20,6 +21,14 @@ long		HTTPClient::m_iConnectionTimeout = 10;
 long		HTTPClient::m_iTimeout = 90; //max, time that a download has to be finished?
 std::string	HTTPClient::m_sUserAgent = "domoticz/1.0";
 
+//All transfers run here, so connections are reused between calls.
+//Made on first use and never destroyed, Cleanup stops it (no thread to join during static destruction)
+static CHTTPEngine &GetEngine()
+{
+	static CHTTPEngine *pEngine = new CHTTPEngine();
+	return *pEngine;
+}
+
 
 /************************************************************************
  *									*
@@ -88,6 +97,7 @@ bool HTTPClient::CheckIfGlobalInitDone()
 
 void HTTPClient::Cleanup()
 {
+	GetEngine().Stop();
 	if (m_bCurlGlobalInitialized)
 	{
 		curl_global_cleanup();
@@ -222,6 +232,93 @@ void HTTPClient::SetUserAgent(const std::string &useragent)
 	m_sUserAgent = useragent;
 }
 
+void HTTPClient::GetStatistics(std::map<std::string, CHTTPEngine::_tHostStatistics> &stats)
+{
+	GetEngine().GetStatistics(stats);
+}
+
+
+/************************************************************************
+ *									*
+ * asynchronous method							*
+ *									*
+ ************************************************************************/
+
+struct _tAsyncRequest
+{
+	CURL *curl;
+	struct curl_slist *headers;
+	std::string data;
+	std::vector<unsigned char> response;
+	std::vector<std::string> vHeaderData;
+};
+
+void HTTPClient::Request(const _eHTTPmethod method, const std::string &url, const std::string &data, const std::vector<std::string> &ExtraHeaders, const TResponseFunction &callback, const bool bFollowRedirect, const long TimeOut)
+{
+	std::shared_ptr<_tAsyncRequest> request = std::make_shared<_tAsyncRequest>();
+	request->curl = NULL;
+	request->headers = NULL;
+	if (CheckIfGlobalInitDone())
+		request->curl = curl_easy_init();
+	if (!request->curl)
+	{
+		callback(false, request->response, request->vHeaderData);
+		return;
+	}
+	CURL *curl = request->curl;
+	request->data = data;
+
+	SetGlobalOptions(curl);
+	if (TimeOut != -1)
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, TimeOut);
+	if (!bFollowRedirect)
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 0L);
+
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, write_curl_headerdata);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &request->vHeaderData);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&request->response);
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+
+	if (method == HTTP_METHOD_POST)
+		curl_easy_setopt(curl, CURLOPT_POST, 1);
+	else if (method == HTTP_METHOD_PUT)
+		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+	else if (method == HTTP_METHOD_DELETE)
+		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+	if (method != HTTP_METHOD_GET)
+	{
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->data.c_str());
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)request->data.size());
+	}
+
+	for (const auto & itt : ExtraHeaders)
+		request->headers = curl_slist_append(request->headers, itt.c_str());
+	if (request->headers != NULL)
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+
+	CHTTPEngine::TDoneFunction onDone = [request, callback](const int result) {
+		long http_code = 0;
+		curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &http_code);
+		bool bOK = ((result == CURLE_OK) && (http_code) && (http_code < 400));
+		if ((result != CURLE_OK) && (result != CURLE_HTTP_RETURNED_ERROR))
+		{
+			//Need to generate a header
+			std::stringstream ss;
+			ss << "HTTP/1.1 " << result << " " << curl_easy_strerror((CURLcode)result);
+			request->vHeaderData.push_back(ss.str());
+		}
+		else if (!bOK)
+			LogError(http_code);
+
+		curl_easy_cleanup(request->curl);
+		if (request->headers != NULL)
+			curl_slist_free_all(request->headers);
+		callback(bOK, request->response, request->vHeaderData);
+	};
+	if (!GetEngine().Add(curl, url, onDone))
+		onDone(curl_easy_perform(curl));
+}
+
 
 /************************************************************************
  *									*
@@ -259,7 +356,7 @@ bool HTTPClient::GETBinary(const std::string &url, const std::vector<std::string
 		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &vHeaderData);
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&response);
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		res = curl_easy_perform(curl);
+		res = (CURLcode)GetEngine().Perform(curl, url);
 
 		bool bOK = false;
 		if (res == CURLE_OK)
@@ -335,7 +432,9 @@ bool HTTPClient::POSTBinary(const std::string &url, const std::string &postdata,
 		}
 
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postdata.c_str());
-		res = curl_easy_perform(curl);
+		//postdata can be binary (compressed)
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)postdata.size());
+		res = (CURLcode)GetEngine().Perform(curl, url);
 
 		if (res != CURLE_OK)
 		{
@@ -405,7 +504,7 @@ std::vector<std::string> &vHeaderData, const long TimeOut)
 		}
 
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, putdata.c_str());
-		res = curl_easy_perform(curl);
+		res = (CURLcode)GetEngine().Perform(curl, url);
 
 		if (res != CURLE_OK)
 		{
@@ -475,7 +574,7 @@ std::vector<std::string> &vHeaderData, const long TimeOut)
 		}
 
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, putdata.c_str());
-		res = curl_easy_perform(curl);
+		res = (CURLcode)GetEngine().Perform(curl, url);
 
 		if (res != CURLE_OK)
 		{
@@ -554,7 +653,7 @@ bool HTTPClient::GETBinarySingleLine(const std::string &url, const std::vector<s
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_curl_data_single_line);
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&response);
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		res = curl_easy_perform(curl);
+		res = (CURLcode)GetEngine().Perform(curl, url);
 
 		if (
 			(res == CURLE_WRITE_ERROR) &&
@@ -744,7 +843,7 @@ bool HTTPClient::GETBinaryToFile(const std::string &url, const std::string &outp
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_curl_data_file);
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&outfile);
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		res = curl_easy_perform(curl);
+		res = (CURLcode)GetEngine().Perform(curl, url);
 		curl_easy_cleanup(curl);
 
 		outfile.close();
@@ -1,4 +1,7 @@
 #pragma once
+#include <functional>
+#include <map>
+#include "HTTPEngine.h"
 
 class HTTPClient
 {
@@ -38,6 +41,9 @@ public:
 	static void SetUserAgent(const std::string &useragent);
 	static void SetSecurityOptions(const bool verifypeer, const bool verifyhost);
 
+	//Requests, connections and timings per host
+	static void GetStatistics(std::map<std::string, CHTTPEngine::_tHostStatistics> &stats);
+
 
 	/************************************************************************
 	 *									*
@@ -108,6 +114,18 @@ std::vector<std::string> &vHeaderData, const long TimeOut = -1);
 std::vector<std::string> &vHeaderData, const long TimeOut = -1);
 
 
+	/************************************************************************
+	 *									*
+	 * asynchronous method							*
+	 *   - returns at once, the callback is called on the HTTP client	*
+	 *     thread when the request is finished. Keep it short and do not	*
+	 *     wait for other requests in it					*
+	 *									*
+	 ************************************************************************/
+
+	typedef std::function<void(const bool bOK, const std::vector<unsigned char> &response, const std::vector<std::string> &vHeaderData)> TResponseFunction;
+	static void Request(const _eHTTPmethod method, const std::string &url, const std::string &data, const std::vector<std::string> &ExtraHeaders, const TResponseFunction &callback, const bool bFollowRedirect = true, const long TimeOut = -1);
+
 
 private:
 	static void SetGlobalOptions(void *curlobj);
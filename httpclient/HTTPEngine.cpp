@@ -0,0 +1,244 @@
+#include "stdafx.h"
+#include "HTTPEngine.h"
+#include <curl/curl.h>
+#include <condition_variable>
+#include "../main/Helper.h"
+#include "../main/Logger.h"
+
+// connections to one host, more requests wait for a free connection
+#define HTTP_MAX_HOST_CONNECTIONS 4
+// idle connections kept for reuse
+#define HTTP_MAX_CACHED_CONNECTIONS 32
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+	//curl_multi_poll/curl_multi_wakeup (7.68.0)
+	#define HTTP_HAVE_MULTI_WAKEUP
+	#define HTTP_POLL_TIMEOUT 1000
+#else
+	//new requests are picked up when the wait times out
+	#define HTTP_POLL_TIMEOUT 50
+#endif
+
+CHTTPEngine::CHTTPEngine() :
+	m_multi(NULL),
+	m_bStopRequested(false),
+	m_bStopped(false)
+{
+}
+
+CHTTPEngine::~CHTTPEngine()
+{
+	Stop();
+}
+
+bool CHTTPEngine::StartIfNeeded()
+{
+	//called with m_mutex locked
+	if (m_bStopped)
+		return false;
+	if (m_thread)
+		return true;
+	CURLM *multi = curl_multi_init();
+	if (multi == NULL)
+	{
+		_log.Log(LOG_ERROR, "HTTPClient: Could not create curl multi handle!");
+		return false;
+	}
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)HTTP_MAX_HOST_CONNECTIONS);
+	curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)HTTP_MAX_CACHED_CONNECTIONS);
+	m_multi = multi;
+	m_thread = std::make_shared<std::thread>(&CHTTPEngine::Do_Work, this);
+	SetThreadName(m_thread->native_handle(), "HTTPClient");
+	return true;
+}
+
+void CHTTPEngine::Stop()
+{
+	std::shared_ptr<std::thread> thread;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_bStopped = true;
+		if (!m_thread)
+			return;
+		m_bStopRequested = true;
+		thread.swap(m_thread);
+		Wakeup();
+	}
+	thread->join();
+	std::lock_guard<std::mutex> l(m_mutex);
+	curl_multi_cleanup((CURLM*)m_multi);
+	m_multi = NULL;
+}
+
+void CHTTPEngine::Wakeup()
+{
+	//called with m_mutex locked, so Stop can not free the multi handle meanwhile
+#ifdef HTTP_HAVE_MULTI_WAKEUP
+	if (m_multi != NULL)
+		curl_multi_wakeup((CURLM*)m_multi);
+#endif
+}
+
+std::string CHTTPEngine::GetHost(const std::string &url)
+{
+	size_t pos = url.find("://");
+	pos = (pos == std::string::npos) ? 0 : pos + 3;
+	size_t end = url.find_first_of("/?#", pos);
+	std::string host = url.substr(pos, (end == std::string::npos) ? std::string::npos : end - pos);
+	//no credentials in the statistics
+	size_t at = host.rfind('@');
+	if (at != std::string::npos)
+		host = host.substr(at + 1);
+	return host;
+}
+
+bool CHTTPEngine::Add(void *curlobj, const std::string &url, const TDoneFunction &onDone)
+{
+	_tTransfer transfer;
+	transfer.curl = curlobj;
+	transfer.host = GetHost(url);
+	transfer.onDone = onDone;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!StartIfNeeded())
+			return false;
+		m_pending.push_back(transfer);
+		m_stats[transfer.host].active++;
+		Wakeup();
+	}
+	return true;
+}
+
+int CHTTPEngine::Perform(void *curlobj, const std::string &url)
+{
+	{
+		//a completion function that makes a blocking call would wait for itself
+		std::lock_guard<std::mutex> l(m_mutex);
+		if ((m_thread) && (m_thread->get_id() == std::this_thread::get_id()))
+			return curl_easy_perform((CURL*)curlobj);
+	}
+	std::mutex doneMutex;
+	std::condition_variable doneCondition;
+	bool bDone = false;
+	int res = CURLE_OK;
+	bool bAdded = Add(curlobj, url, [&](const int result) {
+		std::lock_guard<std::mutex> l(doneMutex);
+		res = result;
+		bDone = true;
+		doneCondition.notify_one();
+	});
+	if (!bAdded)
+		return curl_easy_perform((CURL*)curlobj);
+
+	std::unique_lock<std::mutex> lock(doneMutex);
+	doneCondition.wait(lock, [&] { return bDone; });
+	return res;
+}
+
+void CHTTPEngine::Finish(const _tTransfer &transfer, const int result)
+{
+	CURL *curl = (CURL*)transfer.curl;
+	long http_code = 0;
+	long connects = 0;
+	double totalTime = 0;
+	double connectTime = 0;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+	curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+	curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &totalTime);
+	curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &connectTime);
+	if (connectTime == 0)
+		curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connectTime);
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		_tHostStatistics &stats = m_stats[transfer.host];
+		stats.active--;
+		stats.requests++;
+		if ((result != CURLE_OK) || (http_code >= 400))
+			stats.failed++;
+		stats.connects += connects;
+		stats.totalTime += totalTime;
+		stats.connectTime += connectTime;
+		if (totalTime > stats.maxTime)
+			stats.maxTime = totalTime;
+	}
+	try
+	{
+		transfer.onDone(result);
+	}
+	catch (...)
+	{
+		_log.Log(LOG_ERROR, "HTTPClient: Exception in completion of request to %s", transfer.host.c_str());
+	}
+}
+
+void CHTTPEngine::Do_Work()
+{
+	CURLM *multi = (CURLM*)m_multi;
+	while (true)
+	{
+		std::vector<_tTransfer> added;
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			if (m_bStopRequested)
+				break;
+			added.swap(m_pending);
+		}
+		for (const auto & itt : added)
+		{
+			if (curl_multi_add_handle(multi, (CURL*)itt.curl) != CURLM_OK)
+			{
+				Finish(itt, CURLE_FAILED_INIT);
+				continue;
+			}
+			m_running[itt.curl] = itt;
+		}
+
+		int running = 0;
+		curl_multi_perform(multi, &running);
+
+		CURLMsg *msg;
+		int left = 0;
+		while ((msg = curl_multi_info_read(multi, &left)) != NULL)
+		{
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			//msg is not valid anymore after the handle is removed
+			CURL *curl = msg->easy_handle;
+			CURLcode res = msg->data.result;
+			curl_multi_remove_handle(multi, curl);
+			std::map<void*, _tTransfer>::iterator itt = m_running.find(curl);
+			if (itt == m_running.end())
+				continue;
+			_tTransfer transfer = itt->second;
+			m_running.erase(itt);
+			Finish(transfer, res);
+		}
+
+#ifdef HTTP_HAVE_MULTI_WAKEUP
+		curl_multi_poll(multi, NULL, 0, HTTP_POLL_TIMEOUT, NULL);
+#else
+		curl_multi_wait(multi, NULL, 0, HTTP_POLL_TIMEOUT, NULL);
+#endif
+	}
+
+	//whoever is still waiting gets an error
+	for (const auto & itt : m_running)
+	{
+		curl_multi_remove_handle(multi, (CURL*)itt.first);
+		Finish(itt.second, CURLE_ABORTED_BY_CALLBACK);
+	}
+	m_running.clear();
+	std::vector<_tTransfer> pending;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		pending.swap(m_pending);
+	}
+	for (const auto & itt : pending)
+		Finish(itt, CURLE_ABORTED_BY_CALLBACK);
+}
+
+void CHTTPEngine::GetStatistics(std::map<std::string, _tHostStatistics> &stats)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	stats = m_stats;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Runs the transfers of all HTTPClient calls on one thread with a single curl multi handle.
+//Connections (and TLS sessions) stay in the cache of the multi handle, so requests to the same host reuse them,
+//and the number of connections per host is limited (more requests to that host wait inside libcurl).
+class CHTTPEngine
+{
+public:
+	//result is a CURLcode
+	typedef std::function<void(const int result)> TDoneFunction;
+
+	struct _tHostStatistics
+	{
+		uint64_t requests;
+		uint64_t failed;
+		uint64_t connects;		//requests that needed a new connection, the others reused one
+		uint64_t active;		//running or waiting for a connection
+		double totalTime;		//seconds, all requests together
+		double connectTime;		//seconds, including the TLS handshake
+		double maxTime;
+	};
+
+	CHTTPEngine();
+	~CHTTPEngine();
+	void Stop();
+
+	//Starts the transfer of a prepared easy handle. onDone is called on the engine thread when it is finished,
+	//the handle belongs to the caller again from then. onDone should be short, all transfers wait for it.
+	//False when the engine is stopped (onDone is not called)
+	bool Add(void *curlobj, const std::string &url, const TDoneFunction &onDone);
+	//Waits for the transfer, replacement for curl_easy_perform
+	int Perform(void *curlobj, const std::string &url);
+
+	void GetStatistics(std::map<std::string, _tHostStatistics> &stats);
+private:
+	struct _tTransfer
+	{
+		void *curl;
+		std::string host;
+		TDoneFunction onDone;
+	};
+	bool StartIfNeeded();
+	void Do_Work();
+	void Wakeup();
+	void Finish(const _tTransfer &transfer, const int result);
+	static std::string GetHost(const std::string &url);
+
+	std::mutex m_mutex;
+	std::shared_ptr<std::thread> m_thread;
+	void *m_multi;
+	bool m_bStopRequested;
+	bool m_bStopped;
+	std::vector<_tTransfer> m_pending;			//not yet given to the multi handle
+	std::map<void*, _tTransfer> m_running;		//only used by the engine thread
+	std::map<std::string, _tHostStatistics> m_stats;
+};
@@ -0,0 +1,99 @@
+#include "stdafx.h"
+#include "ChangeJournal.h"
+#include <ctime>
+
+//deleted rows that are remembered, after that clients that are further behind reload everything
+#define JOURNAL_MAX_DELETED 1024
+
+CChangeJournal::CChangeJournal() :
+	m_sequence(0),
+	m_forgotten(0),
+	m_deleted(0)
+{
+	m_ID = std::to_string(time(NULL));
+}
+
+void CChangeJournal::Clear()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	//a restarted journal has to look different to clients of the previous one
+	std::string newID = std::to_string(time(NULL));
+	if (newID == m_ID)
+		newID += "-" + std::to_string(m_sequence);
+	m_ID = newID;
+	m_sequence = 0;
+	m_forgotten = 0;
+	m_deleted = 0;
+	m_latest.clear();
+	m_changes.clear();
+}
+
+void CChangeJournal::Add(const _eJournalType type, const uint64_t ID, const bool bDeleted)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::pair<int, uint64_t> key(type, ID);
+	std::map<std::pair<int, uint64_t>, uint64_t>::iterator itt = m_latest.find(key);
+	if (itt != m_latest.end())
+	{
+		std::map<uint64_t, _tJournalChange>::iterator ittChange = m_changes.find(itt->second);
+		if (ittChange->second.bDeleted)
+			m_deleted--;
+		m_changes.erase(ittChange);
+	}
+	_tJournalChange change;
+	change.type = type;
+	change.ID = ID;
+	change.sequence = ++m_sequence;
+	change.bDeleted = bDeleted;
+	m_changes[change.sequence] = change;
+	m_latest[key] = change.sequence;
+	if (!bDeleted)
+		return;
+
+	m_deleted++;
+	if (m_deleted <= JOURNAL_MAX_DELETED)
+		return;
+	//forget the oldest delete, everything before it can not be answered anymore
+	for (std::map<uint64_t, _tJournalChange>::iterator ittChange = m_changes.begin(); ittChange != m_changes.end(); ++ittChange)
+	{
+		if (!ittChange->second.bDeleted)
+			continue;
+		m_forgotten = ittChange->first;
+		m_latest.erase(std::make_pair((int)ittChange->second.type, ittChange->second.ID));
+		m_changes.erase(ittChange);
+		m_deleted--;
+		break;
+	}
+}
+
+void CChangeJournal::OnChanged(const _eJournalType type, const uint64_t ID)
+{
+	Add(type, ID, false);
+}
+
+void CChangeJournal::OnDeleted(const _eJournalType type, const uint64_t ID)
+{
+	Add(type, ID, true);
+}
+
+bool CChangeJournal::GetChanges(const uint64_t since, std::vector<_tJournalChange> &changes)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	if ((since < m_forgotten) || (since > m_sequence))
+		return false;
+	for (std::map<uint64_t, _tJournalChange>::const_iterator itt = m_changes.upper_bound(since); itt != m_changes.end(); ++itt)
+		changes.push_back(itt->second);
+	return true;
+}
+
+uint64_t CChangeJournal::GetSequence()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_sequence;
+}
+
+std::string CChangeJournal::GetID()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_ID;
+}
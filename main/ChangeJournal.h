@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum _eJournalType
+{
+	JOURNAL_DEVICE = 0,
+	JOURNAL_SCENE,
+	JOURNAL_VARIABLE,
+};
+
+struct _tJournalChange
+{
+	_eJournalType type;
+	uint64_t ID;
+	uint64_t sequence;
+	bool bDeleted;
+};
+
+//Sequence numbers of the last change of every device, scene and user variable (since startup),
+//so polling clients can ask for what changed since the last sequence they have seen.
+//Every row has one entry (the latest change), deleted rows are kept for JOURNAL_MAX_DELETED deletes.
+class CChangeJournal
+{
+public:
+	CChangeJournal();
+
+	//Start over, with a new journal ID (clients of the old journal will reload everything)
+	void Clear();
+	void OnChanged(const _eJournalType type, const uint64_t ID);
+	void OnDeleted(const _eJournalType type, const uint64_t ID);
+
+	//Changes after 'since' in sequence order. False when changes after 'since' were forgotten,
+	//or since is not a sequence of this journal, then the client has to reload everything
+	bool GetChanges(const uint64_t since, std::vector<_tJournalChange> &changes);
+	uint64_t GetSequence();
+	std::string GetID();
+private:
+	void Add(const _eJournalType type, const uint64_t ID, const bool bDeleted);
+
+	std::mutex m_mutex;
+	std::string m_ID;
+	uint64_t m_sequence;
+	uint64_t m_forgotten;		//changes up to this sequence are not in the journal anymore
+	size_t m_deleted;
+	std::map<std::pair<int, uint64_t>, uint64_t> m_latest;		//(type, ID) -> sequence of its last change
+	std::map<uint64_t, _tJournalChange> m_changes;				//sequence -> change
+};
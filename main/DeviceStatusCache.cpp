@@ -0,0 +1,232 @@
+#include "stdafx.h"
+#include "DeviceStatusCache.h"
+
+_tDeviceStatusRow::_tDeviceStatusRow() :
+	ID(0),
+	HardwareID(0),
+	Unit(0),
+	Used(false),
+	Type(0),
+	SubType(0),
+	SwitchType(0),
+	Favorite(0),
+	SignalLevel(0),
+	BatteryLevel(0),
+	nValue(0),
+	Order(0),
+	AddjValue(0.0),
+	AddjMulti(1.0),
+	AddjValue2(0.0),
+	AddjMulti2(1.0),
+	LastLevel(0),
+	Protected(0),
+	CustomImage(0)
+{
+}
+
+CDeviceStatusCache::CDeviceStatusCache() :
+	m_bLoaded(false)
+{
+}
+
+void CDeviceStatusCache::Clear()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_bLoaded = false;
+	m_rows.clear();
+	m_keys.clear();
+	m_duplicateKeys.clear();
+	m_stale.clear();
+}
+
+bool CDeviceStatusCache::IsLoaded()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_bLoaded;
+}
+
+void CDeviceStatusCache::SetLoaded()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_bLoaded = true;
+}
+
+void CDeviceStatusCache::OnRowChanged(const uint64_t ID)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<uint64_t, _tCacheEntry>::iterator itt = m_rows.find(ID);
+	if (itt == m_rows.end())
+	{
+		_tCacheEntry entry;
+		entry.generation = 1;
+		entry.loadedGeneration = 0;
+		entry.bLoaded = false;
+		m_rows[ID] = entry;
+	}
+	else
+		itt->second.generation++;
+	m_stale.insert(ID);
+}
+
+void CDeviceStatusCache::OnRowDeleted(const uint64_t ID)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<uint64_t, _tCacheEntry>::iterator itt = m_rows.find(ID);
+	if (itt == m_rows.end())
+		return;
+	if (itt->second.bLoaded)
+		RemoveKey(itt->second.row);
+	m_rows.erase(itt);
+	m_stale.erase(ID);
+}
+
+void CDeviceStatusCache::GetStaleRows(std::vector<std::pair<uint64_t, uint32_t> > &rows)
+{
+	rows.clear();
+	std::lock_guard<std::mutex> l(m_mutex);
+	for (const auto & itt : m_stale)
+	{
+		std::map<uint64_t, _tCacheEntry>::const_iterator ittEntry = m_rows.find(itt);
+		if (ittEntry != m_rows.end())
+			rows.push_back(std::make_pair(itt, ittEntry->second.generation));
+	}
+}
+
+bool CDeviceStatusCache::HasStaleRows()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return !m_stale.empty();
+}
+
+void CDeviceStatusCache::Store(const _tDeviceStatusRow &row, const uint32_t generation, const bool bCreate)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<uint64_t, _tCacheEntry>::iterator itt = m_rows.find(row.ID);
+	if (itt == m_rows.end())
+	{
+		if (!bCreate)
+			return; //deleted while we were loading it
+		_tCacheEntry entry;
+		entry.generation = generation;
+		entry.loadedGeneration = generation;
+		entry.bLoaded = true;
+		entry.row = row;
+		m_rows[row.ID] = entry;
+		AddKey(row);
+		return;
+	}
+	_tCacheEntry &entry = itt->second;
+	if (entry.bLoaded)
+		RemoveKey(entry.row);
+	entry.row = row;
+	entry.loadedGeneration = generation;
+	entry.bLoaded = true;
+	AddKey(row);
+	if (entry.generation == generation)
+		m_stale.erase(row.ID);
+}
+
+bool CDeviceStatusCache::StoreWrite(const _tDeviceStatusRow &row, const uint32_t generation)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<uint64_t, _tCacheEntry>::iterator itt = m_rows.find(row.ID);
+	if (itt == m_rows.end())
+		return false;
+	_tCacheEntry &entry = itt->second;
+	if ((!entry.bLoaded) || (entry.loadedGeneration != generation) || (entry.generation != generation + 1))
+		return false; //someone else changed the row as well, it will be reloaded
+	RemoveKey(entry.row);
+	entry.row = row;
+	entry.loadedGeneration = entry.generation;
+	AddKey(row);
+	m_stale.erase(row.ID);
+	return true;
+}
+
+void CDeviceStatusCache::RemoveUnlisted(const std::set<uint64_t> &rows)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<uint64_t, _tCacheEntry>::iterator itt = m_rows.begin();
+	while (itt != m_rows.end())
+	{
+		if ((rows.find(itt->first) == rows.end()) && (m_stale.find(itt->first) == m_stale.end()))
+		{
+			if (itt->second.bLoaded)
+				RemoveKey(itt->second.row);
+			itt = m_rows.erase(itt);
+		}
+		else
+			++itt;
+	}
+}
+
+bool CDeviceStatusCache::Get(const uint64_t ID, _tDeviceStatusRow &row, uint32_t &generation)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<uint64_t, _tCacheEntry>::const_iterator itt = m_rows.find(ID);
+	if (itt == m_rows.end())
+		return false;
+	if ((!itt->second.bLoaded) || (itt->second.loadedGeneration != itt->second.generation))
+		return false;
+	row = itt->second.row;
+	generation = itt->second.generation;
+	return true;
+}
+
+bool CDeviceStatusCache::Find(const int HardwareID, const std::string &DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow &row, uint32_t &generation)
+{
+	uint64_t ID;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		std::map<_tDeviceKey, uint64_t>::const_iterator itt = m_keys.find(std::make_tuple(HardwareID, DeviceID, unit, devType, subType));
+		if (itt == m_keys.end())
+			return false;
+		ID = itt->second;
+	}
+	return Get(ID, row, generation);
+}
+
+bool CDeviceStatusCache::IsDuplicateKey(const int HardwareID, const std::string &DeviceID, const int unit, const int devType, const int subType)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return (m_duplicateKeys.find(std::make_tuple(HardwareID, DeviceID, unit, devType, subType)) != m_duplicateKeys.end());
+}
+
+void CDeviceStatusCache::GetAll(std::vector<_tDeviceStatusRow> &rows)
+{
+	rows.clear();
+	std::lock_guard<std::mutex> l(m_mutex);
+	rows.reserve(m_rows.size());
+	for (const auto & itt : m_rows)
+	{
+		if (itt.second.bLoaded)
+			rows.push_back(itt.second.row);
+	}
+}
+
+size_t CDeviceStatusCache::Size()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_rows.size();
+}
+
+void CDeviceStatusCache::AddKey(const _tDeviceStatusRow &row)
+{
+	_tDeviceKey key = std::make_tuple(row.HardwareID, row.DeviceID, row.Unit, row.Type, row.SubType);
+	std::map<_tDeviceKey, uint64_t>::iterator itt = m_keys.find(key);
+	if ((itt != m_keys.end()) && (itt->second != row.ID) && (m_rows.find(itt->second) != m_rows.end()))
+	{
+		m_duplicateKeys.insert(key);
+		//Duplicates should not exist, but keep the same row as a 'SELECT ... WHERE' would (lowest ID)
+		if (itt->second < row.ID)
+			return;
+	}
+	m_keys[key] = row.ID;
+}
+
+void CDeviceStatusCache::RemoveKey(const _tDeviceStatusRow &row)
+{
+	std::map<_tDeviceKey, uint64_t>::iterator itt = m_keys.find(std::make_tuple(row.HardwareID, row.DeviceID, row.Unit, row.Type, row.SubType));
+	if ((itt != m_keys.end()) && (itt->second == row.ID))
+		m_keys.erase(itt);
+}
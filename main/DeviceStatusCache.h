@@ -0,0 +1,95 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+//In-memory copy of a DeviceStatus row
+struct _tDeviceStatusRow
+{
+	uint64_t ID;
+	int HardwareID;
+	std::string DeviceID;
+	int Unit;
+	std::string Name;
+	bool Used;
+	int Type;
+	int SubType;
+	int SwitchType;
+	int Favorite;
+	int SignalLevel;
+	int BatteryLevel;
+	int nValue;
+	std::string sValue;
+	std::string LastUpdate;
+	int Order;
+	double AddjValue;
+	double AddjMulti;
+	double AddjValue2;
+	double AddjMulti2;
+	std::string StrParam1;
+	std::string StrParam2;
+	int LastLevel;
+	int Protected;
+	int CustomImage;
+	std::string Description;
+	std::string Options;
+	std::string Color;
+
+	_tDeviceStatusRow();
+};
+
+//Indexed (by row ID and by HardwareID/DeviceID/Unit/Type/SubType) copy of the DeviceStatus table.
+//SQLite stays the storage, every change made on the connection bumps the generation of the row
+//(through the sqlite3 update hook), rows are only served when the loaded generation is the current one.
+class CDeviceStatusCache
+{
+	typedef std::tuple<int, std::string, int, int, int> _tDeviceKey;
+	struct _tCacheEntry
+	{
+		_tDeviceStatusRow row;
+		uint32_t generation;		//bumped on every change in the database
+		uint32_t loadedGeneration;	//generation the row data was loaded at
+		bool bLoaded;
+	};
+public:
+	CDeviceStatusCache();
+
+	void Clear();
+	bool IsLoaded();
+	void SetLoaded();
+
+	//Called from the sqlite update hook, should never query the database
+	void OnRowChanged(const uint64_t ID);
+	void OnRowDeleted(const uint64_t ID);
+
+	//Rows that need to be (re)loaded, together with their current generation
+	void GetStaleRows(std::vector<std::pair<uint64_t, uint32_t> > &rows);
+	bool HasStaleRows();
+	//Store a row that was loaded from the database at the given generation
+	void Store(const _tDeviceStatusRow &row, const uint32_t generation, const bool bCreate);
+	//Store a row we just wrote ourselves, only accepted if our write is the only change since generation
+	bool StoreWrite(const _tDeviceStatusRow &row, const uint32_t generation);
+	//Forget rows that were not seen by a full load
+	void RemoveUnlisted(const std::set<uint64_t> &rows);
+
+	bool Get(const uint64_t ID, _tDeviceStatusRow &row, uint32_t &generation);
+	bool Find(const int HardwareID, const std::string &DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow &row, uint32_t &generation);
+	//More than one row was seen with this HardwareID/DeviceID/Unit/Type/SubType, Find only returns one of them
+	bool IsDuplicateKey(const int HardwareID, const std::string &DeviceID, const int unit, const int devType, const int subType);
+	void GetAll(std::vector<_tDeviceStatusRow> &rows);
+	size_t Size();
+private:
+	void AddKey(const _tDeviceStatusRow &row);
+	void RemoveKey(const _tDeviceStatusRow &row);
+
+	std::mutex m_mutex;
+	bool m_bLoaded;
+	std::map<uint64_t, _tCacheEntry> m_rows;
+	std::map<_tDeviceKey, uint64_t> m_keys;
+	std::set<_tDeviceKey> m_duplicateKeys;	//only cleared with the whole table, duplicates are rare
+	std::set<uint64_t> m_stale;
+};
@@ -122,9 +122,17 @@ const CEventSystem::_tJsonMap CEventSystem::JsonMap[] =
 	{ NULL,					NULL,						JTYPE_STRING	}
 };
 
-CEventSystem::CEventSystem(void)
+CEventSystem::CEventSystem(void) :
+	m_luaStatePool(CEventSystem::InitLuaState),
+	m_dzVentsStatePool(CdzVents::InitLuaState)
 {
 	m_bEnabled = false;
+	m_bDatabaseScripts = false;
+	m_deviceVersion = 0;
+	m_deviceStatesGeneration = 0;
+	m_measureEnergyDivider = 0;
+	m_measureGasDivider = 0;
+	m_measureWaterDivider = 0;
 }
 
 CEventSystem::~CEventSystem(void)
@@ -146,6 +154,7 @@ void CEventSystem::StartEventSystem()
 	m_sql.GetPreferencesVar("SecStatus", m_SecStatus);
 
 	LoadEvents();
+	m_scriptRegistry.Start();
 	GetCurrentStates();
 	GetCurrentScenesGroups();
 	GetCurrentUserVariables();
@@ -181,6 +190,12 @@ void CEventSystem::StopEventSystem()
 #ifdef ENABLE_PYTHON
 	Plugins::PythonEventsStop();
 #endif
+
+	m_scriptRegistry.Stop();
+
+	std::lock_guard<std::mutex> l(luaMutex);
+	m_luaStatePool.Clear();
+	m_dzVentsStatePool.Clear();
 }
 
 void CEventSystem::SetEnabled(const bool bEnabled)
@@ -210,6 +225,8 @@ void CEventSystem::LoadEvents()
 	dzvents->m_scriptsDir = szUserDataFolder + "scripts/dzVents/scripts/";
 	dzvents->m_runtimeDir = szStartupFolder + "dzVents/runtime/";
 #endif
+	m_scriptRegistry.SetDirectory(SCRIPTDIR_LUA, m_lua_Dir, ".lua");
+	m_scriptRegistry.SetDirectory(SCRIPTDIR_DZVENTS, dzvents->m_scriptsDir, ".lua");
 
 	boost::unique_lock<boost::shared_mutex> eventsMutexLock(m_eventsMutex);
 	_log.Log(LOG_STATUS, "EventSystem: reset all events...");
@@ -257,6 +274,7 @@ void CEventSystem::LoadEvents()
 	result = m_sql.safe_query(
 		"SELECT ID, Name, Interpreter, Type, Status, XMLStatement FROM EventMaster "
 		"WHERE Interpreter <> 'Blockly' AND Status > 0 ORDER BY ID");
+	dzvents->ClearDatabaseTriggers();
 
 	if (!result.empty())
 	{
@@ -278,6 +296,7 @@ void CEventSystem::LoadEvents()
 			// Write active dzVents scripts to disk.
 			if ((eitem.Interpreter == "dzVents") && (eitem.EventStatus != 0))
 			{
+				dzvents->AddDatabaseTriggers(eitem.Actions);
 				s = dzv_Dir + eitem.Name.c_str() + ".lua";
 				_log.Log(LOG_STATUS, "dzVents: Write file: %s", s.c_str());
 				FILE *fOut = fopen(s.c_str(), "wb+");
@@ -294,11 +313,63 @@ void CEventSystem::LoadEvents()
 			}
 		}
 	}
+	BuildEventIndex();
 #ifdef _DEBUG
 	_log.Log(LOG_STATUS, "EventSystem: Events (re)loaded");
 #endif
 }
 
+//Should be called with m_eventsMutex locked
+void CEventSystem::BuildEventIndex()
+{
+	m_blocklyDeviceEvents.clear();
+	m_blocklyVariableEvents.clear();
+	m_blocklySecurityEvents.clear();
+	m_blocklyTimeEvents.clear();
+	m_bDatabaseScripts = false;
+
+	for (size_t index = 0; index < m_events.size(); index++)
+	{
+		const _tEventItem &eitem = m_events[index];
+		if (eitem.Interpreter != "Blockly")
+		{
+			if ((eitem.Interpreter == "Lua") || (eitem.Interpreter == "Python"))
+				m_bDatabaseScripts = true;
+			continue;
+		}
+
+		// every [idx] can match a device, variable[idx] is a variable as well
+		const std::string &conditions = eitem.Conditions;
+		const size_t len = conditions.length();
+		size_t pos = 0;
+		while ((pos = conditions.find('[', pos)) != std::string::npos)
+		{
+			size_t epos = pos + 1;
+			while ((epos < len) && isdigit((unsigned char)conditions[epos]))
+				epos++;
+			if ((epos > pos + 1) && (epos < len) && (conditions[epos] == ']') && ((conditions[pos + 1] != '0') || (epos == pos + 2)))
+			{
+				uint64_t idx = std::strtoull(conditions.substr(pos + 1, epos - pos - 1).c_str(), NULL, 10);
+				std::vector<size_t> &devEvents = m_blocklyDeviceEvents[idx];
+				if (devEvents.empty() || (devEvents.back() != index))
+					devEvents.push_back(index);
+				if ((pos >= 8) && (conditions.compare(pos - 8, 8, "variable") == 0))
+				{
+					std::vector<size_t> &varEvents = m_blocklyVariableEvents[idx];
+					if (varEvents.empty() || (varEvents.back() != index))
+						varEvents.push_back(index);
+				}
+			}
+			pos++;
+		}
+		if (conditions.find("securitystatus") != std::string::npos)
+			m_blocklySecurityEvents.push_back(index);
+		// time rules will only run when time or date based criteria are found
+		if ((conditions.find("timeofday") != std::string::npos) || (conditions.find("weekday") != std::string::npos))
+			m_blocklyTimeEvents.push_back(index);
+	}
+}
+
 void CEventSystem::Do_Work()
 {
 #ifdef ENABLE_PYTHON
@@ -307,6 +378,7 @@ void CEventSystem::Do_Work()
 #else
 	m_python_Dir = szUserDataFolder + "scripts/python/";
 #endif
+	m_scriptRegistry.SetDirectory(SCRIPTDIR_PYTHON, m_python_Dir, ".py");
 #endif
 	time_t lasttime = mytime(NULL);
 	struct tm tmptime;
@@ -440,81 +512,85 @@ void CEventSystem::GetCurrentStates()
 
 	_log.Log(LOG_STATUS, "EventSystem: reset all device statuses...");
 	m_devicestates.clear();
+	m_deviceStatesGeneration++;
 
-	result = m_sql.safe_query("SELECT A.HardwareID, A.ID, A.Name, A.nValue, A.sValue, A.Type, A.SubType, A.SwitchType, A.LastUpdate, A.LastLevel, A.Options, A.Description, A.BatteryLevel, A.SignalLevel, A.Unit, A.DeviceID, A.Protected "
-		"FROM DeviceStatus AS A, Hardware AS B "
-		"WHERE (A.Used = '1') AND (B.ID == A.HardwareID) AND (B.Enabled == 1)");
-	if (!result.empty())
+	std::set<int> _enabledHardware;
+	result = m_sql.safe_query("SELECT ID FROM Hardware WHERE (Enabled == 1)");
+	for (const auto & itt : result)
+		_enabledHardware.insert(atoi(itt[0].c_str()));
+
+	std::vector<_tDeviceStatusRow> _devices;
+	m_sql.GetDeviceStatusRows(_devices);
+
+	std::map<uint64_t, _tDeviceStatus> m_devicestates_temp;
+	for (const auto & itt : _devices)
 	{
-		std::map<uint64_t, _tDeviceStatus> m_devicestates_temp;
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt = result.begin(); itt != result.end(); ++itt)
-		{
-			std::vector<std::string> sd = *itt;
+		if ((!itt.Used) || (_enabledHardware.find(itt.HardwareID) == _enabledHardware.end()))
+			continue;
 
-			_tDeviceStatus sitem;
+		_tDeviceStatus sitem;
 
-			// Fix string capacity to avoid map entry resizing
-			std::string l_deviceName;		l_deviceName.reserve(100);
-			std::string l_sValue;			l_sValue.reserve(200);
-			std::string l_nValueWording;	l_nValueWording.reserve(20);
-			std::string l_lastUpdate;		l_lastUpdate.reserve(30);
-			std::string l_description;		l_description.reserve(200);
-			std::string l_deviceID;			l_deviceID.reserve(25);
+		// Fix string capacity to avoid map entry resizing
+		std::string l_deviceName;		l_deviceName.reserve(100);
+		std::string l_sValue;			l_sValue.reserve(200);
+		std::string l_nValueWording;	l_nValueWording.reserve(20);
+		std::string l_lastUpdate;		l_lastUpdate.reserve(30);
+		std::string l_description;		l_description.reserve(200);
+		std::string l_deviceID;			l_deviceID.reserve(25);
 
-			sitem.ID = std::stoull(sd[1]);
-			sitem.deviceName = l_deviceName.assign(sd[2]);
+		sitem.ID = itt.ID;
+		sitem.deviceName = l_deviceName.assign(itt.Name);
 
-			sitem.devType = atoi(sd[5].c_str());
-			sitem.subType = atoi(sd[6].c_str());
+		sitem.devType = itt.Type;
+		sitem.subType = itt.SubType;
 
-			if ((sitem.devType == pTypeGeneral) && (sitem.subType == sTypeCounterIncremental))
-			{
-				//special case for incremental counter, need to calculate the actual count value
+		std::string sValue = itt.sValue;
+		if ((sitem.devType == pTypeGeneral) && (sitem.subType == sTypeCounterIncremental))
+		{
+			//special case for incremental counter, need to calculate the actual count value
 
-				uint64_t total_min, total_max, total_real;
-				std::vector<std::vector<std::string> > result2;
+			uint64_t total_min, total_max, total_real;
+			std::vector<std::vector<std::string> > result2;
 
-				result2 = m_sql.safe_query("SELECT sValue FROM DeviceStatus WHERE (ID=%" PRIu64 ")", sitem.ID);
-				total_max = std::stoull(result2[0][0]);
+			total_max = std::stoull(itt.sValue);
 
-				//get value of today
-				std::string szDate = TimeToString(NULL, TF_Date);
-				result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')", sitem.ID, szDate.c_str());
-				if (!result2.empty())
-				{
-					total_min = std::stoull(result2[0][0]);
-					total_real = total_max - total_min;
+			//get value of today
+			std::string szDate = TimeToString(NULL, TF_Date);
+			result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')", sitem.ID, szDate.c_str());
+			if (!result2.empty())
+			{
+				total_min = std::stoull(result2[0][0]);
+				total_real = total_max - total_min;
 
-					sd[4] = std::to_string(total_real); //sitem.sValue = l_sValue.assign(sd[4]);
-				}
+				sValue = std::to_string(total_real);
 			}
+		}
 
-			sitem.nValue = atoi(sd[3].c_str());
-			sitem.sValue = l_sValue.assign(sd[4]);
-
-			sitem.switchtype = atoi(sd[7].c_str());
-			_eSwitchType switchtype = (_eSwitchType)sitem.switchtype;
-			std::map<std::string, std::string> options = m_sql.BuildDeviceOptions(sd[10].c_str());
-			sitem.nValueWording = l_nValueWording.assign(nValueToWording(sitem.devType, sitem.subType, switchtype, sitem.nValue, sitem.sValue, options));
-			sitem.lastUpdate = l_lastUpdate.assign(sd[8]);
-			sitem.lastLevel = atoi(sd[9].c_str());
-			sitem.description = l_description.assign(sd[11]);
-			sitem.batteryLevel = atoi(sd[12].c_str());
-			sitem.signalLevel = atoi(sd[13].c_str());
-			sitem.unit = atoi(sd[14].c_str());
-			sitem.deviceID = l_deviceID.assign(sd[15]);
-			sitem.protection = atoi(sd[16].c_str());
-			sitem.hardwareID = atoi(sd[0].c_str());
+		sitem.nValue = itt.nValue;
+		sitem.sValue = l_sValue.assign(sValue);
 
-			if (!m_sql.m_bDisableDzVentsSystem)
-			{
-				UpdateJsonMap(sitem, sitem.ID);
-			}
-			m_devicestates_temp[sitem.ID] = sitem;
+		sitem.switchtype = itt.SwitchType;
+		_eSwitchType switchtype = (_eSwitchType)sitem.switchtype;
+		std::map<std::string, std::string> options = m_sql.BuildDeviceOptions(itt.Options);
+		sitem.nValueWording = l_nValueWording.assign(nValueToWording(sitem.devType, sitem.subType, switchtype, sitem.nValue, sitem.sValue, options));
+		sitem.lastUpdate = l_lastUpdate.assign(itt.LastUpdate);
+		sitem.lastLevel = itt.LastLevel;
+		sitem.description = l_description.assign(itt.Description);
+		sitem.batteryLevel = itt.BatteryLevel;
+		sitem.signalLevel = itt.SignalLevel;
+		sitem.unit = itt.Unit;
+		sitem.deviceID = l_deviceID.assign(itt.DeviceID);
+		sitem.protection = itt.Protected;
+		sitem.hardwareID = itt.HardwareID;
+
+		if (!m_sql.m_bDisableDzVentsSystem)
+		{
+			UpdateJsonMap(sitem, sitem.ID);
 		}
-		m_devicestates = m_devicestates_temp;
+		sitem.version = ++m_deviceVersion;
+		m_devicestates_temp[sitem.ID] = sitem;
 	}
+	m_devicestates = m_devicestates_temp;
 }
 
 void CEventSystem::GetCurrentUserVariables()
@@ -588,36 +664,31 @@ void CEventSystem::GetCurrentScenesGroups()
 	}
 }
 
-void CEventSystem::GetCurrentMeasurementStates()
+//Lua tables with the measurements of all devices
+static const struct _tMeasurementTable
 {
-	m_tempValuesByName.clear();
-	m_dewValuesByName.clear();
-	m_humValuesByName.clear();
-	m_baroValuesByName.clear();
-	m_utilityValuesByName.clear();
-	m_rainValuesByName.clear();
-	m_rainLastHourValuesByName.clear();
-	m_uvValuesByName.clear();
-	m_weatherValuesByName.clear();
-	m_winddirValuesByName.clear();
-	m_windspeedValuesByName.clear();
-	m_windgustValuesByName.clear();
-	m_zwaveAlarmValuesByName.clear();
-
-	m_tempValuesByID.clear();
-	m_dewValuesByID.clear();
-	m_humValuesByID.clear();
-	m_baroValuesByID.clear();
-	m_utilityValuesByID.clear();
-	m_rainValuesByID.clear();
-	m_rainLastHourValuesByID.clear();
-	m_uvValuesByID.clear();
-	m_weatherValuesByID.clear();
-	m_winddirValuesByID.clear();
-	m_windspeedValuesByID.clear();
-	m_windgustValuesByID.clear();
-	m_zwaveAlarmValuesByID.clear();
+	uint16_t flag;
+	const char *szDeviceTable;			//blockly, by idx
+	const char *szOtherDevicesTable;	//classic lua, by name
+	const char *szChangedSuffix;		//classic lua, devicechanged value of the changed device
+} MeasurementTables[] = {
+	{ CEventSystem::MEASURE_TEMP, "temperaturedevice", "otherdevices_temperature", "_Temperature" },
+	{ CEventSystem::MEASURE_DEW, "dewpointdevice", "otherdevices_dewpoint", "_Dewpoint" },
+	{ CEventSystem::MEASURE_HUM, "humiditydevice", "otherdevices_humidity", "_Humidity" },
+	{ CEventSystem::MEASURE_BARO, "barometerdevice", "otherdevices_barometer", "_Barometer" },
+	{ CEventSystem::MEASURE_UTILITY, "utilitydevice", "otherdevices_utility", "_Utility" },
+	{ CEventSystem::MEASURE_WEATHER, "weatherdevice", "otherdevices_weather", "_Weather" },
+	{ CEventSystem::MEASURE_RAIN, "raindevice", "otherdevices_rain", "_Rain" },
+	{ CEventSystem::MEASURE_RAINLASTHOUR, "rainlasthourdevice", "otherdevices_rain_lasthour", "_RainLastHour" },
+	{ CEventSystem::MEASURE_UV, "uvdevice", "otherdevices_uv", "_UV" },
+	{ CEventSystem::MEASURE_WINDDIR, "winddirdevice", "otherdevices_winddir", NULL },
+	{ CEventSystem::MEASURE_WINDSPEED, "windspeeddevice", "otherdevices_windspeed", NULL },
+	{ CEventSystem::MEASURE_WINDGUST, "windgustdevice", "otherdevices_windgust", NULL },
+	{ CEventSystem::MEASURE_ZWAVEALARM, "zwavealarms", "otherdevices_zwavealarms", "_ZWaveAlarm" },
+};
 
+void CEventSystem::RefreshMeasurementStates()
+{
 	float EnergyDivider = 1000.0f;
 	float GasDivider = 100.0f;
 	float WaterDivider = 100.0f;
@@ -634,448 +705,346 @@ void CEventSystem::GetCurrentMeasurementStates()
 	{
 		WaterDivider = float(tValue);
 	}
+	bool bAll = (
+		(EnergyDivider != m_measureEnergyDivider) ||
+		(GasDivider != m_measureGasDivider) ||
+		(WaterDivider != m_measureWaterDivider)
+		);
+	m_measureEnergyDivider = EnergyDivider;
+	m_measureGasDivider = GasDivider;
+	m_measureWaterDivider = WaterDivider;
 
-	boost::shared_lock<boost::shared_mutex> devicestatesMutexLock(m_devicestatesMutex);
+	//changed devices, and devices with values from today's history once a minute
+	time_t now = mytime(NULL);
+	std::vector<_tDeviceStatus> _changed;
+	{
+		boost::shared_lock<boost::shared_mutex> devicestatesMutexLock(m_devicestatesMutex);
+		for (const auto & itt : m_devicestates)
+		{
+			const _tMeasurement &measurement = itt.second.measurement;
+			if (
+				(bAll) ||
+				(measurement.calculated == 0) ||
+				((measurement.bDatabase) && (measurement.calculated / 60 != now / 60))
+				)
+				_changed.push_back(itt.second);
+		}
+	}
+	if (_changed.empty())
+		return;
 
-	//char szTmp[300];
+	//calculated without the lock, that can take database queries
+	for (auto & itt : _changed)
+	{
+		CalculateMeasurement(itt, itt.measurement);
+		itt.measurement.calculated = now;
+	}
+
+	boost::unique_lock<boost::shared_mutex> devicestatesMutexLock(m_devicestatesMutex);
+	for (const auto & itt : _changed)
+	{
+		std::map<uint64_t, _tDeviceStatus>::iterator itt2 = m_devicestates.find(itt.ID);
+		if (itt2 == m_devicestates.end())
+			continue;
+		//never older than what is kept, when the state was updated in the meantime calculate again with the next refresh
+		const bool bUpdated = (itt2->second.version != itt.version);
+		itt2->second.measurement = itt.measurement;
+		if (bUpdated)
+			itt2->second.measurement.calculated = 0;
+	}
+}
 
-	std::map<uint64_t, _tDeviceStatus>::const_iterator itt;
-	for (itt = m_devicestates.begin(); itt != m_devicestates.end(); ++itt)
+void CEventSystem::CalculateMeasurement(const _tDeviceStatus &sitem, _tMeasurement &measurement)
+{
+	const float EnergyDivider = m_measureEnergyDivider;
+	const float GasDivider = m_measureGasDivider;
+	const float WaterDivider = m_measureWaterDivider;
+
+	measurement.flags = 0;
+	measurement.bDatabase = (
+		((sitem.devType == pTypeGeneral) && (sitem.subType == sTypeCounterIncremental)) ||
+		(sitem.devType == pTypeRAIN) ||
+		(sitem.devType == pTypeP1Gas) ||
+		((sitem.devType == pTypeRFXMeter) && (sitem.subType == sTypeRFXMeterCount))
+		);
+
+	std::vector<std::string> splitresults;
+	StringSplit(sitem.sValue, ";", splitresults);
+
+	if ((sitem.devType == pTypeGeneral) && (sitem.subType == sTypeCounterIncremental))
+		splitresults.clear();
+
+	float temp = 0;
+	int humidity = 0;
+	float barometer = 0;
+	float rainmm = 0;
+	float rainmmlasthour = 0;
+	float uv = 0;
+	float dewpoint = 0;
+	float utilityval = 0;
+	float weatherval = 0;
+	float winddir = 0;
+	float windspeed = 0;
+	float windgust = 0;
+	int alarmval = 0;
+
+	bool isTemp = false;
+	bool isDew = false;
+	bool isHum = false;
+	bool isBaro = false;
+	bool isUtility = false;
+	bool isWeather = false;
+	bool isRain = false;
+	bool isUV = false;
+	bool isWindDir = false;
+	bool isWindSpeed = false;
+	bool isWindGust = false;
+	bool isZWaveAlarm = false;
+
+	switch (sitem.devType)
 	{
-		_tDeviceStatus sitem = itt->second;
-		std::vector<std::string> splitresults;
-		StringSplit(sitem.sValue, ";", splitresults);
-
-		if ((itt->second.devType == pTypeGeneral) && (itt->second.subType == sTypeCounterIncremental))
-			splitresults.clear();
-
-		float temp = 0;
-		int humidity = 0;
-		float barometer = 0;
-		float rainmm = 0;
-		float rainmmlasthour = 0;
-		float uv = 0;
-		float dewpoint = 0;
-		float utilityval = 0;
-		float weatherval = 0;
-		float winddir = 0;
-		float windspeed = 0;
-		float windgust = 0;
-		int alarmval = 0;
-
-		bool isTemp = false;
-		bool isDew = false;
-		bool isHum = false;
-		bool isBaro = false;
-		bool isUtility = false;
-		bool isWeather = false;
-		bool isRain = false;
-		bool isUV = false;
-		bool isWindDir = false;
-		bool isWindSpeed = false;
-		bool isWindGust = false;
-		bool isZWaveAlarm = false;
-
-		switch (sitem.devType)
+	case pTypeRego6XXTemp:
+	case pTypeTEMP:
+		if (!splitresults.empty())
+		{
+			temp = static_cast<float>(atof(splitresults[0].c_str()));
+			isTemp = true;
+		}
+		break;
+	case pTypeThermostat:
+		if (sitem.subType == sTypeThermTemperature)
 		{
-		case pTypeRego6XXTemp:
-		case pTypeTEMP:
 			if (!splitresults.empty())
 			{
 				temp = static_cast<float>(atof(splitresults[0].c_str()));
 				isTemp = true;
 			}
-			break;
-		case pTypeThermostat:
-			if (sitem.subType == sTypeThermTemperature)
-			{
-				if (!splitresults.empty())
-				{
-					temp = static_cast<float>(atof(splitresults[0].c_str()));
-					isTemp = true;
-				}
-			}
-			else
-			{
-				if (!splitresults.empty())
-				{
-					utilityval = static_cast<float>(atof(splitresults[0].c_str()));
-					isUtility = true;
-				}
-			}
-			break;
-		case pTypeThermostat1:
+		}
+		else
+		{
 			if (!splitresults.empty())
 			{
-				temp = static_cast<float>(atof(splitresults[0].c_str()));
-				isTemp = true;
-			}
-			break;
-		case pTypeHUM:
-			humidity = sitem.nValue;
-			isHum = true;
-			break;
-		case pTypeTEMP_HUM:
-			if (splitresults.size() > 1)
-			{
-				temp = static_cast<float>(atof(splitresults[0].c_str()));
-				humidity = atoi(splitresults[1].c_str());
-				dewpoint = (float)CalculateDewPoint(temp, humidity);
-				isTemp = true;
-				isHum = true;
-				isDew = true;
-			}
-			break;
-		case pTypeTEMP_HUM_BARO:
-			if (splitresults.size() < 5) {
-				_log.Log(LOG_ERROR, "EventSystem: TEMP_HUM_BARO missing values : ID=%" PRIu64 ", sValue=%s", sitem.ID, sitem.sValue.c_str());
-				continue;
+				utilityval = static_cast<float>(atof(splitresults[0].c_str()));
+				isUtility = true;
 			}
+		}
+		break;
+	case pTypeThermostat1:
+		if (!splitresults.empty())
+		{
+			temp = static_cast<float>(atof(splitresults[0].c_str()));
+			isTemp = true;
+		}
+		break;
+	case pTypeHUM:
+		humidity = sitem.nValue;
+		isHum = true;
+		break;
+	case pTypeTEMP_HUM:
+		if (splitresults.size() > 1)
+		{
 			temp = static_cast<float>(atof(splitresults[0].c_str()));
 			humidity = atoi(splitresults[1].c_str());
-			barometer = static_cast<float>(atof(splitresults[3].c_str()));
 			dewpoint = (float)CalculateDewPoint(temp, humidity);
 			isTemp = true;
 			isHum = true;
-			isBaro = true;
 			isDew = true;
-			break;
-		case pTypeTEMP_BARO:
-			if (splitresults.size() > 1)
+		}
+		break;
+	case pTypeTEMP_HUM_BARO:
+		if (splitresults.size() < 5) {
+			_log.Log(LOG_ERROR, "EventSystem: TEMP_HUM_BARO missing values : ID=%" PRIu64 ", sValue=%s", sitem.ID, sitem.sValue.c_str());
+			return;
+		}
+		temp = static_cast<float>(atof(splitresults[0].c_str()));
+		humidity = atoi(splitresults[1].c_str());
+		barometer = static_cast<float>(atof(splitresults[3].c_str()));
+		dewpoint = (float)CalculateDewPoint(temp, humidity);
+		isTemp = true;
+		isHum = true;
+		isBaro = true;
+		isDew = true;
+		break;
+	case pTypeTEMP_BARO:
+		if (splitresults.size() > 1)
+		{
+			temp = static_cast<float>(atof(splitresults[0].c_str()));
+			barometer = static_cast<float>(atof(splitresults[1].c_str()));
+			isTemp = true;
+			isBaro = true;
+		}
+		break;
+	case pTypeBARO:
+		barometer = static_cast<float>(atof(splitresults[0].c_str()));
+		isBaro = true;
+		break;
+	case pTypeRadiator1:
+		if (sitem.subType == sTypeSmartwares)
+		{
+			utilityval = static_cast<float>(atof(sitem.sValue.c_str()));
+			isUtility = true;
+		}
+		break;
+	case pTypeUV:
+		if (splitresults.size() == 2)
+		{
+			uv = static_cast<float>(atof(splitresults[0].c_str()));
+			isUV = true;
+			weatherval = uv;
+			isWeather = true;
+
+			if (sitem.subType == sTypeUV3)
 			{
-				temp = static_cast<float>(atof(splitresults[0].c_str()));
-				barometer = static_cast<float>(atof(splitresults[1].c_str()));
+				temp = static_cast<float>(atof(splitresults[1].c_str()));
 				isTemp = true;
-				isBaro = true;
 			}
-			break;
-		case pTypeBARO:
-			barometer = static_cast<float>(atof(splitresults[0].c_str()));
-			isBaro = true;
-			break;
-		case pTypeRadiator1:
-			if (sitem.subType == sTypeSmartwares)
+		}
+		break;
+	case pTypeWIND:
+		if (splitresults.size() == 6)
+		{
+			winddir = static_cast<float>(atof(splitresults[0].c_str()));
+			isWindDir = true;
+
+			if (sitem.subType != sTypeWIND5)
 			{
-				utilityval = static_cast<float>(atof(sitem.sValue.c_str()));
-				isUtility = true;
+				int intSpeed = atoi(splitresults[2].c_str());
+				windspeed = float(intSpeed) * 0.1f; //m/s
+				isWindSpeed = true;
 			}
-			break;
-		case pTypeUV:
-			if (splitresults.size() == 2)
-			{
-				uv = static_cast<float>(atof(splitresults[0].c_str()));
-				isUV = true;
-				weatherval = uv;
-				isWeather = true;
 
-				if (sitem.subType == sTypeUV3)
-				{
-					temp = static_cast<float>(atof(splitresults[1].c_str()));
-					isTemp = true;
-				}
-			}
-			break;
-		case pTypeWIND:
-			if (splitresults.size() == 6)
+			int intGust = atoi(splitresults[3].c_str());
+			windgust = float(intGust) * 0.1f; //m/s
+			isWindGust = true;
+			if ((windgust == 0) && (windspeed != 0))
 			{
-				winddir = static_cast<float>(atof(splitresults[0].c_str()));
-				isWindDir = true;
-
-				if (sitem.subType != sTypeWIND5)
-				{
-					int intSpeed = atoi(splitresults[2].c_str());
-					windspeed = float(intSpeed) * 0.1f; //m/s
-					isWindSpeed = true;
-				}
-
-				int intGust = atoi(splitresults[3].c_str());
-				windgust = float(intGust) * 0.1f; //m/s
-				isWindGust = true;
-				if ((windgust == 0) && (windspeed != 0))
-				{
-					weatherval = windspeed;
-					isWeather = true;
-				}
-				else
-				{
-					weatherval = windgust;
-					isWeather = true;
-				}
-				if ((sitem.subType == sTypeWIND4) || (sitem.subType == sTypeWINDNoTemp))
-				{
-					temp = static_cast<float>(atof(splitresults[4].c_str()));
-					//chill = static_cast<float>(atof(splitresults[5].c_str()));
-					isTemp = true;
-				}
+				weatherval = windspeed;
+				isWeather = true;
 			}
-			break;
-		case pTypeRFXSensor:
-			if (sitem.subType == sTypeRFXSensorTemp)
+			else
 			{
-				if (!splitresults.empty())
-				{
-					temp = static_cast<float>(atof(splitresults[0].c_str()));
-					isTemp = true;
-				}
+				weatherval = windgust;
+				isWeather = true;
 			}
-			else if ((sitem.subType == sTypeRFXSensorVolt) || (sitem.subType == sTypeRFXSensorAD))
+			if ((sitem.subType == sTypeWIND4) || (sitem.subType == sTypeWINDNoTemp))
 			{
-				utilityval = static_cast<float>(atof(sitem.sValue.c_str()));
-				isUtility = true;
+				temp = static_cast<float>(atof(splitresults[4].c_str()));
+				//chill = static_cast<float>(atof(splitresults[5].c_str()));
+				isTemp = true;
 			}
-			break;
-		case pTypeAirQuality:
-			utilityval = (float)(sitem.nValue);
-			isUtility = true;
-			break;
-		case pTypeENERGY:
+		}
+		break;
+	case pTypeRFXSensor:
+		if (sitem.subType == sTypeRFXSensorTemp)
+		{
 			if (!splitresults.empty())
 			{
-				if (splitresults.size() == 2)
-					utilityval = static_cast<float>(atof(splitresults[1].c_str()));
-				else
-					utilityval = static_cast<float>(atof(splitresults[0].c_str()));
-				isUtility = true;
+				temp = static_cast<float>(atof(splitresults[0].c_str()));
+				isTemp = true;
 			}
-			break;
-		case pTypePOWER:
-			if (!splitresults.empty())
-			{
+		}
+		else if ((sitem.subType == sTypeRFXSensorVolt) || (sitem.subType == sTypeRFXSensorAD))
+		{
+			utilityval = static_cast<float>(atof(sitem.sValue.c_str()));
+			isUtility = true;
+		}
+		break;
+	case pTypeAirQuality:
+		utilityval = (float)(sitem.nValue);
+		isUtility = true;
+		break;
+	case pTypeENERGY:
+		if (!splitresults.empty())
+		{
+			if (splitresults.size() == 2)
+				utilityval = static_cast<float>(atof(splitresults[1].c_str()));
+			else
 				utilityval = static_cast<float>(atof(splitresults[0].c_str()));
-				isUtility = true;
-			}
-			break;
-		case pTypeUsage:
-			if (!splitresults.empty())
+			isUtility = true;
+		}
+		break;
+	case pTypePOWER:
+		if (!splitresults.empty())
+		{
+			utilityval = static_cast<float>(atof(splitresults[0].c_str()));
+			isUtility = true;
+		}
+		break;
+	case pTypeUsage:
+		if (!splitresults.empty())
+		{
+			utilityval = static_cast<float>(atof(splitresults[0].c_str()));
+			isUtility = true;
+		}
+		break;
+	case pTypeP1Power:
+		if (splitresults.size() == 6)
+		{
+			utilityval = static_cast<float>(atof(splitresults[4].c_str()));
+			isUtility = true;
+		}
+		break;
+	case pTypeLux:
+		if (!splitresults.empty())
+		{
+			utilityval = static_cast<float>(atof(splitresults[0].c_str()));
+			isUtility = true;
+		}
+		break;
+	case pTypeGeneral:
+	{
+		if (!splitresults.empty())
+		{
+			if ((sitem.subType == sTypeVisibility) || (sitem.subType == sTypeSolarRadiation))
 			{
 				utilityval = static_cast<float>(atof(splitresults[0].c_str()));
 				isUtility = true;
+				weatherval = utilityval;
+				isWeather = true;
 			}
-			break;
-		case pTypeP1Power:
-			if (splitresults.size() == 6)
+			else if (sitem.subType == sTypeBaro)
 			{
-				utilityval = static_cast<float>(atof(splitresults[4].c_str()));
-				isUtility = true;
+				barometer = static_cast<float>(atof(splitresults[0].c_str()));
+				isBaro = true;
 			}
-			break;
-		case pTypeLux:
-			if (!splitresults.empty())
+			else if ((sitem.subType == sTypeAlert)
+				|| (sitem.subType == sTypeDistance)
+				|| (sitem.subType == sTypePercentage)
+				|| (sitem.subType == sTypeWaterflow)
+				|| (sitem.subType == sTypeCustom)
+				|| (sitem.subType == sTypeVoltage)
+				|| (sitem.subType == sTypeCurrent)
+				|| (sitem.subType == sTypeSetPoint)
+				|| (sitem.subType == sTypeKwh)
+				|| (sitem.subType == sTypeSoundLevel)
+				)
 			{
 				utilityval = static_cast<float>(atof(splitresults[0].c_str()));
 				isUtility = true;
 			}
-			break;
-		case pTypeGeneral:
+		}
+		else
 		{
-			if (!splitresults.empty())
+			if (sitem.subType == sTypeZWaveAlarm)
 			{
-				if ((sitem.subType == sTypeVisibility) || (sitem.subType == sTypeSolarRadiation))
-				{
-					utilityval = static_cast<float>(atof(splitresults[0].c_str()));
-					isUtility = true;
-					weatherval = utilityval;
-					isWeather = true;
-				}
-				else if (sitem.subType == sTypeBaro)
-				{
-					barometer = static_cast<float>(atof(splitresults[0].c_str()));
-					isBaro = true;
-				}
-				else if ((sitem.subType == sTypeAlert)
-					|| (sitem.subType == sTypeDistance)
-					|| (sitem.subType == sTypePercentage)
-					|| (sitem.subType == sTypeWaterflow)
-					|| (sitem.subType == sTypeCustom)
-					|| (sitem.subType == sTypeVoltage)
-					|| (sitem.subType == sTypeCurrent)
-					|| (sitem.subType == sTypeSetPoint)
-					|| (sitem.subType == sTypeKwh)
-					|| (sitem.subType == sTypeSoundLevel)
-					)
-				{
-					utilityval = static_cast<float>(atof(splitresults[0].c_str()));
-					isUtility = true;
-				}
+				alarmval = sitem.nValue;
+				isZWaveAlarm = true;
 			}
-			else
+			else if (sitem.subType == sTypeCounterIncremental)
 			{
-				if (sitem.subType == sTypeZWaveAlarm)
-				{
-					alarmval = sitem.nValue;
-					isZWaveAlarm = true;
-				}
-				else if (sitem.subType == sTypeCounterIncremental)
-				{
-					uint64_t total_min, total_max, total_real;
-					std::vector<std::vector<std::string> > result2;
-
-					result2 = m_sql.safe_query("SELECT sValue FROM DeviceStatus WHERE (ID=%" PRIu64 ")", sitem.ID);
-					total_max = std::stoull(result2[0][0]);
-
-					//get value of today
-					std::string szDate = TimeToString(NULL, TF_Date);
-					result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
-						sitem.ID, szDate.c_str());
-					if (!result2.empty())
-					{
-						total_min = std::stoull(result2[0][0]);
-						total_real = total_max - total_min;
-
-						char szTmp[100];
-						sprintf(szTmp, "%" PRIu64, total_real);
-
-						float musage = 0;
-						_eMeterType metertype = (_eMeterType)sitem.switchtype;
-						switch (metertype)
-						{
-						case MTYPE_ENERGY:
-						case MTYPE_ENERGY_GENERATED:
-							musage = float(total_real) / EnergyDivider;
-							sprintf(szTmp, "%.03f kWh", musage);
-							break;
-						case MTYPE_GAS:
-							musage = float(total_real) / GasDivider;
-							sprintf(szTmp, "%.02f m3", musage);
-							break;
-						case MTYPE_WATER:
-							musage = float(total_real) / WaterDivider;
-							sprintf(szTmp, "%.02f m3", musage);
-							break;
-						case MTYPE_COUNTER:
-							sprintf(szTmp, "%" PRIu64, total_real);
-							break;
-						default:
-							continue; //not handled
-						}
-						utilityval = static_cast<float>(atof(szTmp));
-						isUtility = true;
-					}
-				}
-				else if (sitem.subType == sTypeManagedCounter)
-				{
-					if (splitresults.size() > 1) {
-						float usage = static_cast<float>(atof(splitresults[1].c_str()));
-
-						if (usage < 0.0) {
-							usage = 0.0;
-						}
-
-						char szTmp[100];
-						sprintf(szTmp, "%.02f", usage);
-
-						float musage = 0;
-						_eMeterType metertype = (_eMeterType)sitem.switchtype;
-						switch (metertype)
-						{
-						case MTYPE_ENERGY:
-						case MTYPE_ENERGY_GENERATED:
-							musage = usage / EnergyDivider;
-							sprintf(szTmp, "%.03f kWh", musage);
-							break;
-						case MTYPE_GAS:
-							musage = usage / GasDivider;
-							sprintf(szTmp, "%.02f m3", musage);
-							break;
-						case MTYPE_WATER:
-							musage = usage / WaterDivider;
-							sprintf(szTmp, "%.02f m3", musage);
-							break;
-						case MTYPE_COUNTER:
-							break;
-						default:
-							continue; //not handled
-						}
-						utilityval = static_cast<float>(atof(szTmp));
-						isUtility = true;
-					}
-				}
-			}
-		}
-		break;
-		case pTypeRAIN:
-			if (splitresults.size() == 2)
-			{
-				rainmm = 0;
-				rainmmlasthour = static_cast<float>(atof(splitresults[0].c_str())) / 100.0f;
-				isRain = true;
-				weatherval = rainmmlasthour;
-				isWeather = true;
-
-				//Calculate the total rainfall of today
-
-				std::string szDate = TimeToString(NULL, TF_Date);
+				uint64_t total_min, total_max, total_real;
 				std::vector<std::vector<std::string> > result2;
 
-				if (sitem.subType == sTypeRAINWU || sitem.subType == sTypeRAINByRate)
-				{
-					result2 = m_sql.safe_query(
-						"SELECT Total, Total FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q') ORDER BY ROWID DESC LIMIT 1",
-						sitem.ID, szDate.c_str());
-				}
-				else
-				{
-					result2 = m_sql.safe_query(
-						"SELECT MIN(Total), MAX(Total) FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
-						sitem.ID, szDate.c_str());
-				}
-				if (!result2.empty())
-				{
-					double total_real = 0;
-					std::vector<std::string> sd2 = result2[0];
-					if (sitem.subType == sTypeRAINWU || sitem.subType == sTypeRAINByRate)
-					{
-						total_real = atof(sd2[1].c_str());
-					}
-					else
-					{
-						float total_min = static_cast<float>(atof(sd2[0].c_str()));
-						float total_max = static_cast<float>(atof(splitresults[1].c_str()));
-						total_real = total_max - total_min;
-					}
-					rainmm = float(total_real);
-				}
-			}
-			break;
-		case pTypeP1Gas:
-		{
-			float GasDivider = 1000.0f;
-			//get lowest value of today
-			std::string szDate = TimeToString(NULL, TF_Date);
-			std::vector<std::vector<std::string> > result2;
-			result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
-				sitem.ID, szDate.c_str());
-			if (!result2.empty())
-			{
-				std::vector<std::string> sd2 = result2[0];
-
-				uint64_t total_min_gas, total_real_gas;
-				uint64_t gasactual;
+				result2 = m_sql.safe_query("SELECT sValue FROM DeviceStatus WHERE (ID=%" PRIu64 ")", sitem.ID);
+				total_max = std::stoull(result2[0][0]);
 
-				total_min_gas = std::stoull(sd2[0]);
-				gasactual = std::stoull(sitem.sValue);
-				total_real_gas = gasactual - total_min_gas;
-				utilityval = float(total_real_gas) / GasDivider;
-				isUtility = true;
-			}
-		}
-		break;
-		case pTypeRFXMeter:
-			if (sitem.subType == sTypeRFXMeterCount)
-			{
 				//get value of today
 				std::string szDate = TimeToString(NULL, TF_Date);
-				std::vector<std::vector<std::string> > result2;
-				result2 = m_sql.safe_query("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
+				result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
 					sitem.ID, szDate.c_str());
 				if (!result2.empty())
 				{
-					std::vector<std::string> sd2 = result2[0];
-
-					uint64_t total_min, total_max, total_real;
-
-					total_min = std::stoull(sd2[0]);
-					total_max = std::stoull(sd2[1]);
+					total_min = std::stoull(result2[0][0]);
 					total_real = total_max - total_min;
 
 					char szTmp[100];
@@ -1102,72 +1071,260 @@ void CEventSystem::GetCurrentMeasurementStates()
 						sprintf(szTmp, "%" PRIu64, total_real);
 						break;
 					default:
-						continue; //not handled
+						return; //not handled
 					}
 					utilityval = static_cast<float>(atof(szTmp));
 					isUtility = true;
 				}
 			}
-			break;
-		default:
-			//Unknown device
-			continue;
-		}
+			else if (sitem.subType == sTypeManagedCounter)
+			{
+				if (splitresults.size() > 1) {
+					float usage = static_cast<float>(atof(splitresults[1].c_str()));
 
-		if (isTemp) {
-			m_tempValuesByName[sitem.deviceName] = temp;
-			m_tempValuesByID[sitem.ID] = temp;
-		}
-		if (isDew) {
-			m_dewValuesByName[sitem.deviceName] = dewpoint;
-			m_dewValuesByID[sitem.ID] = dewpoint;
-		}
-		if (isHum) {
-			m_humValuesByName[sitem.deviceName] = humidity;
-			m_humValuesByID[sitem.ID] = humidity;
-		}
-		if (isBaro) {
-			m_baroValuesByName[sitem.deviceName] = barometer;
-			m_baroValuesByID[sitem.ID] = barometer;
+					if (usage < 0.0) {
+						usage = 0.0;
+					}
+
+					char szTmp[100];
+					sprintf(szTmp, "%.02f", usage);
+
+					float musage = 0;
+					_eMeterType metertype = (_eMeterType)sitem.switchtype;
+					switch (metertype)
+					{
+					case MTYPE_ENERGY:
+					case MTYPE_ENERGY_GENERATED:
+						musage = usage / EnergyDivider;
+						sprintf(szTmp, "%.03f kWh", musage);
+						break;
+					case MTYPE_GAS:
+						musage = usage / GasDivider;
+						sprintf(szTmp, "%.02f m3", musage);
+						break;
+					case MTYPE_WATER:
+						musage = usage / WaterDivider;
+						sprintf(szTmp, "%.02f m3", musage);
+						break;
+					case MTYPE_COUNTER:
+						break;
+					default:
+						return; //not handled
+					}
+					utilityval = static_cast<float>(atof(szTmp));
+					isUtility = true;
+				}
+			}
 		}
-		if (isUtility)
+	}
+	break;
+	case pTypeRAIN:
+		if (splitresults.size() == 2)
 		{
-			m_utilityValuesByName[sitem.deviceName] = utilityval;
-			m_utilityValuesByID[sitem.ID] = utilityval;
-		}
-		if (isRain) {
-			m_rainValuesByName[sitem.deviceName] = rainmm;
-			m_rainValuesByID[sitem.ID] = rainmm;
-			m_rainLastHourValuesByName[sitem.deviceName] = rainmmlasthour;
-			m_rainLastHourValuesByID[sitem.ID] = rainmmlasthour;
+			rainmm = 0;
+			rainmmlasthour = static_cast<float>(atof(splitresults[0].c_str())) / 100.0f;
+			isRain = true;
+			weatherval = rainmmlasthour;
+			isWeather = true;
+
+			//Calculate the total rainfall of today
+
+			std::string szDate = TimeToString(NULL, TF_Date);
+			std::vector<std::vector<std::string> > result2;
+
+			if (sitem.subType == sTypeRAINWU || sitem.subType == sTypeRAINByRate)
+			{
+				result2 = m_sql.safe_query(
+					"SELECT Total, Total FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q') ORDER BY ROWID DESC LIMIT 1",
+					sitem.ID, szDate.c_str());
+			}
+			else
+			{
+				result2 = m_sql.safe_query(
+					"SELECT MIN(Total), MAX(Total) FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
+					sitem.ID, szDate.c_str());
+			}
+			if (!result2.empty())
+			{
+				double total_real = 0;
+				std::vector<std::string> sd2 = result2[0];
+				if (sitem.subType == sTypeRAINWU || sitem.subType == sTypeRAINByRate)
+				{
+					total_real = atof(sd2[1].c_str());
+				}
+				else
+				{
+					float total_min = static_cast<float>(atof(sd2[0].c_str()));
+					float total_max = static_cast<float>(atof(splitresults[1].c_str()));
+					total_real = total_max - total_min;
+				}
+				rainmm = float(total_real);
+			}
 		}
-		if (isWeather)
+		break;
+	case pTypeP1Gas:
+	{
+		float GasDivider = 1000.0f;
+		//get lowest value of today
+		std::string szDate = TimeToString(NULL, TF_Date);
+		std::vector<std::vector<std::string> > result2;
+		result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
+			sitem.ID, szDate.c_str());
+		if (!result2.empty())
 		{
-			m_weatherValuesByName[sitem.deviceName] = weatherval;
-			m_weatherValuesByID[sitem.ID] = weatherval;
-		}
-		if (isUV) {
-			m_uvValuesByName[sitem.deviceName] = uv;
-			m_uvValuesByID[sitem.ID] = uv;
-		}
-		if (isWindDir) {
-			m_winddirValuesByName[sitem.deviceName] = winddir;
-			m_winddirValuesByID[sitem.ID] = winddir;
-		}
-		if (isWindSpeed) {
-			m_windspeedValuesByName[sitem.deviceName] = windspeed;
-			m_windspeedValuesByID[sitem.ID] = windspeed;
-		}
-		if (isWindGust) {
-			m_windgustValuesByName[sitem.deviceName] = windgust;
-			m_windgustValuesByID[sitem.ID] = windgust;
+			std::vector<std::string> sd2 = result2[0];
+
+			uint64_t total_min_gas, total_real_gas;
+			uint64_t gasactual;
+
+			total_min_gas = std::stoull(sd2[0]);
+			gasactual = std::stoull(sitem.sValue);
+			total_real_gas = gasactual - total_min_gas;
+			utilityval = float(total_real_gas) / GasDivider;
+			isUtility = true;
 		}
-		if (isZWaveAlarm)
+	}
+	break;
+	case pTypeRFXMeter:
+		if (sitem.subType == sTypeRFXMeterCount)
 		{
-			m_zwaveAlarmValuesByName[sitem.deviceName] = alarmval;
-			m_zwaveAlarmValuesByID[sitem.ID] = alarmval;
+			//get value of today
+			std::string szDate = TimeToString(NULL, TF_Date);
+			std::vector<std::vector<std::string> > result2;
+			result2 = m_sql.safe_query("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
+				sitem.ID, szDate.c_str());
+			if (!result2.empty())
+			{
+				std::vector<std::string> sd2 = result2[0];
+
+				uint64_t total_min, total_max, total_real;
+
+				total_min = std::stoull(sd2[0]);
+				total_max = std::stoull(sd2[1]);
+				total_real = total_max - total_min;
+
+				char szTmp[100];
+				sprintf(szTmp, "%" PRIu64, total_real);
+
+				float musage = 0;
+				_eMeterType metertype = (_eMeterType)sitem.switchtype;
+				switch (metertype)
+				{
+				case MTYPE_ENERGY:
+				case MTYPE_ENERGY_GENERATED:
+					musage = float(total_real) / EnergyDivider;
+					sprintf(szTmp, "%.03f kWh", musage);
+					break;
+				case MTYPE_GAS:
+					musage = float(total_real) / GasDivider;
+					sprintf(szTmp, "%.02f m3", musage);
+					break;
+				case MTYPE_WATER:
+					musage = float(total_real) / WaterDivider;
+					sprintf(szTmp, "%.02f m3", musage);
+					break;
+				case MTYPE_COUNTER:
+					sprintf(szTmp, "%" PRIu64, total_real);
+					break;
+				default:
+					return; //not handled
+				}
+				utilityval = static_cast<float>(atof(szTmp));
+				isUtility = true;
+			}
 		}
+		break;
+	default:
+		//Unknown device
+		return;
+	}
+
+	if (isTemp) {
+		measurement.flags |= MEASURE_TEMP;
+		measurement.temp = temp;
+	}
+	if (isDew) {
+		measurement.flags |= MEASURE_DEW;
+		measurement.dewpoint = dewpoint;
+	}
+	if (isHum) {
+		measurement.flags |= MEASURE_HUM;
+		measurement.humidity = humidity;
+	}
+	if (isBaro) {
+		measurement.flags |= MEASURE_BARO;
+		measurement.barometer = barometer;
+	}
+	if (isUtility)
+	{
+		measurement.flags |= MEASURE_UTILITY;
+		measurement.utility = utilityval;
 	}
+	if (isRain) {
+		measurement.flags |= MEASURE_RAIN | MEASURE_RAINLASTHOUR;
+		measurement.rain = rainmm;
+		measurement.rainLastHour = rainmmlasthour;
+	}
+	if (isWeather)
+	{
+		measurement.flags |= MEASURE_WEATHER;
+		measurement.weather = weatherval;
+	}
+	if (isUV) {
+		measurement.flags |= MEASURE_UV;
+		measurement.uv = uv;
+	}
+	if (isWindDir) {
+		measurement.flags |= MEASURE_WINDDIR;
+		measurement.winddir = winddir;
+	}
+	if (isWindSpeed) {
+		measurement.flags |= MEASURE_WINDSPEED;
+		measurement.windspeed = windspeed;
+	}
+	if (isWindGust) {
+		measurement.flags |= MEASURE_WINDGUST;
+		measurement.windgust = windgust;
+	}
+	if (isZWaveAlarm)
+	{
+		measurement.flags |= MEASURE_ZWAVEALARM;
+		measurement.zwaveAlarm = alarmval;
+	}
+}
+
+float CEventSystem::GetMeasurementValue(const _tMeasurement &measurement, const uint16_t flag)
+{
+	switch (flag)
+	{
+	case MEASURE_TEMP:
+		return measurement.temp;
+	case MEASURE_DEW:
+		return measurement.dewpoint;
+	case MEASURE_HUM:
+		return float(measurement.humidity);
+	case MEASURE_BARO:
+		return measurement.barometer;
+	case MEASURE_UTILITY:
+		return measurement.utility;
+	case MEASURE_WEATHER:
+		return measurement.weather;
+	case MEASURE_RAIN:
+		return measurement.rain;
+	case MEASURE_RAINLASTHOUR:
+		return measurement.rainLastHour;
+	case MEASURE_UV:
+		return measurement.uv;
+	case MEASURE_WINDDIR:
+		return measurement.winddir;
+	case MEASURE_WINDSPEED:
+		return measurement.windspeed;
+	case MEASURE_WINDGUST:
+		return measurement.windgust;
+	case MEASURE_ZWAVEALARM:
+		return float(measurement.zwaveAlarm);
+	}
+	return 0;
 }
 
 void CEventSystem::RemoveSingleState(const uint64_t ulDevID, const _eReason reason)
@@ -1179,6 +1336,7 @@ void CEventSystem::RemoveSingleState(const uint64_t ulDevID, const _eReason reas
 	{
 		boost::unique_lock<boost::shared_mutex> devicestatesMutexLock(m_devicestatesMutex);
 		m_devicestates.erase(ulDevID);
+		m_deviceStatesGeneration++;
 	}
 	else if (reason == REASON_SCENEGROUP)
 	{
@@ -1203,6 +1361,7 @@ void CEventSystem::WWWUpdateSingleState(const uint64_t ulDevID, const std::strin
 		{
 			_tDeviceStatus replaceitem = itt->second;
 			replaceitem.deviceName = l_deviceName;
+			replaceitem.version = ++m_deviceVersion;
 			itt->second = replaceitem;
 		}
 	}
@@ -1387,6 +1546,7 @@ void CEventSystem::UpdateBatteryLevel(const uint64_t ulDevID, const unsigned cha
 	{
 		_tDeviceStatus replaceitem = itt->second;
 		replaceitem.batteryLevel = batteryLevel;
+		replaceitem.version = ++m_deviceVersion;
 		itt->second = replaceitem;
 	}
 }
@@ -1432,6 +1592,8 @@ std::string CEventSystem::UpdateSingleState(
 			replaceitem.lastUpdate = l_lastUpdate;
 		if (lastLevel != 255)
 			replaceitem.lastLevel = lastLevel;
+		replaceitem.measurement.calculated = 0;
+		replaceitem.version = ++m_deviceVersion;
 
 		if (!m_sql.m_bDisableDzVentsSystem)
 		{
@@ -1453,6 +1615,7 @@ std::string CEventSystem::UpdateSingleState(
 		newitem.nValueWording = l_nValueWording;
 		newitem.lastUpdate = l_lastUpdate;
 		newitem.lastLevel = lastLevel;
+		newitem.version = ++m_deviceVersion;
 		//newitem.batteryLevel = batteryLevel;
 
 		if (!m_sql.m_bDisableDzVentsSystem)
@@ -1593,6 +1756,7 @@ void CEventSystem::ProcessDevice(
 			_tDeviceStatus replaceitem = itt->second;
 			replaceitem.lastUpdate = lastUpdate;
 			replaceitem.lastLevel = lastLevel;
+			replaceitem.version = ++m_deviceVersion;
 			itt->second = replaceitem;
 		}
 		m_eventqueue.push(item);
@@ -1607,109 +1771,103 @@ void CEventSystem::ProcessMinute()
 	m_eventqueue.push(item);
 }
 
+//Script file category that is run for an event
+static int ReasonToScriptTrigger(const int reason)
+{
+	switch (reason)
+	{
+	case CEventSystem::REASON_DEVICE:
+		return CScriptRegistry::TRIGGER_DEVICE;
+	case CEventSystem::REASON_TIME:
+		return CScriptRegistry::TRIGGER_TIME;
+	case CEventSystem::REASON_SECURITY:
+		return CScriptRegistry::TRIGGER_SECURITY;
+	case CEventSystem::REASON_NOTIFICATION:
+		return CScriptRegistry::TRIGGER_NOTIFICATION;
+	case CEventSystem::REASON_USERVARIABLE:
+		return CScriptRegistry::TRIGGER_VARIABLE;
+	}
+	return 0;
+}
+
 void CEventSystem::EvaluateEvent(const std::vector<_tEventQueue> &items)
 {
 	if (!m_bEnabled)
 		return;
 
-	std::vector<std::string> FileEntries;
-	std::vector<std::string>::const_iterator itt2;
-	std::string filename;
+	CScriptRegistry::TScriptList luaScripts = m_scriptRegistry.GetScripts(SCRIPTDIR_LUA);
 #ifdef ENABLE_PYTHON
-	std::vector<std::string> FileEntriesPython;
-	DirectoryListing(FileEntriesPython, m_python_Dir, false, true);
+	CScriptRegistry::TScriptList pythonScripts = m_scriptRegistry.GetScripts(SCRIPTDIR_PYTHON);
 #endif
 
 	if (!m_sql.m_bDisableDzVentsSystem)
 	{
 		CdzVents* dzvents = CdzVents::GetInstance();
-		if (dzvents->m_bdzVentsExist)
+		bool bRunDzVents = dzvents->m_bdzVentsExist;
+		CScriptRegistry::TScriptList dzVentsScripts = m_scriptRegistry.GetScripts(SCRIPTDIR_DZVENTS);
+		if (!bRunDzVents)
+			bRunDzVents = !dzVentsScripts->empty();
+		//device changes only need the runtime when a script has a trigger for one of them
+		if (bRunDzVents)
+			bRunDzVents = dzvents->IsDeviceTriggered(items, dzVentsScripts, m_scriptRegistry.GetGeneration(SCRIPTDIR_DZVENTS));
+		if (bRunDzVents)
 			EvaluateLua(items, dzvents->m_runtimeDir + "dzVents.lua", "");
-		else
-		{
-			DirectoryListing(FileEntries, dzvents->m_scriptsDir, false, true);
-			for (itt2 = FileEntries.begin(); itt2 != FileEntries.end(); ++itt2)
-			{
-				filename = *itt2;
-				if (filename.length() > 4 &&
-					filename.compare(filename.length() - 4, 4, ".lua") == 0)
-				{
-					EvaluateLua(items, dzvents->m_runtimeDir + "dzVents.lua", "");
-					break;
-				}
-			}
-			FileEntries.clear();
-		}
 	}
 
-	bool bDeviceFileFound = false;
-	DirectoryListing(FileEntries, m_lua_Dir, false, true);
+	//normalized names of all devices, only loaded when a _device_ script needs them
+	std::set<std::string> deviceNames;
+	bool bDeviceNamesLoaded = false;
+
 	std::vector<_tEventQueue>::const_iterator itt;
 	for (itt = items.begin(); itt != items.end(); ++itt)
 	{
-		for (itt2 = FileEntries.begin(); itt2 != FileEntries.end(); ++itt2)
+		const int trigger = ReasonToScriptTrigger(itt->reason);
+		std::string triggerDeviceName;
+		if (trigger == CScriptRegistry::TRIGGER_DEVICE)
+			triggerDeviceName = SpaceToUnderscore(LowerCase(itt->devname));
+
+		for (const auto & script : *luaScripts)
 		{
-			filename = *itt2;
-			if (filename.length() > 4 &&
-				filename.compare(filename.length() - 4, 4, ".lua") == 0 &&
-				filename.find("_demo.lua") == std::string::npos)
+			if ((script.bDemo) || ((script.triggers & trigger) == 0))
+				continue;
+
+			if (trigger == CScriptRegistry::TRIGGER_DEVICE)
 			{
-				if (itt->reason == REASON_DEVICE && filename.find("_device_") != std::string::npos)
+				if (!bDeviceNamesLoaded)
 				{
-					bDeviceFileFound = false;
 					boost::shared_lock<boost::shared_mutex> devicestatesMutexLock(m_devicestatesMutex);
-					std::map<uint64_t, _tDeviceStatus>::const_iterator itt3;
-					for (itt3 = m_devicestates.begin(); itt3 != m_devicestates.end(); ++itt3)
-					{
-						std::string deviceName = SpaceToUnderscore(LowerCase(itt3->second.deviceName));
-						if (filename.find("_device_" + deviceName + ".lua") != std::string::npos)
-						{
-							bDeviceFileFound = true;
-							if (deviceName == SpaceToUnderscore(LowerCase(itt->devname)))
-							{
-								devicestatesMutexLock.unlock();
-								EvaluateLua(*itt, m_lua_Dir + filename, "");
-								break;
-							}
-						}
-					}
-					if (!bDeviceFileFound)
-					{
-						devicestatesMutexLock.unlock();
-						EvaluateLua(*itt, m_lua_Dir + filename, "");
-					}
+					for (const auto & itt3 : m_devicestates)
+						deviceNames.insert(SpaceToUnderscore(LowerCase(itt3.second.deviceName)));
+					bDeviceNamesLoaded = true;
 				}
-				else if ((itt->reason == REASON_TIME && filename.find("_time_") != std::string::npos) ||
-					(itt->reason == REASON_SECURITY && filename.find("_security_") != std::string::npos) ||
-					(itt->reason == REASON_NOTIFICATION && filename.find("_notification_") != std::string::npos) ||
-					(itt->reason == REASON_USERVARIABLE && filename.find("_variable_") != std::string::npos))
+				//a script named after an existing device only runs for that device
+				bool bDeviceFileFound = false;
+				bool bThisDevice = false;
+				for (const auto & itt3 : script.deviceNames)
 				{
-					EvaluateLua(*itt, m_lua_Dir + filename, "");
+					if (deviceNames.find(itt3) == deviceNames.end())
+						continue;
+					bDeviceFileFound = true;
+					if (itt3 == triggerDeviceName)
+						bThisDevice = true;
 				}
+				if (bDeviceFileFound && !bThisDevice)
+					continue;
 			}
-			// else _log.Log(LOG_STATUS,"EventSystem: ignore file not .lua or is demo file: %s", filename.c_str());
+			EvaluateLua(*itt, m_lua_Dir + script.filename, "");
 		}
 
 #ifdef ENABLE_PYTHON
 		boost::unique_lock<boost::shared_mutex> uservariablesMutexLock(m_uservariablesMutex);
 		try
 		{
-			for (itt2 = FileEntriesPython.begin(); itt2 != FileEntriesPython.end(); ++itt2)
+			if (trigger != CScriptRegistry::TRIGGER_NOTIFICATION)
 			{
-				filename = *itt2;
-				if (filename.length() > 3 &&
-					filename.compare(filename.length() - 3, 3, ".py") == 0 &&
-					filename.find("_demo.py") == std::string::npos)
+				for (const auto & script : *pythonScripts)
 				{
-					if ((itt->reason == REASON_DEVICE && filename.find("_device_") != std::string::npos) ||
-						(itt->reason == REASON_TIME && filename.find("_time_") != std::string::npos) ||
-						(itt->reason == REASON_SECURITY && filename.find("_security_") != std::string::npos) ||
-						(itt->reason == REASON_USERVARIABLE && filename.find("_variable_") != std::string::npos))
-					{
-						EvaluatePython(*itt, m_python_Dir + filename, "");
-					}
+					if ((!script.bDemo) && ((script.triggers & trigger) != 0))
+						EvaluatePython(*itt, m_python_Dir + script.filename, "");
 				}
-				// else _log.Log(LOG_STATUS,"EventSystem: ignore file not .py or is demo file: %s", filename.c_str());
 			}
 		}
 		catch (...)
@@ -1782,148 +1940,51 @@ lua_State *CEventSystem::CreateBlocklyLuaState()
 	devicestatesMutexLock.unlock();
 
 	boost::shared_lock<boost::shared_mutex> uservariablesMutexLock(m_uservariablesMutex);
-	
-	luaTable.InitTable(lua_state, "variable", (int)m_uservariables.size(), 0);
-
-	std::map<uint64_t, _tUserVariable>::const_iterator ittvar;
-	for (ittvar = m_uservariables.begin(); ittvar != m_uservariables.end(); ++ittvar) {
-		_tUserVariable uvitem = ittvar->second;
-		if (uvitem.variableType == 0) {
-			//Integer
-			luaTable.AddInteger(uvitem.ID, atoi(uvitem.variableValue.c_str()));
-		}
-		else if (uvitem.variableType == 1) {
-			//Float
-			luaTable.AddNumber(uvitem.ID, atof(uvitem.variableValue.c_str()));
-		}
-		else {
-			//String,Date,Time
-			luaTable.AddString(uvitem.ID, uvitem.variableValue.c_str());
-		}
-	}
-	luaTable.Publish();
-	uservariablesMutexLock.unlock();
-
-	std::lock_guard<std::mutex> measurementStatesMutexLock(m_measurementStatesMutex);
-	GetCurrentMeasurementStates();
-
-	if (m_tempValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "temperaturedevice", (int)m_tempValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_tempValuesByID.begin(); p != m_tempValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_dewValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "dewpointdevice", (int)m_dewValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_dewValuesByID.begin(); p != m_dewValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_humValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "humiditydevice", (int)m_humValuesByID.size(), 0);
-		std::map<uint64_t, int>::iterator p;
-		for (p = m_humValuesByID.begin(); p != m_humValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_baroValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "barometerdevice", (int)m_baroValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_baroValuesByID.begin(); p != m_baroValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_utilityValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "utilitydevice", (int)m_utilityValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_utilityValuesByID.begin(); p != m_utilityValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_weatherValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "weatherdevice", (int)m_weatherValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_weatherValuesByID.begin(); p != m_weatherValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_rainValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "raindevice", (int)m_rainValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_rainValuesByID.begin(); p != m_rainValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_rainLastHourValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "rainlasthourdevice", (int)m_rainLastHourValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_rainLastHourValuesByID.begin(); p != m_rainLastHourValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
-		}
-		luaTable.Publish();
-	}
-	if (m_uvValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "uvdevice", (int)m_uvValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_uvValuesByID.begin(); p != m_uvValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
+	
+	luaTable.InitTable(lua_state, "variable", (int)m_uservariables.size(), 0);
+
+	std::map<uint64_t, _tUserVariable>::const_iterator ittvar;
+	for (ittvar = m_uservariables.begin(); ittvar != m_uservariables.end(); ++ittvar) {
+		_tUserVariable uvitem = ittvar->second;
+		if (uvitem.variableType == 0) {
+			//Integer
+			luaTable.AddInteger(uvitem.ID, atoi(uvitem.variableValue.c_str()));
 		}
-		luaTable.Publish();
-	}
-	if (m_winddirValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "winddirdevice", (int)m_winddirValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_winddirValuesByID.begin(); p != m_winddirValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
+		else if (uvitem.variableType == 1) {
+			//Float
+			luaTable.AddNumber(uvitem.ID, atof(uvitem.variableValue.c_str()));
 		}
-		luaTable.Publish();
-	}
-	if (m_windspeedValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "windspeeddevice", (int)m_windspeedValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_windspeedValuesByID.begin(); p != m_windspeedValuesByID.end(); ++p)
-		{
-			luaTable.AddNumber(p->first, p->second);
+		else {
+			//String,Date,Time
+			luaTable.AddString(uvitem.ID, uvitem.variableValue.c_str());
 		}
-		luaTable.Publish();
 	}
-	if (m_windgustValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "windgustdevice", (int)m_windgustValuesByID.size(), 0);
-		std::map<uint64_t, float>::iterator p;
-		for (p = m_windgustValuesByID.begin(); p != m_windgustValuesByID.end(); ++p)
+	luaTable.Publish();
+	uservariablesMutexLock.unlock();
+
+	std::lock_guard<std::mutex> measurementStatesMutexLock(m_measurementStatesMutex);
+	RefreshMeasurementStates();
+
+	devicestatesMutexLock.lock();
+	for (const auto & table : MeasurementTables)
+	{
+		int count = 0;
+		for (const auto & itt : m_devicestates)
 		{
-			luaTable.AddNumber(p->first, p->second);
+			if (itt.second.measurement.flags & table.flag)
+				count++;
 		}
-		luaTable.Publish();
-	}
-	if (m_zwaveAlarmValuesByID.size() > 0) {
-		luaTable.InitTable(lua_state, "zwavealarms", (int)m_zwaveAlarmValuesByID.size(), 0);
-		std::map<uint64_t, int>::iterator p;
-		for (p = m_zwaveAlarmValuesByID.begin(); p != m_zwaveAlarmValuesByID.end(); ++p)
+		if (count == 0)
+			continue;
+		luaTable.InitTable(lua_state, table.szDeviceTable, count, 0);
+		for (const auto & itt : m_devicestates)
 		{
-			luaTable.AddNumber(p->first, p->second);
+			if (itt.second.measurement.flags & table.flag)
+				luaTable.AddNumber(itt.first, GetMeasurementValue(itt.second.measurement, table.flag));
 		}
 		luaTable.Publish();
 	}
+	devicestatesMutexLock.unlock();
 
 	lua_pushnumber(lua_state, (lua_Number)m_SecStatus);
 	lua_setglobal(lua_state, "securitystatus");
@@ -1976,6 +2037,30 @@ void CEventSystem::EvaluateDatabaseEvents(const _tEventQueue &item)
 	lua_State *lua_state = NULL;
 
 	boost::shared_lock<boost::shared_mutex> eventsMutexLock(m_eventsMutex);
+
+	// Blockly events that mention this item in their conditions
+	static const std::vector<size_t> noEvents;
+	const std::vector<size_t> *pBlocklyEvents = &noEvents;
+	std::map<uint64_t, std::vector<size_t> >::const_iterator ittIndex;
+	if ((item.reason == REASON_DEVICE) && (item.id > 0))
+	{
+		ittIndex = m_blocklyDeviceEvents.find(item.id);
+		if (ittIndex != m_blocklyDeviceEvents.end())
+			pBlocklyEvents = &ittIndex->second;
+	}
+	else if (item.reason == REASON_SECURITY)
+		pBlocklyEvents = &m_blocklySecurityEvents;
+	else if (item.reason == REASON_TIME)
+		pBlocklyEvents = &m_blocklyTimeEvents;
+	else if ((item.reason == REASON_USERVARIABLE) && (item.id > 0))
+	{
+		ittIndex = m_blocklyVariableEvents.find(item.id);
+		if (ittIndex != m_blocklyVariableEvents.end())
+			pBlocklyEvents = &ittIndex->second;
+	}
+	if (pBlocklyEvents->empty() && !m_bDatabaseScripts)
+		return;
+
 	std::vector<_tEventItem>::const_iterator it;
 	try
 	{
@@ -1988,35 +2073,8 @@ void CEventSystem::EvaluateDatabaseEvents(const _tEventQueue &item)
 			{
 				if (it->Interpreter == "Blockly")
 				{
-					std::size_t found = std::string::npos;
-					if ((item.reason == REASON_DEVICE) && (item.id > 0))
-					{
-						std::stringstream sstr;
-						sstr << "[" << item.id << "]";
-						found = it->Conditions.find(sstr.str());
-					}
-					else if (item.reason == REASON_SECURITY)
-					{
-						// security status change
-						std::stringstream sstr;
-						sstr << "securitystatus";
-						found = it->Conditions.find(sstr.str());
-					}
-					else if (item.reason == REASON_TIME)
-					{
-						// time rules will only run when time or date based criteria are found
-						found = it->Conditions.find("timeofday");
-						if (found == std::string::npos)
-							found = it->Conditions.find("weekday");
-					}
-					else if ((item.reason == REASON_USERVARIABLE) && (item.id > 0))
-					{
-						std::stringstream sstr;
-						sstr << "variable[" << item.id << "]";
-						found = it->Conditions.find(sstr.str());
-					}
-
-					if (found != std::string::npos)
+					const size_t index = it - m_events.begin();
+					if (std::binary_search(pBlocklyEvents->begin(), pBlocklyEvents->end(), index))
 						lua_state = ParseBlocklyLua(lua_state, *it);
 				}
 				else if (it->Interpreter == "Lua")
@@ -2063,143 +2121,32 @@ std::string CEventSystem::ProcessVariableArgument(const std::string &Argument)
 	if (dindex == -1)
 		return ret;
 
-	if (Argument.find("temperaturedevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_tempValuesByID.find(dindex);
-		if (itt != m_tempValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("dewpointdevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_dewValuesByID.find(dindex);
-		if (itt != m_dewValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("humiditydevice") == 0)
-	{
-		std::map<uint64_t, int>::const_iterator itt = m_humValuesByID.find(dindex);
-		if (itt != m_humValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("barometerdevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_baroValuesByID.find(dindex);
-		if (itt != m_baroValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("utilitydevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_utilityValuesByID.find(dindex);
-		if (itt != m_utilityValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("weatherdevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_weatherValuesByID.find(dindex);
-		if (itt != m_weatherValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("raindevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_rainValuesByID.find(dindex);
-		if (itt != m_rainValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("rainlasthourdevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_rainLastHourValuesByID.find(dindex);
-		if (itt != m_rainLastHourValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("uvdevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_uvValuesByID.find(dindex);
-		if (itt != m_uvValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("winddirdevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_winddirValuesByID.find(dindex);
-		if (itt != m_winddirValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("windspeeddevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_windspeedValuesByID.find(dindex);
-		if (itt != m_windspeedValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("windgustdevice") == 0)
-	{
-		std::map<uint64_t, float>::const_iterator itt = m_windgustValuesByID.find(dindex);
-		if (itt != m_windgustValuesByID.end())
-		{
-			std::stringstream sstr;
-			sstr << itt->second;
-			return sstr.str();
-		}
-	}
-	else if (Argument.find("variable") == 0)
+	if (Argument.find("variable") == 0)
 	{
 		std::map<uint64_t, _tUserVariable>::const_iterator itt = m_uservariables.find(dindex);
 		if (itt != m_uservariables.end())
 		{
 			return itt->second.variableValue;
 		}
+		return ret;
 	}
-	else if (Argument.find("zwavealarms") == 0)
+
+	for (const auto & table : MeasurementTables)
 	{
-		std::map<uint64_t, int>::const_iterator itt = m_zwaveAlarmValuesByID.find(dindex);
-		if (itt != m_zwaveAlarmValuesByID.end())
+		if (Argument.find(table.szDeviceTable) != 0)
+			continue;
+		boost::shared_lock<boost::shared_mutex> devicestatesMutexLock(m_devicestatesMutex);
+		std::map<uint64_t, _tDeviceStatus>::const_iterator itt = m_devicestates.find(dindex);
+		if ((itt != m_devicestates.end()) && (itt->second.measurement.flags & table.flag))
 		{
 			std::stringstream sstr;
-			sstr << (int)itt->second;
+			if ((table.flag == MEASURE_HUM) || (table.flag == MEASURE_ZWAVEALARM))
+				sstr << (int)GetMeasurementValue(itt->second.measurement, table.flag);
+			else
+				sstr << GetMeasurementValue(itt->second.measurement, table.flag);
 			return sstr.str();
 		}
+		break;
 	}
 
 	return ret;
@@ -2752,257 +2699,51 @@ void CEventSystem::ExportDeviceStatesToLua(lua_State *lua_state, const _tEventQu
 
 void CEventSystem::EvaluateLuaClassic(lua_State *lua_state, const _tEventQueue &item, const int secStatus)
 {
-	// reroute print library to Domoticz logger
-	luaL_openlibs(lua_state);
-	lua_pushcfunction(lua_state, l_domoticz_print);
-	lua_setglobal(lua_state, "print");
-
 	{
 		std::lock_guard<std::mutex> measurementStatesMutexLock(m_measurementStatesMutex);
-		GetCurrentMeasurementStates();
-
-		float thisDeviceTemp = 0;
-		float thisDeviceDew = 0;
-		float thisDeviceRain = 0;
-		float thisDeviceRainLastHour = 0;
-		float thisDeviceUV = 0;
-		unsigned char thisDeviceHum = 0;
-		float thisDeviceBaro = 0;
-		float thisDeviceUtility = 0;
-		//float thisDeviceWindDir = 0;
-		//float thisDeviceWindSpeed = 0;
-		//float thisDeviceWindGust = 0;
-		float thisDeviceWeather = 0;
-		int thisZwaveAlarm = 0;
-
-		if (m_tempValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_temperature", (int)m_tempValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_tempValuesByName.begin(); p != m_tempValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceTemp = p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_dewValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_dewpoint", (int)m_dewValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_dewValuesByName.begin(); p != m_dewValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceDew = p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_humValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_humidity", (int)m_humValuesByName.size(), 0);
-			std::map<std::string, int>::iterator p;
-			for (p = m_humValuesByName.begin(); p != m_humValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceHum = p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_baroValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_barometer", (int)m_baroValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_baroValuesByName.begin(); p != m_baroValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceBaro = (float)p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_utilityValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_utility", (int)m_utilityValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_utilityValuesByName.begin(); p != m_utilityValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceUtility = p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_rainValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_rain", (int)m_rainValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_rainValuesByName.begin(); p != m_rainValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceRain = p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_rainLastHourValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_rain_lasthour", (int)m_rainLastHourValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_rainLastHourValuesByName.begin(); p != m_rainLastHourValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceRainLastHour = p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_uvValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_uv", (int)m_uvValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_uvValuesByName.begin(); p != m_uvValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceUV = p->second;
-				}
-			}
-			luaTable.Publish();
-		}
-		if (m_winddirValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_winddir", (int)m_winddirValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_winddirValuesByName.begin(); p != m_winddirValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				//if (p->first == item.devname) {
-					//thisDeviceWindDir = p->second;
-				//}
-			}
-			luaTable.Publish();
-		}
-		if (m_windspeedValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_windspeed", (int)m_windspeedValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_windspeedValuesByName.begin(); p != m_windspeedValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				//if (p->first == item.devname) {
-					//thisDeviceWindSpeed = p->second;
-				//}
-			}
-			luaTable.Publish();
-		}
-		if (m_windgustValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_windgust", (int)m_windgustValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_windgustValuesByName.begin(); p != m_windgustValuesByName.end(); ++p)
-			{
-				luaTable.AddNumber(p->first, p->second);
-				//if (p->first == item.devname) {
-					//thisDeviceWindGust = p->second;
-				//}
-			}
-			luaTable.Publish();
-		}
-		if (m_weatherValuesByName.size() > 0)
+		RefreshMeasurementStates();
+
+		//values of the changed device (by name, as the tables)
+		float thisDeviceValues[sizeof(MeasurementTables) / sizeof(MeasurementTables[0])] = { 0 };
+
+		boost::shared_lock<boost::shared_mutex> devicestatesMutexLock(m_devicestatesMutex);
+		for (size_t ii = 0; ii < sizeof(MeasurementTables) / sizeof(MeasurementTables[0]); ii++)
 		{
-			CLuaTable luaTable(lua_state, "otherdevices_weather", (int)m_weatherValuesByName.size(), 0);
-			std::map<std::string, float>::iterator p;
-			for (p = m_weatherValuesByName.begin(); p != m_weatherValuesByName.end(); ++p)
+			const _tMeasurementTable &table = MeasurementTables[ii];
+			int count = 0;
+			for (const auto & itt : m_devicestates)
 			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisDeviceWeather = p->second;
-				}
+				if (itt.second.measurement.flags & table.flag)
+					count++;
 			}
-			luaTable.Publish();
-		}
-		if (m_zwaveAlarmValuesByName.size() > 0)
-		{
-			CLuaTable luaTable(lua_state, "otherdevices_zwavealarms", (int)m_zwaveAlarmValuesByName.size(), 0);
-			std::map<std::string, int>::iterator p;
-			for (p = m_zwaveAlarmValuesByName.begin(); p != m_zwaveAlarmValuesByName.end(); ++p)
+			if (count == 0)
+				continue;
+			CLuaTable luaTable(lua_state, table.szOtherDevicesTable, count, 0);
+			for (const auto & itt : m_devicestates)
 			{
-				luaTable.AddNumber(p->first, p->second);
-				if (p->first == item.devname) {
-					thisZwaveAlarm = p->second;
+				if (!(itt.second.measurement.flags & table.flag))
+					continue;
+				float value = GetMeasurementValue(itt.second.measurement, table.flag);
+				luaTable.AddNumber(itt.second.deviceName, value);
+				if (itt.second.deviceName == item.devname) {
+					thisDeviceValues[ii] = value;
 				}
 			}
 			luaTable.Publish();
 		}
+		devicestatesMutexLock.unlock();
 
 		if (item.reason == REASON_DEVICE)
 		{
 			CLuaTable luaTable(lua_state, "devicechanged", 1, 0);
 			luaTable.AddString(item.devname, item.nValueWording);
-			if (thisDeviceTemp != 0)
-			{
-				std::string tempName = item.devname;
-				tempName += "_Temperature";
-				luaTable.AddNumber(tempName, thisDeviceTemp);
-			}
-			if (thisDeviceDew != 0)
-			{
-				std::string tempName = item.devname;
-				tempName += "_Dewpoint";
-				luaTable.AddNumber(tempName, thisDeviceDew);
-			}
-			if (thisDeviceHum != 0) {
-				std::string humName = item.devname;
-				humName += "_Humidity";
-				luaTable.AddNumber(humName, thisDeviceHum);
-			}
-			if (thisDeviceBaro != 0) {
-				std::string baroName = item.devname;
-				baroName += "_Barometer";
-				luaTable.AddNumber(baroName, thisDeviceBaro);
-			}
-			if (thisDeviceUtility != 0) {
-				std::string utilityName = item.devname;
-				utilityName += "_Utility";
-				luaTable.AddNumber(utilityName, thisDeviceUtility);
-			}
-			if (thisDeviceWeather != 0) {
-				std::string weatherName = item.devname;
-				weatherName += "_Weather";
-				luaTable.AddNumber(weatherName, thisDeviceWeather);
-			}
-			if (thisDeviceRain != 0)
-			{
-				std::string tempName = item.devname;
-				tempName += "_Rain";
-				luaTable.AddNumber(tempName, thisDeviceRain);
-			}
-			if (thisDeviceRainLastHour != 0)
-			{
-				std::string tempName = item.devname;
-				tempName += "_RainLastHour";
-				luaTable.AddNumber(tempName, thisDeviceRainLastHour);
-			}
-			if (thisDeviceUV != 0)
+			for (size_t ii = 0; ii < sizeof(MeasurementTables) / sizeof(MeasurementTables[0]); ii++)
 			{
-				std::string tempName = item.devname;
-				tempName += "_UV";
-				luaTable.AddNumber(tempName, thisDeviceUV);
-			}
-			if (thisZwaveAlarm != 0) {
-				std::string alarmName = item.devname;
-				alarmName += "_ZWaveAlarm";
-				luaTable.AddNumber(alarmName, thisZwaveAlarm);
+				if ((MeasurementTables[ii].szChangedSuffix == NULL) || (thisDeviceValues[ii] == 0))
+					continue;
+				std::string valueName = item.devname;
+				valueName += MeasurementTables[ii].szChangedSuffix;
+				luaTable.AddNumber(valueName, thisDeviceValues[ii]);
 			}
 			luaTable.Publish();
 
@@ -3111,32 +2852,13 @@ void CEventSystem::EvaluateLua(const std::vector<_tEventQueue> &items, const std
 {
 	std::lock_guard<std::mutex> l(luaMutex);
 
-	lua_State *lua_state;
-	lua_state = luaL_newstate();
-
-	// load Lua libraries
-	static const luaL_Reg lualibs[] =
-	{
-		{ "base", luaopen_base },
-		{ "io", luaopen_io },
-		{ "table", luaopen_table },
-		{ "string", luaopen_string },
-		{ "math", luaopen_math },
-		{ NULL, NULL }
-	};
-
-	const luaL_Reg *lib = lualibs;
-	for (; lib->func != NULL; lib++)
-	{
-		lib->func(lua_state);
-		lua_settop(lua_state, 0);
-	}
-
-	lua_pushcfunction(lua_state, l_domoticz_applyJsonPath);
-	lua_setglobal(lua_state, "domoticz_applyJsonPath");
+	CdzVents* dzvents = CdzVents::GetInstance();
+	bool bdzVents = (!m_sql.m_bDisableDzVentsSystem && filename == dzvents->m_runtimeDir + "dzVents.lua");
+	CLuaStatePool *pool = (bdzVents) ? &m_dzVentsStatePool : &m_luaStatePool;
 
-	lua_pushcfunction(lua_state, l_domoticz_applyXPath);
-	lua_setglobal(lua_state, "domoticz_applyXPath");
+	lua_State *lua_state = pool->Acquire();
+	if (lua_state == NULL)
+		return;
 
 #ifdef _DEBUG
 	_log.Log(LOG_STATUS, "EventSystem: script %s trigger (%s)", m_szReason[items[0].reason].c_str(), filename.c_str());
@@ -3198,23 +2920,22 @@ void CEventSystem::EvaluateLua(const std::vector<_tEventQueue> &items, const std
 
 	int secstatus = 0;
 	m_sql.GetPreferencesVar("SecStatus", secstatus);
-	CdzVents* dzvents = CdzVents::GetInstance();
-	if (!m_sql.m_bDisableDzVentsSystem && filename == dzvents->m_runtimeDir + "dzVents.lua")
+	if (bdzVents)
 		dzvents->EvaluateDzVents(lua_state, items, secstatus);
 	else
 		EvaluateLuaClassic(lua_state, items[0], secstatus);
 
 	int status = 0;
 	if (LuaString.length() == 0)
-		status = luaL_loadfile(lua_state, filename.c_str());
+		status = pool->LoadFile(lua_state, filename);
 	else
-		status = luaL_loadstring(lua_state, LuaString.c_str());
+		status = pool->LoadString(lua_state, LuaString);
 
 	if (status == 0)
 	{
 		lua_sethook(lua_state, luaStop, LUA_MASKCOUNT, 10000000);
 
-		boost::thread luaThread(boost::bind(&CEventSystem::luaThread, this, lua_state, filename));
+		boost::thread luaThread(boost::bind(&CEventSystem::luaThread, this, pool, lua_state, filename));
 		SetThreadName(luaThread.native_handle(), "luaThread");
 
 		if (!luaThread.timed_join(boost::posix_time::seconds(10)))
@@ -3229,7 +2950,7 @@ void CEventSystem::EvaluateLua(const std::vector<_tEventQueue> &items, const std
 	else
 	{
 		report_errors(lua_state, status, filename);
-		lua_close(lua_state);
+		pool->Release(lua_state);
 		return;
 	}
 
@@ -3265,7 +2986,7 @@ void CEventSystem::EvaluateLua(const std::vector<_tEventQueue> &items, const std
 	*/
 }
 
-void CEventSystem::luaThread(lua_State *lua_state, const std::string &filename)
+void CEventSystem::luaThread(CLuaStatePool *pool, lua_State *lua_state, const std::string &filename)
 {
 	int status;
 	status = lua_pcall(lua_state, 0, LUA_MULTRET, 0);
@@ -3292,8 +3013,7 @@ void CEventSystem::luaThread(lua_State *lua_state, const std::string &filename)
 			_log.Log(LOG_STATUS, "EventSystem: Script event triggered: %s", filename.c_str());
 	}
 
-	lua_close(lua_state);
-
+	pool->Release(lua_state);
 }
 
 void CEventSystem::luaStop(lua_State *L, lua_Debug *ar)
@@ -3982,6 +3702,20 @@ std::string CEventSystem::nValueToWording(const uint8_t dType, const uint8_t dSu
 	return lstatus;
 }
 
+//Setup of the pooled states, done once per state
+void CEventSystem::InitLuaState(lua_State *lua_state)
+{
+	// reroute print library to Domoticz logger
+	lua_pushcfunction(lua_state, l_domoticz_print);
+	lua_setglobal(lua_state, "print");
+
+	lua_pushcfunction(lua_state, l_domoticz_applyJsonPath);
+	lua_setglobal(lua_state, "domoticz_applyJsonPath");
+
+	lua_pushcfunction(lua_state, l_domoticz_applyXPath);
+	lua_setglobal(lua_state, "domoticz_applyXPath");
+}
+
 int CEventSystem::l_domoticz_print(lua_State* lua_state)
 {
 	int nargs = lua_gettop(lua_state);
@@ -6,6 +6,8 @@
 #include "../httpclient/HTTPClient.h"
 
 #include "LuaCommon.h"
+#include "LuaStatePool.h"
+#include "ScriptRegistry.h"
 #include "concurrent_queue.h"
 #include "StoppableTask.h"
 #include "NotificationObserver.h"
@@ -16,6 +18,13 @@ class CEventSystem : public CLuaCommon, StoppableTask, CNotificationObserver
 	friend class CLuaHandler;
 	typedef struct lua_State lua_State;
 
+	enum _eScriptDir
+	{
+		SCRIPTDIR_LUA,
+		SCRIPTDIR_PYTHON,
+		SCRIPTDIR_DZVENTS
+	};
+
 	struct _tEventItem
 	{
 		uint64_t ID;
@@ -51,6 +60,45 @@ public:
 		REASON_NOTIFICATION		// 6
 	};
 
+	enum _eMeasurement
+	{
+		MEASURE_TEMP = 0x0001,
+		MEASURE_DEW = 0x0002,
+		MEASURE_HUM = 0x0004,
+		MEASURE_BARO = 0x0008,
+		MEASURE_UTILITY = 0x0010,
+		MEASURE_WEATHER = 0x0020,
+		MEASURE_RAIN = 0x0040,
+		MEASURE_RAINLASTHOUR = 0x0080,
+		MEASURE_UV = 0x0100,
+		MEASURE_WINDDIR = 0x0200,
+		MEASURE_WINDSPEED = 0x0400,
+		MEASURE_WINDGUST = 0x0800,
+		MEASURE_ZWAVEALARM = 0x1000,
+	};
+
+	//Values for the measurement tables (temperaturedevice, otherdevices_temperature, ..),
+	//calculated again only when the device changed
+	struct _tMeasurement
+	{
+		uint16_t flags = 0;			//MEASURE_xxx this device has
+		bool bDatabase = false;		//(also) based on the history of today, calculated again every minute
+		time_t calculated = 0;		//0 = has to be calculated
+		float temp;
+		float dewpoint;
+		float barometer;
+		float utility;
+		float weather;
+		float rain;
+		float rainLastHour;
+		float uv;
+		float winddir;
+		float windspeed;
+		float windgust;
+		int humidity;
+		int zwaveAlarm;
+	};
+
 	struct _tDeviceStatus
 	{
 		uint64_t ID;
@@ -74,6 +122,8 @@ public:
 		std::map<uint8_t, float> JsonMapFloat;
 		std::map<uint8_t, bool> JsonMapBool;
 		std::map<uint8_t, std::string> JsonMapString;
+		_tMeasurement measurement;
+		uint64_t version = 0;	//changes with every update of the state, used to re-export only changed devices
 	};
 
 	struct _tUserVariable
@@ -175,12 +225,17 @@ private:
 	std::vector<_tEventTrigger> m_eventtrigger;
 	bool m_bEnabled;
 	boost::shared_mutex m_devicestatesMutex;
+	uint64_t m_deviceVersion;				//last version given to a device state
+	uint64_t m_deviceStatesGeneration;		//changes when device states are reloaded or removed
 	boost::shared_mutex m_eventsMutex;
 	boost::shared_mutex m_uservariablesMutex;
 	boost::shared_mutex m_scenesgroupsMutex;
 	boost::shared_mutex m_eventtriggerMutex;
 	std::mutex m_measurementStatesMutex;
 	std::mutex luaMutex;
+	CLuaStatePool m_luaStatePool;
+	CLuaStatePool m_dzVentsStatePool;
+	CScriptRegistry m_scriptRegistry;
 	std::shared_ptr<std::thread> m_thread;
 	std::shared_ptr<std::thread> m_eventqueuethread;
 	StoppableTask m_TaskQueue;
@@ -194,7 +249,9 @@ private:
 	//our thread
 	void Do_Work();
 	void ProcessMinute();
-	void GetCurrentMeasurementStates();
+	void RefreshMeasurementStates();
+	void CalculateMeasurement(const _tDeviceStatus &sitem, _tMeasurement &measurement);
+	static float GetMeasurementValue(const _tMeasurement &measurement, const uint16_t flag);
 	std::string UpdateSingleState(
 		const uint64_t ulDevID, 
 		const std::string &devname, 
@@ -208,6 +265,7 @@ private:
 	);
 	void EvaluateEvent(const std::vector<_tEventQueue> &items);
 	void EvaluateDatabaseEvents(const _tEventQueue &item);
+	void BuildEventIndex();
 	lua_State *ParseBlocklyLua(lua_State *lua_state, const _tEventItem &item);
 	bool parseBlocklyActions(const _tEventItem &item);
 	std::string ProcessVariableArgument(const std::string &Argument);
@@ -217,10 +275,11 @@ private:
 #endif
 	void EvaluateLua(const _tEventQueue &item, const std::string &filename, const std::string &LuaString);
 	void EvaluateLua(const std::vector<_tEventQueue> &items, const std::string &filename, const std::string &LuaString);
-	void luaThread(lua_State *lua_state, const std::string &filename);
+	void luaThread(CLuaStatePool *pool, lua_State *lua_state, const std::string &filename);
 	static void luaStop(lua_State *L, lua_Debug *ar);
 	std::string nValueToWording(const uint8_t dType, const uint8_t dSubType, const _eSwitchType switchtype, const int nValue, const std::string &sValue, const std::map<std::string, std::string> & options);
 	static int l_domoticz_print(lua_State* lua_state);
+	static void InitLuaState(lua_State *lua_state);
 	void OpenURL(const float delay, const std::string &URL);
 	void WriteToLog(const std::string &devNameNoQuotes, const std::string &doWhat);
 	bool ScheduleEvent(int deviceID, const std::string &Action, bool isScene, const std::string &eventName, int sceneType);
@@ -237,38 +296,21 @@ private:
 
 	//std::string reciprocalAction (std::string Action);
 	std::vector<_tEventItem> m_events;
+	//Blockly events (index in m_events) by the device/variable idx or the state mentioned in their conditions
+	std::map<uint64_t, std::vector<size_t> > m_blocklyDeviceEvents;
+	std::map<uint64_t, std::vector<size_t> > m_blocklyVariableEvents;
+	std::vector<size_t> m_blocklySecurityEvents;
+	std::vector<size_t> m_blocklyTimeEvents;
+	bool m_bDatabaseScripts;	//Lua or Python events present
 
 
 	std::map<uint64_t, _tDeviceStatus> m_devicestates;
 	std::map<uint64_t, _tUserVariable> m_uservariables;
 	std::map<uint64_t, _tScenesGroups> m_scenesgroups;
-	std::map<std::string, float> m_tempValuesByName;
-	std::map<std::string, float> m_dewValuesByName;
-	std::map<std::string, float> m_rainValuesByName;
-	std::map<std::string, float> m_rainLastHourValuesByName;
-	std::map<std::string, float> m_uvValuesByName;
-	std::map<std::string, float> m_weatherValuesByName;
-	std::map<std::string, int>	 m_humValuesByName;
-	std::map<std::string, float> m_baroValuesByName;
-	std::map<std::string, float> m_utilityValuesByName;
-	std::map<std::string, float> m_winddirValuesByName;
-	std::map<std::string, float> m_windspeedValuesByName;
-	std::map<std::string, float> m_windgustValuesByName;
-	std::map<std::string, int>	 m_zwaveAlarmValuesByName;
-
-	std::map<uint64_t, float> m_tempValuesByID;
-	std::map<uint64_t, float> m_dewValuesByID;
-	std::map<uint64_t, float> m_rainValuesByID;
-	std::map<uint64_t, float> m_rainLastHourValuesByID;
-	std::map<uint64_t, float> m_uvValuesByID;
-	std::map<uint64_t, float> m_weatherValuesByID;
-	std::map<uint64_t, int>	m_humValuesByID;
-	std::map<uint64_t, float> m_baroValuesByID;
-	std::map<uint64_t, float> m_utilityValuesByID;
-	std::map<uint64_t, float> m_winddirValuesByID;
-	std::map<uint64_t, float> m_windspeedValuesByID;
-	std::map<uint64_t, float> m_windgustValuesByID;
-	std::map<uint64_t, int> m_zwaveAlarmValuesByID;
+	//meter dividers the measurements were calculated with (guarded by m_measurementStatesMutex)
+	float m_measureEnergyDivider;
+	float m_measureGasDivider;
+	float m_measureWaterDivider;
 
 	void reportMissingDevice(const int deviceID, const _tEventItem &item);
 	int getSunRiseSunSetMinutes(const std::string &what);
@@ -0,0 +1,201 @@
+#include "stdafx.h"
+#include "GraphDownsample.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+//Value fields of the series, numbers or strings holding a number (like "hu" or "ba").
+//Every field is scaled to 0..1 so series with a large range do not hide the others
+static void GetNormalizedValues(const Json::Value &series, std::vector<std::vector<double> > &values)
+{
+	const Json::ArrayIndex count = series.size();
+	std::vector<std::string> fields;
+	for (Json::ArrayIndex ii = 0; ii < count; ii++)
+	{
+		for (const auto & itt : series[ii].getMemberNames())
+		{
+			if ((itt != "d") && (std::find(fields.begin(), fields.end(), itt) == fields.end()))
+				fields.push_back(itt);
+		}
+	}
+	for (const auto & field : fields)
+	{
+		std::vector<double> column(count, NAN);
+		double minValue = 0, maxValue = 0;
+		bool bFound = false;
+		for (Json::ArrayIndex ii = 0; ii < count; ii++)
+		{
+			const Json::Value &value = series[ii][field];
+			double dValue;
+			if (value.isNumeric())
+				dValue = value.asDouble();
+			else if (value.isString())
+			{
+				const char *szValue = value.asCString();
+				char *pEnd = NULL;
+				dValue = strtod(szValue, &pEnd);
+				if ((pEnd == szValue) || (*pEnd != 0))
+					continue;
+			}
+			else
+				continue;
+			column[ii] = dValue;
+			if ((!bFound) || (dValue < minValue))
+				minValue = dValue;
+			if ((!bFound) || (dValue > maxValue))
+				maxValue = dValue;
+			bFound = true;
+		}
+		if ((!bFound) || (maxValue == minValue))
+			continue; //a flat line does not influence the selection
+		for (auto & itt : column)
+		{
+			if (!std::isnan(itt))
+				itt = (itt - minValue) / (maxValue - minValue);
+		}
+		values.push_back(column);
+	}
+}
+
+//Sum of the triangle areas (a, b, c) of all fields, b and c can be averages
+static double TriangleArea(const std::vector<std::vector<double> > &values, const double ax, const size_t a, const double bx, const size_t b, const double cx, const std::vector<double> &cy)
+{
+	double area = 0;
+	for (size_t field = 0; field < values.size(); field++)
+	{
+		double ay = values[field][a];
+		double by = values[field][b];
+		if (std::isnan(ay) || std::isnan(by) || std::isnan(cy[field]))
+			continue;
+		area += std::fabs((ax - cx) * (by - ay) - (ax - bx) * (cy[field] - ay));
+	}
+	return area;
+}
+
+static void SelectLTTB(const std::vector<std::vector<double> > &values, const size_t count, const size_t maxPoints, std::vector<size_t> &selected)
+{
+	selected.push_back(0);
+	if (maxPoints < 3)
+	{
+		selected.push_back(count - 1);
+		return;
+	}
+	double bucketSize = double(count - 2) / double(maxPoints - 2);
+	size_t a = 0;
+	std::vector<double> avg(values.size());
+	for (size_t bucket = 0; bucket < maxPoints - 2; bucket++)
+	{
+		size_t start = (size_t)(bucket * bucketSize) + 1;
+		size_t end = (size_t)((bucket + 1) * bucketSize) + 1;
+		size_t nextStart = end;
+		size_t nextEnd = std::min((size_t)((bucket + 2) * bucketSize) + 1, count);
+
+		//average of the next bucket (the last point for the last bucket)
+		double avgx = (nextStart + nextEnd - 1) / 2.0;
+		for (size_t field = 0; field < values.size(); field++)
+		{
+			double sum = 0;
+			int n = 0;
+			for (size_t ii = nextStart; ii < nextEnd; ii++)
+			{
+				if (!std::isnan(values[field][ii]))
+				{
+					sum += values[field][ii];
+					n++;
+				}
+			}
+			avg[field] = (n != 0) ? sum / n : NAN;
+		}
+
+		size_t best = start;
+		double bestArea = -1;
+		for (size_t ii = start; ii < end; ii++)
+		{
+			double area = TriangleArea(values, (double)a, a, (double)ii, ii, avgx, avg);
+			if (area > bestArea)
+			{
+				bestArea = area;
+				best = ii;
+			}
+		}
+		selected.push_back(best);
+		a = best;
+	}
+	selected.push_back(count - 1);
+}
+
+//Two points per bucket: the lowest and highest point of the field that changes most within the bucket
+static void SelectMinMax(const std::vector<std::vector<double> > &values, const size_t count, const size_t maxPoints, std::vector<size_t> &selected)
+{
+	//first and last point are always kept
+	size_t buckets = (maxPoints - 2) / 2;
+	std::vector<bool> bKeep(count, false);
+	bKeep[0] = true;
+	bKeep[count - 1] = true;
+	for (size_t bucket = 0; bucket < buckets; bucket++)
+	{
+		size_t start = 1 + (bucket * (count - 2)) / buckets;
+		size_t end = 1 + ((bucket + 1) * (count - 2)) / buckets;
+		size_t bestMin = end, bestMax = end;
+		double bestRange = -1;
+		for (const auto & column : values)
+		{
+			size_t minIdx = end, maxIdx = end;
+			for (size_t ii = start; ii < end; ii++)
+			{
+				if (std::isnan(column[ii]))
+					continue;
+				if ((minIdx == end) || (column[ii] < column[minIdx]))
+					minIdx = ii;
+				if ((maxIdx == end) || (column[ii] > column[maxIdx]))
+					maxIdx = ii;
+			}
+			if ((minIdx != end) && (column[maxIdx] - column[minIdx] > bestRange))
+			{
+				bestRange = column[maxIdx] - column[minIdx];
+				bestMin = minIdx;
+				bestMax = maxIdx;
+			}
+		}
+		if (bestMin != end)
+		{
+			bKeep[bestMin] = true;
+			bKeep[bestMax] = true;
+		}
+	}
+	for (size_t ii = 0; ii < count; ii++)
+	{
+		if (bKeep[ii])
+			selected.push_back(ii);
+	}
+}
+
+_eDownsampleMethod DownsampleMethodFromString(const std::string &szMethod)
+{
+	if (szMethod == "minmax")
+		return DOWNSAMPLE_MINMAX;
+	return DOWNSAMPLE_LTTB;
+}
+
+void DownsampleGraph(Json::Value &series, const size_t maxPoints, const _eDownsampleMethod method)
+{
+	if ((!series.isArray()) || (maxPoints == 0) || (series.size() <= maxPoints))
+		return;
+	const size_t count = series.size();
+
+	std::vector<std::vector<double> > values;
+	GetNormalizedValues(series, values);
+
+	std::vector<size_t> selected;
+	//min/max needs room for at least one bucket besides the first and last point
+	if ((method == DOWNSAMPLE_MINMAX) && (!values.empty()) && (maxPoints >= 4))
+		SelectMinMax(values, count, maxPoints, selected);
+	else
+		SelectLTTB(values, count, maxPoints, selected);
+
+	Json::Value result(Json::arrayValue);
+	for (const auto & itt : selected)
+		result.append(series[(Json::ArrayIndex)itt]);
+	series.swap(result);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <json/json.h>
+#include <string>
+
+enum _eDownsampleMethod
+{
+	DOWNSAMPLE_LTTB = 0,	//largest triangle three buckets, keeps the visual shape
+	DOWNSAMPLE_MINMAX,		//keeps the lowest and highest point of every series per bucket
+};
+
+_eDownsampleMethod DownsampleMethodFromString(const std::string &szMethod);
+
+//Reduces a graph result (array of objects with a "d" date and value fields, in date order)
+//to at most maxPoints entries (minimum 2, the first and last entry are always kept).
+//Entries are selected, never changed, so every field keeps its type
+void DownsampleGraph(Json::Value &series, const size_t maxPoints, const _eDownsampleMethod method);
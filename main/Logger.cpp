@@ -2,6 +2,7 @@
 #include "Logger.h"
 #include <iostream>
 #include <stdarg.h>
+#include <inttypes.h>
 #include <time.h>
 #include <algorithm>
 #include "localtime_r.h"
@@ -18,6 +19,11 @@
 #define MAX_LOG_LINE_BUFFER 100
 #define MAX_LOG_LINE_LENGTH (2048*3)
 
+//asynchronous mode
+#define LOG_RING_SIZE 2048			//records, power of 2
+#define LOG_SINK_INTERVAL 100		//ms between batches
+#define LOG_FLUSH_INTERVAL 1000		//ms between flushes of the file/console (errors are flushed immediately)
+
 extern bool g_bRunAsDaemon;
 extern bool g_bUseSyslog;
 
@@ -28,9 +34,18 @@ CLogger::_tLogLineStruct::_tLogLineStruct(const _eLogLevel nlevel, const std::st
 	logmessage = nlogmessage;
 }
 
-CLogger::CLogger(void)
+thread_local bool CLogger::m_bInSequenceMode = false;
+thread_local std::stringstream CLogger::m_sequencestring;
+
+CLogger::CLogger(void) :
+	m_enqueuePos(0),
+	m_dequeuePos(0),
+	m_droppedLines(0),
+	m_bAsync(false),
+	m_asyncWriters(0),
+	m_bDraining(false),
+	m_bStopSink(false)
 {
-	m_bInSequenceMode = false;
 	m_bEnableLogThreadIDs = false;
 	m_bEnableLogTimestamps = true;
 	m_bEnableErrorsToNotificationSystem = false;
@@ -41,6 +56,7 @@ CLogger::CLogger(void)
 
 CLogger::~CLogger(void)
 {
+	StopAsync();
 	if (m_outputfile.is_open())
 		m_outputfile.close();
 }
@@ -173,6 +189,67 @@ void CLogger::Log(const _eLogLevel level, const char* logline, ...)
 	vsnprintf(cbuffer, sizeof(cbuffer), logline, argList);
 	va_end(argList);
 
+	char szLine[MAX_LOG_LINE_LENGTH + 64];
+	size_t msgOffset;
+	size_t length = FormatLine(level, cbuffer, szLine, sizeof(szLine), msgOffset);
+
+	if (m_bAsync)
+	{
+		//only counted in asynchronous mode, StopAsync switches it off first and then waits for the
+		//writers that are counted, a writer that sees it switched off after counting itself writes directly
+		m_asyncWriters++;
+		if (m_bAsync)
+		{
+			if ((PushRecord(level, szLine, length, msgOffset)) && (level & LOG_ERROR))
+				m_sinkCondition.notify_one(); //errors are written (and flushed) right away
+			m_asyncWriters--;
+			return;
+		}
+		m_asyncWriters--;
+	}
+
+	SyslogLine(level, cbuffer);
+	OutputLine(level, mytime(NULL), std::string(szLine, length));
+}
+
+//Timestamp, thread id and level prefix followed by the message, returns the length
+size_t CLogger::FormatLine(const _eLogLevel level, const char *szMessage, char *szLine, const size_t maxLength, size_t &msgOffset)
+{
+	size_t pos = 0;
+	if (m_bEnableLogTimestamps)
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		time_t tv_sec = tv.tv_sec;
+		struct tm timeinfo;
+		localtime_r(&tv_sec, &timeinfo);
+		pos += snprintf(szLine + pos, maxLength - pos, "%04d-%02d-%02d %02d:%02d:%02d.%03d  ",
+			timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
+			timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec, (int)(tv.tv_usec / 1000));
+	}
+
+	if ((m_log_flags & LOG_DEBUG_INT) && (m_debug_flags & DEBUG_THREADIDS))
+	{
+#ifdef WIN32
+		pos += snprintf(szLine + pos, maxLength - pos, "[%04lx] ", (unsigned long)::GetCurrentThreadId());
+#else
+		pos += snprintf(szLine + pos, maxLength - pos, "[%04lx] ", (unsigned long)pthread_self());
+#endif
+	}
+
+	if (level & LOG_STATUS)
+		pos += snprintf(szLine + pos, maxLength - pos, "Status: ");
+	else if (level & LOG_ERROR)
+		pos += snprintf(szLine + pos, maxLength - pos, "Error: ");
+	else if (level & LOG_DEBUG_INT)
+		pos += snprintf(szLine + pos, maxLength - pos, "Debug: ");
+	msgOffset = pos;
+	pos += snprintf(szLine + pos, maxLength - pos, "%s", szMessage);
+	return std::min(pos, maxLength - 1);
+}
+
+void CLogger::SyslogLine(const _eLogLevel level, const char *szMessage)
+{
 #ifndef WIN32
 	if (g_bUseSyslog)
 	{
@@ -181,80 +258,261 @@ void CLogger::Log(const _eLogLevel level, const char* logline, ...)
 			sLogLevel = LOG_ERR;
 		else if (level & LOG_STATUS)
 			sLogLevel = LOG_NOTICE;
-		syslog(sLogLevel, "%s", cbuffer);
+		syslog(sLogLevel, "%s", szMessage);
 	}
 #endif
+}
 
-	std::stringstream sstr;
+//Console, log file and in-memory buffers. In asynchronous mode only called by the sink thread,
+//which flushes the console and file itself
+void CLogger::OutputLine(const _eLogLevel level, const time_t logtime, const std::string &szIntLog)
+{
+	// Locked region to allow multiple threads to print at the same time
+	std::unique_lock<std::mutex> lock(m_mutex);
 
-	if (m_bEnableLogTimestamps)
-		sstr << TimeToString(NULL, TF_DateTimeMs) << "  ";
+	if ((level & LOG_ERROR) && (m_bEnableErrorsToNotificationSystem))
+	{
+		if (m_notification_log.size() >= MAX_LOG_LINE_BUFFER)
+			m_notification_log.erase(m_notification_log.begin());
+		m_notification_log.push_back(_tLogLineStruct(level, szIntLog));
+		m_notification_log.back().logtime = logtime;
+		if ((m_notification_log.size() == 1) && (mytime(NULL) - m_LastLogNotificationsSend >= 5))
+		{
+			m_mainworker.ForceLogNotificationCheck();
+		}
+	}
 
-	if ((m_log_flags & LOG_DEBUG_INT) && (m_debug_flags & DEBUG_THREADIDS))
+	if (!g_bRunAsDaemon)
 	{
-#ifdef WIN32
-		sstr << "[" << std::setfill('0') << std::setw(4) << std::hex << ::GetCurrentThreadId() << "] ";
-#else
-		sstr << "[" << std::setfill('0') << std::setw(4) << std::hex << pthread_self() << "] ";
+		//output to console
+#ifndef WIN32
+		if (level != LOG_ERROR)
 #endif
+			std::cout << szIntLog << '\n';
+#ifndef WIN32
+		else  // print text in red color
+			std::cout << szIntLog.substr(0, 25) << "\033[1;31m" << szIntLog.substr(25) << "\033[0;0m" << '\n';
+#endif
+		if (!m_bAsync)
+			std::cout.flush();
 	}
 
-	if (level & LOG_STATUS)
-		sstr << "Status: " << cbuffer;
-	else if (level & LOG_ERROR)
-		sstr << "Error: " << cbuffer;
-	else if (level & LOG_DEBUG_INT)
-		sstr << "Debug: " << cbuffer;
-	else
-		sstr << cbuffer;
+	if (m_outputfile.is_open())
+	{
+		//output to file
+		m_outputfile << szIntLog << '\n';
+		if (!m_bAsync)
+			m_outputfile.flush();
+	}
 
-	std::string szIntLog = sstr.str();
+	std::deque<_tLogLineStruct> &lastlog = m_lastlog[level];
+	if (lastlog.size() >= MAX_LOG_LINE_BUFFER)
+		lastlog.erase(lastlog.begin());
+	lastlog.push_back(_tLogLineStruct(level, szIntLog));
+	lastlog.back().logtime = logtime;
+}
 
+void CLogger::StartAsync()
+{
+	if (m_sinkThread)
+		return;
+	m_ring.reset(new _tLogRecord[LOG_RING_SIZE]);
+	for (size_t ii = 0; ii < LOG_RING_SIZE; ii++)
+		m_ring[ii].sequence.store(ii, std::memory_order_relaxed);
+	m_enqueuePos = 0;
+	m_dequeuePos = 0;
+	m_bStopSink = false;
+	m_sinkThread = std::make_shared<std::thread>(&CLogger::Do_Work_Sink, this);
+	SetThreadName(m_sinkThread->native_handle(), "LogSink");
+	m_bAsync = true;
+}
+
+void CLogger::StopAsync()
+{
+	if (!m_sinkThread)
+		return;
+	m_bAsync = false;
+	//lines that are being pushed right now still end up in the ring
+	while (m_asyncWriters != 0)
+		std::this_thread::yield();
+	m_bStopSink = true;
+	m_sinkCondition.notify_one();
+	m_sinkThread->join(); //writes what is left in the ring
+	m_sinkThread.reset();
+}
+
+//Called by the fatal signal handler: the process is about to die, so what is in the ring is written
+//by the calling thread (the sink thread could be the one that crashed) and further lines are written directly
+void CLogger::StopAsyncFatal()
+{
+	if ((!m_sinkThread) || (!m_bAsync.exchange(false)))
+		return;
+	//lines that are being pushed right now, a writer that crashed never finishes
+	for (int ii = 0; (ii < 100) && (m_asyncWriters != 0); ii++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	if (std::this_thread::get_id() == m_sinkThread->get_id())
+		m_bDraining = false;
+	std::string szLine;
+	bool bFlush = true;
+	bool bWritten = false;
+	//give a sink thread that is writing a batch right now some time to finish it
+	for (int ii = 0; (ii < 1000) && (!DrainRing(szLine, bFlush, bWritten)); ii++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!g_bRunAsDaemon)
+		std::cout.flush();
+	if (m_outputfile.is_open())
+		m_outputfile.flush();
+}
+
+uint64_t CLogger::GetDroppedLines()
+{
+	return m_droppedLines;
+}
+
+//Multiple producer ring (per record sequence numbers), a line uses one or more consecutive records.
+//Never blocks: when the ring is full the line is counted as dropped.
+bool CLogger::PushRecord(const _eLogLevel level, const char *szLine, const size_t length, const size_t msgOffset)
+{
+	const size_t textSize = sizeof(m_ring[0].text);
+	const size_t parts = std::max<size_t>((length + textSize - 1) / textSize, 1);
+	size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+	for (;;)
 	{
-		// Locked region to allow multiple threads to print at the same time
-		std::unique_lock<std::mutex> lock(m_mutex);
+		//records are consumed in order, when the last one we need is free the others are as well
+		size_t last = pos + parts - 1;
+		size_t seq = m_ring[last & (LOG_RING_SIZE - 1)].sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)last;
+		if (diff == 0)
+		{
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + parts, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			m_droppedLines++;
+			return false;
+		}
+		else
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+	}
+
+	time_t logtime = mytime(NULL);
+	for (size_t ii = 0; ii < parts; ii++)
+	{
+		_tLogRecord &record = m_ring[(pos + ii) & (LOG_RING_SIZE - 1)];
+		size_t offset = ii * textSize;
+		record.level = level;
+		record.logtime = logtime;
+		record.parts = (uint16_t)parts;
+		record.msgOffset = (uint16_t)msgOffset;
+		record.length = (uint16_t)std::min(length - std::min(offset, length), textSize);
+		memcpy(record.text, szLine + std::min(offset, length), record.length);
+		record.sequence.store(pos + ii + 1, std::memory_order_release);
+	}
+	//do not wait for the timer during a burst, wake the sink every quarter of the ring
+	if ((pos / (LOG_RING_SIZE / 4)) != ((pos + parts) / (LOG_RING_SIZE / 4)))
+		m_sinkCondition.notify_one();
+	return true;
+}
 
-		if ((level & LOG_ERROR) && (m_bEnableErrorsToNotificationSystem))
+//Writes the complete lines in the ring, by the sink thread or (after a fatal signal) the thread that takes over.
+//Only one thread at a time reads the ring, returns false when another thread is doing it
+bool CLogger::DrainRing(std::string &szLine, bool &bFlush, bool &bWritten)
+{
+	if (m_bDraining.exchange(true))
+		return false;
+	for (;;)
+	{
+		_tLogRecord &first = m_ring[m_dequeuePos & (LOG_RING_SIZE - 1)];
+		if (first.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+			break; //empty
+		size_t parts = first.parts;
+		_tLogRecord &last = m_ring[(m_dequeuePos + parts - 1) & (LOG_RING_SIZE - 1)];
+		if (last.sequence.load(std::memory_order_acquire) != m_dequeuePos + parts)
+			break; //still being written
+
+		szLine.clear();
+		for (size_t ii = 0; ii < parts; ii++)
 		{
-			if (m_notification_log.size() >= MAX_LOG_LINE_BUFFER)
-				m_notification_log.erase(m_notification_log.begin());
-			m_notification_log.push_back(_tLogLineStruct(level, szIntLog));
-			if ((m_notification_log.size() == 1) && (mytime(NULL) - m_LastLogNotificationsSend >= 5))
-			{
-				m_mainworker.ForceLogNotificationCheck();
-			}
+			_tLogRecord &record = m_ring[(m_dequeuePos + ii) & (LOG_RING_SIZE - 1)];
+			szLine.append(record.text, record.length);
+		}
+		_eLogLevel level = first.level;
+		time_t logtime = first.logtime;
+		size_t msgOffset = first.msgOffset;
+		for (size_t ii = 0; ii < parts; ii++)
+		{
+			_tLogRecord &record = m_ring[(m_dequeuePos + ii) & (LOG_RING_SIZE - 1)];
+			record.sequence.store(m_dequeuePos + ii + LOG_RING_SIZE, std::memory_order_release);
 		}
+		m_dequeuePos += parts;
 
-		if (!g_bRunAsDaemon)
+		SyslogLine(level, szLine.c_str() + std::min(msgOffset, szLine.size()));
+		OutputLine(level, logtime, szLine);
+		bWritten = true;
+		if (level & LOG_ERROR)
+			bFlush = true;
+	}
+	m_bDraining = false;
+	return true;
+}
+
+void CLogger::Do_Work_Sink()
+{
+	std::string szLine;
+	szLine.reserve(MAX_LOG_LINE_LENGTH + 64);
+	uint64_t droppedReported = 0;
+	auto lastFlush = std::chrono::steady_clock::now();
+	bool bStop = false;
+	while (!bStop)
+	{
 		{
-			//output to console
-	#ifndef WIN32
-			if (level != LOG_ERROR)
-	#endif
-				std::cout << szIntLog << std::endl;
-	#ifndef WIN32
-			else  // print text in red color
-				std::cout << szIntLog.substr(0, 25) << "\033[1;31m" << szIntLog.substr(25) << "\033[0;0m" << std::endl;
-	#endif
+			std::unique_lock<std::mutex> lock(m_sinkMutex);
+			if (!m_bStopSink)
+				m_sinkCondition.wait_for(lock, std::chrono::milliseconds(LOG_SINK_INTERVAL));
 		}
+		bStop = m_bStopSink;
 
-		if (m_outputfile.is_open())
+		bool bFlush = bStop;
+		bool bWritten = false;
+		DrainRing(szLine, bFlush, bWritten);
+		if ((bStop) && (m_dequeuePos != m_enqueuePos.load(std::memory_order_acquire)))
 		{
-			//output to file
-			m_outputfile << szIntLog << std::endl;
-			m_outputfile.flush();
+			//a line is still being written, stop once the read position reaches the write position
+			bStop = false;
+			std::this_thread::yield();
 		}
 
-		std::map<_eLogLevel, std::deque<_tLogLineStruct> >::iterator itt;
+		uint64_t dropped = m_droppedLines;
+		if (dropped != droppedReported)
+		{
+			char szMessage[100];
+			sprintf(szMessage, "Logger: %" PRIu64 " log lines dropped (log ring full)", dropped - droppedReported);
+			droppedReported = dropped;
+			char szDropped[200];
+			size_t msgOffset;
+			size_t length = FormatLine(LOG_ERROR, szMessage, szDropped, sizeof(szDropped), msgOffset);
+			SyslogLine(LOG_ERROR, szMessage);
+			OutputLine(LOG_ERROR, mytime(NULL), std::string(szDropped, length));
+			bWritten = true;
+		}
 
-		itt = m_lastlog.find(level);
-		if (itt != m_lastlog.end())
+		auto now = std::chrono::steady_clock::now();
+		if ((bWritten) && ((bFlush) || (now - lastFlush >= std::chrono::milliseconds(LOG_FLUSH_INTERVAL))))
 		{
-			if (m_lastlog[level].size() >= MAX_LOG_LINE_BUFFER)
-				m_lastlog[level].erase(m_lastlog[level].begin());
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (!g_bRunAsDaemon)
+				std::cout.flush();
+			if (m_outputfile.is_open())
+				m_outputfile.flush();
+			lastFlush = now;
 		}
-		m_lastlog[level].push_back(_tLogLineStruct(level, szIntLog));
 	}
+	std::unique_lock<std::mutex> lock(m_mutex);
+	std::cout.flush();
+	if (m_outputfile.is_open())
+		m_outputfile.flush();
 }
 
 void CLogger::Debug(const _eDebugLevel level, const char* logline, ...)
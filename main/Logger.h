@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <list>
+#include <memory>
 #include <string>
 #include <fstream>
+#include <thread>
 
 enum _eLogLevel : uint32_t
 {
@@ -87,7 +91,32 @@ public:
 
 	std::list<_tLogLineStruct> GetNotificationLogs();
 	bool NotificationLogsEnabled();
+
+	//Asynchronous mode: Log() only formats the line into a ring of fixed-size records,
+	//a sink thread writes them to the console, log file and syslog in batches
+	void StartAsync();
+	void StopAsync();
+	//Fatal signal: write what is in the ring from the calling thread and log synchronously from now on
+	void StopAsyncFatal();
+	uint64_t GetDroppedLines();
 private:
+	struct _tLogRecord
+	{
+		std::atomic<size_t> sequence;
+		_eLogLevel level;
+		time_t logtime;
+		uint16_t parts;				//number of records holding the line (first record only)
+		uint16_t msgOffset;			//start of the message after timestamp/prefix (first record only)
+		uint16_t length;
+		char text[232];
+	};
+	size_t FormatLine(const _eLogLevel level, const char *szMessage, char *szLine, const size_t maxLength, size_t &msgOffset);
+	void OutputLine(const _eLogLevel level, const time_t logtime, const std::string &szIntLog);
+	void SyslogLine(const _eLogLevel level, const char *szMessage);
+	bool PushRecord(const _eLogLevel level, const char *szLine, const size_t length, const size_t msgOffset);
+	bool DrainRing(std::string &szLine, bool &bFlush, bool &bWritten);
+	void Do_Work_Sink();
+
 	uint32_t m_log_flags;
 	uint32_t m_debug_flags;
 
@@ -95,11 +124,25 @@ private:
 	std::ofstream m_outputfile;
 	std::map<_eLogLevel, std::deque<_tLogLineStruct> > m_lastlog;
 	std::deque<_tLogLineStruct> m_notification_log;
-	bool m_bInSequenceMode;
 	bool m_bEnableLogTimestamps;
 	bool m_bEnableLogThreadIDs;
 	bool m_bEnableErrorsToNotificationSystem;
 	time_t m_LastLogNotificationsSend;
-	std::stringstream m_sequencestring;
+
+	std::unique_ptr<_tLogRecord[]> m_ring;
+	std::atomic<size_t> m_enqueuePos;
+	size_t m_dequeuePos;
+	std::atomic<uint64_t> m_droppedLines;
+	std::atomic<bool> m_bAsync;
+	std::atomic<int> m_asyncWriters;		//Log calls that saw m_bAsync and may still push to the ring
+	std::atomic<bool> m_bDraining;			//a thread is reading the ring
+	std::atomic<bool> m_bStopSink;
+	std::mutex m_sinkMutex;
+	std::condition_variable m_sinkCondition;
+	std::shared_ptr<std::thread> m_sinkThread;
+
+	//log sequences are built per thread, several threads decode received messages
+	static thread_local bool m_bInSequenceMode;
+	static thread_local std::stringstream m_sequencestring;
 };
 extern CLogger _log;
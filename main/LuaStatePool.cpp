@@ -0,0 +1,303 @@
+#include "stdafx.h"
+#include "LuaStatePool.h"
+#include "../main/Logger.h"
+#include <sys/stat.h>
+
+extern "C" {
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+}
+
+#ifndef LUA_LOADED_TABLE
+#define LUA_LOADED_TABLE "_LOADED"
+#endif
+
+#define LUA_STATE_POOL_SIZE 4
+#define LUA_CHUNK_CACHE_SIZE 256
+
+//registry keys holding the globals and modules present after initialization
+#define LUA_POOL_BASE_GLOBALS "domoticz_pool_globals"
+#define LUA_POOL_BASE_LOADED "domoticz_pool_loaded"
+#define LUA_POOL_BASE_LIBRARIES "domoticz_pool_libraries"
+
+//Shallow copy of the table at index idx, pushed on the stack
+static void CopyTable(lua_State *lua_state, int idx)
+{
+	idx = lua_absindex(lua_state, idx);
+	lua_newtable(lua_state);
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, idx) != 0)
+	{
+		lua_pushvalue(lua_state, -2);
+		lua_insert(lua_state, -2);
+		lua_rawset(lua_state, -4);
+	}
+}
+
+//Make table tIndex equal to the (shallow) baseline table bIndex again
+static void RestoreTable(lua_State *lua_state, int tIndex, int bIndex)
+{
+	tIndex = lua_absindex(lua_state, tIndex);
+	bIndex = lua_absindex(lua_state, bIndex);
+
+	//collect the keys first, a table can not be cleared while it is traversed
+	lua_newtable(lua_state);
+	int kIndex = lua_gettop(lua_state);
+	lua_Integer nKeys = 0;
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, tIndex) != 0)
+	{
+		lua_pop(lua_state, 1);
+		lua_pushvalue(lua_state, -1);
+		lua_rawget(lua_state, bIndex);
+		bool bKnown = !lua_isnil(lua_state, -1);
+		lua_pop(lua_state, 1);
+		if (!bKnown)
+		{
+			lua_pushvalue(lua_state, -1);
+			lua_rawseti(lua_state, kIndex, ++nKeys);
+		}
+	}
+	for (lua_Integer ii = 1; ii <= nKeys; ii++)
+	{
+		lua_rawgeti(lua_state, kIndex, ii);
+		lua_pushnil(lua_state);
+		lua_rawset(lua_state, tIndex);
+	}
+	lua_pop(lua_state, 1);
+
+	//put back anything that was overwritten
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, bIndex) != 0)
+	{
+		lua_pushvalue(lua_state, -2);
+		lua_insert(lua_state, -2);
+		lua_rawset(lua_state, tIndex);
+	}
+}
+
+//Store a baseline copy of the table at idx in the libraries table at lIndex, the table itself is the key
+static void AddLibraryTable(lua_State *lua_state, int lIndex, int idx)
+{
+	lIndex = lua_absindex(lua_state, lIndex);
+	idx = lua_absindex(lua_state, idx);
+	lua_pushvalue(lua_state, idx);
+	CopyTable(lua_state, idx);
+	lua_rawset(lua_state, lIndex);
+}
+
+static int lua_chunk_writer(lua_State *lua_state, const void *p, size_t sz, void *ud)
+{
+	(void)lua_state;
+	((std::string*)ud)->append((const char*)p, sz);
+	return 0;
+}
+
+CLuaStatePool::CLuaStatePool(TInitFunction initFunction) :
+	m_initFunction(initFunction)
+{
+}
+
+CLuaStatePool::~CLuaStatePool()
+{
+	Clear();
+}
+
+lua_State *CLuaStatePool::Acquire()
+{
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_states.empty())
+		{
+			lua_State *lua_state = m_states.back();
+			m_states.pop_back();
+			return lua_state;
+		}
+	}
+	return CreateState();
+}
+
+void CLuaStatePool::Release(lua_State *lua_state)
+{
+	if (lua_state == NULL)
+		return;
+	ResetState(lua_state);
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_states.size() < LUA_STATE_POOL_SIZE)
+		{
+			m_states.push_back(lua_state);
+			return;
+		}
+	}
+	lua_close(lua_state);
+}
+
+void CLuaStatePool::Clear()
+{
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (auto & itt : m_states)
+			lua_close(itt);
+		m_states.clear();
+	}
+	std::lock_guard<std::mutex> l(m_chunkMutex);
+	m_chunks.clear();
+}
+
+lua_State *CLuaStatePool::CreateState()
+{
+	lua_State *lua_state = luaL_newstate();
+	if (lua_state == NULL)
+	{
+		_log.Log(LOG_ERROR, "EventSystem: Could not create Lua state");
+		return NULL;
+	}
+	luaL_openlibs(lua_state);
+	if (m_initFunction)
+		m_initFunction(lua_state);
+
+	//let 'require' find Lua modules through our bytecode cache
+	lua_getglobal(lua_state, "package");
+	lua_getfield(lua_state, -1, "searchers");
+	if (lua_istable(lua_state, -1))
+	{
+		lua_pushlightuserdata(lua_state, this);
+		lua_pushcclosure(lua_state, l_cached_searcher, 1);
+		lua_rawseti(lua_state, -2, 2);
+	}
+	lua_settop(lua_state, 0);
+
+	lua_pushglobaltable(lua_state);
+	CopyTable(lua_state, -1);
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, LUA_POOL_BASE_GLOBALS);
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	CopyTable(lua_state, -1);
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, LUA_POOL_BASE_LOADED);
+	lua_settop(lua_state, 0);
+
+	//the library tables (package, string, table, math, os...) and the string metatable are shared by
+	//every run, a script that changes string.format or os.time should not change it for the next one
+	lua_newtable(lua_state);
+	lua_pushglobaltable(lua_state);
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, 3) != 0)
+	{
+		//the globals are restored on their own
+		if ((lua_istable(lua_state, -1)) && (!lua_rawequal(lua_state, -1, 2)))
+			AddLibraryTable(lua_state, 1, -1);
+		lua_pop(lua_state, 1);
+	}
+	lua_settop(lua_state, 1);
+	lua_pushliteral(lua_state, "");
+	if (lua_getmetatable(lua_state, -1))
+		AddLibraryTable(lua_state, 1, -1);
+	lua_settop(lua_state, 1);
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, LUA_POOL_BASE_LIBRARIES);
+	lua_settop(lua_state, 0);
+	return lua_state;
+}
+
+void CLuaStatePool::ResetState(lua_State *lua_state)
+{
+	lua_settop(lua_state, 0);
+	lua_sethook(lua_state, NULL, 0, 0);
+
+	lua_pushglobaltable(lua_state);
+	lua_pushnil(lua_state);
+	lua_setmetatable(lua_state, 1);
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, LUA_POOL_BASE_GLOBALS);
+	RestoreTable(lua_state, 1, 2);
+	lua_settop(lua_state, 0);
+
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, LUA_POOL_BASE_LOADED);
+	RestoreTable(lua_state, 1, 2);
+	lua_settop(lua_state, 0);
+
+	//scripts like to extend package.path, or add functions to string
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, LUA_POOL_BASE_LIBRARIES);
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, 1) != 0)
+	{
+		RestoreTable(lua_state, -2, -1);
+		lua_pop(lua_state, 1);
+	}
+	lua_settop(lua_state, 0);
+}
+
+int CLuaStatePool::LoadFile(lua_State *lua_state, const std::string &filename)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0)
+		return luaL_loadfile(lua_state, filename.c_str()); //gives the proper error message
+	{
+		std::lock_guard<std::mutex> l(m_chunkMutex);
+		std::map<std::string, _tLuaChunk>::const_iterator itt = m_chunks.find(filename);
+		if ((itt != m_chunks.end()) && (itt->second.mtime == st.st_mtime) && (itt->second.size == st.st_size))
+		{
+			std::string chunkname = "@" + filename;
+			return luaL_loadbufferx(lua_state, itt->second.bytecode.data(), itt->second.bytecode.size(), chunkname.c_str(), "b");
+		}
+	}
+	int status = luaL_loadfile(lua_state, filename.c_str());
+	if (status == LUA_OK)
+		StoreChunk(lua_state, filename, st.st_mtime, st.st_size);
+	return status;
+}
+
+int CLuaStatePool::LoadString(lua_State *lua_state, const std::string &script)
+{
+	std::string key = "=" + script;
+	{
+		std::lock_guard<std::mutex> l(m_chunkMutex);
+		std::map<std::string, _tLuaChunk>::const_iterator itt = m_chunks.find(key);
+		if (itt != m_chunks.end())
+			return luaL_loadbufferx(lua_state, itt->second.bytecode.data(), itt->second.bytecode.size(), script.c_str(), "b");
+	}
+	int status = luaL_loadstring(lua_state, script.c_str());
+	if (status == LUA_OK)
+		StoreChunk(lua_state, key, 0, 0);
+	return status;
+}
+
+void CLuaStatePool::StoreChunk(lua_State *lua_state, const std::string &key, const time_t mtime, const off_t size)
+{
+	_tLuaChunk chunk;
+	chunk.mtime = mtime;
+	chunk.size = size;
+	if (lua_dump(lua_state, lua_chunk_writer, &chunk.bytecode, 0) != 0)
+		return;
+
+	std::lock_guard<std::mutex> l(m_chunkMutex);
+	if ((m_chunks.size() >= LUA_CHUNK_CACHE_SIZE) && (m_chunks.find(key) == m_chunks.end()))
+		m_chunks.clear(); //scripts that were edited or removed leave entries behind, start over
+	m_chunks[key] = chunk;
+}
+
+//package.searchers replacement for the Lua file searcher, same lookup but loads through the cache
+int CLuaStatePool::l_cached_searcher(lua_State *lua_state)
+{
+	CLuaStatePool *pool = (CLuaStatePool*)lua_touserdata(lua_state, lua_upvalueindex(1));
+	std::string name = luaL_checkstring(lua_state, 1);
+
+	lua_getglobal(lua_state, "package");
+	lua_getfield(lua_state, -1, "searchpath");
+	lua_pushstring(lua_state, name.c_str());
+	lua_getfield(lua_state, -3, "path");
+	lua_call(lua_state, 2, 2);
+	if (lua_isnil(lua_state, -2))
+		return 1; //error message of searchpath
+
+	std::string filename = lua_tostring(lua_state, -2);
+	lua_settop(lua_state, 1);
+	if (pool->LoadFile(lua_state, filename) != LUA_OK)
+	{
+		return luaL_error(lua_state, "error loading module '%s' from file '%s':\n\t%s",
+			name.c_str(), filename.c_str(), lua_tostring(lua_state, -1));
+	}
+	lua_pushstring(lua_state, filename.c_str());
+	return 2;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+struct lua_State;
+
+//Pool of initialized Lua states that are reused between script runs.
+//When a state is returned its globals, loaded modules and library tables are reset to what they were after initialization,
+//compiled chunks (scripts and required modules) are kept as bytecode so they are only parsed when changed.
+class CLuaStatePool
+{
+	struct _tLuaChunk
+	{
+		time_t mtime;
+		off_t size;
+		std::string bytecode;
+	};
+public:
+	typedef void(*TInitFunction)(lua_State *lua_state);
+
+	explicit CLuaStatePool(TInitFunction initFunction);
+	~CLuaStatePool();
+
+	lua_State *Acquire();
+	void Release(lua_State *lua_state);
+	void Clear();
+
+	//Replacements for luaL_loadfile/luaL_loadstring that go through the bytecode cache
+	int LoadFile(lua_State *lua_state, const std::string &filename);
+	int LoadString(lua_State *lua_state, const std::string &script);
+private:
+	lua_State *CreateState();
+	void ResetState(lua_State *lua_state);
+	void StoreChunk(lua_State *lua_state, const std::string &key, const time_t mtime, const off_t size);
+	static int l_cached_searcher(lua_State *lua_state);
+
+	TInitFunction m_initFunction;
+	std::mutex m_mutex;
+	std::vector<lua_State*> m_states;
+
+	std::mutex m_chunkMutex;
+	std::map<std::string, _tLuaChunk> m_chunks;
+};
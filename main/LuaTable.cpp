@@ -180,6 +180,24 @@ void CLuaTable::PushRow(std::vector<_tEntry>::iterator itt)
 }
 
 void CLuaTable::Publish()
+{
+	if (PushEntries(0))
+		lua_setglobal(m_lua_state, m_name.c_str());
+}
+
+void CLuaTable::PushTable()
+{
+	if (!PushEntries(0))
+		lua_pushnil(m_lua_state);
+}
+
+void CLuaTable::PublishInto(const int tableIndex)
+{
+	if (PushEntries(lua_absindex(m_lua_state, tableIndex)))
+		lua_pop(m_lua_state, 1);
+}
+
+bool CLuaTable::PushEntries(const int tableIndex)
 {
 	if ((m_subtable_level == 0) && (m_luatable.size() > 0))
 	{
@@ -188,7 +206,10 @@ void CLuaTable::Publish()
 			switch (itt->label_type)
 			{
 			case TYPE_TABLE:
-				lua_createtable(m_lua_state, itt->nrCols, itt->nrRows);
+				if (tableIndex != 0)
+					lua_pushvalue(m_lua_state, tableIndex);
+				else
+					lua_createtable(m_lua_state, itt->nrCols, itt->nrRows);
 				break;
 			case TYPE_SUBTABLE_OPEN_LABEL:
 				lua_pushstring(m_lua_state, itt->label.c_str());
@@ -209,11 +230,9 @@ void CLuaTable::Publish()
 				_log.Log(LOG_ERROR, "Unsupported label type in LuaTable!");
 			}
 		}
-		lua_setglobal(m_lua_state, m_name.c_str());
 		m_luatable.clear();
+		return true;
 	}
-	else
-		_log.Log(LOG_ERROR, "Lua table %s is not published. Not all sub tables are closed!", m_name.c_str());	
+	_log.Log(LOG_ERROR, "Lua table %s is not published. Not all sub tables are closed!", m_name.c_str());
+	return false;
 }
-
-
@@ -8,6 +8,10 @@ class CLuaTable
 public:
 
 	void Publish();
+	// leave the table on the stack instead of setting the global
+	void PushTable();
+	// add the entries to the existing table at tableIndex
+	void PublishInto(const int tableIndex);
 	
 	// constructors
 	CLuaTable(lua_State *lua_state, std::string Name, int NrCols, int NrRows);
@@ -73,4 +77,5 @@ private:
 	int m_subtable_level;
 
 	void PushRow(std::vector<_tEntry>::iterator table_entry);
+	bool PushEntries(const int tableIndex);
 };
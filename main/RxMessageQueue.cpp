@@ -0,0 +1,244 @@
+#include "stdafx.h"
+#include "RxMessageQueue.h"
+#include "RFXtrx.h"
+#include "concurrent_queue.h"
+#include "Logger.h"
+#include <cstring>
+
+static_assert(sizeof(tRBUF) <= RX_FRAME_SIZE, "RX_FRAME_SIZE too small for a RBUF");
+
+#define RX_QUEUE_SLAB_SIZE 64
+#define RX_QUEUE_HASH_SIZE 256
+#define RX_NAME_TABLE_SIZE 8192
+#define RX_TRIGGER_POOL_SIZE 16
+
+//Copy an item without the unused part of the frame
+static void CopyRxItem(_tRxQueueItem &dest, const _tRxQueueItem &src)
+{
+	dest.Name = src.Name;
+	if (src.Name == NULL)
+		dest.sName = src.sName;		//the slot keeps the capacity, so this only allocates for the first long names
+	dest.BatteryLevel = src.BatteryLevel;
+	dest.rxMessageIdx = src.rxMessageIdx;
+	dest.hardwareId = src.hardwareId;
+	memcpy(dest.rxCommand, src.rxCommand, src.rxCommand[0] + 1);
+	dest.crc = src.crc;
+	dest.trigger = src.trigger;
+	dest.bPriority = src.bPriority;
+	dest.coalesceKey = src.coalesceKey;
+	dest.queueTime = src.queueTime;
+}
+
+CRxMessageQueue::CRxMessageQueue() :
+	m_pFree(NULL),
+	m_pending(RX_QUEUE_HASH_SIZE, NULL),
+	m_maxDepth(0),
+	m_pushed(0),
+	m_coalesced(0),
+	m_popped(0),
+	m_totalLatency(0),
+	m_maxLatency(0)
+{
+	m_priorityItems.pHead = m_priorityItems.pTail = NULL;
+	m_priorityItems.size = 0;
+	m_items.pHead = m_items.pTail = NULL;
+	m_items.size = 0;
+	//first slab up front, so a normal load never allocates
+	_tSlot *pSlot = AllocSlot();
+	pSlot->pNext = m_pFree;
+	m_pFree = pSlot;
+}
+
+CRxMessageQueue::_tSlot *CRxMessageQueue::AllocSlot()
+{
+	if (m_pFree == NULL)
+	{
+		std::unique_ptr<_tSlot[]> slab(new _tSlot[RX_QUEUE_SLAB_SIZE]);
+		for (int ii = 0; ii < RX_QUEUE_SLAB_SIZE; ii++)
+		{
+			slab[ii].pNext = m_pFree;
+			m_pFree = &slab[ii];
+		}
+		m_slabs.push_back(std::move(slab));
+	}
+	_tSlot *pSlot = m_pFree;
+	m_pFree = pSlot->pNext;
+	pSlot->pNext = NULL;
+	pSlot->pHashNext = NULL;
+	return pSlot;
+}
+
+CRxMessageQueue::_tSlot **CRxMessageQueue::FindPending(const int hardwareId, const uint64_t coalesceKey)
+{
+	uint64_t hash = coalesceKey ^ ((uint64_t)hardwareId * 0x9E3779B97F4A7C15ULL);
+	_tSlot **ppSlot = &m_pending[(hash ^ (hash >> 32)) % RX_QUEUE_HASH_SIZE];
+	while ((*ppSlot != NULL) && (((*ppSlot)->item.hardwareId != hardwareId) || ((*ppSlot)->item.coalesceKey != coalesceKey)))
+		ppSlot = &(*ppSlot)->pHashNext;
+	return ppSlot;
+}
+
+bool CRxMessageQueue::Push(const _tRxQueueItem &item)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_pushed++;
+	//someone waiting for this frame to be processed wants exactly this frame
+	bool bCoalesce = (item.coalesceKey != 0) && (item.trigger == NULL) && (!item.bPriority);
+	_tSlot **ppPending = NULL;
+	if (bCoalesce)
+	{
+		ppPending = FindPending(item.hardwareId, item.coalesceKey);
+		if (*ppPending != NULL)
+		{
+			_tRxQueueItem &queued = (*ppPending)->item;
+			std::chrono::steady_clock::time_point queueTime = queued.queueTime;
+			CopyRxItem(queued, item);
+			queued.queueTime = queueTime;
+			m_coalesced++;
+			return false;
+		}
+	}
+
+	_tSlot *pSlot = AllocSlot();
+	CopyRxItem(pSlot->item, item);
+	pSlot->item.queueTime = std::chrono::steady_clock::now();
+	if (bCoalesce)
+		*ppPending = pSlot;
+
+	_tLane &lane = (item.bPriority) ? m_priorityItems : m_items;
+	if (lane.pTail != NULL)
+		lane.pTail->pNext = pSlot;
+	else
+		lane.pHead = pSlot;
+	lane.pTail = pSlot;
+	lane.size++;
+
+	size_t depth = m_priorityItems.size + m_items.size;
+	if (depth > m_maxDepth)
+		m_maxDepth = depth;
+	lock.unlock();
+	m_cond.notify_one();
+	return true;
+}
+
+bool CRxMessageQueue::TimedPop(_tRxQueueItem &item, const std::chrono::milliseconds &timeout)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!m_cond.wait_for(lock, timeout, [this] { return (m_priorityItems.pHead != NULL) || (m_items.pHead != NULL); }))
+		return false;
+
+	_tLane &lane = (m_priorityItems.pHead != NULL) ? m_priorityItems : m_items;
+	_tSlot *pSlot = lane.pHead;
+	lane.pHead = pSlot->pNext;
+	if (lane.pHead == NULL)
+		lane.pTail = NULL;
+	lane.size--;
+
+	if (pSlot->item.coalesceKey != 0)
+	{
+		//frames queued with a trigger are not in the hash, the entry can belong to a later frame
+		_tSlot **ppPending = FindPending(pSlot->item.hardwareId, pSlot->item.coalesceKey);
+		if (*ppPending == pSlot)
+			*ppPending = pSlot->pHashNext;
+	}
+	CopyRxItem(item, pSlot->item);
+	pSlot->pNext = m_pFree;
+	m_pFree = pSlot;
+
+	double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - item.queueTime).count();
+	m_popped++;
+	m_totalLatency += latency;
+	if (latency > m_maxLatency)
+		m_maxLatency = latency;
+	return true;
+}
+
+size_t CRxMessageQueue::Size()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_priorityItems.size + m_items.size;
+}
+
+void CRxMessageQueue::GetStats(_tRxQueueStats &stats)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	stats.workers = 1;
+	stats.depth = m_priorityItems.size + m_items.size;
+	stats.priorityDepth = m_priorityItems.size;
+	stats.maxDepth = m_maxDepth;
+	stats.pushed = m_pushed;
+	stats.coalesced = m_coalesced;
+	stats.popped = m_popped;
+	stats.avgLatency = (m_popped != 0) ? m_totalLatency / m_popped : 0;
+	stats.maxLatency = m_maxLatency;
+}
+
+CRxNameTable::CRxNameTable() :
+	m_bFullLogged(false)
+{
+}
+
+const char *CRxNameTable::Intern(const char *name)
+{
+	if ((name == NULL) || (*name == 0))
+		return "";
+	//FNV-1a
+	uint32_t hash = 2166136261U;
+	for (const char *p = name; *p != 0; p++)
+		hash = (hash ^ (uint8_t)*p) * 16777619U;
+
+	std::lock_guard<std::mutex> l(m_mutex);
+	auto range = m_index.equal_range(hash);
+	for (auto itt = range.first; itt != range.second; ++itt)
+	{
+		if (strcmp(itt->second, name) == 0)
+			return itt->second;
+	}
+	if (m_names.size() >= RX_NAME_TABLE_SIZE)
+	{
+		//names are expected to be constant per device, something is generating them
+		if (!m_bFullLogged)
+		{
+			_log.Log(LOG_ERROR, "RxQueue: too many different device names, new names are copied with every frame");
+			m_bFullLogged = true;
+		}
+		return NULL;
+	}
+	m_names.push_back(name);
+	const char *interned = m_names.back().c_str();
+	m_index.insert(std::make_pair(hash, interned));
+	return interned;
+}
+
+CRxTriggerPool::~CRxTriggerPool()
+{
+	for (auto & itt : m_triggers)
+		delete itt;
+}
+
+queue_element_trigger *CRxTriggerPool::Acquire()
+{
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_triggers.empty())
+		{
+			queue_element_trigger *trigger = m_triggers.back();
+			m_triggers.pop_back();
+			trigger->reset();
+			return trigger;
+		}
+	}
+	return new queue_element_trigger();
+}
+
+void CRxTriggerPool::Release(queue_element_trigger *trigger)
+{
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_triggers.size() < RX_TRIGGER_POOL_SIZE)
+		{
+			m_triggers.push_back(trigger);
+			return;
+		}
+	}
+	delete trigger;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class queue_element_trigger;
+
+//A frame starts with its length byte, so it is never larger than a RBUF (checked in RxMessageQueue.cpp)
+#define RX_FRAME_SIZE 256
+
+struct _tRxQueueItem
+{
+	const char *Name;						//interned (CRxNameTable), NULL when the name is in sName
+	std::string sName;						//only used when the name table is full
+	int BatteryLevel;
+	unsigned long rxMessageIdx;
+	int hardwareId;
+	uint8_t rxCommand[RX_FRAME_SIZE];		//only the first rxCommand[0] + 1 bytes are used
+	uint16_t crc;
+	queue_element_trigger* trigger;
+	bool bPriority;							//switch/security frames, served before everything else
+	uint64_t coalesceKey;					//sensor identification within the hardware, 0 = keep every frame
+	std::chrono::steady_clock::time_point queueTime;
+
+	const char *GetName() const
+	{
+		return (Name != NULL) ? Name : sName.c_str();
+	}
+};
+
+struct _tRxQueueStats
+{
+	size_t workers;
+	size_t depth;
+	size_t priorityDepth;
+	size_t maxDepth;
+	uint64_t pushed;
+	uint64_t coalesced;
+	uint64_t popped;
+	double avgLatency;						//ms spent in the queue
+	double maxLatency;
+};
+
+//Queue between the hardware threads and the RX message worker.
+//Frames marked as priority are always popped first. A sensor reading that is still waiting
+//when a newer reading of the same sensor arrives is replaced by it (and keeps its place in the queue).
+//Items are stored in preallocated slots, a new slab is only allocated when all slots are in use.
+class CRxMessageQueue
+{
+	struct _tSlot
+	{
+		_tRxQueueItem item;
+		_tSlot *pNext;						//free list or lane
+		_tSlot *pHashNext;					//pending readings by coalesce key
+	};
+	struct _tLane
+	{
+		_tSlot *pHead;
+		_tSlot *pTail;
+		size_t size;
+	};
+public:
+	CRxMessageQueue();
+
+	//Returns false when the frame replaced a queued reading instead of being added
+	bool Push(const _tRxQueueItem &item);
+	bool TimedPop(_tRxQueueItem &item, const std::chrono::milliseconds &timeout);
+	size_t Size();
+	void GetStats(_tRxQueueStats &stats);
+private:
+	_tSlot *AllocSlot();
+	_tSlot **FindPending(const int hardwareId, const uint64_t coalesceKey);
+
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::vector<std::unique_ptr<_tSlot[]> > m_slabs;
+	_tSlot *m_pFree;
+	_tLane m_priorityItems;
+	_tLane m_items;
+	std::vector<_tSlot*> m_pending;			//hash buckets
+
+	size_t m_maxDepth;
+	uint64_t m_pushed;
+	uint64_t m_coalesced;
+	uint64_t m_popped;
+	double m_totalLatency;
+	double m_maxLatency;
+};
+
+//Default device names passed with received frames. The same few names are used over and over,
+//so they are stored once and the queue only passes pointers around.
+class CRxNameTable
+{
+public:
+	CRxNameTable();
+	//Returns a pointer that stays valid for the lifetime of the table,
+	//NULL when the table is full and the caller has to keep its own copy
+	const char *Intern(const char *name);
+private:
+	std::mutex m_mutex;
+	std::deque<std::string> m_names;
+	std::unordered_multimap<uint32_t, const char*> m_index;
+	bool m_bFullLogged;
+};
+
+//Triggers used to wait for a frame to be processed, reused instead of allocated per frame
+class CRxTriggerPool
+{
+public:
+	~CRxTriggerPool();
+	queue_element_trigger *Acquire();
+	void Release(queue_element_trigger *trigger);
+private:
+	std::mutex m_mutex;
+	std::vector<queue_element_trigger*> m_triggers;
+};
@@ -30,9 +30,13 @@
 #endif
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <zlib.h>
 
 #define DB_VERSION 143
 
+//Columns of the temperature log in the segment store: Temperature, Chill, Humidity, Barometer, DewPoint, SetPoint
+#define TEMPERATURE_LOG_COLUMNS 6
+
 extern http::server::CWebServerHelper m_webservers;
 extern std::string szWWWFolder;
 
@@ -583,6 +587,35 @@ const char* sqlCreateMobileDevices =
 
 extern std::string szUserDataFolder;
 
+//Called by sqlite (with m_sqlQueryMutex held) for every row inserted, updated or deleted on our connection
+static void DeviceStatusUpdateHook(void* pUser, int op, char const* /*dbName*/, char const* tableName, sqlite3_int64 rowID)
+{
+	reinterpret_cast<CSQLHelper*>(pUser)->OnRowUpdated((op == SQLITE_DELETE), tableName, static_cast<uint64_t>(rowID));
+}
+
+void CSQLHelper::OnRowUpdated(const bool bDeleted, const char *tableName, const uint64_t rowID)
+{
+	_eJournalType type;
+	if (strcmp(tableName, "DeviceStatus") == 0)
+	{
+		if (bDeleted)
+			m_devicestatuscache.OnRowDeleted(rowID);
+		else
+			m_devicestatuscache.OnRowChanged(rowID);
+		type = JOURNAL_DEVICE;
+	}
+	else if (strcmp(tableName, "Scenes") == 0)
+		type = JOURNAL_SCENE;
+	else if (strcmp(tableName, "UserVariables") == 0)
+		type = JOURNAL_VARIABLE;
+	else
+		return;
+	if (bDeleted)
+		m_changejournal.OnDeleted(type, rowID);
+	else
+		m_changejournal.OnChanged(type, rowID);
+}
+
 CSQLHelper::CSQLHelper(void)
 {
 	m_LastSwitchRowID = 0;
@@ -603,6 +636,16 @@ CSQLHelper::CSQLHelper(void)
 	m_ShortLogInterval = 5;
 	m_bPreviousAcceptNewHardware = false;
 	m_bLogEventScriptTrigger = false;
+	m_statementCacheHits = 0;
+	m_statementCacheMisses = 0;
+	m_bStopWriter = false;
+	m_bGroupTransaction = false;
+	m_groupStatements = 0;
+	m_groupCommitInterval = 1000;
+	m_groupCommitStatements = 250;
+	m_readPoolOpen = 0;
+	m_readPoolGeneration = 0;
+	m_bReadPoolEnabled = false;
 
 	SetDatabaseName("domoticz.db");
 }
@@ -623,6 +666,9 @@ bool CSQLHelper::OpenDatabase()
 		sqlite3_close(m_dbase);
 		return false;
 	}
+	m_devicestatuscache.Clear();
+	m_changejournal.Clear();
+	sqlite3_update_hook(m_dbase, DeviceStatusUpdateHook, this);
 #ifndef WIN32
 	//test, this could improve performance
 	sqlite3_exec(m_dbase, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
@@ -3206,6 +3252,57 @@ bool CSQLHelper::OpenDatabase()
 		nValue = 5;
 	m_ShortLogInterval = nValue;
 
+	//Group commit of device updates and log inserts, an interval of 0 commits every write
+	nValue = 1000;
+	if (!GetPreferencesVar("DBGroupCommitInterval", nValue))
+	{
+		UpdatePreferencesVar("DBGroupCommitInterval", nValue);
+	}
+	m_groupCommitInterval = (nValue > 0) ? nValue : 0;
+	nValue = 250;
+	if (!GetPreferencesVar("DBGroupCommitStatements", nValue))
+	{
+		UpdatePreferencesVar("DBGroupCommitStatements", nValue);
+	}
+	m_groupCommitStatements = (nValue > 0) ? nValue : 1;
+
+	//Number of threads decoding received messages, 0 = one per core (at most 4)
+	if (!GetPreferencesVar("RxWorkerThreads", nValue))
+	{
+		UpdatePreferencesVar("RxWorkerThreads", 0);
+	}
+
+	//Automatic backups are written as .db.gz files when set
+	if (!GetPreferencesVar("BackupCompress", nValue))
+	{
+		UpdatePreferencesVar("BackupCompress", 0);
+	}
+
+	//InfluxDB link: points per request, ms between sends and gzip request bodies
+	if (!GetPreferencesVar("InfluxBatchSize", nValue))
+	{
+		UpdatePreferencesVar("InfluxBatchSize", 500);
+	}
+	if (!GetPreferencesVar("InfluxFlushInterval", nValue))
+	{
+		UpdatePreferencesVar("InfluxFlushInterval", 500);
+	}
+	if (!GetPreferencesVar("InfluxCompress", nValue))
+	{
+		UpdatePreferencesVar("InfluxCompress", 1);
+	}
+
+	//1 = temperature short log in segment files instead of the Temperature table (read at startup, 0 moves the samples back)
+	if (!GetPreferencesVar("ShortLogStore", nValue))
+	{
+		UpdatePreferencesVar("ShortLogStore", 0);
+		nValue = 0;
+	}
+	if (nValue == 1)
+		OpenShortLogStore();
+	else
+		CloseShortLogStore();
+
 	if (!GetPreferencesVar("SendErrorsAsNotification", nValue))
 	{
 		UpdatePreferencesVar("SendErrorsAsNotification", 0);
@@ -3222,6 +3319,11 @@ bool CSQLHelper::OpenDatabase()
 		UpdatePreferencesVar("EmailEnabled", 1);
 	}
 
+	//Load the in-memory device table
+	RefreshDeviceStatusCache();
+
+	OpenReadPool();
+
 	//Start background thread
 	if (!StartThread())
 		return false;
@@ -3230,13 +3332,17 @@ bool CSQLHelper::OpenDatabase()
 
 void CSQLHelper::CloseDatabase()
 {
+	CloseReadPool();
 	std::lock_guard<std::mutex> l(m_sqlQueryMutex);
 	if (m_dbase != NULL)
 	{
+		CommitGroupTransaction();
+		FinalizeStatements();
 		OptimizeDatabase(m_dbase);
 		sqlite3_close(m_dbase);
 		m_dbase = NULL;
 	}
+	m_devicestatuscache.Clear();
 }
 
 void CSQLHelper::StopThread()
@@ -3247,16 +3353,125 @@ void CSQLHelper::StopThread()
 		m_thread->join();
 		m_thread.reset();
 	}
+	StopWriterThread();
 }
 
 bool CSQLHelper::StartThread()
 {
+	StartWriterThread();
 	RequestStart();
 	m_thread = std::make_shared<std::thread>(&CSQLHelper::Do_Work, this);
 	SetThreadName(m_thread->native_handle(), "SQLHelper");
 	return (m_thread != NULL);
 }
 
+void CSQLHelper::StartWriterThread()
+{
+	m_bStopWriter = false;
+	m_writer_thread = std::make_shared<std::thread>(&CSQLHelper::Do_Writer_Work, this);
+	SetThreadName(m_writer_thread->native_handle(), "SQLWriter");
+}
+
+void CSQLHelper::StopWriterThread()
+{
+	if (m_writer_thread)
+	{
+		{
+			std::lock_guard<std::mutex> l(m_writer_mutex);
+			m_bStopWriter = true;
+		}
+		m_writer_cond.notify_one();
+		m_writer_thread->join();
+		m_writer_thread.reset();
+	}
+	CommitWrites();
+}
+
+void CSQLHelper::Do_Writer_Work()
+{
+	std::unique_lock<std::mutex> lock(m_writer_mutex);
+	while (!m_bStopWriter)
+	{
+		m_writer_cond.wait_for(lock, std::chrono::milliseconds(100));
+		if (m_bStopWriter)
+			break;
+		lock.unlock();
+		{
+			std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+			if (m_bGroupTransaction)
+			{
+				int64_t msOpen = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_groupStart).count();
+				if ((msOpen >= m_groupCommitInterval) || (m_groupStatements >= m_groupCommitStatements))
+					CommitGroupTransaction();
+			}
+		}
+		lock.lock();
+	}
+}
+
+void CSQLHelper::BeginGroupTransaction()
+{
+	if ((m_dbase == NULL) || (m_groupCommitInterval <= 0) || (!m_writer_thread))
+		return;
+	if (m_bGroupTransaction)
+		return;
+	if (sqlite3_get_autocommit(m_dbase) == 0)
+		return; //another transaction is active, the write becomes part of that one
+	if (sqlite3_exec(m_dbase, "BEGIN TRANSACTION", NULL, NULL, NULL) != SQLITE_OK)
+		return;
+	m_bGroupTransaction = true;
+	m_groupStatements = 0;
+	m_groupStart = std::chrono::steady_clock::now();
+}
+
+void CSQLHelper::AddGroupStatement(const char *szTable, const uint64_t DeviceRowID)
+{
+	if (!m_bGroupTransaction)
+		return;
+	m_groupRows.insert(std::make_pair(std::string(szTable), DeviceRowID));
+	m_groupStatements++;
+	if (m_groupStatements >= m_groupCommitStatements)
+		m_writer_cond.notify_one();
+}
+
+void CSQLHelper::CommitGroupTransaction()
+{
+	if ((!m_bGroupTransaction) || (m_dbase == NULL))
+		return;
+	char* errorMessage = NULL;
+	if (sqlite3_exec(m_dbase, "COMMIT TRANSACTION", NULL, NULL, &errorMessage) != SQLITE_OK)
+	{
+		_log.Log(LOG_ERROR, "SQL: Group commit of %d statements failed: %s", m_groupStatements, (errorMessage != NULL) ? errorMessage : "?");
+		sqlite3_free(errorMessage);
+		if (sqlite3_get_autocommit(m_dbase) == 0)
+			return; //still open, try again later
+		//rolled back, the in-memory device table could contain values that never made it to disk
+		m_devicestatuscache.Clear();
+	}
+	m_bGroupTransaction = false;
+	m_groupStatements = 0;
+	m_groupRows.clear();
+}
+
+void CSQLHelper::CommitGroupBeforeWrite(sqlite3_stmt *statement)
+{
+	if ((m_bGroupTransaction) && (!sqlite3_stmt_readonly(statement)))
+		CommitGroupTransaction();
+}
+
+void CSQLHelper::CommitWrites()
+{
+	std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+	CommitGroupTransaction();
+}
+
+void CSQLHelper::CommitWrites(const std::string &szTable, const uint64_t DeviceRowID)
+{
+	std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+	if (m_groupRows.find(std::make_pair(szTable, DeviceRowID)) != m_groupRows.end())
+		CommitGroupTransaction();
+}
+
 bool CSQLHelper::SwitchLightFromTasker(const std::string& idx, const std::string& switchcmd, const std::string& level, const std::string& color, const std::string& User)
 {
 	_tColor ocolor(color);
@@ -3656,6 +3871,8 @@ bool CSQLHelper::safe_UpdateBlobInTableWithID(const std::string& Table, const st
 		_log.Log(LOG_ERROR, "SQL: Out of memory, or invalid printf!....");
 		return false;
 	}
+	std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+	CommitGroupTransaction();
 	int rc = sqlite3_prepare_v2(m_dbase, zQuery, -1, &stmt, NULL);
 	sqlite3_free(zQuery);
 	if (rc != SQLITE_OK) {
@@ -3706,6 +3923,7 @@ std::vector<std::vector<std::string> > CSQLHelper::query(const std::string& szQu
 
 	if (sqlite3_prepare_v2(m_dbase, szQuery.c_str(), -1, &statement, 0) == SQLITE_OK)
 	{
+		CommitGroupBeforeWrite(statement);
 		int cols = sqlite3_column_count(statement);
 		while (true)
 		{
@@ -3773,6 +3991,7 @@ std::vector<std::vector<std::string> > CSQLHelper::queryBlob(const std::string&
 
 	if (sqlite3_prepare_v2(m_dbase, szQuery.c_str(), -1, &statement, 0) == SQLITE_OK)
 	{
+		CommitGroupBeforeWrite(statement);
 		int cols = sqlite3_column_count(statement);
 		while (true)
 		{
@@ -3808,6 +4027,317 @@ std::vector<std::vector<std::string> > CSQLHelper::queryBlob(const std::string&
 	return results;
 }
 
+//Maximum number of prepared statements kept, the least recently used one is finalized first
+#define SQL_STATEMENT_CACHE_SIZE 64
+//Number of read-only connections used next to the writer connection
+#define SQL_READ_POOL_SIZE 3
+
+int CSQLRow::ColumnCount() const
+{
+	return sqlite3_column_count(m_statement);
+}
+
+bool CSQLRow::IsNull(const int col) const
+{
+	return (sqlite3_column_type(m_statement, col) == SQLITE_NULL);
+}
+
+int CSQLRow::GetInt(const int col) const
+{
+	return sqlite3_column_int(m_statement, col);
+}
+
+int64_t CSQLRow::GetInt64(const int col) const
+{
+	return static_cast<int64_t>(sqlite3_column_int64(m_statement, col));
+}
+
+uint64_t CSQLRow::GetUInt64(const int col) const
+{
+	return static_cast<uint64_t>(sqlite3_column_int64(m_statement, col));
+}
+
+double CSQLRow::GetDouble(const int col) const
+{
+	return sqlite3_column_double(m_statement, col);
+}
+
+const char* CSQLRow::GetText(const int col) const
+{
+	const char* value = (const char*)sqlite3_column_text(m_statement, col);
+	return (value != NULL) ? value : "";
+}
+
+int CSQLRow::GetTextLength(const int col) const
+{
+	//sqlite3_column_text should be called first, the length could change by the conversion
+	sqlite3_column_text(m_statement, col);
+	return sqlite3_column_bytes(m_statement, col);
+}
+
+std::string CSQLRow::GetString(const int col) const
+{
+	const char* value = (const char*)sqlite3_column_text(m_statement, col);
+	if (value == NULL)
+		return "";
+	return std::string(value, sqlite3_column_bytes(m_statement, col));
+}
+
+sqlite3_stmt* CSQLHelper::GetCachedStatement(const char* szQuery)
+{
+	if (!m_dbase)
+	{
+		_log.Log(LOG_ERROR, "Database not open!!...Check your user rights!..");
+		return NULL;
+	}
+	std::map<std::string, TStatementList::iterator>::iterator itt = m_statementIndex.find(szQuery);
+	if (itt != m_statementIndex.end())
+	{
+		m_statementCacheHits++;
+		//move to the front of the list
+		m_statements.splice(m_statements.begin(), m_statements, itt->second);
+		return itt->second->second;
+	}
+	m_statementCacheMisses++;
+
+	sqlite3_stmt* statement = NULL;
+	if (sqlite3_prepare_v2(m_dbase, szQuery, -1, &statement, 0) != SQLITE_OK)
+	{
+		_log.Log(LOG_ERROR, "SQL Query(\"%s\") : %s", szQuery, sqlite3_errmsg(m_dbase));
+		sqlite3_finalize(statement);
+		return NULL;
+	}
+	if (m_statements.size() >= SQL_STATEMENT_CACHE_SIZE)
+	{
+		//drop the least recently used statement
+		sqlite3_finalize(m_statements.back().second);
+		m_statementIndex.erase(m_statements.back().first);
+		m_statements.pop_back();
+	}
+	m_statements.push_front(std::make_pair(std::string(szQuery), statement));
+	m_statementIndex[szQuery] = m_statements.begin();
+	return statement;
+}
+
+bool CSQLHelper::StepStatement(sqlite3_stmt* statement, const char* szQuery, const TSqlRowCallback* pCallback)
+{
+	CSQLRow row(statement);
+	int result;
+	try
+	{
+		while ((result = sqlite3_step(statement)) == SQLITE_ROW)
+		{
+			if ((pCallback != NULL) && (!(*pCallback)(row)))
+				break;
+		}
+	}
+	catch (...)
+	{
+		sqlite3_reset(statement);
+		sqlite3_clear_bindings(statement);
+		throw;
+	}
+	bool bSuccess = ((result == SQLITE_ROW) || (result == SQLITE_DONE));
+	if (!bSuccess)
+		_log.Log(LOG_ERROR, "SQL Query(\"%s\") : %s", szQuery, sqlite3_errmsg(sqlite3_db_handle(statement)));
+	//Keep the statement for the next call, but release its locks and bound values now
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
+	return bSuccess;
+}
+
+int CSQLHelper::GetChanges()
+{
+	return sqlite3_changes(m_dbase);
+}
+
+void CSQLHelper::FinalizeStatements()
+{
+	for (auto& itt : m_statements)
+		sqlite3_finalize(itt.second);
+	m_statements.clear();
+	m_statementIndex.clear();
+}
+
+void CSQLHelper::GetStatementCacheStats(uint64_t& hits, uint64_t& misses, size_t& entries)
+{
+	std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+	hits = m_statementCacheHits;
+	misses = m_statementCacheMisses;
+	entries = m_statements.size();
+}
+
+void CSQLHelper::AddResultRow(const CSQLRow& row, std::vector<std::vector<std::string> >& results)
+{
+	//Same as query(), rows with an empty first column are skipped
+	if (row.IsNull(0))
+		return;
+	std::vector<std::string> values;
+	int cols = row.ColumnCount();
+	values.reserve(cols);
+	for (int col = 0; col < cols; col++)
+		values.push_back(row.GetString(col));
+	results.push_back(values);
+}
+
+void CSQLHelper::BindParam(sqlite3_stmt* statement, const int index, const std::string& value)
+{
+	sqlite3_bind_text(statement, index, value.c_str(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+}
+
+void CSQLHelper::BindParam(sqlite3_stmt* statement, const int index, const char* value)
+{
+	if (value == NULL)
+		sqlite3_bind_null(statement, index);
+	else
+		sqlite3_bind_text(statement, index, value, -1, SQLITE_TRANSIENT);
+}
+
+void CSQLHelper::BindInt64(sqlite3_stmt* statement, const int index, const int64_t value)
+{
+	sqlite3_bind_int64(statement, index, static_cast<sqlite3_int64>(value));
+}
+
+void CSQLHelper::BindDouble(sqlite3_stmt* statement, const int index, const double value)
+{
+	sqlite3_bind_double(statement, index, value);
+}
+
+std::vector<std::vector<std::string> > CSQLHelper::safe_query_read(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	char* zQuery = sqlite3_vmprintf(fmt, args);
+	va_end(args);
+	if (!zQuery)
+	{
+		_log.Log(LOG_ERROR, "SQL: Out of memory, or invalid printf!....");
+		std::vector<std::vector<std::string> > results;
+		return results;
+	}
+	std::vector<std::vector<std::string> > results = queryRead(zQuery);
+	sqlite3_free(zQuery);
+	return results;
+}
+
+std::vector<std::vector<std::string> > CSQLHelper::queryRead(const std::string& szQuery)
+{
+	CReadConnection connection(this);
+	if (!connection.IsOpen())
+		return query(szQuery);
+
+	std::vector<std::vector<std::string> > results;
+	sqlite3_stmt* statement = connection.Prepare(szQuery.c_str());
+	if (statement == NULL)
+		return results;
+	TSqlRowCallback callback = [&results](const CSQLRow& row) {
+		AddResultRow(row, results);
+		return true;
+	};
+	StepStatement(statement, szQuery.c_str(), &callback);
+	return results;
+}
+
+CSQLHelper::CReadConnection::CReadConnection(CSQLHelper* pSQLHelper) :
+	m_pSQLHelper(pSQLHelper),
+	m_generation(0)
+{
+	m_dbase = m_pSQLHelper->AcquireReadConnection(m_generation);
+}
+
+CSQLHelper::CReadConnection::~CReadConnection()
+{
+	for (auto& itt : m_statements)
+		sqlite3_finalize(itt);
+	if (m_dbase != NULL)
+		m_pSQLHelper->ReleaseReadConnection(m_dbase, m_generation);
+}
+
+sqlite3_stmt* CSQLHelper::CReadConnection::Prepare(const char* szQuery)
+{
+	sqlite3_stmt* statement = NULL;
+	if (sqlite3_prepare_v2(m_dbase, szQuery, -1, &statement, 0) != SQLITE_OK)
+	{
+		_log.Log(LOG_ERROR, "SQL Query(\"%s\") : %s", szQuery, sqlite3_errmsg(m_dbase));
+		sqlite3_finalize(statement);
+		return NULL;
+	}
+	m_statements.push_back(statement);
+	return statement;
+}
+
+sqlite3* CSQLHelper::AcquireReadConnection(int& generation)
+{
+	std::unique_lock<std::mutex> lock(m_readPoolMutex);
+	while (m_bReadPoolEnabled)
+	{
+		generation = m_readPoolGeneration;
+		if (!m_readPool.empty())
+		{
+			sqlite3* dbase = m_readPool.back();
+			m_readPool.pop_back();
+			return dbase;
+		}
+		if (m_readPoolOpen < SQL_READ_POOL_SIZE)
+		{
+			sqlite3* dbase = NULL;
+			if (sqlite3_open_v2(m_dbase_name.c_str(), &dbase, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+			{
+				_log.Log(LOG_ERROR, "SQL: Could not open read connection: %s", sqlite3_errmsg(dbase));
+				sqlite3_close(dbase);
+				return NULL;
+			}
+			sqlite3_busy_timeout(dbase, 1000);
+			m_readPoolOpen++;
+			return dbase;
+		}
+		m_readPoolCond.wait(lock);
+	}
+	return NULL;
+}
+
+void CSQLHelper::ReleaseReadConnection(sqlite3* dbase, const int generation)
+{
+	{
+		std::lock_guard<std::mutex> l(m_readPoolMutex);
+		if ((m_bReadPoolEnabled) && (generation == m_readPoolGeneration))
+			m_readPool.push_back(dbase);
+		else
+		{
+			sqlite3_close(dbase);
+			if (generation == m_readPoolGeneration)
+				m_readPoolOpen--;
+		}
+	}
+	m_readPoolCond.notify_one();
+}
+
+void CSQLHelper::OpenReadPool()
+{
+	//Readers only run next to the writer in WAL mode
+	std::string journal_mode;
+	std::vector<std::vector<std::string> > result = query("PRAGMA journal_mode");
+	if (!result.empty())
+		journal_mode = result[0][0];
+	std::lock_guard<std::mutex> l(m_readPoolMutex);
+	m_bReadPoolEnabled = (journal_mode == "wal");
+}
+
+void CSQLHelper::CloseReadPool()
+{
+	{
+		std::lock_guard<std::mutex> l(m_readPoolMutex);
+		m_bReadPoolEnabled = false;
+		for (auto& itt : m_readPool)
+			sqlite3_close(itt);
+		m_readPool.clear();
+		//borrowed connections are closed when they are returned
+		m_readPoolOpen = 0;
+		m_readPoolGeneration++;
+	}
+	m_readPoolCond.notify_all();
+}
+
 uint64_t CSQLHelper::CreateDevice(const int HardwareID, const int SensorType, const int SensorSubType, std::string& devname, const unsigned long nid, const std::string& soptions)
 {
 	uint64_t DeviceRowIdx = (uint64_t)-1;
@@ -4363,14 +4893,8 @@ uint64_t CSQLHelper::InsertDevice(const int HardwareID, const char* ID, const un
 }
 
 bool CSQLHelper::DoesDeviceExist(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType) {
-	std::vector<std::vector<std::string> > result;
-	result = safe_query("SELECT ID,Name FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%q' AND Unit=%d AND Type=%d AND SubType=%d)", HardwareID, ID, unit, devType, subType);
-	if (result.empty()) {
-		return false;
-	}
-	else {
-		return true;
-	}
+	_tDeviceStatusRow row;
+	return GetDeviceStatusRow(HardwareID, ID, unit, devType, subType, row);
 }
 
 uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, std::string& devname, const bool bUseOnOffAction)
@@ -4388,8 +4912,10 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 	_eSwitchType stype = STYPE_OnOff;
 
 	std::vector<std::vector<std::string> > result;
-	result = safe_query("SELECT ID, Name, Used, SwitchType, nValue, sValue, LastUpdate, Options FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%q' AND Unit=%d AND Type=%d AND SubType=%d)", HardwareID, ID, unit, devType, subType);
-	if (result.empty())
+	_tDeviceStatusRow devRow;
+	uint32_t devGeneration = 0;
+	bool bCachedRow = FindCachedDeviceStatusRow(HardwareID, ID, unit, devType, subType, devRow, devGeneration);
+	if ((!bCachedRow) && ((!m_devicestatuscache.HasStaleRows()) || (!QueryDeviceStatusRow(HardwareID, ID, unit, devType, subType, devRow))))
 	{
 		//Insert
 		ulID = InsertDevice(HardwareID, ID, unit, devType, subType, 0, nValue, sValue, devname, signallevel, batterylevel);
@@ -4411,17 +4937,18 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 	else
 	{
 		//Update
-		ulID = std::stoull(result[0][0]);
-		std::string sOption = result[0][7];
-		auto options = BuildDeviceOptions(sOption);
-		devname = result[0][1];
-		bDeviceUsed = atoi(result[0][2].c_str()) != 0;
-		stype = (_eSwitchType)atoi(result[0][3].c_str());
-		old_nValue = atoi(result[0][4].c_str());
-		old_sValue = result[0][5];
+		ulID = devRow.ID;
+		auto options = BuildDeviceOptions(devRow.Options);
+		devname = devRow.Name;
+		bDeviceUsed = devRow.Used;
+		stype = (_eSwitchType)devRow.SwitchType;
+		old_nValue = devRow.nValue;
+		old_sValue = devRow.sValue;
 		time_t now = time(0);
 		struct tm ltime;
 		localtime_r(&now, &ltime);
+		char szLastUpdate[40];
+		sprintf(szLastUpdate, "%04d-%02d-%02d %02d:%02d:%02d", ltime.tm_year + 1900, ltime.tm_mon + 1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec);
 		//Commit: If Option 1: energy is computed as usage*time
 		//Default is option 0, read from device
 		if (options["EnergyMeterMode"] == "1" && devType == pTypeGeneral && subType == sTypeKwh)
@@ -4431,12 +4958,11 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 			double interval;
 			float nEnergy;
 			char sCompValue[100];
-			std::string sLastUpdate = result[0][6];
 			time_t lutime;
-			ParseSQLdatetime(lutime, ntime, sLastUpdate, ltime.tm_isdst);
+			ParseSQLdatetime(lutime, ntime, devRow.LastUpdate, ltime.tm_isdst);
 
 			interval = difftime(now, lutime);
-			StringSplit(result[0][5].c_str(), ";", parts);
+			StringSplit(old_sValue, ";", parts);
 			nEnergy = static_cast<float>(strtof(parts[0].c_str(), NULL) * interval / 3600 + strtof(parts[1].c_str(), NULL)); //Rob: whats happening here... strtof ?
 			StringSplit(sValue, ";", parts);
 			sprintf(sCompValue, "%s;%.1f", parts[0].c_str(), nEnergy);
@@ -4445,12 +4971,12 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 		//~ use different update queries based on the device type
 		if (devType == pTypeGeneral && subType == sTypeCounterIncremental)
 		{
-			result = safe_query(
-				"UPDATE DeviceStatus SET SignalLevel=%d, BatteryLevel=%d, nValue= nValue + %d, sValue= sValue + '%q', LastUpdate='%04d-%02d-%02d %02d:%02d:%02d' "
-				"WHERE (ID = %" PRIu64 ")",
+			bind_exec_grouped("DeviceStatus", ulID,
+				"UPDATE DeviceStatus SET SignalLevel=?, BatteryLevel=?, nValue= nValue + ?, sValue= sValue + ?, LastUpdate=? "
+				"WHERE (ID = ?)",
 				signallevel, batterylevel,
 				nValue, sValue,
-				ltime.tm_year + 1900, ltime.tm_mon + 1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec,
+				szLastUpdate,
 				ulID);
 		}
 		else
@@ -4544,13 +5070,23 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 				}
 			}
 
-			result = safe_query(
-				"UPDATE DeviceStatus SET SignalLevel=%d, BatteryLevel=%d, nValue=%d, sValue='%q', LastUpdate='%04d-%02d-%02d %02d:%02d:%02d' "
-				"WHERE (ID = %" PRIu64 ")",
+			bind_exec_grouped("DeviceStatus", ulID,
+				"UPDATE DeviceStatus SET SignalLevel=?, BatteryLevel=?, nValue=?, sValue=?, LastUpdate=? "
+				"WHERE (ID = ?)",
 				signallevel, batterylevel,
 				nValue, sValue,
-				ltime.tm_year + 1900, ltime.tm_mon + 1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec,
+				szLastUpdate,
 				ulID);
+			if (bCachedRow)
+			{
+				//Write through, so the next update does not have to reload the row
+				devRow.SignalLevel = signallevel;
+				devRow.BatteryLevel = batterylevel;
+				devRow.nValue = nValue;
+				devRow.sValue = sValue;
+				devRow.LastUpdate = szLastUpdate;
+				m_devicestatuscache.StoreWrite(devRow, devGeneration);
+			}
 		}
 	}
 
@@ -4608,20 +5144,20 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 			|| (stype == STYPE_PushOff)
 			)
 		{
-			result = safe_query(
+			bind_exec_grouped("LightingLog", ulID,
 				"INSERT INTO LightingLog (DeviceRowID, nValue, sValue, User) "
-				"VALUES ('%" PRIu64 "', '%d', '%q', '%q')",
+				"VALUES (?, ?, ?, ?)",
 				ulID,
 				nValue, sValue,
-				m_mainworker.m_szLastSwitchUser.c_str()
+				m_mainworker.m_szLastSwitchUser
 			);
 		}
 		if (!bDeviceUsed)
 			return ulID;	//don't process further as the device is not used
 		std::string lstatus = "";
 
-		result = safe_query(
-			"SELECT Name,SwitchType,AddjValue,StrParam1,StrParam2,Options,LastLevel FROM DeviceStatus WHERE (ID = %" PRIu64 ")",
+		result = safe_bind_query(
+			"SELECT Name,SwitchType,AddjValue,StrParam1,StrParam2,Options,LastLevel FROM DeviceStatus WHERE (ID = ?)",
 			ulID);
 		if (!result.empty())
 		{
@@ -4652,8 +5188,8 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 						llevel = 0;
 				}
 				//update level for device
-				safe_query(
-					"UPDATE DeviceStatus SET LastLevel='%d' WHERE (ID = %" PRIu64 ")",
+				bind_exec_grouped("DeviceStatus", ulID,
+					"UPDATE DeviceStatus SET LastLevel=? WHERE (ID = ?)",
 					llevel,
 					ulID);
 				if (bUseOnOffAction)
@@ -4876,56 +5412,194 @@ uint64_t CSQLHelper::UpdateValueInt(const int HardwareID, const char* ID, const
 
 bool CSQLHelper::GetLastValue(const int HardwareID, const char* DeviceID, const unsigned char unit, const unsigned char devType, const unsigned char subType, int& nValue, std::string& sValue, struct tm& LastUpdateTime)
 {
-	bool result = false;
-	std::vector<std::vector<std::string> > sqlresult;
-	std::string sLastUpdate;
-	//std::string sValue;
-	//struct tm LastUpdateTime;
-	sqlresult = safe_query(
-		"SELECT nValue,sValue,LastUpdate FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%q' AND Unit=%d AND Type=%d AND SubType=%d) order by LastUpdate desc limit 1",
-		HardwareID, DeviceID, unit, devType, subType);
+	_tDeviceStatusRow row;
+	if (!GetDeviceStatusRow(HardwareID, DeviceID, unit, devType, subType, row))
+		return false;
 
-	if (sqlresult.size() != 0)
+	std::string sLastUpdate = row.LastUpdate;
+	nValue = row.nValue;
+	sValue = row.sValue;
+	if (m_devicestatuscache.IsDuplicateKey(HardwareID, DeviceID, unit, devType, subType))
 	{
-		nValue = (int)atoi(sqlresult[0][0].c_str());
-		sValue = sqlresult[0][1];
-		sLastUpdate = sqlresult[0][2];
-
-		time_t lutime;
-		ParseSQLdatetime(lutime, LastUpdateTime, sLastUpdate);
-
-		result = true;
+		//the device is in the table more than once, the one that was updated last is used
+		bind_query([&](const CSQLRow& sd) {
+			nValue = sd.GetInt(0);
+			sValue = sd.GetString(1);
+			sLastUpdate = sd.GetString(2);
+			return false;
+		}, "SELECT nValue, sValue, LastUpdate FROM DeviceStatus WHERE (HardwareID=? AND DeviceID=? AND Unit=? AND Type=? AND SubType=?) ORDER BY LastUpdate DESC LIMIT 1",
+			HardwareID, DeviceID, unit, devType, subType);
 	}
 
-	return result;
+	time_t lutime;
+	ParseSQLdatetime(lutime, LastUpdateTime, sLastUpdate);
+	return true;
 }
 
 
-void CSQLHelper::GetAddjustment(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, float& AddjValue, float& AddjMulti)
+#define DEVICESTATUS_CACHE_COLUMNS "ID, HardwareID, DeviceID, Unit, Name, Used, Type, SubType, SwitchType, Favorite, SignalLevel, BatteryLevel, nValue, sValue, LastUpdate, [Order], AddjValue, AddjMulti, AddjValue2, AddjMulti2, StrParam1, StrParam2, LastLevel, Protected, CustomImage, Description, Options, Color"
+
+//Maximum number of changed rows we reload one by one, above this we reload the complete table
+#define DEVICESTATUS_CACHE_MAX_ROW_RELOAD 100
+
+static void DeviceStatusRowFromRow(const CSQLRow& sd, _tDeviceStatusRow& row)
+{
+	row.ID = sd.GetUInt64(0);
+	row.HardwareID = sd.GetInt(1);
+	row.DeviceID = sd.GetString(2);
+	row.Unit = sd.GetInt(3);
+	row.Name = sd.GetString(4);
+	row.Used = (sd.GetInt(5) != 0);
+	row.Type = sd.GetInt(6);
+	row.SubType = sd.GetInt(7);
+	row.SwitchType = sd.GetInt(8);
+	row.Favorite = sd.GetInt(9);
+	row.SignalLevel = sd.GetInt(10);
+	row.BatteryLevel = sd.GetInt(11);
+	row.nValue = sd.GetInt(12);
+	row.sValue = sd.GetString(13);
+	row.LastUpdate = sd.GetString(14);
+	row.Order = sd.GetInt(15);
+	row.AddjValue = sd.GetDouble(16);
+	row.AddjMulti = sd.GetDouble(17);
+	row.AddjValue2 = sd.GetDouble(18);
+	row.AddjMulti2 = sd.GetDouble(19);
+	row.StrParam1 = sd.GetString(20);
+	row.StrParam2 = sd.GetString(21);
+	row.LastLevel = sd.GetInt(22);
+	row.Protected = sd.GetInt(23);
+	row.CustomImage = sd.GetInt(24);
+	row.Description = sd.GetString(25);
+	row.Options = sd.GetString(26);
+	row.Color = sd.GetString(27);
+}
+
+void CSQLHelper::RefreshDeviceStatusCache()
+{
+	if (!m_dbase)
+		return;
+	std::lock_guard<std::mutex> l(m_devicestatuscacheMutex);
+
+	std::vector<std::pair<uint64_t, uint32_t> > staleRows;
+	if (m_devicestatuscache.IsLoaded())
+	{
+		m_devicestatuscache.GetStaleRows(staleRows);
+		if (staleRows.empty())
+			return;
+		if (staleRows.size() > DEVICESTATUS_CACHE_MAX_ROW_RELOAD)
+		{
+			m_devicestatuscache.Clear();
+			staleRows.clear();
+		}
+	}
+
+	if (!m_devicestatuscache.IsLoaded())
+	{
+		//(Re)load the complete table, rows are stored while stepping
+		std::set<uint64_t> _rows;
+		bind_query([this, &_rows](const CSQLRow& sd) {
+			_tDeviceStatusRow row;
+			DeviceStatusRowFromRow(sd, row);
+			m_devicestatuscache.Store(row, 0, true);
+			_rows.insert(row.ID);
+			return true;
+		}, "SELECT " DEVICESTATUS_CACHE_COLUMNS " FROM DeviceStatus");
+		m_devicestatuscache.RemoveUnlisted(_rows);
+		m_devicestatuscache.SetLoaded();
+		m_devicestatuscache.GetStaleRows(staleRows);
+	}
+
+	for (const auto& itt : staleRows)
+	{
+		_tDeviceStatusRow row;
+		if (!QueryDeviceStatusRow(itt.first, row))
+		{
+			m_devicestatuscache.OnRowDeleted(itt.first);
+			continue;
+		}
+		m_devicestatuscache.Store(row, itt.second, false);
+	}
+}
+
+bool CSQLHelper::QueryDeviceStatusRow(const uint64_t idx, _tDeviceStatusRow& row)
+{
+	bool bFound = false;
+	bind_query([&](const CSQLRow& sd) {
+		DeviceStatusRowFromRow(sd, row);
+		bFound = true;
+		return false;
+	}, "SELECT " DEVICESTATUS_CACHE_COLUMNS " FROM DeviceStatus WHERE (ID==?)", idx);
+	return bFound;
+}
+
+bool CSQLHelper::GetDeviceStatusRow(const uint64_t idx, _tDeviceStatusRow& row)
+{
+	uint32_t generation;
+	if (m_devicestatuscache.Get(idx, row, generation))
+		return true;
+	RefreshDeviceStatusCache();
+	if (m_devicestatuscache.Get(idx, row, generation))
+		return true;
+	if (!m_devicestatuscache.HasStaleRows())
+		return false;
+	//Changed again while we were refreshing, read it directly
+	return QueryDeviceStatusRow(idx, row);
+}
+
+bool CSQLHelper::FindCachedDeviceStatusRow(const int HardwareID, const std::string& DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow& row, uint32_t& generation)
+{
+	//Rows that changed could have a new key, or could be new devices
+	RefreshDeviceStatusCache();
+	return m_devicestatuscache.Find(HardwareID, DeviceID, unit, devType, subType, row, generation);
+}
+
+bool CSQLHelper::QueryDeviceStatusRow(const int HardwareID, const std::string& DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow& row)
+{
+	bool bFound = false;
+	bind_query([&](const CSQLRow& sd) {
+		DeviceStatusRowFromRow(sd, row);
+		bFound = true;
+		return false;
+	}, "SELECT " DEVICESTATUS_CACHE_COLUMNS " FROM DeviceStatus WHERE (HardwareID=? AND DeviceID=? AND Unit=? AND Type=? AND SubType=?)",
+		HardwareID, DeviceID, unit, devType, subType);
+	return bFound;
+}
+
+bool CSQLHelper::GetDeviceStatusRow(const int HardwareID, const std::string& DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow& row)
+{
+	uint32_t generation;
+	if (FindCachedDeviceStatusRow(HardwareID, DeviceID, unit, devType, subType, row, generation))
+		return true;
+	if (!m_devicestatuscache.HasStaleRows())
+		return false;
+	return QueryDeviceStatusRow(HardwareID, DeviceID, unit, devType, subType, row);
+}
+
+void CSQLHelper::GetDeviceStatusRows(std::vector<_tDeviceStatusRow>& rows)
+{
+	RefreshDeviceStatusCache();
+	m_devicestatuscache.GetAll(rows);
+}
+
+void CSQLHelper::GetAddjustment(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, float& AddjValue, float& AddjMulti)
 {
 	AddjValue = 0.0f;
 	AddjMulti = 1.0f;
-	std::vector<std::vector<std::string> > result;
-	result = safe_query(
-		"SELECT AddjValue,AddjMulti FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%q' AND Unit=%d AND Type=%d AND SubType=%d)",
-		HardwareID, ID, unit, devType, subType);
-	if (!result.empty())
+	_tDeviceStatusRow row;
+	if (GetDeviceStatusRow(HardwareID, ID, unit, devType, subType, row))
 	{
-		AddjValue = static_cast<float>(atof(result[0][0].c_str()));
-		AddjMulti = static_cast<float>(atof(result[0][1].c_str()));
+		AddjValue = static_cast<float>(row.AddjValue);
+		AddjMulti = static_cast<float>(row.AddjMulti);
 	}
 }
 
 void CSQLHelper::GetMeterType(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, int& meterType)
 {
 	meterType = 0;
-	std::vector<std::vector<std::string> > result;
-	result = safe_query(
-		"SELECT SwitchType FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%q' AND Unit=%d AND Type=%d AND SubType=%d)",
-		HardwareID, ID, unit, devType, subType);
-	if (!result.empty())
+	_tDeviceStatusRow row;
+	if (GetDeviceStatusRow(HardwareID, ID, unit, devType, subType, row))
 	{
-		meterType = atoi(result[0][0].c_str());
+		meterType = row.SwitchType;
 	}
 }
 
@@ -4933,14 +5607,11 @@ void CSQLHelper::GetAddjustment2(const int HardwareID, const char* ID, const uns
 {
 	AddjValue = 0.0f;
 	AddjMulti = 1.0f;
-	std::vector<std::vector<std::string> > result;
-	result = safe_query(
-		"SELECT AddjValue2,AddjMulti2 FROM DeviceStatus WHERE (HardwareID=%d AND DeviceID='%q' AND Unit=%d AND Type=%d AND SubType=%d)",
-		HardwareID, ID, unit, devType, subType);
-	if (!result.empty())
+	_tDeviceStatusRow row;
+	if (GetDeviceStatusRow(HardwareID, ID, unit, devType, subType, row))
 	{
-		AddjValue = static_cast<float>(atof(result[0][0].c_str()));
-		AddjMulti = static_cast<float>(atof(result[0][1].c_str()));
+		AddjValue = static_cast<float>(row.AddjValue2);
+		AddjMulti = static_cast<float>(row.AddjMulti2);
 	}
 }
 
@@ -4965,19 +5636,18 @@ void CSQLHelper::UpdatePreferencesVar(const std::string& Key, const int nValue,
 		return;
 
 	std::vector<std::vector<std::string> > result;
-	result = safe_query("SELECT ROWID FROM Preferences WHERE (Key='%q')",
-		Key.c_str());
+	result = safe_bind_query("SELECT ROWID FROM Preferences WHERE (Key=?)", Key);
 	if (result.empty())
 	{
 		//Insert
-		result = safe_query("INSERT INTO Preferences (Key, nValue, sValue) VALUES ('%q', %d,'%q')",
-			Key.c_str(), nValue, sValue.c_str());
+		bind_exec("INSERT INTO Preferences (Key, nValue, sValue) VALUES (?, ?, ?)",
+			Key, nValue, sValue);
 	}
 	else
 	{
 		//Update
-		result = safe_query("UPDATE Preferences SET Key='%q', nValue=%d, sValue='%q' WHERE (ROWID = '%q')",
-			Key.c_str(), nValue, sValue.c_str(), result[0][0].c_str());
+		bind_exec("UPDATE Preferences SET Key=?, nValue=?, sValue=? WHERE (ROWID = ?)",
+			Key, nValue, sValue, result[0][0]);
 	}
 }
 
@@ -4987,14 +5657,13 @@ bool CSQLHelper::GetPreferencesVar(const std::string& Key, std::string& sValue)
 		return false;
 
 
-	std::vector<std::vector<std::string> > result;
-	result = safe_query("SELECT sValue FROM Preferences WHERE (Key='%q')",
-		Key.c_str());
-	if (result.empty())
+	bool bFound = false;
+	bind_query([&](const CSQLRow& sd) {
+		sValue = sd.GetString(0);
+		bFound = true;
 		return false;
-	std::vector<std::string> sd = result[0];
-	sValue = sd[0];
-	return true;
+	}, "SELECT sValue FROM Preferences WHERE (Key=?)", Key);
+	return bFound;
 }
 
 bool CSQLHelper::GetPreferencesVar(const std::string& Key, double& Value)
@@ -5014,15 +5683,14 @@ bool CSQLHelper::GetPreferencesVar(const std::string& Key, int& nValue, std::str
 	if (!m_dbase)
 		return false;
 
-	std::vector<std::vector<std::string> > result;
-	result = safe_query("SELECT nValue, sValue FROM Preferences WHERE (Key='%q')",
-		Key.c_str());
-	if (result.empty())
+	bool bFound = false;
+	bind_query([&](const CSQLRow& sd) {
+		nValue = sd.GetInt(0);
+		sValue = sd.GetString(1);
+		bFound = true;
 		return false;
-	std::vector<std::string> sd = result[0];
-	nValue = atoi(sd[0].c_str());
-	sValue = sd[1];
-	return true;
+	}, "SELECT nValue, sValue FROM Preferences WHERE (Key=?)", Key);
+	return bFound;
 }
 
 bool CSQLHelper::GetPreferencesVar(const std::string& Key, int& nValue)
@@ -5039,7 +5707,7 @@ void CSQLHelper::DeletePreferencesVar(const std::string& Key)
 	//if found, delete
 	if (GetPreferencesVar(Key, sValue) == true)
 	{
-		safe_query("DELETE FROM Preferences WHERE (Key='%q')", Key.c_str());
+		bind_exec("DELETE FROM Preferences WHERE (Key=?)", Key);
 	}
 }
 
@@ -5227,44 +5895,53 @@ void CSQLHelper::UpdateTemperatureLog()
 	int SensorTimeOut = 60;
 	GetPreferencesVar("SensorTimeout", SensorTimeOut);
 
-	std::vector<std::vector<std::string> > result;
-	result = safe_query("SELECT ID,Type,SubType,nValue,sValue,LastUpdate FROM DeviceStatus WHERE (Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR Type=%d OR (Type=%d AND SubType=%d) OR (Type=%d AND SubType=%d) OR (Type=%d AND SubType=%d))",
-		pTypeTEMP,
-		pTypeHUM,
-		pTypeTEMP_HUM,
-		pTypeTEMP_HUM_BARO,
-		pTypeTEMP_BARO,
-		pTypeUV,
-		pTypeWIND,
-		pTypeThermostat1,
-		pTypeRFXSensor,
-		pTypeRego6XXTemp,
-		pTypeEvohomeZone,
-		pTypeEvohomeWater,
-		pTypeRadiator1,
-		pTypeGeneral, sTypeSystemTemp,
-		pTypeThermostat, sTypeThermSetpoint,
-		pTypeGeneral, sTypeBaro
-	);
-	if (!result.empty())
+	//Sensor devices are taken from the in-memory DeviceStatus table
+	std::vector<_tDeviceStatusRow> devices;
+	GetDeviceStatusRows(devices);
+	if (!devices.empty())
 	{
-		for (const auto& itt : result)
+		for (const auto& itt : devices)
 		{
-			std::vector<std::string> sd = itt;
+			unsigned char dType = itt.Type;
+			unsigned char dSubType = itt.SubType;
+			switch (itt.Type)
+			{
+			case pTypeTEMP:
+			case pTypeHUM:
+			case pTypeTEMP_HUM:
+			case pTypeTEMP_HUM_BARO:
+			case pTypeTEMP_BARO:
+			case pTypeUV:
+			case pTypeWIND:
+			case pTypeThermostat1:
+			case pTypeRFXSensor:
+			case pTypeRego6XXTemp:
+			case pTypeEvohomeZone:
+			case pTypeEvohomeWater:
+			case pTypeRadiator1:
+				break;
+			case pTypeGeneral:
+				if ((itt.SubType != sTypeSystemTemp) && (itt.SubType != sTypeBaro))
+					continue;
+				break;
+			case pTypeThermostat:
+				if (itt.SubType != sTypeThermSetpoint)
+					continue;
+				break;
+			default:
+				continue;
+			}
 
-			uint64_t ID = std::stoull(sd[0]);
-			unsigned char dType = atoi(sd[1].c_str());
-			unsigned char dSubType = atoi(sd[2].c_str());
-			int nValue = atoi(sd[3].c_str());
-			std::string sValue = sd[4];
+			uint64_t ID = itt.ID;
+			int nValue = itt.nValue;
+			const std::string& sValue = itt.sValue;
 
 			if (dType != pTypeRadiator1)
 			{
 				//do not include sensors that have no reading within an hour (except for devices that do not provide feedback, like the smartware radiator)
-				std::string sLastUpdate = sd[5];
 				struct tm ntime;
 				time_t checktime;
-				ParseSQLdatetime(checktime, ntime, sLastUpdate, tm1.tm_isdst);
+				ParseSQLdatetime(checktime, ntime, itt.LastUpdate, tm1.tm_isdst);
 
 				if (difftime(now, checktime) >= SensorTimeOut * 60)
 					continue;
@@ -5381,17 +6058,30 @@ void CSQLHelper::UpdateTemperatureLog()
 				}
 				break;
 			}
-			//insert record
-			safe_query(
+			//insert record (values are stored with 2 decimals, as before)
+			if (m_temperatureStore.IsOpen())
+			{
+				double values[TEMPERATURE_LOG_COLUMNS] = {
+					round_digits(temp, 2),
+					round_digits(chill, 2),
+					(double)humidity,
+					(double)barometer,
+					round_digits(dewpoint, 2),
+					round_digits(setpoint, 2)
+				};
+				m_temperatureStore.Append(ID, now, values);
+				continue;
+			}
+			bind_exec_grouped("Temperature", ID,
 				"INSERT INTO Temperature (DeviceRowID, Temperature, Chill, Humidity, Barometer, DewPoint, SetPoint) "
-				"VALUES ('%" PRIu64 "', '%.2f', '%.2f', '%d', '%d', '%.2f', '%.2f')",
+				"VALUES (?, ?, ?, ?, ?, ?, ?)",
 				ID,
-				temp,
-				chill,
+				round_digits(temp, 2),
+				round_digits(chill, 2),
 				humidity,
 				barometer,
-				dewpoint,
-				setpoint
+				round_digits(dewpoint, 2),
+				round_digits(setpoint, 2)
 			);
 		}
 	}
@@ -5440,11 +6130,11 @@ void CSQLHelper::UpdateRainLog()
 			float total = static_cast<float>(atof(splitresults[1].c_str()));
 
 			//insert record
-			safe_query(
+			bind_exec_grouped("Rain", ID,
 				"INSERT INTO Rain (DeviceRowID, Total, Rate) "
-				"VALUES ('%" PRIu64 "', '%.2f', '%d')",
+				"VALUES (?, ?, ?)",
 				ID,
-				total,
+				round_digits(total, 2),
 				rate
 			);
 		}
@@ -5513,11 +6203,11 @@ void CSQLHelper::UpdateWindLog()
 
 
 			//insert record
-			safe_query(
+			bind_exec_grouped("Wind", ID,
 				"INSERT INTO Wind (DeviceRowID, Direction, Speed, Gust) "
-				"VALUES ('%" PRIu64 "', '%.2f', '%d', '%d')",
+				"VALUES (?, ?, ?, ?)",
 				ID,
-				direction,
+				round_digits(direction, 2),
 				speed,
 				gust
 			);
@@ -5570,11 +6260,11 @@ void CSQLHelper::UpdateUVLog()
 			float level = static_cast<float>(atof(splitresults[0].c_str()));
 
 			//insert record
-			safe_query(
+			bind_exec_grouped("UV", ID,
 				"INSERT INTO UV (DeviceRowID, Level) "
-				"VALUES ('%" PRIu64 "', '%g')",
+				"VALUES (?, ?)",
 				ID,
-				level
+				round_digits(level, 6)
 			);
 		}
 	}
@@ -6017,9 +6707,9 @@ void CSQLHelper::UpdateMeter()
 			}
 
 			//insert record
-			safe_query(
+			bind_exec_grouped("Meter", ID,
 				"INSERT INTO Meter (DeviceRowID, Value, [Usage]) "
-				"VALUES ('%" PRIu64 "', '%lld', '%lld')",
+				"VALUES (?, ?, ?)",
 				ID,
 				MeterValue,
 				MeterUsage
@@ -6124,9 +6814,9 @@ void CSQLHelper::UpdateMultiMeter()
 				continue;//don't know you (yet)
 
 			//insert record
-			safe_query(
+			bind_exec_grouped("MultiMeter", ID,
 				"INSERT INTO MultiMeter (DeviceRowID, Value1, Value2, Value3, Value4, Value5, Value6) "
-				"VALUES ('%" PRIu64 "', '%llu', '%llu', '%llu', '%llu', '%llu', '%llu')",
+				"VALUES (?, ?, ?, ?, ?, ?, ?)",
 				ID,
 				value1,
 				value2,
@@ -6186,11 +6876,11 @@ void CSQLHelper::UpdatePercentageLog()
 			float percentage = static_cast<float>(atof(sValue.c_str()));
 
 			//insert record
-			safe_query(
+			bind_exec_grouped("Percentage", ID,
 				"INSERT INTO Percentage (DeviceRowID, Percentage) "
-				"VALUES ('%" PRIu64 "', '%g')",
+				"VALUES (?, ?)",
 				ID,
-				percentage
+				round_digits(percentage, 6)
 			);
 		}
 	}
@@ -6241,9 +6931,9 @@ void CSQLHelper::UpdateFanLog()
 			int speed = (int)atoi(sValue.c_str());
 
 			//insert record
-			safe_query(
+			bind_exec_grouped("Fan", ID,
 				"INSERT INTO Fan (DeviceRowID, Speed) "
-				"VALUES ('%" PRIu64 "', '%d')",
+				"VALUES (?, ?)",
 				ID,
 				speed
 			);
@@ -6254,12 +6944,6 @@ void CSQLHelper::UpdateFanLog()
 
 void CSQLHelper::AddCalendarTemperature()
 {
-	//Get All temperature devices in the Temperature Table
-	std::vector<std::vector<std::string> > resultdevices;
-	resultdevices = safe_query("SELECT DISTINCT(DeviceRowID) FROM Temperature ORDER BY DeviceRowID");
-	if (resultdevices.size() < 1)
-		return; //nothing to do
-
 	char szDateStart[40];
 	char szDateEnd[40];
 
@@ -6273,21 +6957,27 @@ void CSQLHelper::AddCalendarTemperature()
 	getNoon(yesterday, tm2, ltime.tm_year + 1900, ltime.tm_mon + 1, ltime.tm_mday - 1); // we only want the date
 	sprintf(szDateStart, "%04d-%02d-%02d", tm2.tm_year + 1900, tm2.tm_mon + 1, tm2.tm_mday);
 
+	//Get All temperature devices in the Temperature log
+	std::vector<uint64_t> devices;
+	if (m_temperatureStore.IsOpen())
+		m_temperatureStore.GetSeries(yesterday, now, devices);
+	else
+	{
+		std::vector<std::vector<std::string> > resultdevices;
+		resultdevices = safe_query("SELECT DISTINCT(DeviceRowID) FROM Temperature ORDER BY DeviceRowID");
+		for (const auto& itt : resultdevices)
+			devices.push_back(std::stoull(itt[0]));
+	}
+	if (devices.empty())
+		return; //nothing to do
+
 	std::vector<std::vector<std::string> > result;
 
-	for (const auto& itt : resultdevices)
+	for (const auto& ID : devices)
 	{
-		std::vector<std::string> sddev = itt;
-		uint64_t ID = std::stoull(sddev[0]);
-
-		result = safe_query("SELECT MIN(Temperature), MAX(Temperature), AVG(Temperature), MIN(Chill), MAX(Chill), AVG(Humidity), AVG(Barometer), MIN(DewPoint), MIN(SetPoint), MAX(SetPoint), AVG(SetPoint) FROM Temperature WHERE (DeviceRowID='%" PRIu64 "' AND Date>='%q' AND Date<='%q 00:00:00')",
-			ID,
-			szDateStart,
-			szDateEnd
-		);
-		if (!result.empty())
+		std::vector<std::string> sd = GetTemperatureLogStats(ID, szDateStart, std::string(szDateEnd) + " 00:00:00");
+		if (!sd.empty())
 		{
-			std::vector<std::string> sd = result[0];
 
 			float temp_min = static_cast<float>(atof(sd[0].c_str()));
 			float temp_max = static_cast<float>(atof(sd[1].c_str()));
@@ -6976,6 +7666,10 @@ void CSQLHelper::AddCalendarUpdateFan()
 	}
 }
 
+//Rows deleted per statement by the shortlog cleanup, the database lock is released in between
+#define SHORTLOG_CLEANUP_CHUNK 500
+#define SHORTLOG_CLEANUP_SLEEP_MS 5
+
 void CSQLHelper::CleanupShortLog()
 {
 	int n5MinuteHistoryDays = 1;
@@ -6987,42 +7681,327 @@ void CSQLHelper::CleanupShortLog()
 			_log.Log(LOG_ERROR, "CleanupShortLog(): MinuteHistoryDays is zero!");
 			return;
 		}
-#if 0
-		char szDateStr[40];
-		time_t clear_time = mytime(NULL) - (n5MinuteHistoryDays * 24 * 3600);
-		struct tm ltime;
-		localtime_r(&clear_time, &ltime);
-		sprintf(szDateStr, "%04d-%02d-%02d %02d:%02d:%02d", ltime.tm_year + 1900, ltime.tm_mon + 1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec);
-		_log.Log(LOG_STATUS, "Cleaning up shortlog older than %s", szDateStr);
-#endif
+		//Dates are stored as local time strings, so a plain string compare can use the (DeviceRowID, Date) indexes.
+		//The cutoff is the same local time n days ago (like the light log cleanup), also across a DST change
+		time_t now = mytime(NULL);
+		struct tm tm1;
+		localtime_r(&now, &tm1);
+		time_t clear_time;
+		struct tm tm2;
+		constructTime(clear_time, tm2, tm1.tm_year + 1900, tm1.tm_mon + 1, tm1.tm_mday - n5MinuteHistoryDays, tm1.tm_hour, tm1.tm_min, tm1.tm_sec, tm1.tm_isdst);
+		std::string szDate = TimeToString(&clear_time, TF_DateTime);
+		const char* szDateStr = szDate.c_str();
+
+		if (m_temperatureStore.IsOpen())
+			m_temperatureStore.DeleteBefore(clear_time);
+
+		static const char* szTables[] = { "Temperature", "Rain", "Wind", "UV", "Meter", "MultiMeter", "Percentage", "Fan" };
+		std::string szReport;
+		for (const auto& itt : szTables)
+		{
+			std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+			int nRows = CleanupShortLogTable(itt, szDateStr);
+			int64_t msDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+			if (nRows == 0)
+				continue;
+			char szTmp[100];
+			sprintf(szTmp, "%s%s: %d rows (%" PRId64 " ms)", (szReport.empty()) ? "" : ", ", itt, nRows, msDuration);
+			szReport += szTmp;
+		}
+		if (!szReport.empty())
+			_log.Debug(DEBUG_NORM, "CleanupShortLog(): older than %s, %s", szDateStr, szReport.c_str());
+	}
+}
 
-		char szQuery[250];
-		std::string szQueryFilter = "strftime('%s',datetime('now','localtime')) - strftime('%s',Date) > (SELECT p.nValue * 86400 From Preferences AS p WHERE p.Key='5MinuteHistoryDays')";
+//Deletes the rows before the cutoff date device by device, in small transactions.
+//Returns the number of rows removed
+int CSQLHelper::CleanupShortLogTable(const std::string& TableName, const std::string& szCutoffDate)
+{
+	std::string szNextDevice = "SELECT DeviceRowID FROM " + TableName + " WHERE (DeviceRowID > ?) ORDER BY DeviceRowID LIMIT 1";
+	std::string szDelete = "DELETE FROM " + TableName + " WHERE rowid IN (SELECT rowid FROM " + TableName + " WHERE (DeviceRowID == ?) AND (Date < ?) LIMIT ?)";
+	int nTotal = 0;
+	int64_t deviceRowID = -1;
+	while (!IsStopRequested(0))
+	{
+		bool bFound = false;
+		bind_query([&](const CSQLRow& row) {
+			deviceRowID = row.GetInt64(0);
+			bFound = true;
+			return false;
+		}, szNextDevice.c_str(), deviceRowID);
+		if (!bFound)
+			break;
+
+		int nRows;
+		do
+		{
+			nRows = bind_exec_changes(szDelete.c_str(), deviceRowID, szCutoffDate, SHORTLOG_CLEANUP_CHUNK);
+			if (nRows <= 0)
+				break;
+			nTotal += nRows;
+			if (nRows == SHORTLOG_CLEANUP_CHUNK)
+				sqlite3_sleep(SHORTLOG_CLEANUP_SLEEP_MS);
+		} while (nRows == SHORTLOG_CLEANUP_CHUNK);
+	}
+	return nTotal;
+}
 
-		sprintf(szQuery, "DELETE FROM Temperature WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+static std::string GetShortLogStoreDir(const std::string& dbaseName)
+{
+#ifdef WIN32
+	return dbaseName + "-shortlog\\temperature\\";
+#else
+	return dbaseName + "-shortlog/temperature/";
+#endif
+}
 
-		sprintf(szQuery, "DELETE FROM Rain WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+//Short log samples kept in the segment store instead of SQLite, existing rows are moved to it
+void CSQLHelper::OpenShortLogStore()
+{
+	std::string szDir = GetShortLogStoreDir(m_dbase_name);
+	if (!m_temperatureStore.Open(szDir, TEMPERATURE_LOG_COLUMNS))
+		return;
+	_log.Log(LOG_STATUS, "Temperature short log stored in %s", szDir.c_str());
+
+	//only rows that are in the store are removed, after a failed append the rest is moved on the next start.
+	//Rows that are not newer than the last sample of the device are in the store already, a restored backup
+	//has the samples of the store in its Temperature table
+	std::map<uint64_t, time_t> lastTimes;
+	m_temperatureStore.GetLastTimes(lastTimes);
+	std::vector<int64_t> moved;
+	bool bFailed = false;
+	int nSkipped = 0;
+	bind_query([&](const CSQLRow& row) {
+		time_t tDate;
+		struct tm ltime;
+		if (!ParseSQLdatetime(tDate, ltime, row.GetString(8)))
+			return true;
+		std::map<uint64_t, time_t>::const_iterator ittLast = lastTimes.find(row.GetUInt64(1));
+		if ((ittLast != lastTimes.end()) && (tDate <= ittLast->second))
+		{
+			moved.push_back(row.GetInt64(0));
+			nSkipped++;
+			return true;
+		}
+		double values[TEMPERATURE_LOG_COLUMNS];
+		for (int ii = 0; ii < TEMPERATURE_LOG_COLUMNS; ii++)
+			values[ii] = row.GetDouble(ii + 2);
+		if (!m_temperatureStore.Append(row.GetUInt64(1), tDate, values))
+		{
+			bFailed = true;
+			return false;
+		}
+		moved.push_back(row.GetInt64(0));
+		return true;
+	}, "SELECT rowid, DeviceRowID, Temperature, Chill, Humidity, Barometer, DewPoint, SetPoint, Date FROM Temperature ORDER BY DeviceRowID, Date");
+	if (!moved.empty())
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		CommitGroupTransaction();
+		sqlite3_stmt* stmt = NULL;
+		if (sqlite3_prepare_v2(m_dbase, "DELETE FROM Temperature WHERE (rowid == ?)", -1, &stmt, NULL) == SQLITE_OK)
+		{
+			sqlite3_exec(m_dbase, "BEGIN TRANSACTION", NULL, NULL, NULL);
+			for (const auto& itt : moved)
+			{
+				sqlite3_bind_int64(stmt, 1, itt);
+				sqlite3_step(stmt);
+				sqlite3_reset(stmt);
+			}
+			sqlite3_exec(m_dbase, "COMMIT TRANSACTION", NULL, NULL, NULL);
+			sqlite3_finalize(stmt);
+		}
+		_log.Log(LOG_STATUS, "Temperature short log: %d rows moved to the segment store (%d were in it already)", (int)moved.size(), nSkipped);
+	}
+	if (bFailed)
+		_log.Log(LOG_ERROR, "Temperature short log: could not move all rows to the segment store, the others are moved on the next start");
+}
 
-		sprintf(szQuery, "DELETE FROM Wind WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+//ShortLogStore switched off: the samples of the segment store go back to the Temperature table
+void CSQLHelper::CloseShortLogStore()
+{
+	if (!m_temperatureStore.IsOpen())
+	{
+		std::string szDir = GetShortLogStoreDir(m_dbase_name);
+		if (!file_exist(szDir.c_str()))
+			return;
+		if (!m_temperatureStore.Open(szDir, TEMPERATURE_LOG_COLUMNS))
+			return;
+	}
+	int n5MinuteHistoryDays = 1;
+	GetPreferencesVar("5MinuteHistoryDays", n5MinuteHistoryDays);
+	int nRows;
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		CommitGroupTransaction();
+		nRows = CopyShortLogStore(m_dbase, n5MinuteHistoryDays);
+	}
+	if (nRows < 0)
+	{
+		//keep the segments, the next start tries again
+		_log.Log(LOG_ERROR, "Temperature short log: could not move the segment store back to the database");
+		m_temperatureStore.Close();
+		return;
+	}
+	m_temperatureStore.Clear();
+	m_temperatureStore.Close();
+	if (nRows != 0)
+		_log.Log(LOG_STATUS, "Temperature short log: %d rows moved back from the segment store", nRows);
+}
 
-		sprintf(szQuery, "DELETE FROM UV WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+//Writes the samples of the segment store as rows of the Temperature table of db (the database itself or a backup).
+//Returns the number of rows, -1 on an error (nothing is written then)
+int CSQLHelper::CopyShortLogStore(sqlite3* db, const int nHistoryDays)
+{
+	//cleanup removes whole days, so nothing is older than the history days plus one
+	time_t now = mytime(NULL);
+	time_t tStart = now - ((nHistoryDays + 1) * 86400);
+	std::vector<uint64_t> devices;
+	m_temperatureStore.GetSeries(tStart, now, devices);
+	if (devices.empty())
+		return 0;
 
-		sprintf(szQuery, "DELETE FROM Meter WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+	sqlite3_stmt* stmt = NULL;
+	if (sqlite3_prepare_v2(db, "INSERT INTO Temperature (DeviceRowID, Temperature, Chill, Humidity, Barometer, DewPoint, SetPoint, Date) VALUES (?, ?, ?, ?, ?, ?, ?, ?)", -1, &stmt, NULL) != SQLITE_OK)
+		return -1;
+	sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+	int nRows = 0;
+	bool bError = false;
+	for (const auto& ID : devices)
+	{
+		m_temperatureStore.Read(ID, tStart, 0, [&](const CTimeSeriesStore::_tSample& sample) {
+			if (bError)
+				return;
+			std::string szDate = TimeToString(&sample.time, TF_DateTime);
+			sqlite3_bind_int64(stmt, 1, (sqlite3_int64)ID);
+			sqlite3_bind_double(stmt, 2, sample.values[0]);
+			sqlite3_bind_double(stmt, 3, sample.values[1]);
+			sqlite3_bind_int(stmt, 4, (int)sample.values[2]);
+			sqlite3_bind_int(stmt, 5, (int)sample.values[3]);
+			sqlite3_bind_double(stmt, 6, sample.values[4]);
+			sqlite3_bind_double(stmt, 7, sample.values[5]);
+			sqlite3_bind_text(stmt, 8, szDate.c_str(), -1, SQLITE_TRANSIENT);
+			if (sqlite3_step(stmt) != SQLITE_DONE)
+				bError = true;
+			else
+				nRows++;
+			sqlite3_reset(stmt);
+		});
+		if (bError)
+			break;
+	}
+	sqlite3_finalize(stmt);
+	if (bError)
+	{
+		_log.Log(LOG_ERROR, "Temperature short log: %s", sqlite3_errmsg(db));
+		sqlite3_exec(db, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+		return -1;
+	}
+	sqlite3_exec(db, "COMMIT TRANSACTION", NULL, NULL, NULL);
+	return nRows;
+}
 
-		sprintf(szQuery, "DELETE FROM MultiMeter WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+//A date or datetime as used in the log tables
+static bool ParseLogDate(const std::string& szDate, time_t& time)
+{
+	struct tm ltime;
+	if (szDate.length() == 10)
+		return ParseSQLdatetime(time, ltime, szDate + " 00:00:00");
+	return ParseSQLdatetime(time, ltime, szDate);
+}
 
-		sprintf(szQuery, "DELETE FROM Percentage WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+static std::string FormatLogValue(const double value)
+{
+	char szTmp[40];
+	sprintf(szTmp, "%.15g", value);
+	return szTmp;
+}
 
-		sprintf(szQuery, "DELETE FROM Fan WHERE %s", szQueryFilter.c_str());
-		query(szQuery);
+std::vector<std::vector<std::string> > CSQLHelper::GetTemperatureLog(const uint64_t idx, const std::string& szDateStart, const std::string& szDateEnd)
+{
+	if (!m_temperatureStore.IsOpen())
+	{
+		return safe_query_read(
+			"SELECT Temperature, Chill, Humidity, Barometer,"
+			" Date, DewPoint, SetPoint "
+			"FROM Temperature WHERE (DeviceRowID==%" PRIu64 ""
+			" AND Date>='%q' AND Date<='%q') ORDER BY Date ASC",
+			idx, szDateStart.c_str(), szDateEnd.c_str());
 	}
+	std::vector<std::vector<std::string> > result;
+	time_t tStart, tEnd;
+	if ((!ParseLogDate(szDateStart, tStart)) || (!ParseLogDate(szDateEnd, tEnd)))
+		return result;
+	m_temperatureStore.Read(idx, tStart, tEnd, [&result](const CTimeSeriesStore::_tSample& sample) {
+		struct tm ltime;
+		localtime_r(&sample.time, &ltime);
+		char szDate[40];
+		sprintf(szDate, "%04d-%02d-%02d %02d:%02d:%02d", ltime.tm_year + 1900, ltime.tm_mon + 1, ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec);
+		std::vector<std::string> row;
+		row.push_back(FormatLogValue(sample.values[0]));
+		row.push_back(FormatLogValue(sample.values[1]));
+		row.push_back(FormatLogValue(sample.values[2]));
+		row.push_back(FormatLogValue(sample.values[3]));
+		row.push_back(szDate);
+		row.push_back(FormatLogValue(sample.values[4]));
+		row.push_back(FormatLogValue(sample.values[5]));
+		result.push_back(row);
+	});
+	return result;
+}
+
+std::vector<std::string> CSQLHelper::GetTemperatureLogStats(const uint64_t idx, const std::string& szDateStart, const std::string& szDateEnd)
+{
+	if (!m_temperatureStore.IsOpen())
+	{
+		std::vector<std::vector<std::string> > result;
+		if (szDateEnd.empty())
+		{
+			result = safe_query_read("SELECT MIN(Temperature), MAX(Temperature), AVG(Temperature), MIN(Chill), MAX(Chill), AVG(Humidity), AVG(Barometer), MIN(DewPoint), MIN(SetPoint), MAX(SetPoint), AVG(SetPoint) FROM Temperature WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
+				idx, szDateStart.c_str());
+		}
+		else
+		{
+			result = safe_query_read("SELECT MIN(Temperature), MAX(Temperature), AVG(Temperature), MIN(Chill), MAX(Chill), AVG(Humidity), AVG(Barometer), MIN(DewPoint), MIN(SetPoint), MAX(SetPoint), AVG(SetPoint) FROM Temperature WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q')",
+				idx, szDateStart.c_str(), szDateEnd.c_str());
+		}
+		if (result.empty())
+			return std::vector<std::string>(11);
+		return result[0];
+	}
+
+	//same layout (and empty values without samples) as the SQL aggregate
+	std::vector<std::string> sd(11);
+	time_t tStart, tEnd = 0;
+	if ((!ParseLogDate(szDateStart, tStart)) || ((!szDateEnd.empty()) && (!ParseLogDate(szDateEnd, tEnd))))
+		return sd;
+	int nSamples = 0;
+	double minValues[TEMPERATURE_LOG_COLUMNS], maxValues[TEMPERATURE_LOG_COLUMNS], sumValues[TEMPERATURE_LOG_COLUMNS];
+	m_temperatureStore.Read(idx, tStart, tEnd, [&](const CTimeSeriesStore::_tSample& sample) {
+		for (int ii = 0; ii < TEMPERATURE_LOG_COLUMNS; ii++)
+		{
+			if ((nSamples == 0) || (sample.values[ii] < minValues[ii]))
+				minValues[ii] = sample.values[ii];
+			if ((nSamples == 0) || (sample.values[ii] > maxValues[ii]))
+				maxValues[ii] = sample.values[ii];
+			sumValues[ii] = (nSamples == 0) ? sample.values[ii] : sumValues[ii] + sample.values[ii];
+		}
+		nSamples++;
+	});
+	if (nSamples == 0)
+		return sd;
+	sd[0] = FormatLogValue(minValues[0]);
+	sd[1] = FormatLogValue(maxValues[0]);
+	sd[2] = FormatLogValue(sumValues[0] / nSamples);
+	sd[3] = FormatLogValue(minValues[1]);
+	sd[4] = FormatLogValue(maxValues[1]);
+	sd[5] = FormatLogValue(sumValues[2] / nSamples);
+	sd[6] = FormatLogValue(sumValues[3] / nSamples);
+	sd[7] = FormatLogValue(minValues[4]);
+	sd[8] = FormatLogValue(minValues[5]);
+	sd[9] = FormatLogValue(maxValues[5]);
+	sd[10] = FormatLogValue(sumValues[5] / nSamples);
+	return sd;
 }
 
 void CSQLHelper::ClearShortLog()
@@ -7035,12 +8014,24 @@ void CSQLHelper::ClearShortLog()
 	query("DELETE FROM MultiMeter");
 	query("DELETE FROM Percentage");
 	query("DELETE FROM Fan");
+	if (m_temperatureStore.IsOpen())
+		m_temperatureStore.Clear();
 	VacuumDatabase();
 }
 
 void CSQLHelper::VacuumDatabase()
 {
-	query("VACUUM");
+	if (!m_dbase)
+		return;
+	//VACUUM can not run inside a transaction, so commit pending writes under the same lock
+	std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+	CommitGroupTransaction();
+	char* errorMessage = NULL;
+	if (sqlite3_exec(m_dbase, "VACUUM", NULL, NULL, &errorMessage) != SQLITE_OK)
+	{
+		_log.Log(LOG_ERROR, "SQL Query(\"VACUUM\") : %s", (errorMessage != NULL) ? errorMessage : "?");
+		sqlite3_free(errorMessage);
+	}
 }
 
 void CSQLHelper::OptimizeDatabase(sqlite3* dbase)
@@ -7125,6 +8116,7 @@ void CSQLHelper::DeleteDevices(const std::string& idx)
 		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
 
 		char* errorMessage;
+		CommitGroupTransaction();
 		sqlite3_exec(m_dbase, "BEGIN TRANSACTION", NULL, NULL, &errorMessage);
 
 		for (const auto& itt : _idx)
@@ -7136,6 +8128,8 @@ void CSQLHelper::DeleteDevices(const std::string& idx)
 			safe_exec_no_return("DELETE FROM Rain WHERE (DeviceRowID == '%q')", itt.c_str());
 			safe_exec_no_return("DELETE FROM Rain_Calendar WHERE (DeviceRowID == '%q')", itt.c_str());
 			safe_exec_no_return("DELETE FROM Temperature WHERE (DeviceRowID == '%q')", itt.c_str());
+			if (m_temperatureStore.IsOpen())
+				m_temperatureStore.DeleteSeries(std::stoull(itt));
 			safe_exec_no_return("DELETE FROM Temperature_Calendar WHERE (DeviceRowID == '%q')", itt.c_str());
 			safe_exec_no_return("DELETE FROM Timers WHERE (DeviceRowID == '%q')", itt.c_str());
 			safe_exec_no_return("DELETE FROM SetpointTimers WHERE (DeviceRowID == '%q')", itt.c_str());
@@ -7195,6 +8189,7 @@ void CSQLHelper::DeleteScenes(const std::string& idx)
 		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
 
 		char* errorMessage;
+		CommitGroupTransaction();
 		sqlite3_exec(m_dbase, "BEGIN TRANSACTION", NULL, NULL, &errorMessage);
 
 		for (const auto& itt : _idx)
@@ -7244,6 +8239,8 @@ void CSQLHelper::TransferDevice(const std::string& idx, const std::string& newid
 		safe_query("UPDATE Temperature SET DeviceRowID='%q' WHERE (DeviceRowID == '%q') AND (Date<'%q')", newidx.c_str(), idx.c_str(), result[0][0].c_str());
 	else
 		safe_query("UPDATE Temperature SET DeviceRowID='%q' WHERE (DeviceRowID == '%q')", newidx.c_str(), idx.c_str());
+	if (m_temperatureStore.IsOpen())
+		m_temperatureStore.MoveSeries(std::stoull(idx), std::stoull(newidx));
 
 	result = safe_query("SELECT Date FROM Temperature_Calendar WHERE (DeviceRowID == '%q') ORDER BY Date ASC LIMIT 1", newidx.c_str());
 	if (!result.empty())
@@ -7518,6 +8515,8 @@ void CSQLHelper::DeleteDataPoint(const char* ID, const std::string& Date)
 		safe_query("DELETE FROM Wind WHERE (DeviceRowID=='%q') AND (Date>='%q') AND (Date<='%q')", ID, Date.c_str(), szDateEnd);
 		safe_query("DELETE FROM UV WHERE (DeviceRowID=='%q') AND (Date>='%q') AND (Date<='%q')", ID, Date.c_str(), szDateEnd);
 		safe_query("DELETE FROM Temperature WHERE (DeviceRowID=='%q') AND (Date>='%q') AND (Date<='%q')", ID, Date.c_str(), szDateEnd);
+		if (m_temperatureStore.IsOpen())
+			m_temperatureStore.DeleteRange(std::stoull(ID), cEndTime, cEndTime + 120);
 		safe_query("DELETE FROM Meter WHERE (DeviceRowID=='%q') AND (Date>='%q') AND (Date<='%q')", ID, Date.c_str(), szDateEnd);
 		safe_query("DELETE FROM MultiMeter WHERE (DeviceRowID=='%q') AND (Date>='%q') AND (Date<='%q')", ID, Date.c_str(), szDateEnd);
 		safe_query("DELETE FROM Percentage WHERE (DeviceRowID=='%q') AND (Date>='%q') AND (Date<='%q')", ID, Date.c_str(), szDateEnd);
@@ -7642,6 +8641,11 @@ bool CSQLHelper::RestoreDatabase(const std::string& dbase)
 	StopThread();
 
 	//stop database
+	CloseReadPool();
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		FinalizeStatements();
+	}
 	sqlite3_close(m_dbase);
 	m_dbase = NULL;
 	std::ofstream outfile2;
@@ -7678,49 +8682,160 @@ bool CSQLHelper::RestoreDatabase(const std::string& dbase)
 	return true;
 }
 
-bool CSQLHelper::BackupDatabase(const std::string& OutputFile)
+//Pages copied per step while holding the database lock, device updates wait at most one step
+#define BACKUP_PAGES_PER_STEP 256
+#define BACKUP_STEP_SLEEP_MS 10
+
+//Moves a completely written backup over the previous one
+static bool ReplaceBackupFile(const std::string& TempFile, const std::string& OutputFile)
+{
+#ifdef WIN32
+	//rename does not overwrite an existing file on Windows
+	if (!MoveFileExA(TempFile.c_str(), OutputFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+	//rename replaces the previous backup atomically
+	if (std::rename(TempFile.c_str(), OutputFile.c_str()) != 0)
+#endif
+	{
+		_log.Log(LOG_ERROR, "Backup Database: Could not rename %s to %s", TempFile.c_str(), OutputFile.c_str());
+		std::remove(TempFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+//Online backup: pages are copied in steps and the lock is released in between, so the rest of the
+//application keeps using the database. Writes done through our connection in the meantime are
+//also applied to the backup by SQLite. The snapshot is not vacuumed.
+bool CSQLHelper::BackupDatabase(const std::string& OutputFile, const bool bCompress)
 {
 	if (!m_dbase)
 		return false; //database not open!
 
-	//First cleanup the database
-	OptimizeDatabase(m_dbase);
-	VacuumDatabase();
-
-	std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+	std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
 
-	int rc;                     // Function return code
-	sqlite3* pFile;             // Database connection opened on zFilename
-	sqlite3_backup* pBackup;    // Backup handle used to copy data
-
-	// Open the database file identified by zFilename.
-	rc = sqlite3_open(OutputFile.c_str(), &pFile);
+	//write to a temporary file first, a failed backup should not destroy the previous one.
+	//A compressed backup is written to OutputFile.tmp by CompressFile, the copy needs another name
+	std::string szTempFile = OutputFile + ((bCompress) ? ".db.tmp" : ".tmp");
+	sqlite3* pFile;
+	int rc = sqlite3_open(szTempFile.c_str(), &pFile);
 	if (rc != SQLITE_OK)
+	{
+		_log.Log(LOG_ERROR, "Backup Database: Could not create %s", szTempFile.c_str());
+		sqlite3_close(pFile);
 		return false;
+	}
 
-	// Open the sqlite3_backup object used to accomplish the transfer
-	pBackup = sqlite3_backup_init(pFile, "main", m_dbase, "main");
+	sqlite3_backup* pBackup;
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		pBackup = sqlite3_backup_init(pFile, "main", m_dbase, "main");
+	}
+	int lastPercentage = 0;
 	if (pBackup)
 	{
-		// Each iteration of this loop copies 5 database pages from database
-		// pDb to the backup database.
 		do {
-			rc = sqlite3_backup_step(pBackup, 5);
-			//xProgress(  sqlite3_backup_remaining(pBackup), sqlite3_backup_pagecount(pBackup) );
-			//if( rc==SQLITE_OK || rc==SQLITE_BUSY || rc==SQLITE_LOCKED ){
-			  //sqlite3_sleep(250);
-			//}
-		} while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+			{
+				std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+				//the source may not be in a write transaction while we read from it
+				CommitGroupTransaction();
+				rc = sqlite3_backup_step(pBackup, BACKUP_PAGES_PER_STEP);
+			}
+			int pageCount = sqlite3_backup_pagecount(pBackup);
+			if (pageCount > 0)
+			{
+				int percentage = ((pageCount - sqlite3_backup_remaining(pBackup)) * 100) / pageCount;
+				if (percentage >= lastPercentage + 10)
+				{
+					_log.Debug(DEBUG_NORM, "Backup Database: %d%% (%d pages)", percentage, pageCount);
+					lastPercentage = percentage;
+				}
+			}
+			if (rc == SQLITE_OK)
+				sqlite3_sleep(BACKUP_STEP_SLEEP_MS);
+			else if ((rc == SQLITE_BUSY) || (rc == SQLITE_LOCKED))
+				sqlite3_sleep(BACKUP_STEP_SLEEP_MS * 10);
+		} while ((rc == SQLITE_OK) || (rc == SQLITE_BUSY) || (rc == SQLITE_LOCKED));
 
+		int pageCount = sqlite3_backup_pagecount(pBackup);
 		/* Release resources allocated by backup_init(). */
 		sqlite3_backup_finish(pBackup);
+		rc = sqlite3_errcode(pFile);
+		//the samples of the segment store are written to the Temperature table of the copy,
+		//so the backup can be restored with or without ShortLogStore
+		if ((rc == SQLITE_OK) && (m_temperatureStore.IsOpen()))
+		{
+			int n5MinuteHistoryDays = 1;
+			GetPreferencesVar("5MinuteHistoryDays", n5MinuteHistoryDays);
+			int nRows = CopyShortLogStore(pFile, n5MinuteHistoryDays);
+			if (nRows < 0)
+				rc = SQLITE_ERROR;
+			else if (nRows != 0)
+				_log.Log(LOG_STATUS, "Backup Database: %d temperature short log rows added from the segment store", nRows);
+		}
+		if (rc == SQLITE_OK)
+		{
+			int64_t msDuration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+			_log.Log(LOG_STATUS, "Backup Database: %d pages copied in %.1f seconds", pageCount, msDuration / 1000.0);
+		}
 	}
-	rc = sqlite3_errcode(pFile);
-	// Close the database connection opened on database file zFilename
-	// and return the result of this function.
+	else
+		rc = sqlite3_errcode(pFile);
+	if (rc != SQLITE_OK)
+		_log.Log(LOG_ERROR, "Backup Database: %s", sqlite3_errmsg(pFile));
 	sqlite3_close(pFile);
 
-	return (rc == SQLITE_OK);
+	if (rc != SQLITE_OK)
+	{
+		std::remove(szTempFile.c_str());
+		return false;
+	}
+	if (bCompress)
+	{
+		bool bResult = CompressFile(szTempFile, OutputFile);
+		std::remove(szTempFile.c_str());
+		return bResult;
+	}
+	return ReplaceBackupFile(szTempFile, OutputFile);
+}
+
+bool CSQLHelper::CompressFile(const std::string& InputFile, const std::string& OutputFile)
+{
+	FILE* fIn = fopen(InputFile.c_str(), "rb");
+	if (fIn == NULL)
+		return false;
+	//the previous backup is only replaced once the compressed file is complete
+	std::string szTempFile = OutputFile + ".tmp";
+	gzFile fOut = gzopen(szTempFile.c_str(), "wb6");
+	if (fOut == NULL)
+	{
+		_log.Log(LOG_ERROR, "Backup Database: Could not create %s", szTempFile.c_str());
+		fclose(fIn);
+		return false;
+	}
+	bool bResult = true;
+	std::vector<char> buffer(64 * 1024);
+	size_t len;
+	while ((len = fread(buffer.data(), 1, buffer.size(), fIn)) > 0)
+	{
+		if (gzwrite(fOut, buffer.data(), (unsigned)len) != (int)len)
+		{
+			bResult = false;
+			break;
+		}
+	}
+	if (ferror(fIn))
+		bResult = false;
+	fclose(fIn);
+	if (gzclose(fOut) != Z_OK)
+		bResult = false;
+	if (!bResult)
+	{
+		_log.Log(LOG_ERROR, "Backup Database: Error writing %s", szTempFile.c_str());
+		std::remove(szTempFile.c_str());
+		return false;
+	}
+	return ReplaceBackupFile(szTempFile, OutputFile);
 }
 
 uint64_t CSQLHelper::UpdateValueLighting2GroupCmd(const int HardwareID, const char* ID, const unsigned char unit,
@@ -1,16 +1,25 @@
 #pragma once
 
 #include <string>
+#include <functional>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <type_traits>
 #include "RFXNames.h"
 #include "../hardware/hardwaretypes.h"
 #include "Helper.h"
 #include "../httpclient/UrlEncode.h"
 #include "../httpclient/HTTPClient.h"
 #include "StoppableTask.h"
+#include "DeviceStatusCache.h"
+#include "ChangeJournal.h"
+#include "TimeSeriesStore.h"
 
 #define timer_resolution_hz 25
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 enum _eWindUnit
 {
@@ -299,6 +308,28 @@ typedef   std::vector<std::string> TSqlRowQuery;
 // result for an sql query : Vector of TSqlRowQuery
 typedef   std::vector<TSqlRowQuery> TSqlQueryResult;
 
+//Typed view on the current row of a running statement, no copies are made.
+//Returned text pointers are only valid until the next row is stepped
+class CSQLRow
+{
+public:
+	explicit CSQLRow(sqlite3_stmt *statement) : m_statement(statement) {}
+	int ColumnCount() const;
+	bool IsNull(const int col) const;
+	int GetInt(const int col) const;
+	int64_t GetInt64(const int col) const;
+	uint64_t GetUInt64(const int col) const;
+	double GetDouble(const int col) const;
+	const char* GetText(const int col) const; //never NULL, empty for NULL columns
+	int GetTextLength(const int col) const;
+	std::string GetString(const int col) const;
+private:
+	sqlite3_stmt *m_statement;
+};
+
+//Called for each row, return false to stop stepping
+typedef std::function<bool(const CSQLRow &row)> TSqlRowCallback;
+
 class CSQLHelper : public StoppableTask
 {
 public:
@@ -310,7 +341,8 @@ public:
 	bool OpenDatabase();
 	void CloseDatabase();
 
-	bool BackupDatabase(const std::string &OutputFile);
+	//Online backup, the database stays usable while it runs. bCompress writes a gzip file
+	bool BackupDatabase(const std::string &OutputFile, const bool bCompress = false);
 	bool RestoreDatabase(const std::string &dbase);
 
 	//Returns DeviceRowID
@@ -326,6 +358,11 @@ public:
 
 	bool GetLastValue(const int HardwareID, const char* DeviceID, const unsigned char unit, const unsigned char devType, const unsigned char subType, int &nvalue, std::string &sValue, struct tm &LastUpdateTime);
 
+	//DeviceStatus rows served from the in-memory device table
+	bool GetDeviceStatusRow(const uint64_t idx, _tDeviceStatusRow &row);
+	bool GetDeviceStatusRow(const int HardwareID, const std::string &DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow &row);
+	void GetDeviceStatusRows(std::vector<_tDeviceStatusRow> &rows);
+
 	void Lighting2GroupCmd(const std::string &ID, const unsigned char subType, const unsigned char GroupCmd);
 	void HomeConfortGroupCmd(const std::string &ID, const unsigned char subType, const unsigned char GroupCmd);
 	void GeneralSwitchGroupCmd(const std::string &ID, const unsigned char subType, const unsigned char GroupCmd);
@@ -395,6 +432,99 @@ public:
 	std::vector<std::vector<std::string> > safe_query(const char *fmt, ...);
 	std::vector<std::vector<std::string> > safe_queryBlob(const char *fmt, ...);
 	void safe_exec_no_return(const char *fmt, ...);
+
+	//Prepared (and cached) statements with '?' parameters, rows are handed to the callback while stepping.
+	//The callback runs with the database locked, it should not query the database itself
+	template<typename... Args>
+	bool bind_query(const TSqlRowCallback &callback, const char *szQuery, const Args&... args)
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		sqlite3_stmt *statement = GetCachedStatement(szQuery);
+		if (statement == NULL)
+			return false;
+		BindParams(statement, 1, args...);
+		CommitGroupBeforeWrite(statement);
+		return StepStatement(statement, szQuery, &callback);
+	}
+	template<typename... Args>
+	bool bind_exec(const char *szQuery, const Args&... args)
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		sqlite3_stmt *statement = GetCachedStatement(szQuery);
+		if (statement == NULL)
+			return false;
+		BindParams(statement, 1, args...);
+		CommitGroupBeforeWrite(statement);
+		return StepStatement(statement, szQuery, NULL);
+	}
+	//Like bind_exec, but the commit is shared with other grouped writes (see CommitWrites),
+	//szTable/DeviceRowID name the rows the statement writes
+	template<typename... Args>
+	bool bind_exec_grouped(const char *szTable, const uint64_t DeviceRowID, const char *szQuery, const Args&... args)
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		sqlite3_stmt *statement = GetCachedStatement(szQuery);
+		if (statement == NULL)
+			return false;
+		BindParams(statement, 1, args...);
+		BeginGroupTransaction();
+		bool bRet = StepStatement(statement, szQuery, NULL);
+		AddGroupStatement(szTable, DeviceRowID);
+		return bRet;
+	}
+	//Returns the number of rows changed by the statement, -1 on error
+	template<typename... Args>
+	int bind_exec_changes(const char *szQuery, const Args&... args)
+	{
+		std::lock_guard<std::mutex> l(m_sqlQueryMutex);
+		sqlite3_stmt *statement = GetCachedStatement(szQuery);
+		if (statement == NULL)
+			return -1;
+		BindParams(statement, 1, args...);
+		CommitGroupBeforeWrite(statement);
+		if (!StepStatement(statement, szQuery, NULL))
+			return -1;
+		return GetChanges();
+	}
+	//Durability barrier, commits the grouped writes now instead of waiting for the writer thread
+	void CommitWrites();
+	//Commits the grouped writes only when they hold rows of the device in szTable
+	void CommitWrites(const std::string &szTable, const uint64_t DeviceRowID);
+
+	//Read-only queries on a pooled connection (WAL mode), they do not wait for the writer and do not block it.
+	//Grouped writes become visible to these once they are committed, call CommitWrites(table, device) first when the last values are needed
+	std::vector<std::vector<std::string> > safe_query_read(const char *fmt, ...);
+	template<typename... Args>
+	bool bind_query_read(const TSqlRowCallback &callback, const char *szQuery, const Args&... args)
+	{
+		CReadConnection connection(this);
+		if (!connection.IsOpen())
+			return bind_query(callback, szQuery, args...);
+		sqlite3_stmt *statement = connection.Prepare(szQuery);
+		if (statement == NULL)
+			return false;
+		BindParams(statement, 1, args...);
+		return StepStatement(statement, szQuery, &callback);
+	}
+	//Same result layout as safe_query, for statements that are executed often
+	template<typename... Args>
+	std::vector<std::vector<std::string> > safe_bind_query(const char *szQuery, const Args&... args)
+	{
+		std::vector<std::vector<std::string> > results;
+		bind_query([&results](const CSQLRow &row) {
+			AddResultRow(row, results);
+			return true;
+		}, szQuery, args...);
+		return results;
+	}
+	void GetStatementCacheStats(uint64_t &hits, uint64_t &misses, size_t &entries);
+
+	//Temperature short log, from the Temperature table or from the segment store (ShortLogStore preference).
+	//Rows: Temperature, Chill, Humidity, Barometer, Date, DewPoint, SetPoint
+	std::vector<std::vector<std::string> > GetTemperatureLog(const uint64_t idx, const std::string &szDateStart, const std::string &szDateEnd);
+	//MIN(Temperature), MAX(Temperature), AVG(Temperature), MIN(Chill), MAX(Chill), AVG(Humidity), AVG(Barometer),
+	//MIN(DewPoint), MIN(SetPoint), MAX(SetPoint), AVG(SetPoint). An empty szDateEnd has no upper limit
+	std::vector<std::string> GetTemperatureLogStats(const uint64_t idx, const std::string &szDateStart, const std::string &szDateEnd);
 	bool safe_UpdateBlobInTableWithID(const std::string &Table, const std::string &Column, const std::string &sID, const std::string &BlobData);
 	bool DoesColumnExistsInTable(const std::string &columnname, const std::string &tablename);
 
@@ -444,9 +574,16 @@ public:
 	int			m_ShortLogInterval;
 	bool		m_bLogEventScriptTrigger;
 	bool		m_bDisableDzVentsSystem;
+	CChangeJournal	m_changejournal;	//device, scene and variable changes for polling clients
+
+	//Called by the sqlite update hook, should never query the database
+	void OnRowUpdated(const bool bDeleted, const char *tableName, const uint64_t rowID);
 private:
 	std::mutex		m_sqlQueryMutex;
 	sqlite3			*m_dbase;
+	CDeviceStatusCache	m_devicestatuscache;
+	CTimeSeriesStore	m_temperatureStore;	//only open when the temperature short log is not kept in SQLite
+	std::mutex		m_devicestatuscacheMutex;
 	std::string		m_dbase_name;
 	unsigned char	m_sensortimeoutcounter;
 	std::map<uint64_t, int> m_timeoutlastsend;
@@ -462,12 +599,41 @@ private:
 	void StopThread();
 	void Do_Work();
 
+	//Group commit, grouped writes share one transaction that the writer thread commits
+	//every m_groupCommitInterval ms, or when m_groupCommitStatements writes are pending
+	std::shared_ptr<std::thread> m_writer_thread;
+	std::mutex m_writer_mutex;
+	std::condition_variable m_writer_cond;
+	bool m_bStopWriter;
+	bool m_bGroupTransaction;	//guarded by m_sqlQueryMutex
+	int m_groupStatements;		//guarded by m_sqlQueryMutex
+	std::chrono::steady_clock::time_point m_groupStart;	//guarded by m_sqlQueryMutex
+	std::set<std::pair<std::string, uint64_t> > m_groupRows;	//table/device written by the open group, guarded by m_sqlQueryMutex
+	int m_groupCommitInterval;
+	int m_groupCommitStatements;
+	void StartWriterThread();
+	void StopWriterThread();
+	void Do_Writer_Work();
+	//Called with m_sqlQueryMutex locked
+	void BeginGroupTransaction();
+	void AddGroupStatement(const char *szTable, const uint64_t DeviceRowID);
+	void CommitGroupTransaction();
+	//Only the device update/log writes (bind_exec_grouped) are grouped, other writes commit
+	//the open group first so they are durable when they return
+	void CommitGroupBeforeWrite(sqlite3_stmt *statement);
+	bool CompressFile(const std::string &InputFile, const std::string &OutputFile);
+
 	bool SwitchLightFromTasker(const std::string &idx, const std::string &switchcmd, const std::string &level, const std::string &color, const std::string& User);
 	bool SwitchLightFromTasker(uint64_t idx, const std::string &switchcmd, int level, _tColor color, const std::string& User);
 
 	void FixDaylightSavingTableSimple(const std::string &TableName);
 	void FixDaylightSaving();
 
+	void RefreshDeviceStatusCache();
+	bool FindCachedDeviceStatusRow(const int HardwareID, const std::string &DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow &row, uint32_t &generation);
+	bool QueryDeviceStatusRow(const uint64_t idx, _tDeviceStatusRow &row);
+	bool QueryDeviceStatusRow(const int HardwareID, const std::string &DeviceID, const int unit, const int devType, const int subType, _tDeviceStatusRow &row);
+
 	//Returns DeviceRowID
 	uint64_t UpdateValueInt(const int HardwareID, const char* ID, const unsigned char unit, const unsigned char devType, const unsigned char subType, const unsigned char signallevel, const unsigned char batterylevel, const int nValue, const char* sValue, std::string &devname, const bool bUseOnOffAction);
 
@@ -513,6 +679,10 @@ private:
 	void AddCalendarUpdatePercentage();
 	void AddCalendarUpdateFan();
 	void CleanupShortLog();
+	int CleanupShortLogTable(const std::string &TableName, const std::string &szCutoffDate);
+	void OpenShortLogStore();
+	void CloseShortLogStore();
+	int CopyShortLogStore(sqlite3 *db, const int nHistoryDays);
 	bool CheckDate(const std::string &sDate, int &d, int &m, int &y);
 	bool CheckDateSQL(const std::string &sDate);
 	bool CheckDateTimeSQL(const std::string &sDateTime);
@@ -520,6 +690,71 @@ private:
 
 	std::vector<std::vector<std::string> > query(const std::string &szQuery);
 	std::vector<std::vector<std::string> > queryBlob(const std::string &szQuery);
+
+	static void AddResultRow(const CSQLRow &row, std::vector<std::vector<std::string> > &results);
+
+	std::vector<std::vector<std::string> > queryRead(const std::string &szQuery);
+
+	//Borrows a connection from the read pool for its lifetime
+	class CReadConnection
+	{
+	public:
+		explicit CReadConnection(CSQLHelper *pSQLHelper);
+		~CReadConnection();
+		bool IsOpen() const { return (m_dbase != NULL); }
+		sqlite3_stmt *Prepare(const char *szQuery);
+	private:
+		CSQLHelper *m_pSQLHelper;
+		sqlite3 *m_dbase;
+		int m_generation;
+		std::vector<sqlite3_stmt*> m_statements;
+	};
+	sqlite3 *AcquireReadConnection(int &generation);
+	void ReleaseReadConnection(sqlite3 *dbase, const int generation);
+	void OpenReadPool();
+	void CloseReadPool();
+
+	std::mutex m_readPoolMutex;
+	std::condition_variable m_readPoolCond;
+	std::vector<sqlite3*> m_readPool;	//idle connections
+	int m_readPoolOpen;			//idle and borrowed connections
+	int m_readPoolGeneration;	//bumped when the pool is closed, older connections are not returned to it
+	bool m_bReadPoolEnabled;
+
+	//Prepared statement cache, called with m_sqlQueryMutex locked
+	sqlite3_stmt *GetCachedStatement(const char *szQuery);
+	void FinalizeStatements();
+	bool StepStatement(sqlite3_stmt *statement, const char *szQuery, const TSqlRowCallback *pCallback);
+	int GetChanges();
+
+	void BindParams(sqlite3_stmt *statement, const int index) {}
+	template<typename T, typename... Args>
+	void BindParams(sqlite3_stmt *statement, const int index, const T &value, const Args&... args)
+	{
+		BindParam(statement, index, value);
+		BindParams(statement, index + 1, args...);
+	}
+	template<typename T>
+	typename std::enable_if<std::is_integral<T>::value>::type BindParam(sqlite3_stmt *statement, const int index, const T value)
+	{
+		BindInt64(statement, index, static_cast<int64_t>(value));
+	}
+	template<typename T>
+	typename std::enable_if<std::is_floating_point<T>::value>::type BindParam(sqlite3_stmt *statement, const int index, const T value)
+	{
+		BindDouble(statement, index, static_cast<double>(value));
+	}
+	void BindParam(sqlite3_stmt *statement, const int index, const std::string &value);
+	void BindParam(sqlite3_stmt *statement, const int index, const char *value);
+	void BindInt64(sqlite3_stmt *statement, const int index, const int64_t value);
+	void BindDouble(sqlite3_stmt *statement, const int index, const double value);
+
+	//Prepared statements keyed by query text, most recently used first
+	typedef std::list<std::pair<std::string, sqlite3_stmt*> > TStatementList;
+	TStatementList m_statements;
+	std::map<std::string, TStatementList::iterator> m_statementIndex;
+	uint64_t m_statementCacheHits;
+	uint64_t m_statementCacheMisses;
 };
 
 extern CSQLHelper m_sql;
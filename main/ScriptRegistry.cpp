@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include "ScriptRegistry.h"
+#include "Helper.h"
+#include "Logger.h"
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#define SCRIPT_WATCH_MASK (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+CScriptRegistry::CScriptRegistry() :
+	m_inotifyFD(-1)
+{
+}
+
+CScriptRegistry::~CScriptRegistry()
+{
+	Stop();
+}
+
+bool CScriptRegistry::Start()
+{
+	Stop();
+#if defined(__linux__)
+	m_inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotifyFD < 0)
+	{
+		_log.Log(LOG_STATUS, "EventSystem: inotify not available, script directories will be polled");
+		return false;
+	}
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (auto & itt : m_dirs)
+		{
+			AddWatch(itt.second);
+			itt.second.bDirty = true;
+		}
+	}
+	RequestStart();
+	m_thread = std::make_shared<std::thread>(&CScriptRegistry::Do_Work, this);
+	SetThreadName(m_thread->native_handle(), "ScriptRegistry");
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CScriptRegistry::Stop()
+{
+	if (m_thread)
+	{
+		RequestStop();
+		m_thread->join();
+		m_thread.reset();
+	}
+	std::lock_guard<std::mutex> l(m_mutex);
+	for (auto & itt : m_dirs)
+		RemoveWatch(itt.second);
+#if defined(__linux__)
+	if (m_inotifyFD >= 0)
+	{
+		close(m_inotifyFD);
+		m_inotifyFD = -1;
+	}
+#endif
+}
+
+void CScriptRegistry::SetDirectory(const int dirID, const std::string &dir, const std::string &extension)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<int, _tScriptDir>::iterator itt = m_dirs.find(dirID);
+	if (itt != m_dirs.end())
+	{
+		if ((itt->second.dir == dir) && (itt->second.extension == extension))
+			return;
+		RemoveWatch(itt->second);
+		m_dirs.erase(itt);
+	}
+	_tScriptDir sdir;
+	sdir.dir = dir;
+	sdir.extension = extension;
+	sdir.scripts = std::make_shared<std::vector<_tScriptFile> >();
+	sdir.bDirty = true;
+	sdir.mtime = 0;
+	sdir.scanTime = 0;
+	sdir.wd = -1;
+	sdir.generation = 1;
+	AddWatch(sdir);
+	m_dirs[dirID] = sdir;
+}
+
+CScriptRegistry::TScriptList CScriptRegistry::GetScripts(const int dirID)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<int, _tScriptDir>::iterator itt = m_dirs.find(dirID);
+	if (itt == m_dirs.end())
+		return std::make_shared<std::vector<_tScriptFile> >();
+	_tScriptDir &sdir = itt->second;
+	if (sdir.wd < 0)
+	{
+		//Not watched (yet), re-read when the directory changed or was changed during our last read
+		struct stat st;
+		time_t mtime = (stat(sdir.dir.c_str(), &st) == 0) ? st.st_mtime : 0;
+		if ((mtime != sdir.mtime) || (mtime >= sdir.scanTime))
+		{
+			sdir.bDirty = true;
+			sdir.mtime = mtime;
+		}
+		if (mtime != 0)
+			AddWatch(sdir);
+	}
+	if (sdir.bDirty)
+		Scan(sdir);
+	return sdir.scripts;
+}
+
+uint32_t CScriptRegistry::GetGeneration(const int dirID)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::map<int, _tScriptDir>::const_iterator itt = m_dirs.find(dirID);
+	if ((itt == m_dirs.end()) || (itt->second.wd < 0))
+		return 0;
+	return itt->second.generation;
+}
+
+void CScriptRegistry::Scan(_tScriptDir &sdir)
+{
+	sdir.bDirty = false;
+	sdir.scanTime = time(NULL);
+
+	std::vector<std::string> FileEntries;
+	DirectoryListing(FileEntries, sdir.dir, false, true);
+
+	std::shared_ptr<std::vector<_tScriptFile> > scripts = std::make_shared<std::vector<_tScriptFile> >();
+	scripts->reserve(FileEntries.size());
+	const size_t extLen = sdir.extension.length();
+	for (const auto & itt : FileEntries)
+	{
+		if ((itt.length() <= extLen) || (itt.compare(itt.length() - extLen, extLen, sdir.extension) != 0))
+			continue;
+
+		_tScriptFile sfile;
+		sfile.filename = itt;
+		sfile.bDemo = (itt.find("_demo" + sdir.extension) != std::string::npos);
+		sfile.triggers = 0;
+		if (itt.find("_device_") != std::string::npos)
+			sfile.triggers |= TRIGGER_DEVICE;
+		if (itt.find("_time_") != std::string::npos)
+			sfile.triggers |= TRIGGER_TIME;
+		if (itt.find("_security_") != std::string::npos)
+			sfile.triggers |= TRIGGER_SECURITY;
+		if (itt.find("_notification_") != std::string::npos)
+			sfile.triggers |= TRIGGER_NOTIFICATION;
+		if (itt.find("_variable_") != std::string::npos)
+			sfile.triggers |= TRIGGER_VARIABLE;
+
+		size_t pos = itt.find("_device_");
+		while (pos != std::string::npos)
+		{
+			sfile.deviceNames.push_back(itt.substr(pos + 8, itt.length() - extLen - (pos + 8)));
+			pos = itt.find("_device_", pos + 1);
+		}
+		scripts->push_back(sfile);
+	}
+	sdir.scripts = scripts;
+}
+
+void CScriptRegistry::AddWatch(_tScriptDir &sdir)
+{
+#if defined(__linux__)
+	if ((m_inotifyFD < 0) || (sdir.wd >= 0))
+		return;
+	std::string dir = sdir.dir;
+	if ((dir.length() > 1) && (dir[dir.length() - 1] == '/'))
+		dir = dir.substr(0, dir.length() - 1);
+	sdir.wd = inotify_add_watch(m_inotifyFD, dir.c_str(), SCRIPT_WATCH_MASK);
+	if (sdir.wd >= 0)
+	{
+		sdir.bDirty = true;
+		if (++sdir.generation == 0)
+			sdir.generation = 1;
+	}
+#endif
+}
+
+void CScriptRegistry::RemoveWatch(_tScriptDir &sdir)
+{
+#if defined(__linux__)
+	if ((m_inotifyFD >= 0) && (sdir.wd >= 0))
+		inotify_rm_watch(m_inotifyFD, sdir.wd);
+#endif
+	sdir.wd = -1;
+}
+
+void CScriptRegistry::Do_Work()
+{
+#if defined(__linux__)
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	while (!IsStopRequested(0))
+	{
+		struct pollfd pfd;
+		pfd.fd = m_inotifyFD;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+		ssize_t len = read(m_inotifyFD, buffer, sizeof(buffer));
+		if (len <= 0)
+			continue;
+
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (char *ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len)
+		{
+			const struct inotify_event *event = (const struct inotify_event*)ptr;
+			for (auto & itt : m_dirs)
+			{
+				if ((event->mask & IN_Q_OVERFLOW) || (itt.second.wd == event->wd))
+				{
+					if (++itt.second.generation == 0)
+						itt.second.generation = 1;
+					if ((event->mask & IN_CLOSE_WRITE) == 0)
+						itt.second.bDirty = true; //listing changed
+					if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+						RemoveWatch(itt.second); //directory is gone, poll until it is back
+				}
+			}
+		}
+	}
+#endif
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "StoppableTask.h"
+
+//Listing of the script directories used by the event system.
+//Directories are watched with inotify when available, otherwise they are read again
+//when their modification time changes, so dispatching an event does not need a readdir.
+class CScriptRegistry : public StoppableTask
+{
+public:
+	enum _eScriptTrigger
+	{
+		TRIGGER_DEVICE = 0x01,
+		TRIGGER_TIME = 0x02,
+		TRIGGER_SECURITY = 0x04,
+		TRIGGER_NOTIFICATION = 0x08,
+		TRIGGER_VARIABLE = 0x10,
+	};
+	struct _tScriptFile
+	{
+		std::string filename;
+		int triggers;							//_eScriptTrigger flags, from the file name
+		bool bDemo;								//xxx_demo.ext files are never executed
+		std::vector<std::string> deviceNames;	//everything following '_device_' (without extension)
+	};
+	typedef std::shared_ptr<const std::vector<_tScriptFile> > TScriptList;
+
+	CScriptRegistry();
+	~CScriptRegistry();
+
+	bool Start();
+	void Stop();
+
+	void SetDirectory(const int dirID, const std::string &dir, const std::string &extension);
+	//Current scripts in the directory, the returned list is never modified
+	TScriptList GetScripts(const int dirID);
+	//Changes on every add/remove/write in a watched directory, 0 when the directory is not watched
+	uint32_t GetGeneration(const int dirID);
+private:
+	struct _tScriptDir
+	{
+		std::string dir;
+		std::string extension;
+		TScriptList scripts;
+		bool bDirty;
+		time_t mtime;
+		time_t scanTime;
+		int wd;
+		uint32_t generation;
+	};
+	void Scan(_tScriptDir &sdir);
+	void AddWatch(_tScriptDir &sdir);
+	void RemoveWatch(_tScriptDir &sdir);
+	void Do_Work();
+
+	std::mutex m_mutex;
+	std::map<int, _tScriptDir> m_dirs;
+	std::shared_ptr<std::thread> m_thread;
+	int m_inotifyFD;
+};
@@ -428,6 +428,7 @@ void signal_handler(int sig_num
 		tid = syscall(__NR_gettid);
 #endif
 		if (fatal_handling) {
+			_log.StopAsyncFatal();
 #if defined(__GLIBC__)
 			_log.Log(LOG_ERROR, "Domoticz(pid:%d, tid:%ld('%s')) received fatal signal %d (%s) while backtracing", getpid(), tid, thread_name, sig_num
 #else
@@ -459,6 +460,8 @@ void signal_handler(int sig_num
 #ifndef WIN32
 		fatal_handling_thread = pthread_self();
 #endif
+		// the log sink thread will not get to write the banner and stack trace
+		_log.StopAsyncFatal();
 		_log.Log(LOG_ERROR, "Domoticz(pid:%d, tid:%ld('%s')) received fatal signal %d (%s)", getpid(), tid, thread_name, sig_num
 #ifndef WIN32
 			, strsignal(sig_num));
@@ -477,6 +480,7 @@ void signal_handler(int sig_num
 	case SIGUSR1:
 		fatal_handling = 1;
 		fatal_handling_thread = pthread_self();
+		_log.StopAsyncFatal();
 		_log.Log(LOG_ERROR, "Domoticz(%d) is exiting due to watchdog triggered...", getpid());
 		// Print call stack of all threads to aid debugging of deadlock
 		dumpstack_gdb(true);
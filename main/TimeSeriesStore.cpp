@@ -0,0 +1,569 @@
+#include "stdafx.h"
+#include "TimeSeriesStore.h"
+#include "Helper.h"
+#include "Logger.h"
+#include "localtime_r.h"
+#include <algorithm>
+#include <cstring>
+#include <inttypes.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define TS_MAGIC "DZTS"
+#define TS_VERSION 1
+#define TS_HEADER_SIZE 16
+#define TS_EXTENSION ".seg"
+
+//Read-only view of a complete segment file, memory mapped where possible
+class CSegmentView
+{
+public:
+	explicit CSegmentView(const std::string &filename) :
+		m_data(NULL),
+		m_size(0)
+	{
+#ifndef WIN32
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		struct stat st;
+		if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+		{
+			void *pMap = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (pMap != MAP_FAILED)
+			{
+				m_data = (const uint8_t*)pMap;
+				m_size = (size_t)st.st_size;
+			}
+		}
+		close(fd);
+#else
+		FILE *fIn = fopen(filename.c_str(), "rb");
+		if (fIn == NULL)
+			return;
+		char buffer[4096];
+		size_t len;
+		while ((len = fread(buffer, 1, sizeof(buffer), fIn)) > 0)
+			m_buffer.append(buffer, len);
+		fclose(fIn);
+		m_data = (const uint8_t*)m_buffer.data();
+		m_size = m_buffer.size();
+#endif
+	}
+	~CSegmentView()
+	{
+#ifndef WIN32
+		if (m_data != NULL)
+			munmap((void*)m_data, m_size);
+#endif
+	}
+	const uint8_t *Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+private:
+	const uint8_t *m_data;
+	size_t m_size;
+#ifdef WIN32
+	std::string m_buffer;
+#endif
+};
+
+static int DayKey(const time_t time)
+{
+	struct tm ltime;
+	localtime_r(&time, &ltime);
+	return ((ltime.tm_year + 1900) * 10000) + ((ltime.tm_mon + 1) * 100) + ltime.tm_mday;
+}
+
+//Calls dayFunction for every day between from and to
+static void ForEachDay(const time_t from, const time_t to, const std::function<void(const int day)> &dayFunction)
+{
+	int lastDay = DayKey(to);
+	struct tm ltime;
+	localtime_r(&from, &ltime);
+	for (int offset = 0; ; offset++)
+	{
+		time_t noon;
+		struct tm tm2;
+		getNoon(noon, tm2, ltime.tm_year + 1900, ltime.tm_mon + 1, ltime.tm_mday + offset);
+		int day = DayKey(noon);
+		if (day > lastDay)
+			break;
+		dayFunction(day);
+	}
+}
+
+static void PutVarint(std::string &buffer, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		buffer += (char)((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	buffer += (char)value;
+}
+
+static bool GetVarint(const uint8_t *&ptr, const uint8_t *end, uint64_t &value)
+{
+	value = 0;
+	for (int shift = 0; (ptr < end) && (shift < 64); shift += 7)
+	{
+		uint8_t b = *ptr++;
+		value |= (uint64_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+static uint64_t DoubleBits(const double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double BitsDouble(const uint64_t bits)
+{
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+CTimeSeriesStore::CTimeSeriesStore() :
+	m_nColumns(0)
+{
+}
+
+bool CTimeSeriesStore::Open(const std::string &dir, const int nColumns)
+{
+	if ((nColumns < 1) || (nColumns > TS_MAX_COLUMNS))
+		return false;
+	mkdir_deep(dir.c_str(), 0755);
+	struct stat st;
+	if ((stat(dir.c_str(), &st) != 0) || ((st.st_mode & S_IFDIR) == 0))
+	{
+		_log.Log(LOG_ERROR, "TimeSeriesStore: Could not create directory %s", dir.c_str());
+		return false;
+	}
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_dir = dir;
+	m_nColumns = nColumns;
+	m_writers.clear();
+	return true;
+}
+
+void CTimeSeriesStore::Close()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_dir.clear();
+	m_writers.clear();
+}
+
+std::string CTimeSeriesStore::SegmentName(const int day, const uint64_t id)
+{
+	char szName[64];
+	sprintf(szName, "%08d-%" PRIu64 TS_EXTENSION, day, id);
+	return m_dir + szName;
+}
+
+void CTimeSeriesStore::ListSegments(std::vector<_tSegment> &segments)
+{
+	std::vector<std::string> files;
+	DirectoryListing(files, m_dir, false, true);
+	for (const auto & itt : files)
+	{
+		_tSegment segment;
+		char szExtension[8] = { 0 };
+		if (sscanf(itt.c_str(), "%8d-%" SCNu64 "%7s", &segment.day, &segment.id, szExtension) != 3)
+			continue;
+		if (strcmp(szExtension, TS_EXTENSION) != 0)
+			continue;
+		segment.filename = m_dir + itt;
+		segments.push_back(segment);
+	}
+}
+
+//Decodes a segment, stops at the first incomplete sample (an interrupted append).
+//When pState is given it receives what is needed to append to the segment
+bool CTimeSeriesStore::ReadSegment(const std::string &filename, const TSampleCallback &callback, _tWriteState *pState)
+{
+	CSegmentView view(filename);
+	const uint8_t *ptr = view.Data();
+	if ((ptr == NULL) || (view.Size() < TS_HEADER_SIZE) || (memcmp(ptr, TS_MAGIC, 4) != 0) || (ptr[4] != TS_VERSION) || (ptr[5] != m_nColumns))
+		return false;
+	const uint8_t *end = ptr + view.Size();
+
+	int64_t baseTime = 0;
+	for (int ii = 7; ii >= 0; ii--)
+		baseTime = (baseTime << 8) | ptr[8 + ii];
+	ptr += TS_HEADER_SIZE;
+
+	_tSample sample;
+	memset(&sample, 0, sizeof(sample));
+	sample.time = (time_t)baseTime;
+	int64_t lastDelta = 0;
+	size_t validSize = TS_HEADER_SIZE;
+	while (ptr < end)
+	{
+		uint64_t zigzag;
+		if (!GetVarint(ptr, end, zigzag))
+			break;
+		int64_t delta = lastDelta + (int64_t)((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+		if (ptr >= end)
+			break;
+		uint8_t mask = *ptr++;
+		bool bComplete = true;
+		double values[TS_MAX_COLUMNS];
+		for (int col = 0; col < m_nColumns; col++)
+		{
+			values[col] = sample.values[col];
+			if ((mask & (1 << col)) == 0)
+				continue;
+			if (ptr >= end)
+			{
+				bComplete = false;
+				break;
+			}
+			int lead = *ptr >> 4;
+			int trail = *ptr & 0x0F;
+			int len = 8 - lead - trail;
+			ptr++;
+			if ((len <= 0) || (ptr + len > end))
+			{
+				bComplete = false;
+				break;
+			}
+			uint64_t xorBits = 0;
+			for (int ii = 0; ii < len; ii++)
+				xorBits = (xorBits << 8) | *ptr++;
+			xorBits <<= (trail * 8);
+			values[col] = BitsDouble(DoubleBits(values[col]) ^ xorBits);
+		}
+		if (!bComplete)
+			break;
+		lastDelta = delta;
+		sample.time += (time_t)delta;
+		memcpy(sample.values, values, sizeof(values));
+		validSize = ptr - view.Data();
+		if (callback)
+			callback(sample);
+	}
+	if (pState != NULL)
+	{
+		pState->size = validSize;
+		pState->lastTime = sample.time;
+		pState->lastDelta = lastDelta;
+		memcpy(pState->lastValues, sample.values, sizeof(pState->lastValues));
+	}
+	return true;
+}
+
+void CTimeSeriesStore::EncodeSample(std::string &buffer, const _tSample &sample, _tWriteState &state)
+{
+	int64_t delta = (int64_t)(sample.time - state.lastTime);
+	int64_t dod = delta - state.lastDelta;
+	PutVarint(buffer, ((uint64_t)dod << 1) ^ (uint64_t)(dod >> 63));
+	state.lastDelta = delta;
+	state.lastTime = sample.time;
+
+	size_t maskPos = buffer.size();
+	uint8_t mask = 0;
+	buffer += (char)0;
+	for (int col = 0; col < m_nColumns; col++)
+	{
+		uint64_t xorBits = DoubleBits(sample.values[col]) ^ DoubleBits(state.lastValues[col]);
+		state.lastValues[col] = sample.values[col];
+		if (xorBits == 0)
+			continue;
+		mask |= (1 << col);
+		int lead = 0;
+		while ((xorBits >> (56 - lead * 8)) == 0)
+			lead++;
+		int trail = 0;
+		while (((xorBits >> (trail * 8)) & 0xFF) == 0)
+			trail++;
+		buffer += (char)((lead << 4) | trail);
+		for (int ii = 7 - lead; ii >= trail; ii--)
+			buffer += (char)((xorBits >> (ii * 8)) & 0xFF);
+	}
+	buffer[maskPos] = (char)mask;
+}
+
+//Writes a complete segment (samples sorted by time), an empty list removes it
+bool CTimeSeriesStore::WriteSegment(const std::string &filename, const std::vector<_tSample> &samples)
+{
+	if (samples.empty())
+	{
+		std::remove(filename.c_str());
+		return true;
+	}
+	std::string buffer(TS_MAGIC);
+	buffer += (char)TS_VERSION;
+	buffer += (char)m_nColumns;
+	buffer += (char)0;
+	buffer += (char)0;
+	int64_t baseTime = (int64_t)samples[0].time;
+	for (int ii = 0; ii < 8; ii++)
+		buffer += (char)((baseTime >> (ii * 8)) & 0xFF);
+
+	_tWriteState state;
+	memset(&state, 0, sizeof(state));
+	state.lastTime = samples[0].time;
+	for (const auto & itt : samples)
+		EncodeSample(buffer, itt, state);
+
+	std::string szTempFile = filename + ".tmp";
+	FILE *fOut = fopen(szTempFile.c_str(), "wb");
+	if (fOut == NULL)
+	{
+		_log.Log(LOG_ERROR, "TimeSeriesStore: Could not write %s", szTempFile.c_str());
+		return false;
+	}
+	bool bResult = (fwrite(buffer.data(), 1, buffer.size(), fOut) == buffer.size());
+	if (fclose(fOut) != 0)
+		bResult = false;
+	if (bResult)
+	{
+		std::remove(filename.c_str()); //rename does not overwrite on Windows
+		bResult = (std::rename(szTempFile.c_str(), filename.c_str()) == 0);
+	}
+	if (!bResult)
+	{
+		_log.Log(LOG_ERROR, "TimeSeriesStore: Could not write %s", filename.c_str());
+		std::remove(szTempFile.c_str());
+	}
+	return bResult;
+}
+
+bool CTimeSeriesStore::Append(const uint64_t id, const time_t time, const double *values)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (m_dir.empty())
+		return false;
+	int day = DayKey(time);
+	std::string filename = SegmentName(day, id);
+	std::map<uint64_t, _tWriteState>::iterator itt = m_writers.find(id);
+	if ((itt == m_writers.end()) || (itt->second.day != day))
+	{
+		_tWriteState state;
+		memset(&state, 0, sizeof(state));
+		state.day = day;
+		struct stat st;
+		if (stat(filename.c_str(), &st) == 0)
+		{
+			std::vector<_tSample> samples;
+			if (!ReadSegment(filename, [&samples](const _tSample &sample) { samples.push_back(sample); }, &state))
+			{
+				_log.Log(LOG_ERROR, "TimeSeriesStore: %s is not a valid segment, starting a new one", filename.c_str());
+				std::remove(filename.c_str());
+			}
+			else if ((uint64_t)st.st_size != state.size)
+			{
+				//drop the partial sample of an interrupted append
+				WriteSegment(filename, samples);
+				ReadSegment(filename, NULL, &state);
+			}
+		}
+		if (!file_exist(filename.c_str()))
+		{
+			std::vector<_tSample> samples;
+			_tSample sample;
+			sample.time = time;
+			memcpy(sample.values, values, m_nColumns * sizeof(double));
+			samples.push_back(sample);
+			if (!WriteSegment(filename, samples))
+				return false;
+			ReadSegment(filename, NULL, &state);
+			m_writers[id] = state;
+			return true;
+		}
+		m_writers[id] = state;
+		itt = m_writers.find(id);
+	}
+
+	_tWriteState &state = itt->second;
+	_tSample sample;
+	sample.time = time;
+	memcpy(sample.values, values, m_nColumns * sizeof(double));
+	std::string buffer;
+	EncodeSample(buffer, sample, state);
+
+	FILE *fOut = fopen(filename.c_str(), "ab");
+	bool bResult = (fOut != NULL);
+	if (bResult)
+	{
+		bResult = (fwrite(buffer.data(), 1, buffer.size(), fOut) == buffer.size());
+		if (fclose(fOut) != 0)
+			bResult = false;
+	}
+	if (!bResult)
+	{
+		_log.Log(LOG_ERROR, "TimeSeriesStore: Could not append to %s", filename.c_str());
+		m_writers.erase(itt); //state is ahead of the file, read it again on the next append
+		return false;
+	}
+	state.size += buffer.size();
+	return true;
+}
+
+void CTimeSeriesStore::Read(const uint64_t id, const time_t from, const time_t to, const TSampleCallback &callback)
+{
+	time_t tTo = (to != 0) ? to : mytime(NULL);
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (m_dir.empty())
+		return;
+	ForEachDay(from, tTo, [&](const int day) {
+		ReadSegment(SegmentName(day, id), [&](const _tSample &sample) {
+			if ((sample.time >= from) && ((to == 0) || (sample.time <= to)))
+				callback(sample);
+		}, NULL);
+	});
+}
+
+void CTimeSeriesStore::GetSeries(const time_t from, const time_t to, std::vector<uint64_t> &ids)
+{
+	int fromDay = DayKey(from);
+	int toDay = DayKey(to);
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::vector<_tSegment> segments;
+	ListSegments(segments);
+	for (const auto & itt : segments)
+	{
+		if ((itt.day >= fromDay) && (itt.day <= toDay))
+			ids.push_back(itt.id);
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+void CTimeSeriesStore::GetLastTimes(std::map<uint64_t, time_t> &times)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::vector<_tSegment> segments;
+	ListSegments(segments);
+	//only the last day of every device is read
+	std::map<uint64_t, _tSegment> lastSegments;
+	for (const auto & itt : segments)
+	{
+		std::map<uint64_t, _tSegment>::iterator itt2 = lastSegments.find(itt.id);
+		if ((itt2 == lastSegments.end()) || (itt.day > itt2->second.day))
+			lastSegments[itt.id] = itt;
+	}
+	for (const auto & itt : lastSegments)
+	{
+		_tWriteState state;
+		memset(&state, 0, sizeof(state));
+		if (ReadSegment(itt.second.filename, NULL, &state))
+			times[itt.first] = state.lastTime;
+	}
+}
+
+void CTimeSeriesStore::DeleteSeries(const uint64_t id)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::vector<_tSegment> segments;
+	ListSegments(segments);
+	for (const auto & itt : segments)
+	{
+		if (itt.id == id)
+			std::remove(itt.filename.c_str());
+	}
+	m_writers.erase(id);
+}
+
+void CTimeSeriesStore::DeleteRange(const uint64_t id, const time_t from, const time_t to)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	ForEachDay(from, to, [&](const int day) {
+		std::string filename = SegmentName(day, id);
+		std::vector<_tSample> samples;
+		bool bChanged = false;
+		if (!ReadSegment(filename, [&](const _tSample &sample) {
+			if ((sample.time >= from) && (sample.time <= to))
+				bChanged = true;
+			else
+				samples.push_back(sample);
+		}, NULL))
+			return;
+		if (bChanged)
+			WriteSegment(filename, samples);
+	});
+	m_writers.erase(id);
+}
+
+void CTimeSeriesStore::DeleteBefore(const time_t before)
+{
+	int beforeDay = DayKey(before);
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::vector<_tSegment> segments;
+	ListSegments(segments);
+	for (const auto & itt : segments)
+	{
+		if (itt.day < beforeDay)
+			std::remove(itt.filename.c_str());
+	}
+	for (std::map<uint64_t, _tWriteState>::iterator itt = m_writers.begin(); itt != m_writers.end();)
+	{
+		if (itt->second.day < beforeDay)
+			itt = m_writers.erase(itt);
+		else
+			++itt;
+	}
+}
+
+void CTimeSeriesStore::MoveSeries(const uint64_t fromId, const uint64_t toId)
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::vector<_tSegment> segments;
+	ListSegments(segments);
+	std::sort(segments.begin(), segments.end(), [](const _tSegment &a, const _tSegment &b) { return a.day < b.day; });
+
+	//first sample of the new device, everything from then on stays with the old one
+	time_t firstTime = 0;
+	for (const auto & itt : segments)
+	{
+		if ((itt.id != toId) || (firstTime != 0))
+			continue;
+		ReadSegment(itt.filename, [&firstTime](const _tSample &sample) {
+			if ((firstTime == 0) || (sample.time < firstTime))
+				firstTime = sample.time;
+		}, NULL);
+	}
+
+	for (const auto & itt : segments)
+	{
+		if (itt.id != fromId)
+			continue;
+		std::vector<_tSample> moved;
+		std::vector<_tSample> kept;
+		ReadSegment(itt.filename, [&](const _tSample &sample) {
+			if ((firstTime == 0) || (sample.time < firstTime))
+				moved.push_back(sample);
+			else
+				kept.push_back(sample);
+		}, NULL);
+		if (moved.empty())
+			continue;
+		std::string toFile = SegmentName(itt.day, toId);
+		ReadSegment(toFile, [&moved](const _tSample &sample) { moved.push_back(sample); }, NULL);
+		std::stable_sort(moved.begin(), moved.end(), [](const _tSample &a, const _tSample &b) { return a.time < b.time; });
+		if (WriteSegment(toFile, moved))
+			WriteSegment(itt.filename, kept);
+	}
+	m_writers.erase(fromId);
+	m_writers.erase(toId);
+}
+
+void CTimeSeriesStore::Clear()
+{
+	std::lock_guard<std::mutex> l(m_mutex);
+	std::vector<_tSegment> segments;
+	ListSegments(segments);
+	for (const auto & itt : segments)
+		std::remove(itt.filename.c_str());
+	m_writers.clear();
+}
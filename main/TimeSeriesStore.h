@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define TS_MAX_COLUMNS 8
+
+//Append-only storage for short log samples, as an alternative for the SQLite short log tables.
+//Every device has one segment file per (local) day. Timestamps are stored as delta-of-delta varints
+//and every value as the XOR with the previous value of its column, so a sample that did not change
+//costs a few bytes. Segments are memory mapped for reading, and removing old data is deleting files.
+class CTimeSeriesStore
+{
+public:
+	struct _tSample
+	{
+		time_t time;
+		double values[TS_MAX_COLUMNS];
+	};
+	typedef std::function<void(const _tSample &sample)> TSampleCallback;
+
+	CTimeSeriesStore();
+
+	bool Open(const std::string &dir, const int nColumns);
+	void Close();
+	bool IsOpen() const { return !m_dir.empty(); }
+
+	bool Append(const uint64_t id, const time_t time, const double *values);
+	//Samples of the device between from and to (inclusive, to = 0 is no limit), ordered by time
+	void Read(const uint64_t id, const time_t from, const time_t to, const TSampleCallback &callback);
+	//Devices with samples between from and to
+	void GetSeries(const time_t from, const time_t to, std::vector<uint64_t> &ids);
+	//Time of the last sample of every device
+	void GetLastTimes(std::map<uint64_t, time_t> &times);
+
+	void DeleteSeries(const uint64_t id);
+	void DeleteRange(const uint64_t id, const time_t from, const time_t to);
+	//Removes the days before the day of 'before'
+	void DeleteBefore(const time_t before);
+	//Samples of fromId older than the first sample of toId are given to toId
+	void MoveSeries(const uint64_t fromId, const uint64_t toId);
+	void Clear();
+private:
+	struct _tWriteState
+	{
+		int day;
+		uint64_t size;						//end of the last complete sample
+		time_t lastTime;
+		int64_t lastDelta;
+		double lastValues[TS_MAX_COLUMNS];
+	};
+	struct _tSegment
+	{
+		int day;
+		uint64_t id;
+		std::string filename;
+	};
+	std::string SegmentName(const int day, const uint64_t id);
+	void ListSegments(std::vector<_tSegment> &segments);
+	bool ReadSegment(const std::string &filename, const TSampleCallback &callback, _tWriteState *pState);
+	bool WriteSegment(const std::string &filename, const std::vector<_tSample> &samples);
+	void EncodeSample(std::string &buffer, const _tSample &sample, _tWriteState &state);
+
+	std::mutex m_mutex;
+	std::string m_dir;
+	int m_nColumns;
+	std::map<uint64_t, _tWriteState> m_writers;	//segment being appended to, per device
+};
@@ -10,6 +10,7 @@
 #include "EventSystem.h"
 #include "HTMLSanitizer.h"
 #include "dzVents.h"
+#include "GraphDownsample.h"
 #include "../httpclient/HTTPClient.h"
 #include "../hardware/hardwaretypes.h"
 #include "../hardware/1Wire.h"
@@ -41,6 +42,7 @@
 #endif // WITH_GPIO
 #include "../hardware/Tellstick.h"
 #include "../webserver/Base64.h"
+#include "../webserver/stream_body.hpp"
 #include "../smtpclient/SMTPClient.h"
 #include <json/json.h>
 #include "../main/json_helper.h"
@@ -388,6 +390,7 @@ namespace http {
 			RegisterCommandCode("clearlog", boost::bind(&CWebServer::Cmd_ClearLog, this, _1, _2, _3));
 			RegisterCommandCode("getauth", boost::bind(&CWebServer::Cmd_GetAuth, this, _1, _2, _3), true);
 			RegisterCommandCode("getuptime", boost::bind(&CWebServer::Cmd_GetUptime, this, _1, _2, _3), true);
+			RegisterCommandCode("getstatistics", boost::bind(&CWebServer::Cmd_GetStatistics, this, _1, _2, _3));
 
 
 			RegisterCommandCode("gethardwaretypes", boost::bind(&CWebServer::Cmd_GetHardwareTypes, this, _1, _2, _3));
@@ -590,6 +593,7 @@ namespace http {
 
 			RegisterRType("hardware", boost::bind(&CWebServer::RType_Hardware, this, _1, _2, _3));
 			RegisterRType("devices", boost::bind(&CWebServer::RType_Devices, this, _1, _2, _3));
+			RegisterRType("changes", boost::bind(&CWebServer::RType_Changes, this, _1, _2, _3));
 			RegisterRType("deletedevice", boost::bind(&CWebServer::RType_DeleteDevice, this, _1, _2, _3));
 			RegisterRType("cameras", boost::bind(&CWebServer::RType_Cameras, this, _1, _2, _3));
 			RegisterRType("cameras_user", boost::bind(&CWebServer::RType_CamerasUser, this, _1, _2, _3));
@@ -879,6 +883,17 @@ namespace http {
 			}
 		exitjson:
 			std::string jcallback = request::findValue(&req, "jsoncallback");
+			if ((req.stream_reply) && (IsLargeJSonResponse(rtype, req)))
+			{
+				//send while it is serialized, instead of building the text (and the gzip of it) first
+				std::shared_ptr<json_body_source> source;
+				if (jcallback.size() == 0)
+					source = std::make_shared<json_body_source>(root);
+				else
+					source = std::make_shared<json_body_source>(root, "var data=", "\n" + jcallback + "(data);");
+				reply::set_content_stream(&rep, source);
+				return;
+			}
 			if (jcallback.size() == 0) {
 				reply::set_content(&rep, root.toStyledString());
 				return;
@@ -886,6 +901,13 @@ namespace http {
 			reply::set_content(&rep, "var data=" + root.toStyledString() + '\n' + jcallback + "(data);");
 		}
 
+		bool CWebServer::IsLargeJSonResponse(const std::string &rtype, const request& req)
+		{
+			if ((rtype == "devices") || (rtype == "graph") || (rtype == "lightlog"))
+				return true;
+			return ((rtype == "command") && (request::findValue(&req, "param") == "getlog"));
+		}
+
 		void CWebServer::Cmd_GetLanguage(WebEmSession & session, const request& req, Json::Value &root)
 		{
 			std::string sValue;
@@ -2648,6 +2670,68 @@ namespace http {
 			root["seconds"] = seconds;
 		}
 
+		void CWebServer::Cmd_GetStatistics(WebEmSession & session, const request& req, Json::Value &root)
+		{
+			if (session.rights != 2)
+			{
+				session.reply_status = reply::forbidden;
+				return; //Only admin user allowed
+			}
+			root["status"] = "OK";
+			root["title"] = "GetStatistics";
+
+			uint64_t hits, misses;
+			size_t entries;
+			m_sql.GetStatementCacheStats(hits, misses, entries);
+			root["database"]["statementcache"]["hits"] = (Json::UInt64)hits;
+			root["database"]["statementcache"]["misses"] = (Json::UInt64)misses;
+			root["database"]["statementcache"]["entries"] = (Json::UInt64)entries;
+
+			_tRxQueueStats rxStats;
+			m_mainworker.GetRxQueueStats(rxStats);
+			root["rxqueue"]["workers"] = (Json::UInt64)rxStats.workers;
+			root["rxqueue"]["depth"] = (Json::UInt64)rxStats.depth;
+			root["rxqueue"]["prioritydepth"] = (Json::UInt64)rxStats.priorityDepth;
+			root["rxqueue"]["maxdepth"] = (Json::UInt64)rxStats.maxDepth;
+			root["rxqueue"]["pushed"] = (Json::UInt64)rxStats.pushed;
+			root["rxqueue"]["coalesced"] = (Json::UInt64)rxStats.coalesced;
+			root["rxqueue"]["processed"] = (Json::UInt64)rxStats.popped;
+			root["rxqueue"]["avglatency"] = rxStats.avgLatency;
+			root["rxqueue"]["maxlatency"] = rxStats.maxLatency;
+
+			root["log"]["droppedlines"] = (Json::UInt64)_log.GetDroppedLines();
+
+			CNotificationHelper::_tNotificationQueueStats notificationStats;
+			m_notifications.GetQueueStats(notificationStats);
+			root["notifications"]["workers"] = (Json::UInt64)notificationStats.workers;
+			root["notifications"]["queued"] = (Json::UInt64)notificationStats.queued;
+			root["notifications"]["sent"] = (Json::UInt64)notificationStats.sent;
+			root["notifications"]["failed"] = (Json::UInt64)notificationStats.failed;
+			root["notifications"]["retried"] = (Json::UInt64)notificationStats.retried;
+			root["notifications"]["coalesced"] = (Json::UInt64)notificationStats.coalesced;
+			root["notifications"]["dropped"] = (Json::UInt64)notificationStats.dropped;
+			for (const auto & itt : notificationStats.subsystems)
+				root["notifications"]["subsystems"][itt.first] = (Json::UInt64)itt.second;
+
+			std::map<std::string, CHTTPEngine::_tHostStatistics> httpStats;
+			HTTPClient::GetStatistics(httpStats);
+			int ii = 0;
+			for (const auto & itt : httpStats)
+			{
+				const CHTTPEngine::_tHostStatistics &stats = itt.second;
+				root["httpclient"][ii]["host"] = itt.first;
+				root["httpclient"][ii]["requests"] = (Json::UInt64)stats.requests;
+				root["httpclient"][ii]["failed"] = (Json::UInt64)stats.failed;
+				root["httpclient"][ii]["connects"] = (Json::UInt64)stats.connects;
+				root["httpclient"][ii]["active"] = (Json::UInt64)stats.active;
+				//milliseconds
+				root["httpclient"][ii]["avgtime"] = (stats.requests) ? (int)(stats.totalTime * 1000 / stats.requests) : 0;
+				root["httpclient"][ii]["avgconnecttime"] = (stats.connects) ? (int)(stats.connectTime * 1000 / stats.connects) : 0;
+				root["httpclient"][ii]["maxtime"] = (int)(stats.maxTime * 1000);
+				ii++;
+			}
+		}
+
 		void CWebServer::Cmd_GetActualHistory(WebEmSession & session, const request& req, Json::Value &root)
 		{
 			root["status"] = "OK";
@@ -3100,6 +3184,8 @@ namespace http {
 				session.reply_status = reply::forbidden;
 				return; //Only admin user allowed
 			}
+			//make sure grouped database writes are on disk before the system goes down
+			m_sql.CommitWrites();
 #ifdef WIN32
 			int ret = system("shutdown -s -f -t 1 -d up:125:1");
 #else
@@ -3121,6 +3207,8 @@ namespace http {
 				session.reply_status = reply::forbidden;
 				return; //Only admin user allowed
 			}
+			//make sure grouped database writes are on disk before the system goes down
+			m_sql.CommitWrites();
 #ifdef WIN32
 			int ret = system("shutdown -r -f -t 1 -d up:125:1");
 #else
@@ -8330,6 +8418,104 @@ namespace http {
 			std::string Mode2; // Used to flag DimmerType as relative for some old LimitLessLight type bulbs
 		} tHardwareList;
 
+		//Same column layout as the DeviceStatus/DeviceToPlansMap queries below
+		static void DeviceStatusRowToResult(const _tDeviceStatusRow &row, const std::string &XOffset, const std::string &YOffset, const std::string &PlanID, std::vector<std::string> &sd)
+		{
+			char szTmp[40];
+			sd.clear();
+			sd.reserve(30);
+			sd.push_back(std::to_string(row.ID));
+			sd.push_back(row.DeviceID);
+			sd.push_back(std::to_string(row.Unit));
+			sd.push_back(row.Name);
+			sd.push_back(row.Used ? "1" : "0");
+			sd.push_back(std::to_string(row.Type));
+			sd.push_back(std::to_string(row.SubType));
+			sd.push_back(std::to_string(row.SignalLevel));
+			sd.push_back(std::to_string(row.BatteryLevel));
+			sd.push_back(std::to_string(row.nValue));
+			sd.push_back(row.sValue);
+			sd.push_back(row.LastUpdate);
+			sd.push_back(std::to_string(row.Favorite));
+			sd.push_back(std::to_string(row.SwitchType));
+			sd.push_back(std::to_string(row.HardwareID));
+			sprintf(szTmp, "%.15g", row.AddjValue);
+			sd.push_back(szTmp);
+			sprintf(szTmp, "%.15g", row.AddjMulti);
+			sd.push_back(szTmp);
+			sprintf(szTmp, "%.15g", row.AddjValue2);
+			sd.push_back(szTmp);
+			sprintf(szTmp, "%.15g", row.AddjMulti2);
+			sd.push_back(szTmp);
+			sd.push_back(std::to_string(row.LastLevel));
+			sd.push_back(std::to_string(row.CustomImage));
+			sd.push_back(row.StrParam1);
+			sd.push_back(row.StrParam2);
+			sd.push_back(std::to_string(row.Protected));
+			sd.push_back(XOffset);
+			sd.push_back(YOffset);
+			sd.push_back(PlanID);
+			sd.push_back(row.Description);
+			sd.push_back(row.Options);
+			sd.push_back(row.Color);
+		}
+
+		static bool DeviceStatusRowOrder(const _tDeviceStatusRow &a, const _tDeviceStatusRow &b)
+		{
+			//ORDER BY A.[Order],A.LastUpdate DESC
+			if (a.Order != b.Order)
+				return (a.Order < b.Order);
+			return (a.LastUpdate > b.LastUpdate);
+		}
+
+		//Rows for the 'all devices' list from the in-memory device table (joined with their plans)
+		static void GetDeviceStatusResult(const std::string &hardwareid, std::vector<std::vector<std::string> > &result, const std::set<uint64_t> *pDevices = NULL)
+		{
+			result.clear();
+
+			std::vector<_tDeviceStatusRow> _devices;
+			if (pDevices != NULL)
+			{
+				if (pDevices->empty())
+					return;
+				_tDeviceStatusRow row;
+				for (const auto & itt : *pDevices)
+				{
+					if (m_sql.GetDeviceStatusRow(itt, row))
+						_devices.push_back(row);
+				}
+			}
+			else
+				m_sql.GetDeviceStatusRows(_devices);
+			std::stable_sort(_devices.begin(), _devices.end(), DeviceStatusRowOrder);
+
+			std::multimap<uint64_t, std::vector<std::string> > _plans;
+			std::vector<std::vector<std::string> > result2;
+			result2 = m_sql.safe_query("SELECT DeviceRowID, XOffset, YOffset, PlanID FROM DeviceToPlansMap WHERE (DevSceneType==0)");
+			for (const auto & itt : result2)
+				_plans.insert(std::make_pair(std::stoull(itt[0]), itt));
+
+			int iHardwareID = (hardwareid != "") ? atoi(hardwareid.c_str()) : -1;
+			std::vector<std::string> sd;
+			for (const auto & itt : _devices)
+			{
+				if ((iHardwareID != -1) && (itt.HardwareID != iHardwareID))
+					continue;
+				auto range = _plans.equal_range(itt.ID);
+				if (range.first == range.second)
+				{
+					DeviceStatusRowToResult(itt, "0", "0", "0", sd);
+					result.push_back(sd);
+					continue;
+				}
+				for (auto ittPlan = range.first; ittPlan != range.second; ++ittPlan)
+				{
+					DeviceStatusRowToResult(itt, ittPlan->second[1], ittPlan->second[2], ittPlan->second[3], sd);
+					result.push_back(sd);
+				}
+			}
+		}
+
 		void CWebServer::GetJSonDevices(
 			Json::Value &root,
 			const std::string &rused,
@@ -8343,9 +8529,14 @@ namespace http {
 			const bool bFetchFavorites,
 			const time_t LastUpdate,
 			const std::string &username,
-			const std::string &hardwareid)
+			const std::string &hardwareid,
+			const std::set<uint64_t> *pChangedDevices,
+			const std::set<uint64_t> *pChangedScenes)
 		{
 			std::vector<std::vector<std::string> > result;
+			//rows from the read connections miss the grouped writes that are not committed yet,
+			//their values are taken from the in-memory device table instead
+			bool bCachedRows = false;
 
 			time_t now = mytime(NULL);
 			struct tm tm1;
@@ -8360,7 +8551,7 @@ namespace http {
 
 			//Get All Hardware ID's/Names, need them later
 			std::map<int, _tHardwareListInt> _hardwareNames;
-			result = m_sql.safe_query("SELECT ID, Name, Enabled, Type, Mode1, Mode2 FROM Hardware");
+			result = m_sql.safe_query_read("SELECT ID, Name, Enabled, Type, Mode1, Mode2 FROM Hardware");
 			if (!result.empty())
 			{
 				for (const auto & itt : result)
@@ -8445,7 +8636,7 @@ namespace http {
 					_eUserRights urights = m_users[iUser].userrights;
 					if (urights != URIGHTS_ADMIN)
 					{
-						result = m_sql.safe_query("SELECT COUNT(*) FROM SharedDevices WHERE (SharedUserID == %lu)", m_users[iUser].ID);
+						result = m_sql.safe_query_read("SELECT COUNT(*) FROM SharedDevices WHERE (SharedUserID == %lu)", m_users[iUser].ID);
 						if (!result.empty())
 						{
 							totUserDevices = (unsigned int)std::stoi(result[0][0]);
@@ -8463,12 +8654,13 @@ namespace http {
 			{
 				if (
 					(bShowScenes) &&
-					((rused == "all") || (rused == "true"))
+					((rused == "all") || (rused == "true")) &&
+					((pChangedScenes == NULL) || (!pChangedScenes->empty()))
 					)
 				{
 					//add scenes
 					if (rowid != "")
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT A.ID, A.Name, A.nValue, A.LastUpdate, A.Favorite, A.SceneType,"
 							" A.Protected, B.XOffset, B.YOffset, B.PlanID, A.Description"
 							" FROM Scenes as A"
@@ -8476,14 +8668,14 @@ namespace http {
 							" WHERE (A.ID=='%q')",
 							rowid.c_str());
 					else if ((planID != "") && (planID != "0"))
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT A.ID, A.Name, A.nValue, A.LastUpdate, A.Favorite, A.SceneType,"
 							" A.Protected, B.XOffset, B.YOffset, B.PlanID, A.Description"
 							" FROM Scenes as A, DeviceToPlansMap as B WHERE (B.PlanID=='%q')"
 							" AND (B.DeviceRowID==a.ID) AND (B.DevSceneType==1) ORDER BY B.[Order]",
 							planID.c_str());
 					else if ((floorID != "") && (floorID != "0"))
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT A.ID, A.Name, A.nValue, A.LastUpdate, A.Favorite, A.SceneType,"
 							" A.Protected, B.XOffset, B.YOffset, B.PlanID, A.Description"
 							" FROM Scenes as A, DeviceToPlansMap as B, Plans as C"
@@ -8498,7 +8690,7 @@ namespace http {
 							" LEFT OUTER JOIN DeviceToPlansMap as B ON (B.DeviceRowID==a.ID) AND (B.DevSceneType==1)"
 							" ORDER BY ");
 						szQuery += szOrderBy;
-                                                result = m_sql.safe_query(szQuery.c_str(), order.c_str());
+                                                result = m_sql.safe_query_read(szQuery.c_str(), order.c_str());
 					}
 
 					if (!result.empty())
@@ -8507,6 +8699,9 @@ namespace http {
 						{
 							std::vector<std::string> sd = itt;
 
+							if ((pChangedScenes != NULL) && (pChangedScenes->find(std::stoull(sd[0])) == pChangedScenes->end()))
+								continue;
+
 							unsigned char favorite = atoi(sd[4].c_str());
 							//Check if we only want favorite devices
 							if ((bFetchFavorites) && (!favorite))
@@ -8598,20 +8793,25 @@ namespace http {
 				if (rowid != "")
 				{
 					//_log.Log(LOG_STATUS, "Getting device with id: %s", rowid.c_str());
-					result = m_sql.safe_query(
-						"SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used, A.Type, A.SubType,"
-						" A.SignalLevel, A.BatteryLevel, A.nValue, A.sValue,"
-						" A.LastUpdate, A.Favorite, A.SwitchType, A.HardwareID,"
-						" A.AddjValue, A.AddjMulti, A.AddjValue2, A.AddjMulti2,"
-						" A.LastLevel, A.CustomImage, A.StrParam1, A.StrParam2,"
-						" A.Protected, IFNULL(B.XOffset,0), IFNULL(B.YOffset,0), IFNULL(B.PlanID,0), A.Description,"
-						" A.Options, A.Color "
-						"FROM DeviceStatus A LEFT OUTER JOIN DeviceToPlansMap as B ON (B.DeviceRowID==a.ID) "
-						"WHERE (A.ID=='%q')",
-						rowid.c_str());
+					result.clear();
+					_tDeviceStatusRow devRow;
+					bCachedRows = true;
+					if (m_sql.GetDeviceStatusRow(std::strtoull(rowid.c_str(), NULL, 10), devRow))
+					{
+						std::vector<std::vector<std::string> > result2;
+						result2 = m_sql.safe_query_read("SELECT XOffset, YOffset, PlanID FROM DeviceToPlansMap WHERE (DeviceRowID==%" PRIu64 ")", devRow.ID);
+						if (result2.empty())
+							result2.push_back({ "0", "0", "0" });
+						std::vector<std::string> sd;
+						for (const auto & itt : result2)
+						{
+							DeviceStatusRowToResult(devRow, itt[0], itt[1], itt[2], sd);
+							result.push_back(sd);
+						}
+					}
 				}
 				else if ((planID != "") && (planID != "0"))
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used,"
 						" A.Type, A.SubType, A.SignalLevel, A.BatteryLevel,"
 						" A.nValue, A.sValue, A.LastUpdate, A.Favorite,"
@@ -8626,7 +8826,7 @@ namespace http {
 						" AND (B.DevSceneType==0) ORDER BY B.[Order]",
 						planID.c_str());
 				else if ((floorID != "") && (floorID != "0"))
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used,"
 						" A.Type, A.SubType, A.SignalLevel, A.BatteryLevel,"
 						" A.nValue, A.sValue, A.LastUpdate, A.Favorite,"
@@ -8646,11 +8846,11 @@ namespace http {
 					if (!bDisplayHidden)
 					{
 						//Build a list of Hidden Devices
-						result = m_sql.safe_query("SELECT ID FROM Plans WHERE (Name=='$Hidden Devices')");
+						result = m_sql.safe_query_read("SELECT ID FROM Plans WHERE (Name=='$Hidden Devices')");
 						if (!result.empty())
 						{
 							std::string pID = result[0][0];
-							result = m_sql.safe_query("SELECT DeviceRowID FROM DeviceToPlansMap WHERE (PlanID=='%q') AND (DevSceneType==0)",
+							result = m_sql.safe_query_read("SELECT DeviceRowID FROM DeviceToPlansMap WHERE (PlanID=='%q') AND (DevSceneType==0)",
 								pID.c_str());
 							if (!result.empty())
 							{
@@ -8671,7 +8871,11 @@ namespace http {
 						sprintf(szOrderBy, "A.[Order],A.%%s ASC");
 					}
 					//_log.Log(LOG_STATUS, "Getting all devices: order by %s ", szOrderBy);
-					if (hardwareid != "") {
+					if (order.empty() || (!isAlpha) || (pChangedDevices != NULL)) {
+						GetDeviceStatusResult(hardwareid, result, pChangedDevices);
+						bCachedRows = true;
+					}
+					else if (hardwareid != "") {
 						szQuery = (
 							"SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used,A.Type, A.SubType,"
 							" A.SignalLevel, A.BatteryLevel, A.nValue, A.sValue,"
@@ -8685,7 +8889,7 @@ namespace http {
 							"WHERE (A.HardwareID == %q) "
 							"ORDER BY ");
 						szQuery += szOrderBy;
-						result = m_sql.safe_query(szQuery.c_str(), hardwareid.c_str(), order.c_str());
+						result = m_sql.safe_query_read(szQuery.c_str(), hardwareid.c_str(), order.c_str());
 					}
 					else {
 						szQuery = (
@@ -8700,7 +8904,7 @@ namespace http {
 							"ON (B.DeviceRowID==a.ID) AND (B.DevSceneType==0) "
 							"ORDER BY ");
 						szQuery += szOrderBy;
-						result = m_sql.safe_query(szQuery.c_str(), order.c_str());
+						result = m_sql.safe_query_read(szQuery.c_str(), order.c_str());
 					}
 				}
 			}
@@ -8713,7 +8917,7 @@ namespace http {
 				if (rowid != "")
 				{
 					//_log.Log(LOG_STATUS, "Getting device with id: %s for user %lu", rowid.c_str(), m_users[iUser].ID);
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used,"
 						" A.Type, A.SubType, A.SignalLevel, A.BatteryLevel,"
 						" A.nValue, A.sValue, A.LastUpdate, B.Favorite,"
@@ -8729,7 +8933,7 @@ namespace http {
 						m_users[iUser].ID, rowid.c_str());
 				}
 				else if ((planID != "") && (planID != "0"))
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used,"
 						" A.Type, A.SubType, A.SignalLevel, A.BatteryLevel,"
 						" A.nValue, A.sValue, A.LastUpdate, B.Favorite,"
@@ -8746,7 +8950,7 @@ namespace http {
 						"AND (B.SharedUserID==%lu) ORDER BY C.[Order]",
 						planID.c_str(), m_users[iUser].ID);
 				else if ((floorID != "") && (floorID != "0"))
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT A.ID, A.DeviceID, A.Unit, A.Name, A.Used,"
 						" A.Type, A.SubType, A.SignalLevel, A.BatteryLevel,"
 						" A.nValue, A.sValue, A.LastUpdate, B.Favorite,"
@@ -8766,11 +8970,11 @@ namespace http {
 					if (!bDisplayHidden)
 					{
 						//Build a list of Hidden Devices
-						result = m_sql.safe_query("SELECT ID FROM Plans WHERE (Name=='$Hidden Devices')");
+						result = m_sql.safe_query_read("SELECT ID FROM Plans WHERE (Name=='$Hidden Devices')");
 						if (!result.empty())
 						{
 							std::string pID = result[0][0];
-							result = m_sql.safe_query("SELECT DeviceRowID FROM DeviceToPlansMap WHERE (PlanID=='%q')  AND (DevSceneType==0)",
+							result = m_sql.safe_query_read("SELECT DeviceRowID FROM DeviceToPlansMap WHERE (PlanID=='%q')  AND (DevSceneType==0)",
 								pID.c_str());
 							if (!result.empty())
 							{
@@ -8808,7 +9012,7 @@ namespace http {
 						"WHERE (B.DeviceRowID==A.ID)"
 						" AND (B.SharedUserID==%lu) ORDER BY ");
 					szQuery += szOrderBy;
-					result = m_sql.safe_query(szQuery.c_str(), m_users[iUser].ID, order.c_str());
+					result = m_sql.safe_query_read(szQuery.c_str(), m_users[iUser].ID, order.c_str());
 				}
 			}
 
@@ -8818,6 +9022,23 @@ namespace http {
 				{
 					std::vector<std::string> sd = itt;
 
+					if ((pChangedDevices != NULL) && (pChangedDevices->find(std::stoull(sd[0])) == pChangedDevices->end()))
+						continue;
+
+					if (!bCachedRows)
+					{
+						_tDeviceStatusRow devRow;
+						if (m_sql.GetDeviceStatusRow(std::stoull(sd[0]), devRow))
+						{
+							sd[7] = std::to_string(devRow.SignalLevel);
+							sd[8] = std::to_string(devRow.BatteryLevel);
+							sd[9] = std::to_string(devRow.nValue);
+							sd[10] = devRow.sValue;
+							sd[11] = devRow.LastUpdate;
+							sd[19] = std::to_string(devRow.LastLevel);
+						}
+					}
+
 					unsigned char favorite = atoi(sd[12].c_str());
 					if ((planID != "") && (planID != "0"))
 						favorite = 1;
@@ -9329,7 +9550,7 @@ namespace http {
 
 						bool bIsSubDevice = false;
 						std::vector<std::vector<std::string> > resultSD;
-						resultSD = m_sql.safe_query("SELECT ID FROM LightSubDevices WHERE (DeviceRowID=='%q')",
+						resultSD = m_sql.safe_query_read("SELECT ID FROM LightSubDevices WHERE (DeviceRowID=='%q')",
 							sd[0].c_str());
 						bIsSubDevice = (resultSD.size() > 0);
 
@@ -9677,9 +9898,11 @@ namespace http {
 
 						_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 						uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-						if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 						{
-							tstate = m_mainworker.m_trend_calculator[tID].m_state;
+							std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+							std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+							if (ittTrend != m_mainworker.m_trend_calculator.end())
+								tstate = ittTrend->second.m_state;
 						}
 						root["result"][ii]["trend"] = (int)tstate;
 					}
@@ -9706,9 +9929,11 @@ namespace http {
 						root["result"][ii]["HaveTimeout"] = bHaveTimeout;
 						_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 						uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-						if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 						{
-							tstate = m_mainworker.m_trend_calculator[tID].m_state;
+							std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+							std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+							if (ittTrend != m_mainworker.m_trend_calculator.end())
+								tstate = ittTrend->second.m_state;
 						}
 						root["result"][ii]["trend"] = (int)tstate;
 					}
@@ -9744,9 +9969,11 @@ namespace http {
 
 							_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 							uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-							if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 							{
-								tstate = m_mainworker.m_trend_calculator[tID].m_state;
+								std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+								std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+								if (ittTrend != m_mainworker.m_trend_calculator.end())
+									tstate = ittTrend->second.m_state;
 							}
 							root["result"][ii]["trend"] = (int)tstate;
 						}
@@ -9802,9 +10029,11 @@ namespace http {
 
 							_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 							uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-							if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 							{
-								tstate = m_mainworker.m_trend_calculator[tID].m_state;
+								std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+								std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+								if (ittTrend != m_mainworker.m_trend_calculator.end())
+									tstate = ittTrend->second.m_state;
 							}
 							root["result"][ii]["trend"] = (int)tstate;
 						}
@@ -9832,9 +10061,11 @@ namespace http {
 
 							_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 							uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-							if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 							{
-								tstate = m_mainworker.m_trend_calculator[tID].m_state;
+								std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+								std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+								if (ittTrend != m_mainworker.m_trend_calculator.end())
+									tstate = ittTrend->second.m_state;
 							}
 							root["result"][ii]["trend"] = (int)tstate;
 						}
@@ -9856,9 +10087,11 @@ namespace http {
 
 								_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 								uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-								if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 								{
-									tstate = m_mainworker.m_trend_calculator[tID].m_state;
+									std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+									std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+									if (ittTrend != m_mainworker.m_trend_calculator.end())
+										tstate = ittTrend->second.m_state;
 								}
 								root["result"][ii]["trend"] = (int)tstate;
 							}
@@ -9920,9 +10153,11 @@ namespace http {
 
 								_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 								uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-								if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 								{
-									tstate = m_mainworker.m_trend_calculator[tID].m_state;
+									std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+									std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+									if (ittTrend != m_mainworker.m_trend_calculator.end())
+										tstate = ittTrend->second.m_state;
 								}
 								root["result"][ii]["trend"] = (int)tstate;
 							}
@@ -9947,12 +10182,12 @@ namespace http {
 
 							if (dSubType == sTypeRAINWU || dSubType == sTypeRAINByRate)
 							{
-								result2 = m_sql.safe_query(
+								result2 = m_sql.safe_query_read(
 									"SELECT Total, Rate FROM Rain WHERE (DeviceRowID='%q' AND Date>='%q') ORDER BY ROWID DESC LIMIT 1", sd[0].c_str(), szDate);
 							}
 							else
 							{
-								result2 = m_sql.safe_query(
+								result2 = m_sql.safe_query_read(
 									"SELECT MIN(Total), MAX(Total) FROM Rain WHERE (DeviceRowID='%q' AND Date>='%q')", sd[0].c_str(), szDate);
 							}
 
@@ -10020,7 +10255,7 @@ namespace http {
 
 						std::vector<std::vector<std::string> > result2;
 						strcpy(szTmp, "0");
-						result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')", sd[0].c_str(), szDate);
+						result2 = m_sql.safe_query_read("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')", sd[0].c_str(), szDate);
 						if (!result2.empty())
 						{
 							std::vector<std::string> sd2 = result2[0];
@@ -10126,7 +10361,7 @@ namespace http {
 
 						std::vector<std::vector<std::string> > result2;
 						strcpy(szTmp, "0");
-						result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')", sd[0].c_str(), szDate);
+						result2 = m_sql.safe_query_read("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')", sd[0].c_str(), szDate);
 						if (!result2.empty())
 						{
 							std::vector<std::string> sd2 = result2[0];
@@ -10297,7 +10532,7 @@ namespace http {
 
 						std::vector<std::vector<std::string> > result2;
 						strcpy(szTmp, "0");
-						result2 = m_sql.safe_query("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')", sd[0].c_str(), szDate);
+						result2 = m_sql.safe_query_read("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')", sd[0].c_str(), szDate);
 						if (!result2.empty())
 						{
 							std::vector<std::string> sd2 = result2[0];
@@ -10489,7 +10724,7 @@ namespace http {
 
 							std::vector<std::vector<std::string> > result2;
 							strcpy(szTmp, "0");
-							result2 = m_sql.safe_query("SELECT MIN(Value1), MIN(Value2), MIN(Value5), MIN(Value6) FROM MultiMeter WHERE (DeviceRowID='%q' AND Date>='%q')",
+							result2 = m_sql.safe_query_read("SELECT MIN(Value1), MIN(Value2), MIN(Value5), MIN(Value6) FROM MultiMeter WHERE (DeviceRowID='%q' AND Date>='%q')",
 								sd[0].c_str(), szDate);
 							if (!result2.empty())
 							{
@@ -10535,7 +10770,7 @@ namespace http {
 						float divider = m_sql.GetCounterDivider(int(metertype), int(dType), float(AddjValue2));
 
 						strcpy(szTmp, "0");
-						result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')",
+						result2 = m_sql.safe_query_read("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')",
 							sd[0].c_str(), szDate);
 						if (!result2.empty())
 						{
@@ -10651,7 +10886,7 @@ namespace http {
 
 							std::vector<std::vector<std::string> > result2;
 							strcpy(szTmp, "0");
-							result2 = m_sql.safe_query("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')",
+							result2 = m_sql.safe_query_read("SELECT MIN(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')",
 								sd[0].c_str(), szDate);
 							if (!result2.empty())
 							{
@@ -10826,9 +11061,11 @@ namespace http {
 							root["result"][ii]["Type"] = "temperature";
 							_tTrendCalculator::_eTendencyType tstate = _tTrendCalculator::_eTendencyType::TENDENCY_UNKNOWN;
 							uint64_t tID = ((uint64_t)(hardwareID & 0x7FFFFFFF) << 32) | (devIdx & 0x7FFFFFFF);
-							if (m_mainworker.m_trend_calculator.find(tID) != m_mainworker.m_trend_calculator.end())
 							{
-								tstate = m_mainworker.m_trend_calculator[tID].m_state;
+								std::lock_guard<std::mutex> l(m_mainworker.m_calculatorMutex);
+								std::map<uint64_t, _tTrendCalculator>::const_iterator ittTrend = m_mainworker.m_trend_calculator.find(tID);
+								if (ittTrend != m_mainworker.m_trend_calculator.end())
+									tstate = ittTrend->second.m_state;
 							}
 							root["result"][ii]["trend"] = (int)tstate;
 						}
@@ -11180,7 +11417,7 @@ namespace http {
 
 							std::vector<std::vector<std::string> > result2;
 							strcpy(szTmp, "0");
-							result2 = m_sql.safe_query("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')",
+							result2 = m_sql.safe_query_read("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID='%q' AND Date>='%q')",
 								sd[0].c_str(), szDate);
 							if (!result2.empty())
 							{
@@ -11836,9 +12073,133 @@ namespace http {
 			root["status"] = "OK";
 			root["title"] = "Devices";
 			root["app_version"] = szAppVersion;
+			//taken before reading, changes made while we read are in the next type=changes call
+			root["Journal"] = m_sql.m_changejournal.GetID();
+			root["Sequence"] = std::to_string(m_sql.m_changejournal.GetSequence());
 			GetJSonDevices(root, rused, rfilter, order, rid, planid, floorid, bDisplayHidden, bDisabledDisabled, bFetchFavorites, LastUpdate, session.username, hwidx);
 		}
 
+		//Devices, scenes and user variables changed since the 'since' sequence of a previous type=devices or type=changes call.
+		//When the journal can not tell (restarted, or too far behind) "Reload" is true and the client should get everything again.
+		//"deleted" has the removed rows, "removed" the changed devices/scenes that do not pass the filter anymore
+		void CWebServer::RType_Changes(WebEmSession & session, const request& req, Json::Value &root)
+		{
+			std::string sJournal = request::findValue(&req, "journal");
+			std::string sSince = request::findValue(&req, "since");
+			std::string rfilter = request::findValue(&req, "filter");
+			std::string rused = request::findValue(&req, "used");
+			std::string planid = request::findValue(&req, "plan");
+			std::string floorid = request::findValue(&req, "floor");
+			std::string sDisplayHidden = request::findValue(&req, "displayhidden");
+			std::string sFetchFavorites = request::findValue(&req, "favorite");
+			std::string sDisplayDisabled = request::findValue(&req, "displaydisabled");
+			std::string hwidx = request::findValue(&req, "hwidx");
+			bool bDisplayHidden = (sDisplayHidden == "1");
+			bool bFetchFavorites = (sFetchFavorites == "1");
+
+			int HideDisabledHardwareSensors = 0;
+			m_sql.GetPreferencesVar("HideDisabledHardwareSensors", HideDisabledHardwareSensors);
+			bool bDisabledDisabled = (HideDisabledHardwareSensors == 0);
+			if (sDisplayDisabled == "1")
+				bDisabledDisabled = true;
+
+			root["status"] = "OK";
+			root["title"] = "Changes";
+			root["ActTime"] = static_cast<int>(mytime(NULL));
+			root["Journal"] = m_sql.m_changejournal.GetID();
+			uint64_t sequence = m_sql.m_changejournal.GetSequence();
+			root["Sequence"] = std::to_string(sequence);
+			//the sequence is taken during the write (update hook), the device values below come from the
+			//in-memory device table that has every write up to it, committed or not
+
+			std::vector<_tJournalChange> changes;
+			if (
+				(sJournal != root["Journal"].asString()) ||
+				(sSince.empty()) ||
+				(!m_sql.m_changejournal.GetChanges(std::strtoull(sSince.c_str(), NULL, 10), changes))
+				)
+			{
+				root["Reload"] = true;
+				return;
+			}
+			root["Reload"] = false;
+
+			std::set<uint64_t> _devices, _scenes;
+			std::string szVariables;
+			int ii = 0;
+			for (const auto & itt : changes)
+			{
+				if (itt.bDeleted)
+				{
+					root["deleted"][ii]["idx"] = std::to_string(itt.ID);
+					root["deleted"][ii]["Type"] = (itt.type == JOURNAL_DEVICE) ? "Device" : (itt.type == JOURNAL_SCENE) ? "Scene" : "Variable";
+					ii++;
+				}
+				else if (itt.type == JOURNAL_DEVICE)
+					_devices.insert(itt.ID);
+				else if (itt.type == JOURNAL_SCENE)
+					_scenes.insert(itt.ID);
+				else
+				{
+					if (!szVariables.empty())
+						szVariables += ",";
+					szVariables += std::to_string(itt.ID);
+				}
+			}
+
+			if ((!_devices.empty()) || (!_scenes.empty()))
+			{
+				//scenes are only part of the 'all' filter
+				GetJSonDevices(root, rused, rfilter, "", "", planid, floorid, bDisplayHidden, bDisabledDisabled, bFetchFavorites, 0, session.username, hwidx, &_devices, &_scenes);
+
+				//changed, but not part of this view anymore (hidden, unused, disabled, other plan, not shared with the user),
+				//clients should drop them just like deleted ones
+				std::set<uint64_t> _foundDevices, _foundScenes;
+				for (const auto & item : root["result"])
+				{
+					std::string szType = item["Type"].asString();
+					uint64_t idx = std::strtoull(item["idx"].asString().c_str(), NULL, 10);
+					if ((szType == "Scene") || (szType == "Group"))
+						_foundScenes.insert(idx);
+					else
+						_foundDevices.insert(idx);
+				}
+				ii = 0;
+				for (const auto & itt : _devices)
+				{
+					if (_foundDevices.find(itt) != _foundDevices.end())
+						continue;
+					root["removed"][ii]["idx"] = std::to_string(itt);
+					root["removed"][ii]["Type"] = "Device";
+					ii++;
+				}
+				for (const auto & itt : _scenes)
+				{
+					if (_foundScenes.find(itt) != _foundScenes.end())
+						continue;
+					root["removed"][ii]["idx"] = std::to_string(itt);
+					root["removed"][ii]["Type"] = "Scene";
+					ii++;
+				}
+			}
+
+			if (!szVariables.empty())
+			{
+				std::vector<std::vector<std::string> > result;
+				result = m_sql.safe_query("SELECT ID, Name, ValueType, Value, LastUpdate FROM UserVariables WHERE (ID IN (%s))", szVariables.c_str());
+				ii = 0;
+				for (const auto & sd : result)
+				{
+					root["variables"][ii]["idx"] = sd[0];
+					root["variables"][ii]["Name"] = sd[1];
+					root["variables"][ii]["Type"] = sd[2];
+					root["variables"][ii]["Value"] = sd[3];
+					root["variables"][ii]["LastUpdate"] = sd[4];
+					ii++;
+				}
+			}
+		}
+
 		void CWebServer::RType_Users(WebEmSession & session, const request& req, Json::Value &root)
 		{
 			bool bHaveUser = (session.username != "");
@@ -13448,8 +13809,10 @@ namespace http {
 				idx = std::strtoull(request::findValue(&req, "idx").c_str(), nullptr, 10);
 			}
 			std::vector<std::vector<std::string> > result;
+			//the log is read from a read connection, it only sees committed writes
+			m_sql.CommitWrites("LightingLog", idx);
 			//First get Device Type/SubType
-			result = m_sql.safe_query("SELECT Type, SubType, SwitchType, Options FROM DeviceStatus WHERE (ID == %" PRIu64 ")",
+			result = m_sql.safe_query_read("SELECT Type, SubType, SwitchType, Options FROM DeviceStatus WHERE (ID == %" PRIu64 ")",
 				idx);
 			if (result.empty())
 				return;
@@ -13492,7 +13855,7 @@ namespace http {
 			root["status"] = "OK";
 			root["title"] = "LightLog";
 
-			result = m_sql.safe_query("SELECT ROWID, nValue, sValue, User, Date FROM LightingLog WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date DESC", idx);
+			result = m_sql.safe_query_read("SELECT ROWID, nValue, sValue, User, Date FROM LightingLog WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date DESC", idx);
 			if (!result.empty())
 			{
 				std::map<std::string, std::string> selectorStatuses;
@@ -13613,7 +13976,7 @@ namespace http {
 			root["status"] = "OK";
 			root["title"] = "TextLog";
 
-			result = m_sql.safe_query("SELECT ROWID, sValue, User, Date FROM LightingLog WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date DESC",
+			result = m_sql.safe_query_read("SELECT ROWID, sValue, User, Date FROM LightingLog WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date DESC",
 				idx);
 			if (!result.empty())
 			{
@@ -13662,6 +14025,24 @@ namespace http {
 		}
 
 		void CWebServer::RType_HandleGraph(WebEmSession & session, const request& req, Json::Value &root)
+		{
+			GetGraphData(session, req, root);
+
+			//optional server side downsampling, maxpoints <= 0 (or absent) returns everything.
+			//The first and last point are always kept, so less than 2 is not possible
+			int maxPoints = atoi(request::findValue(&req, "maxpoints").c_str());
+			if ((maxPoints <= 0) || (request::findValue(&req, "sensor") == "winddir"))
+				return;
+			if (maxPoints < 2)
+				maxPoints = 2;
+			_eDownsampleMethod method = DownsampleMethodFromString(request::findValue(&req, "downsample"));
+			if (root.isMember("result"))
+				DownsampleGraph(root["result"], (size_t)maxPoints, method);
+			if (root.isMember("resultprev"))
+				DownsampleGraph(root["resultprev"], (size_t)maxPoints, method);
+		}
+
+		void CWebServer::GetGraphData(WebEmSession & session, const request& req, Json::Value &root)
 		{
 			uint64_t idx = 0;
 			if (request::findValue(&req, "idx") != "")
@@ -13683,7 +14064,7 @@ namespace http {
 			struct tm tm1;
 			localtime_r(&now, &tm1);
 
-			result = m_sql.safe_query("SELECT Type, SubType, SwitchType, AddjValue, AddjMulti, AddjValue2, Options FROM DeviceStatus WHERE (ID == %" PRIu64 ")",
+			result = m_sql.safe_query_read("SELECT Type, SubType, SwitchType, AddjValue, AddjMulti, AddjValue2, Options FROM DeviceStatus WHERE (ID == %" PRIu64 ")",
 				idx);
 			if (result.empty())
 				return;
@@ -13789,6 +14170,12 @@ namespace http {
 				else
 					return;
 			}
+			//the logs are read from the read connections, they only see committed writes.
+			//Week/month/year graphs include today from the short log table
+			std::string shorttable = dbasetable;
+			if (shorttable.find("_Calendar") != std::string::npos)
+				shorttable = shorttable.substr(0, shorttable.find("_Calendar"));
+			m_sql.CommitWrites(shorttable, idx);
 			unsigned char tempsign = m_sql.m_tempsign[0];
 			int iPrev;
 
@@ -13798,90 +14185,89 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Temperature, Chill, Humidity, Barometer, Date, SetPoint FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
-					if (!result.empty())
+					//the whole short log, it can be in the segment store instead of the Temperature table
+					int nHistoryDays = 1;
+					m_sql.GetPreferencesVar("5MinuteHistoryDays", nHistoryDays);
+					time_t tStart = now - ((nHistoryDays + 1) * 86400);
+					result = m_sql.GetTemperatureLog(idx, TimeToString(&tStart, TF_DateTime), TimeToString(&now, TF_DateTime));
+					int ii = 0;
+					for (const auto & sd : result)
 					{
-						int ii = 0;
-						for (const auto & itt : result)
+						root["result"][ii]["d"] = sd[4].substr(0, 16);
+						if (
+							(dType == pTypeRego6XXTemp) ||
+							(dType == pTypeTEMP) ||
+							(dType == pTypeTEMP_HUM) ||
+							(dType == pTypeTEMP_HUM_BARO) ||
+							(dType == pTypeTEMP_BARO) ||
+							((dType == pTypeWIND) && (dSubType == sTypeWIND4)) ||
+							((dType == pTypeUV) && (dSubType == sTypeUV3)) ||
+							(dType == pTypeThermostat1) ||
+							(dType == pTypeRadiator1) ||
+							((dType == pTypeRFXSensor) && (dSubType == sTypeRFXSensorTemp)) ||
+							((dType == pTypeGeneral) && (dSubType == sTypeSystemTemp)) ||
+							((dType == pTypeGeneral) && (dSubType == sTypeBaro)) ||
+							((dType == pTypeThermostat) && (dSubType == sTypeThermSetpoint)) ||
+							(dType == pTypeEvohomeZone) ||
+							(dType == pTypeEvohomeWater)
+							)
 						{
-							std::vector<std::string> sd = itt;
-
-							root["result"][ii]["d"] = sd[4].substr(0, 16);
-							if (
-								(dType == pTypeRego6XXTemp) ||
-								(dType == pTypeTEMP) ||
-								(dType == pTypeTEMP_HUM) ||
-								(dType == pTypeTEMP_HUM_BARO) ||
-								(dType == pTypeTEMP_BARO) ||
-								((dType == pTypeWIND) && (dSubType == sTypeWIND4)) ||
-								((dType == pTypeUV) && (dSubType == sTypeUV3)) ||
-								(dType == pTypeThermostat1) ||
-								(dType == pTypeRadiator1) ||
-								((dType == pTypeRFXSensor) && (dSubType == sTypeRFXSensorTemp)) ||
-								((dType == pTypeGeneral) && (dSubType == sTypeSystemTemp)) ||
-								((dType == pTypeGeneral) && (dSubType == sTypeBaro)) ||
-								((dType == pTypeThermostat) && (dSubType == sTypeThermSetpoint)) ||
-								(dType == pTypeEvohomeZone) ||
-								(dType == pTypeEvohomeWater)
-								)
-							{
-								double tvalue = ConvertTemperature(atof(sd[0].c_str()), tempsign);
-								root["result"][ii]["te"] = tvalue;
-							}
-							if (
-								((dType == pTypeWIND) && (dSubType == sTypeWIND4)) ||
-								((dType == pTypeWIND) && (dSubType == sTypeWINDNoTemp))
-								)
-							{
-								double tvalue = ConvertTemperature(atof(sd[1].c_str()), tempsign);
-								root["result"][ii]["ch"] = tvalue;
-							}
-							if ((dType == pTypeHUM) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO))
-							{
-								root["result"][ii]["hu"] = sd[2];
-							}
-							if (
-								(dType == pTypeTEMP_HUM_BARO) ||
-								(dType == pTypeTEMP_BARO) ||
-								((dType == pTypeGeneral) && (dSubType == sTypeBaro))
-								)
+							double tvalue = ConvertTemperature(atof(sd[0].c_str()), tempsign);
+							root["result"][ii]["te"] = tvalue;
+						}
+						if (
+							((dType == pTypeWIND) && (dSubType == sTypeWIND4)) ||
+							((dType == pTypeWIND) && (dSubType == sTypeWINDNoTemp))
+							)
+						{
+							double tvalue = ConvertTemperature(atof(sd[1].c_str()), tempsign);
+							root["result"][ii]["ch"] = tvalue;
+						}
+						if ((dType == pTypeHUM) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO))
+						{
+							root["result"][ii]["hu"] = sd[2];
+						}
+						if (
+							(dType == pTypeTEMP_HUM_BARO) ||
+							(dType == pTypeTEMP_BARO) ||
+							((dType == pTypeGeneral) && (dSubType == sTypeBaro))
+							)
+						{
+							if (dType == pTypeTEMP_HUM_BARO)
 							{
-								if (dType == pTypeTEMP_HUM_BARO)
-								{
-									if (dSubType == sTypeTHBFloat)
-									{
-										sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
-										root["result"][ii]["ba"] = szTmp;
-									}
-									else
-										root["result"][ii]["ba"] = sd[3];
-								}
-								else if (dType == pTypeTEMP_BARO)
-								{
-									sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
-									root["result"][ii]["ba"] = szTmp;
-								}
-								else if ((dType == pTypeGeneral) && (dSubType == sTypeBaro))
+								if (dSubType == sTypeTHBFloat)
 								{
 									sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
 									root["result"][ii]["ba"] = szTmp;
 								}
+								else
+									root["result"][ii]["ba"] = sd[3];
 							}
-							if ((dType == pTypeEvohomeZone) || (dType == pTypeEvohomeWater))
+							else if (dType == pTypeTEMP_BARO)
 							{
-								double se = ConvertTemperature(atof(sd[5].c_str()), tempsign);
-								root["result"][ii]["se"] = se;
+								sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
+								root["result"][ii]["ba"] = szTmp;
 							}
-
-							ii++;
+							else if ((dType == pTypeGeneral) && (dSubType == sTypeBaro))
+							{
+								sprintf(szTmp, "%.1f", atof(sd[3].c_str()) / 10.0f);
+								root["result"][ii]["ba"] = szTmp;
+							}
+						}
+						if ((dType == pTypeEvohomeZone) || (dType == pTypeEvohomeWater))
+						{
+							double se = ConvertTemperature(atof(sd[6].c_str()), tempsign);
+							root["result"][ii]["se"] = se;
 						}
+
+						ii++;
 					}
 				}
 				else if (sensor == "Percentage") {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Percentage, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+					result = m_sql.safe_query_read("SELECT Percentage, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 					if (!result.empty())
 					{
 						int ii = 0;
@@ -13899,7 +14285,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Speed, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+					result = m_sql.safe_query_read("SELECT Speed, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 					if (!result.empty())
 					{
 						int ii = 0;
@@ -13921,7 +14307,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value1, Value2, Value3, Value4, Value5, Value6, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value1, Value2, Value3, Value4, Value5, Value6, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14033,7 +14419,7 @@ namespace http {
 											int day = ltime.tm_mday;
 											sprintf(szTmp, "%04d-%02d-%02d", year, mon, day);
 											std::vector<std::vector<std::string> > result2;
-											result2 = m_sql.safe_query(
+											result2 = m_sql.safe_query_read(
 												"SELECT Counter1, Counter2, Counter3, Counter4 FROM Multimeter_Calendar WHERE (DeviceRowID==%" PRIu64 ") AND (Date=='%q')",
 												idx, szTmp);
 											if (!result2.empty())
@@ -14078,7 +14464,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14097,7 +14483,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14131,7 +14517,7 @@ namespace http {
 						{
 							vdiv = 1000.0f;
 						}
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14159,7 +14545,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14178,7 +14564,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14197,7 +14583,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14217,7 +14603,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14244,7 +14630,7 @@ namespace http {
 
 						root["displaytype"] = displaytype;
 
-						result = m_sql.safe_query("SELECT Value1, Value2, Value3, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value1, Value2, Value3, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14318,7 +14704,7 @@ namespace http {
 
 						root["displaytype"] = displaytype;
 
-						result = m_sql.safe_query("SELECT Value1, Value2, Value3, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value1, Value2, Value3, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							int ii = 0;
@@ -14388,7 +14774,7 @@ namespace http {
 
 						//First check if we had any usage in the short log, if not, its probably a meter without usage
 						bool bHaveUsage = true;
-						result = m_sql.safe_query("SELECT MIN([Usage]), MAX([Usage]) FROM %s WHERE (DeviceRowID==%" PRIu64 ")", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT MIN([Usage]), MAX([Usage]) FROM %s WHERE (DeviceRowID==%" PRIu64 ")", dbasetable.c_str(), idx);
 						if (!result.empty())
 						{
 							long long minValue = std::strtoll(result[0][0].c_str(), nullptr, 10);
@@ -14400,7 +14786,7 @@ namespace http {
 						}
 
 						int ii = 0;
-						result = m_sql.safe_query("SELECT Value,[Usage], Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+						result = m_sql.safe_query_read("SELECT Value,[Usage], Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 
 						int method = 0;
 						std::string sMethod = request::findValue(&req, "method");
@@ -14547,12 +14933,12 @@ namespace http {
 						time_t lastTime = 0;
 
 						if (bIsManagedCounter) {
-							result = m_sql.safe_query("SELECT Usage, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+							result = m_sql.safe_query_read("SELECT Usage, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 							bHaveFirstValue = true;
 							bHaveFirstRealValue = true;
 						}
 						else {
-							result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+							result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 						}
 
 						int method = 0;
@@ -14732,7 +15118,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Level, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+					result = m_sql.safe_query_read("SELECT Level, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 					if (!result.empty())
 					{
 						int ii = 0;
@@ -14756,7 +15142,7 @@ namespace http {
 					float LastValue = -1;
 					std::string LastDate = "";
 
-					result = m_sql.safe_query("SELECT Total, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+					result = m_sql.safe_query_read("SELECT Total, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 					if (!result.empty())
 					{
 						int ii = 0;
@@ -14802,7 +15188,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Direction, Speed, Gust, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+					result = m_sql.safe_query_read("SELECT Direction, Speed, Gust, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 					if (!result.empty())
 					{
 						int ii = 0;
@@ -14839,7 +15225,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Direction, Speed, Gust FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
+					result = m_sql.safe_query_read("SELECT Direction, Speed, Gust FROM %s WHERE (DeviceRowID==%" PRIu64 ") ORDER BY Date ASC", dbasetable.c_str(), idx);
 					if (!result.empty())
 					{
 						std::map<int, int> _directions;
@@ -15060,7 +15446,7 @@ namespace http {
 					getNoon(weekbefore, tm2, tm1.tm_year + 1900, tm1.tm_mon + 1, tm1.tm_mday - 7); // We only want the date
 					sprintf(szDateStart, "%04d-%02d-%02d", tm2.tm_year + 1900, tm2.tm_mon + 1, tm2.tm_mday);
 
-					result = m_sql.safe_query("SELECT Total, Rate, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+					result = m_sql.safe_query_read("SELECT Total, Rate, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 					int ii = 0;
 					if (!result.empty())
 					{
@@ -15079,13 +15465,13 @@ namespace http {
 					//add today (have to calculate it)
 					if (dSubType == sTypeRAINWU || dSubType == sTypeRAINByRate)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Total, Total, Rate FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q') ORDER BY ROWID DESC LIMIT 1",
 							idx, szDateEnd);
 					}
 					else
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Total), MAX(Total), MAX(Rate) FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 					}
@@ -15133,7 +15519,7 @@ namespace http {
 					int ii = 0;
 					if (dType == pTypeP1Power)
 					{
-						result = m_sql.safe_query("SELECT Value1,Value2,Value5,Value6,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value1,Value2,Value5,Value6,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							bool bHaveDeliverd = false;
@@ -15174,7 +15560,7 @@ namespace http {
 					}
 					else
 					{
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							for (const auto & itt : result)
@@ -15213,7 +15599,7 @@ namespace http {
 					//add today (have to calculate it)
 					if (dType == pTypeP1Power)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value1), MAX(Value1), MIN(Value2), MAX(Value2),MIN(Value5), MAX(Value5), MIN(Value6), MAX(Value6) FROM MultiMeter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -15270,7 +15656,7 @@ namespace http {
 					}
 					else if (!bIsManagedCounter)
 					{
-						result = m_sql.safe_query("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
+						result = m_sql.safe_query_read("SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
 						{
@@ -15375,7 +15761,7 @@ namespace http {
 					root["title"] = "Graph " + sensor + " " + srange;
 
 					//Actual Year
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Temp_Min, Temp_Max, Chill_Min, Chill_Max,"
 						" Humidity, Barometer, Temp_Avg, Date, SetPoint_Min,"
 						" SetPoint_Max, SetPoint_Avg "
@@ -15470,18 +15856,9 @@ namespace http {
 						}
 					}
 					//add today (have to calculate it)
-					result = m_sql.safe_query(
-						"SELECT MIN(Temperature), MAX(Temperature),"
-						" MIN(Chill), MAX(Chill), AVG(Humidity),"
-						" AVG(Barometer), AVG(Temperature), MIN(SetPoint),"
-						" MAX(SetPoint), AVG(SetPoint) "
-						"FROM Temperature WHERE (DeviceRowID==%" PRIu64 ""
-						" AND Date>='%q')",
-						idx, szDateEnd);
-					if (!result.empty())
+					std::vector<std::string> sd = m_sql.GetTemperatureLogStats(idx, szDateEnd, "");
+					if (!sd.empty())
 					{
-						std::vector<std::string> sd = result[0];
-
 						root["result"][ii]["d"] = szDateEnd;
 						if (
 							((dType == pTypeRego6XXTemp) || (dType == pTypeTEMP) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO) || (dType == pTypeTEMP_BARO) || (dType == pTypeWIND) || (dType == pTypeThermostat1) || (dType == pTypeRadiator1)) ||
@@ -15492,7 +15869,7 @@ namespace http {
 						{
 							double te = ConvertTemperature(atof(sd[1].c_str()), tempsign);
 							double tm = ConvertTemperature(atof(sd[0].c_str()), tempsign);
-							double ta = ConvertTemperature(atof(sd[6].c_str()), tempsign);
+							double ta = ConvertTemperature(atof(sd[2].c_str()), tempsign);
 
 							root["result"][ii]["te"] = te;
 							root["result"][ii]["tm"] = tm;
@@ -15503,14 +15880,14 @@ namespace http {
 							((dType == pTypeWIND) && (dSubType == sTypeWINDNoTemp))
 							)
 						{
-							double ch = ConvertTemperature(atof(sd[3].c_str()), tempsign);
-							double cm = ConvertTemperature(atof(sd[2].c_str()), tempsign);
+							double ch = ConvertTemperature(atof(sd[4].c_str()), tempsign);
+							double cm = ConvertTemperature(atof(sd[3].c_str()), tempsign);
 							root["result"][ii]["ch"] = ch;
 							root["result"][ii]["cm"] = cm;
 						}
 						if ((dType == pTypeHUM) || (dType == pTypeTEMP_HUM) || (dType == pTypeTEMP_HUM_BARO))
 						{
-							root["result"][ii]["hu"] = sd[4];
+							root["result"][ii]["hu"] = sd[5];
 						}
 						if (
 							(dType == pTypeTEMP_HUM_BARO) ||
@@ -15522,28 +15899,28 @@ namespace http {
 							{
 								if (dSubType == sTypeTHBFloat)
 								{
-									sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
+									sprintf(szTmp, "%.1f", atof(sd[6].c_str()) / 10.0f);
 									root["result"][ii]["ba"] = szTmp;
 								}
 								else
-									root["result"][ii]["ba"] = sd[5];
+									root["result"][ii]["ba"] = sd[6];
 							}
 							else if (dType == pTypeTEMP_BARO)
 							{
-								sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
+								sprintf(szTmp, "%.1f", atof(sd[6].c_str()) / 10.0f);
 								root["result"][ii]["ba"] = szTmp;
 							}
 							else if ((dType == pTypeGeneral) && (dSubType == sTypeBaro))
 							{
-								sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
+								sprintf(szTmp, "%.1f", atof(sd[6].c_str()) / 10.0f);
 								root["result"][ii]["ba"] = szTmp;
 							}
 						}
 						if ((dType == pTypeEvohomeZone) || (dType == pTypeEvohomeWater))
 						{
-							double sx = ConvertTemperature(atof(sd[8].c_str()), tempsign);
-							double sm = ConvertTemperature(atof(sd[7].c_str()), tempsign);
-							double se = ConvertTemperature(atof(sd[9].c_str()), tempsign);
+							double sx = ConvertTemperature(atof(sd[9].c_str()), tempsign);
+							double sm = ConvertTemperature(atof(sd[8].c_str()), tempsign);
+							double se = ConvertTemperature(atof(sd[10].c_str()), tempsign);
 							root["result"][ii]["se"] = se;
 							root["result"][ii]["sm"] = sm;
 							root["result"][ii]["sx"] = sx;
@@ -15551,7 +15928,7 @@ namespace http {
 						ii++;
 					}
 					//Previous Year
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Temp_Min, Temp_Max, Chill_Min, Chill_Max,"
 						" Humidity, Barometer, Temp_Avg, Date, SetPoint_Min,"
 						" SetPoint_Max, SetPoint_Avg "
@@ -15649,7 +16026,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Percentage_Min, Percentage_Max, Percentage_Avg, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+					result = m_sql.safe_query_read("SELECT Percentage_Min, Percentage_Max, Percentage_Avg, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 					int ii = 0;
 					if (!result.empty())
 					{
@@ -15665,7 +16042,7 @@ namespace http {
 						}
 					}
 					//add today (have to calculate it)
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT MIN(Percentage), MAX(Percentage), AVG(Percentage) FROM Percentage WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
 						idx, szDateEnd);
 					if (!result.empty())
@@ -15683,7 +16060,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Speed_Min, Speed_Max, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+					result = m_sql.safe_query_read("SELECT Speed_Min, Speed_Max, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 					int ii = 0;
 					if (!result.empty())
 					{
@@ -15698,7 +16075,7 @@ namespace http {
 						}
 					}
 					//add today (have to calculate it)
-					result = m_sql.safe_query("SELECT MIN(Speed), MAX(Speed) FROM Fan WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
+					result = m_sql.safe_query_read("SELECT MIN(Speed), MAX(Speed) FROM Fan WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
 						idx, szDateEnd);
 					if (!result.empty())
 					{
@@ -15714,7 +16091,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Level, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+					result = m_sql.safe_query_read("SELECT Level, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 					int ii = 0;
 					if (!result.empty())
 					{
@@ -15728,7 +16105,7 @@ namespace http {
 						}
 					}
 					//add today (have to calculate it)
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT MAX(Level) FROM UV WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
 						idx, szDateEnd);
 					if (!result.empty())
@@ -15740,7 +16117,7 @@ namespace http {
 						ii++;
 					}
 					//Previous Year
-					result = m_sql.safe_query("SELECT Level, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStartPrev, szDateEndPrev);
+					result = m_sql.safe_query_read("SELECT Level, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStartPrev, szDateEndPrev);
 					if (!result.empty())
 					{
 						iPrev = 0;
@@ -15758,7 +16135,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query("SELECT Total, Rate, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+					result = m_sql.safe_query_read("SELECT Total, Rate, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 					int ii = 0;
 					if (!result.empty())
 					{
@@ -15777,13 +16154,13 @@ namespace http {
 					//add today (have to calculate it)
 					if (dSubType == sTypeRAINWU || dSubType == sTypeRAINByRate)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Total, Total, Rate FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q') ORDER BY ROWID DESC LIMIT 1",
 							idx, szDateEnd);
 					}
 					else
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Total), MAX(Total), MAX(Rate) FROM Rain WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 					}
@@ -15811,7 +16188,7 @@ namespace http {
 						ii++;
 					}
 					//Previous Year
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Total, Rate, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStartPrev, szDateEndPrev);
 					if (!result.empty())
 					{
@@ -15838,13 +16215,11 @@ namespace http {
 					//int nValue = 0;
 					std::string sValue = "";
 
-					result = m_sql.safe_query("SELECT nValue, sValue FROM DeviceStatus WHERE (ID==%" PRIu64 ")",
-						idx);
-					if (!result.empty())
+					_tDeviceStatusRow devRow;
+					if (m_sql.GetDeviceStatusRow(idx, devRow))
 					{
-						std::vector<std::string> sd = result[0];
-						//nValue = atoi(sd[0].c_str());
-						sValue = sd[1];
+						//nValue = devRow.nValue;
+						sValue = devRow.sValue;
 					}
 
 					int ii = 0;
@@ -15852,7 +16227,7 @@ namespace http {
 					if (dType == pTypeP1Power)
 					{
 						//Actual Year
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Value1,Value2,Value5,Value6, Date,"
 							" Counter1, Counter2, Counter3, Counter4 "
 							"FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q'"
@@ -15939,7 +16314,7 @@ namespace http {
 							}
 						}
 						//Previous Year
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Value1,Value2,Value5,Value6, Date "
 							"FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC",
 							dbasetable.c_str(), idx, szDateStartPrev, szDateEndPrev);
@@ -15981,7 +16356,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value1,Value2,Value3,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value1,Value2,Value3,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							for (const auto & itt : result)
@@ -15995,7 +16370,7 @@ namespace http {
 								ii++;
 							}
 						}
-						result = m_sql.safe_query("SELECT Value2,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStartPrev, szDateEndPrev);
+						result = m_sql.safe_query_read("SELECT Value2,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStartPrev, szDateEndPrev);
 						if (!result.empty())
 						{
 							iPrev = 0;
@@ -16017,7 +16392,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value1,Value2, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value1,Value2, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							for (const auto & itt : result)
@@ -16053,7 +16428,7 @@ namespace http {
 							vdiv = 1000.0f;
 						}
 
-						result = m_sql.safe_query("SELECT Value1,Value2,Value3,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value1,Value2,Value3,Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							for (const auto & itt : result)
@@ -16106,7 +16481,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query("SELECT Value1,Value2,Value3, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value1,Value2,Value3, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							for (const auto & itt : result)
@@ -16126,7 +16501,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Value1,Value2, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
@@ -16148,7 +16523,7 @@ namespace http {
 						root["status"] = "OK";
 						root["title"] = "Graph " + sensor + " " + srange;
 
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Value1,Value2, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
@@ -16165,7 +16540,7 @@ namespace http {
 					}
 					else if (dType == pTypeCURRENT)
 					{
-						result = m_sql.safe_query("SELECT Value1,Value2,Value3,Value4,Value5,Value6, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value1,Value2,Value3,Value4,Value5,Value6, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							//CM113
@@ -16251,7 +16626,7 @@ namespace http {
 					}
 					else if (dType == pTypeCURRENTENERGY)
 					{
-						result = m_sql.safe_query("SELECT Value1,Value2,Value3,Value4,Value5,Value6, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
+						result = m_sql.safe_query_read("SELECT Value1,Value2,Value3,Value4,Value5,Value6, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
 						if (!result.empty())
 						{
 							//CM180i
@@ -16422,98 +16797,86 @@ namespace http {
 						{
 							root["counter"] = "0";
 						}
-						//Actual Year
-						result = m_sql.safe_query("SELECT Value, Date, Counter FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart, szDateEnd);
-						if (!result.empty())
-						{
-							for (const auto & itt : result)
-							{
-								std::vector<std::string> sd = itt;
+						//Actual Year, rows are converted while they are stepped
+						std::string szQuery = "SELECT Value, Date, Counter FROM " + dbasetable + " WHERE (DeviceRowID==? AND Date>=? AND Date<=?) ORDER BY Date ASC";
+						m_sql.bind_query_read([&](const CSQLRow& sd) {
+							root["result"][ii]["d"] = std::string(sd.GetText(1), std::min(sd.GetTextLength(1), 16));
 
-								root["result"][ii]["d"] = sd[1].substr(0, 16);
+							double fvalue = sd.GetDouble(0);
+							double fcounter = sd.GetDouble(2);
 
-								std::string szValue = sd[0];
-
-								double fcounter = atof(sd[2].c_str());
-
-								switch (metertype)
-								{
-								case MTYPE_ENERGY:
-								case MTYPE_ENERGY_GENERATED:
-									sprintf(szTmp, "%.3f", atof(szValue.c_str()) / divider);
-									root["result"][ii]["v"] = szTmp;
-									if (fcounter != 0)
-										sprintf(szTmp, "%.3f", AddjValue + ((fcounter - atof(szValue.c_str())) / divider));
-									else
-										strcpy(szTmp, "0");
-									root["result"][ii]["c"] = szTmp;
-									break;
-								case MTYPE_GAS:
-									sprintf(szTmp, "%.2f", atof(szValue.c_str()) / divider);
-									root["result"][ii]["v"] = szTmp;
-									if (fcounter != 0)
-										sprintf(szTmp, "%.2f", AddjValue + ((fcounter - atof(szValue.c_str())) / divider));
-									else
-										strcpy(szTmp, "0");
-									root["result"][ii]["c"] = szTmp;
-									break;
-								case MTYPE_WATER:
-									sprintf(szTmp, "%.3f", atof(szValue.c_str()) / divider);
-									root["result"][ii]["v"] = szTmp;
-									if (fcounter != 0)
-										sprintf(szTmp, "%.3f", AddjValue + ((fcounter - atof(szValue.c_str())) / divider));
-									else
-										strcpy(szTmp, "0");
-									root["result"][ii]["c"] = szTmp;
-									break;
-								case MTYPE_COUNTER:
-									sprintf(szTmp, "%.0f", atof(szValue.c_str()));
-									root["result"][ii]["v"] = szTmp;
-									if (fcounter != 0)
-										sprintf(szTmp, "%.0f", AddjValue + ((fcounter - atof(szValue.c_str()))));
-									else
-										strcpy(szTmp, "0");
-									root["result"][ii]["c"] = szTmp;
-									break;
-								}
-								ii++;
+							switch (metertype)
+							{
+							case MTYPE_ENERGY:
+							case MTYPE_ENERGY_GENERATED:
+								sprintf(szTmp, "%.3f", fvalue / divider);
+								root["result"][ii]["v"] = szTmp;
+								if (fcounter != 0)
+									sprintf(szTmp, "%.3f", AddjValue + ((fcounter - fvalue) / divider));
+								else
+									strcpy(szTmp, "0");
+								root["result"][ii]["c"] = szTmp;
+								break;
+							case MTYPE_GAS:
+								sprintf(szTmp, "%.2f", fvalue / divider);
+								root["result"][ii]["v"] = szTmp;
+								if (fcounter != 0)
+									sprintf(szTmp, "%.2f", AddjValue + ((fcounter - fvalue) / divider));
+								else
+									strcpy(szTmp, "0");
+								root["result"][ii]["c"] = szTmp;
+								break;
+							case MTYPE_WATER:
+								sprintf(szTmp, "%.3f", fvalue / divider);
+								root["result"][ii]["v"] = szTmp;
+								if (fcounter != 0)
+									sprintf(szTmp, "%.3f", AddjValue + ((fcounter - fvalue) / divider));
+								else
+									strcpy(szTmp, "0");
+								root["result"][ii]["c"] = szTmp;
+								break;
+							case MTYPE_COUNTER:
+								sprintf(szTmp, "%.0f", fvalue);
+								root["result"][ii]["v"] = szTmp;
+								if (fcounter != 0)
+									sprintf(szTmp, "%.0f", AddjValue + ((fcounter - fvalue)));
+								else
+									strcpy(szTmp, "0");
+								root["result"][ii]["c"] = szTmp;
+								break;
 							}
-						}
+							ii++;
+							return true;
+						}, szQuery.c_str(), idx, szDateStart, szDateEnd);
 						//Past Year
-						result = m_sql.safe_query("SELECT Value, Date, Counter FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStartPrev, szDateEndPrev);
-						if (!result.empty())
-						{
-							iPrev = 0;
-							for (const auto & itt : result)
-							{
-								std::vector<std::string> sd = itt;
-
-								root["resultprev"][iPrev]["d"] = sd[1].substr(0, 16);
+						iPrev = 0;
+						m_sql.bind_query_read([&](const CSQLRow& sd) {
+							root["resultprev"][iPrev]["d"] = std::string(sd.GetText(1), std::min(sd.GetTextLength(1), 16));
 
-								std::string szValue = sd[0];
-								switch (metertype)
-								{
-								case MTYPE_ENERGY:
-								case MTYPE_ENERGY_GENERATED:
-									sprintf(szTmp, "%.3f", atof(szValue.c_str()) / divider);
-									root["resultprev"][iPrev]["v"] = szTmp;
-									break;
-								case MTYPE_GAS:
-									sprintf(szTmp, "%.2f", atof(szValue.c_str()) / divider);
-									root["resultprev"][iPrev]["v"] = szTmp;
-									break;
-								case MTYPE_WATER:
-									sprintf(szTmp, "%.3f", atof(szValue.c_str()) / divider);
-									root["resultprev"][iPrev]["v"] = szTmp;
-									break;
-								case MTYPE_COUNTER:
-									sprintf(szTmp, "%.0f", atof(szValue.c_str()));
-									root["resultprev"][iPrev]["v"] = szTmp;
-									break;
-								}
-								iPrev++;
+							double fvalue = sd.GetDouble(0);
+							switch (metertype)
+							{
+							case MTYPE_ENERGY:
+							case MTYPE_ENERGY_GENERATED:
+								sprintf(szTmp, "%.3f", fvalue / divider);
+								root["resultprev"][iPrev]["v"] = szTmp;
+								break;
+							case MTYPE_GAS:
+								sprintf(szTmp, "%.2f", fvalue / divider);
+								root["resultprev"][iPrev]["v"] = szTmp;
+								break;
+							case MTYPE_WATER:
+								sprintf(szTmp, "%.3f", fvalue / divider);
+								root["resultprev"][iPrev]["v"] = szTmp;
+								break;
+							case MTYPE_COUNTER:
+								sprintf(szTmp, "%.0f", fvalue);
+								root["resultprev"][iPrev]["v"] = szTmp;
+								break;
 							}
-						}
+							iPrev++;
+							return true;
+						}, szQuery.c_str(), idx, szDateStartPrev, szDateEndPrev);
 					}
 					//add today (have to calculate it)
 
@@ -16543,7 +16906,7 @@ namespace http {
 
 					if (dType == pTypeP1Power)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value1), MAX(Value1), MIN(Value2),"
 							" MAX(Value2), MIN(Value5), MAX(Value5),"
 							" MIN(Value6), MAX(Value6) "
@@ -16614,7 +16977,7 @@ namespace http {
 					}
 					else if (dType == pTypeAirQuality)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value), AVG(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -16631,7 +16994,7 @@ namespace http {
 						((dType == pTypeRFXSensor) && ((dSubType == sTypeRFXSensorAD) || (dSubType == sTypeRFXSensorVolt)))
 						)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -16661,7 +17024,7 @@ namespace http {
 							vdiv = 1000.0f;
 						}
 
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -16694,7 +17057,7 @@ namespace http {
 					}
 					else if (dType == pTypeLux)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value), AVG(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -16708,7 +17071,7 @@ namespace http {
 					}
 					else if (dType == pTypeWEIGHT)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -16723,7 +17086,7 @@ namespace http {
 					}
 					else if (dType == pTypeUsage)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID=%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -16736,7 +17099,7 @@ namespace http {
 					}
 					else if (!bIsManagedCounter)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd);
 						if (!result.empty())
@@ -16802,7 +17165,7 @@ namespace http {
 
 					int ii = 0;
 
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Direction, Speed_Min, Speed_Max, Gust_Min,"
 						" Gust_Max, Date "
 						"FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q'"
@@ -16839,7 +17202,7 @@ namespace http {
 						}
 					}
 					//add today (have to calculate it)
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT AVG(Direction), MIN(Speed), MAX(Speed),"
 						" MIN(Gust), MAX(Gust) "
 						"FROM Wind WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q') ORDER BY Date ASC",
@@ -16872,7 +17235,7 @@ namespace http {
 						ii++;
 					}
 					//Previous Year
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Direction, Speed_Min, Speed_Max, Gust_Min,"
 						" Gust_Max, Date "
 						"FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q'"
@@ -16980,12 +17343,7 @@ namespace http {
 					if (sgraphtype == "1")
 					{
 						// Need to get all values of the end date so 23:59:59 is appended to the date string
-						result = m_sql.safe_query(
-							"SELECT Temperature, Chill, Humidity, Barometer,"
-							" Date, DewPoint, SetPoint "
-							"FROM Temperature WHERE (DeviceRowID==%" PRIu64 ""
-							" AND Date>='%q' AND Date<='%q 23:59:59') ORDER BY Date ASC",
-							idx, szDateStart.c_str(), szDateEnd.c_str());
+						result = m_sql.GetTemperatureLog(idx, szDateStart, szDateEnd + " 23:59:59");
 						int ii = 0;
 						if (!result.empty())
 						{
@@ -17051,7 +17409,7 @@ namespace http {
 					}
 					else
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Temp_Min, Temp_Max, Chill_Min, Chill_Max,"
 							" Humidity, Barometer, Date, DewPoint, Temp_Avg,"
 							" SetPoint_Min, SetPoint_Max, SetPoint_Avg "
@@ -17135,23 +17493,15 @@ namespace http {
 						}
 
 						//add today (have to calculate it)
-						result = m_sql.safe_query(
-							"SELECT MIN(Temperature), MAX(Temperature),"
-							" MIN(Chill), MAX(Chill), AVG(Humidity),"
-							" AVG(Barometer), MIN(DewPoint), AVG(Temperature),"
-							" MIN(SetPoint), MAX(SetPoint), AVG(SetPoint) "
-							"FROM Temperature WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
-							idx, szDateEnd.c_str());
-						if (!result.empty())
+						std::vector<std::string> sd = m_sql.GetTemperatureLogStats(idx, szDateEnd, "");
+						if (!sd.empty())
 						{
-							std::vector<std::string> sd = result[0];
-
 							root["result"][ii]["d"] = szDateEnd;
 							if (sendTemp)
 							{
 								double te = ConvertTemperature(atof(sd[1].c_str()), tempsign);
 								double tm = ConvertTemperature(atof(sd[0].c_str()), tempsign);
-								double ta = ConvertTemperature(atof(sd[7].c_str()), tempsign);
+								double ta = ConvertTemperature(atof(sd[2].c_str()), tempsign);
 
 								root["result"][ii]["te"] = te;
 								root["result"][ii]["tm"] = tm;
@@ -17159,14 +17509,14 @@ namespace http {
 							}
 							if (sendChill)
 							{
-								double ch = ConvertTemperature(atof(sd[3].c_str()), tempsign);
-								double cm = ConvertTemperature(atof(sd[2].c_str()), tempsign);
+								double ch = ConvertTemperature(atof(sd[4].c_str()), tempsign);
+								double cm = ConvertTemperature(atof(sd[3].c_str()), tempsign);
 								root["result"][ii]["ch"] = ch;
 								root["result"][ii]["cm"] = cm;
 							}
 							if (sendHum)
 							{
-								root["result"][ii]["hu"] = sd[4];
+								root["result"][ii]["hu"] = sd[5];
 							}
 							if (sendBaro)
 							{
@@ -17174,26 +17524,26 @@ namespace http {
 								{
 									if (dSubType == sTypeTHBFloat)
 									{
-										sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
+										sprintf(szTmp, "%.1f", atof(sd[6].c_str()) / 10.0f);
 										root["result"][ii]["ba"] = szTmp;
 									}
 									else
-										root["result"][ii]["ba"] = sd[5];
+										root["result"][ii]["ba"] = sd[6];
 								}
 								else if (dType == pTypeTEMP_BARO)
 								{
-									sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
+									sprintf(szTmp, "%.1f", atof(sd[6].c_str()) / 10.0f);
 									root["result"][ii]["ba"] = szTmp;
 								}
 								else if ((dType == pTypeGeneral) && (dSubType == sTypeBaro))
 								{
-									sprintf(szTmp, "%.1f", atof(sd[5].c_str()) / 10.0f);
+									sprintf(szTmp, "%.1f", atof(sd[6].c_str()) / 10.0f);
 									root["result"][ii]["ba"] = szTmp;
 								}
 							}
 							if (sendDew)
 							{
-								double dp = ConvertTemperature(atof(sd[6].c_str()), tempsign);
+								double dp = ConvertTemperature(atof(sd[7].c_str()), tempsign);
 								root["result"][ii]["dp"] = dp;
 							}
 							if (sendSet)
@@ -17214,7 +17564,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Level, Date FROM %s WHERE (DeviceRowID==%" PRIu64 ""
 						" AND Date>='%q' AND Date<='%q') ORDER BY Date ASC",
 						dbasetable.c_str(), idx, szDateStart.c_str(), szDateEnd.c_str());
@@ -17231,7 +17581,7 @@ namespace http {
 						}
 					}
 					//add today (have to calculate it)
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT MAX(Level) FROM UV WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 						idx, szDateEnd.c_str());
 					if (!result.empty())
@@ -17247,7 +17597,7 @@ namespace http {
 					root["status"] = "OK";
 					root["title"] = "Graph " + sensor + " " + srange;
 
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Total, Rate, Date FROM %s "
 						"WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC",
 						dbasetable.c_str(), idx, szDateStart.c_str(), szDateEnd.c_str());
@@ -17266,13 +17616,13 @@ namespace http {
 					//add today (have to calculate it)
 					if (dSubType == sTypeRAINWU || dSubType == sTypeRAINByRate)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Total, Total, Rate FROM Rain WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q') ORDER BY ROWID DESC LIMIT 1",
 							idx, szDateEnd.c_str());
 					}
 					else
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Total), MAX(Total), MAX(Rate) FROM Rain WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd.c_str());
 					}
@@ -17308,7 +17658,7 @@ namespace http {
 					int ii = 0;
 					if (dType == pTypeP1Power)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT Value1,Value2,Value5,Value6, Date "
 							"FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q'"
 							" AND Date<='%q') ORDER BY Date ASC",
@@ -17346,7 +17696,7 @@ namespace http {
 					}
 					else
 					{
-						result = m_sql.safe_query("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart.c_str(), szDateEnd.c_str());
+						result = m_sql.safe_query_read("SELECT Value, Date FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q' AND Date<='%q') ORDER BY Date ASC", dbasetable.c_str(), idx, szDateStart.c_str(), szDateEnd.c_str());
 						if (!result.empty())
 						{
 							for (const auto & itt : result)
@@ -17379,7 +17729,7 @@ namespace http {
 					//add today (have to calculate it)
 					if (dType == pTypeP1Power)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value1), MAX(Value1), MIN(Value2),"
 							" MAX(Value2),MIN(Value5), MAX(Value5),"
 							" MIN(Value6), MAX(Value6) "
@@ -17427,7 +17777,7 @@ namespace http {
 					}
 					else if (!bIsManagedCounter)
 					{
-						result = m_sql.safe_query(
+						result = m_sql.safe_query_read(
 							"SELECT MIN(Value), MAX(Value) FROM Meter WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q')",
 							idx, szDateEnd.c_str());
 						if (!result.empty())
@@ -17470,7 +17820,7 @@ namespace http {
 
 					int ii = 0;
 
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT Direction, Speed_Min, Speed_Max, Gust_Min,"
 						" Gust_Max, Date "
 						"FROM %s WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q'"
@@ -17507,7 +17857,7 @@ namespace http {
 						}
 					}
 					//add today (have to calculate it)
-					result = m_sql.safe_query(
+					result = m_sql.safe_query_read(
 						"SELECT AVG(Direction), MIN(Speed), MAX(Speed), MIN(Gust), MAX(Gust) FROM Wind WHERE (DeviceRowID==%" PRIu64 " AND Date>='%q') ORDER BY Date ASC",
 						idx, szDateEnd.c_str());
 					if (!result.empty())
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <set>
 #include <string>
 #include "../webserver/cWebem.h"
 #include "../webserver/request.hpp"
@@ -94,7 +95,9 @@ public:
 		const bool bFetchFavorites,
 		const time_t LastUpdate,
 		const std::string &username,
-		const std::string &hardwareid = ""); // OTO
+		const std::string &hardwareid = "", // OTO
+		const std::set<uint64_t> *pChangedDevices = NULL,	//only these devices/scenes (change journal)
+		const std::set<uint64_t> *pChangedScenes = NULL);
 
 	// SessionStore interface
 	const WebEmStoredSession GetSession(const std::string & sessionId) override;
@@ -107,6 +110,7 @@ public:
 private:
 	void HandleCommand(const std::string &cparam, WebEmSession & session, const request& req, Json::Value &root);
 	void HandleRType(const std::string &rtype, WebEmSession & session, const request& req, Json::Value &root);
+	bool IsLargeJSonResponse(const std::string &rtype, const request& req);
 
 	bool IsIdxForUser(const WebEmSession *pSession, const int Idx);
 
@@ -185,6 +189,7 @@ private:
 	void Cmd_GetVersion(WebEmSession & session, const request& req, Json::Value &root);
 	void Cmd_GetAuth(WebEmSession & session, const request& req, Json::Value &root);
 	void Cmd_GetUptime(WebEmSession & session, const request& req, Json::Value &root);
+	void Cmd_GetStatistics(WebEmSession & session, const request& req, Json::Value &root);
 	void Cmd_GetActualHistory(WebEmSession & session, const request& req, Json::Value &root);
 	void Cmd_GetNewHistory(WebEmSession & session, const request& req, Json::Value &root);
 	void Cmd_GetConfig(WebEmSession& session, const request& req, Json::Value& root);
@@ -299,6 +304,7 @@ private:
 
 	//RTypes
 	void RType_HandleGraph(WebEmSession & session, const request& req, Json::Value &root);
+	void GetGraphData(WebEmSession & session, const request& req, Json::Value &root);
 	void RType_LightLog(WebEmSession & session, const request& req, Json::Value &root);
 	void RType_TextLog(WebEmSession & session, const request& req, Json::Value &root);
 	void RType_SceneLog(WebEmSession & session, const request& req, Json::Value &root);
@@ -306,6 +312,7 @@ private:
 	void RType_Events(WebEmSession & session, const request& req, Json::Value &root);
 	void RType_Hardware(WebEmSession & session, const request& req, Json::Value &root);
 	void RType_Devices(WebEmSession & session, const request& req, Json::Value &root);
+	void RType_Changes(WebEmSession & session, const request& req, Json::Value &root);
 	void RType_Cameras(WebEmSession& session, const request& req, Json::Value& root);
 	void RType_CamerasUser(WebEmSession& session, const request& req, Json::Value& root);
 	void RType_Users(WebEmSession & session, const request& req, Json::Value &root);
@@ -148,14 +148,16 @@ namespace http {
 			const bool bFetchFavorites,
 			const time_t LastUpdate,
 			const std::string &username,
-			const std::string &hardwareid) // OTO
+			const std::string &hardwareid, // OTO
+			const std::set<uint64_t> *pChangedDevices,
+			const std::set<uint64_t> *pChangedScenes)
 		{
 			if (plainServer_) { // assert
-				plainServer_->GetJSonDevices(root, rused, rfilter, order, rowid, planID, floorID, bDisplayHidden, bDisplayDisabled, bFetchFavorites, LastUpdate, username, hardwareid);
+				plainServer_->GetJSonDevices(root, rused, rfilter, order, rowid, planID, floorID, bDisplayHidden, bDisplayDisabled, bFetchFavorites, LastUpdate, username, hardwareid, pChangedDevices, pChangedScenes);
 			}
 #ifdef WWW_ENABLE_SSL
 			else if (secureServer_) {
-				secureServer_->GetJSonDevices(root, rused, rfilter, order, rowid, planID, floorID, bDisplayHidden, bDisplayDisabled, bFetchFavorites, LastUpdate, username, hardwareid);
+				secureServer_->GetJSonDevices(root, rused, rfilter, order, rowid, planID, floorID, bDisplayHidden, bDisplayDisabled, bFetchFavorites, LastUpdate, username, hardwareid, pChangedDevices, pChangedScenes);
 			}
 #endif
 		}
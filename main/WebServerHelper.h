@@ -45,7 +45,9 @@ namespace http {
 				const bool bFetchFavorites,
 				const time_t LastUpdate,
 				const std::string &username,
-				const std::string &hardwareid = "");
+				const std::string &hardwareid = "",
+				const std::set<uint64_t> *pChangedDevices = NULL,
+				const std::set<uint64_t> *pChangedScenes = NULL);
 			// called from CSQLHelper
 			void ReloadCustomSwitchIcons();
 			std::string our_listener_port;
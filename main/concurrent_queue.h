@@ -113,6 +113,10 @@ public:
 	queue_element_trigger() {
 		elementPopped = false;
 	}
+	void reset() {
+		std::unique_lock<std::mutex> lock(the_mutex);
+		elementPopped = false;
+	}
 	void popped() {
 		std::unique_lock<std::mutex> lock(the_mutex);
 		elementPopped = true;
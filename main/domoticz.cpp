@@ -85,6 +85,7 @@ const char *szHelp =
 "\t-loglevel (combination of: normal,status,error,debug)\n"
 "\t-debuglevel (combination of: normal,hardware,received,webserver,eventsystem,python,thread_id)\n"
 "\t-notimestamps (do not prepend timestamps to logs; useful with syslog, etc.)\n"
+"\t-logasync (write logs from a background thread, log calls do not wait for disk/console)\n"
 "\t-php_cgi_path (for example /usr/bin/php-cgi)\n"
 #ifndef WIN32
 "\t-daemon (run as background daemon)\n"
@@ -150,6 +151,7 @@ std::string logfile;
 bool g_bStopApplication = false;
 bool g_bUseSyslog = false;
 bool g_bRunAsDaemon = false;
+bool g_bLogAsync = false;
 bool g_bDontCacheWWW = false;
 http::server::_eWebCompressionMode g_wwwCompressMode = http::server::WWW_USE_GZIP;
 bool g_bUseUpdater = true;
@@ -634,6 +636,9 @@ bool ParseConfigFile(const std::string &szConfigFile)
 		else if (szFlag == "notimestamps") {
 			_log.EnableLogTimestamps(!GetConfigBool(sLine));
 		}
+		else if (szFlag == "log_async") {
+			g_bLogAsync = GetConfigBool(sLine);
+		}
 #ifndef WIN32
 		else if (szFlag == "syslog") {
 			g_bUseSyslog = true;
@@ -744,6 +749,10 @@ int main(int argc, char**argv)
 		{
 			_log.EnableLogTimestamps(false);
 		}
+		if (cmdLine.HasSwitch("-logasync"))
+		{
+			g_bLogAsync = true;
+		}
 		if (cmdLine.HasSwitch("-log"))
 		{
 			if (cmdLine.GetArgumentCount("-log") != 1)
@@ -1193,6 +1202,10 @@ int main(int argc, char**argv)
 #endif
 	}
 
+	// start log sink thread after daemonization
+	if (g_bLogAsync)
+		_log.StartAsync();
+
 	// start Watchdog thread after daemonization
 	m_LastHeartbeat = mytime(NULL);
 	std::thread thread_watchdog(Do_Watchdog_Work);
@@ -1261,6 +1274,7 @@ int main(int argc, char**argv)
 #endif
 	g_stop_watchdog = true;
 	thread_watchdog.join();
+	_log.StopAsync();
 	return 0;
 }
 
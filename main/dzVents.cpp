@@ -11,6 +11,8 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include "../webserver/Base64.h"
+#include <sys/stat.h>
+#include <fstream>
 
 extern "C" {
 #include <lua.h>
@@ -24,9 +26,13 @@ extern http::server::CWebServerHelper m_webservers;
 CdzVents CdzVents::m_dzvents;
 
 CdzVents::CdzVents(void) :
-	m_version("3.0.2")
+	m_version("3.0.2"),
+	m_scriptsGeneration(0),
+	m_bTriggersChanged(true)
 {
 	m_bdzVentsExist = false;
+	m_databaseTriggers.bAll = false;
+	m_deviceTriggers.bAll = false;
 }
 
 CdzVents::~CdzVents(void)
@@ -38,13 +44,17 @@ const std::string CdzVents::GetVersion()
 	return m_version;
 }
 
-void CdzVents::EvaluateDzVents(lua_State *lua_state, const std::vector<CEventSystem::_tEventQueue> &items, const int secStatus)
+void CdzVents::InitLuaState(lua_State *lua_state)
 {
+	CEventSystem::InitLuaState(lua_state);
+
 	// reroute print library to Domoticz logger
-	luaL_openlibs(lua_state);
 	lua_pushcfunction(lua_state, l_domoticz_print);
 	lua_setglobal(lua_state, "print");
+}
 
+void CdzVents::EvaluateDzVents(lua_State *lua_state, const std::vector<CEventSystem::_tEventQueue> &items, const int secStatus)
+{
 	bool reasonTime = false;
 	bool reasonURL = false;
 	bool reasonSecurity = false;
@@ -786,166 +796,371 @@ void CdzVents::ExportHardwareData(CLuaTable &luaTable, int& index, const std::ve
 	;// to be implemented when hardware notification support is added
 }
 
-void CdzVents::ExportDomoticzDataToLua(lua_State *lua_state, const std::vector<CEventSystem::_tEventQueue> &items)
+//Device rows of the last export are kept in the registry of the (pooled) Lua state, together with
+//the version of the device state they were made from, so only rows of changed devices are made again.
+//Scripts can change the tables they get (device._data, rawData), so a kept row is handed out as an empty
+//proxy that reads from the row. What a script assigns lands in the proxy and is removed on the next export.
+#define DZVENTS_DEVICE_SNAPSHOT "dzVents.deviceSnapshot"
+
+//Pushes the kept table behind the proxy at index
+static void PushDeviceRowTarget(lua_State *lua_state, const int index)
 {
-	boost::shared_lock<boost::shared_mutex> devicestatesMutexLock(m_mainworker.m_eventsystem.m_devicestatesMutex);
-	int index = 1;
-	time_t now = mytime(NULL);
-	struct tm tm1;
-	localtime_r(&now, &tm1);
-	struct tm tLastUpdate;
-	localtime_r(&now, &tLastUpdate);
-	int SensorTimeOut = 60;
-	m_sql.GetPreferencesVar("SensorTimeout", SensorTimeOut);
+	lua_getmetatable(lua_state, index);
+	lua_getfield(lua_state, -1, "__index");
+	lua_remove(lua_state, -2);
+}
 
-	struct tm ntime;
-	time_t checktime;
+static bool IsDeviceRowWritten(lua_State *lua_state, const int index)
+{
+	lua_pushnil(lua_state);
+	if (lua_next(lua_state, index) == 0)
+		return false;
+	lua_pop(lua_state, 2);
+	return true;
+}
 
-	CLuaTable luaTable(lua_state, "domoticzData");
+static void CopyRawFields(lua_State *lua_state, const int fromIndex, const int toIndex)
+{
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, fromIndex) != 0)
+	{
+		lua_pushvalue(lua_state, -2);
+		lua_insert(lua_state, -2);
+		lua_rawset(lua_state, toIndex);
+	}
+}
 
-	// First export all the devices.
-	std::map<uint64_t, CEventSystem::_tDeviceStatus>::iterator iterator;
-	for (iterator = m_mainworker.m_eventsystem.m_devicestates.begin(); iterator != m_mainworker.m_eventsystem.m_devicestates.end(); ++iterator)
+//Pushes a table with the kept values of the proxy at index and what was assigned to it in this run
+static void PushDeviceRowMerged(lua_State *lua_state, const int index)
+{
+	lua_newtable(lua_state);
+	const int mergedIndex = lua_gettop(lua_state);
+	PushDeviceRowTarget(lua_state, index);
+	CopyRawFields(lua_state, mergedIndex + 1, mergedIndex);
+	lua_pop(lua_state, 1);
+	CopyRawFields(lua_state, index, mergedIndex);
+}
+
+//__newindex: the first assignment to a key of the proxy, remember the proxy so it is cleaned on the next export.
+//Assigning nil only removes what the script assigned earlier, the kept value shows again.
+static int DeviceRowNewIndex(lua_State *lua_state)
+{
+	lua_settop(lua_state, 3);
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, DZVENTS_DEVICE_SNAPSHOT);
+	if (lua_istable(lua_state, -1))
 	{
-		CEventSystem::_tDeviceStatus sitem = iterator->second;
-		const char *dev_type = RFX_Type_Desc(sitem.devType, 1);
-		const char *sub_type = RFX_Type_SubType_Desc(sitem.devType, sitem.subType);
+		lua_getfield(lua_state, -1, "dirty");
+		lua_pushvalue(lua_state, 1);
+		lua_pushboolean(lua_state, 1);
+		lua_rawset(lua_state, -3);
+	}
+	lua_settop(lua_state, 3);
+	lua_rawset(lua_state, 1);
+	return 0;
+}
 
-		bool triggerDevice = false;
-		std::vector<CEventSystem::_tEventQueue>::const_iterator itt;
-		for (itt = items.begin(); itt != items.end(); ++itt)
+static int DeviceRowNext(lua_State *lua_state)
+{
+	lua_settop(lua_state, 2);
+	if (lua_next(lua_state, 1) != 0)
+		return 2;
+	lua_pushnil(lua_state);
+	return 1;
+}
+
+//__pairs: iterate the kept table itself unless the script assigned something in this run
+static int DeviceRowPairs(lua_State *lua_state)
+{
+	lua_pushcfunction(lua_state, DeviceRowNext);
+	if (IsDeviceRowWritten(lua_state, 1))
+		PushDeviceRowMerged(lua_state, 1);
+	else
+		PushDeviceRowTarget(lua_state, 1);
+	lua_pushnil(lua_state);
+	return 3;
+}
+
+//__len: rawData is used with # and table.concat
+static int DeviceRowLen(lua_State *lua_state)
+{
+	if (IsDeviceRowWritten(lua_state, 1))
+		PushDeviceRowMerged(lua_state, 1);
+	else
+		PushDeviceRowTarget(lua_state, 1);
+	lua_pushinteger(lua_state, (lua_Integer)lua_rawlen(lua_state, -1));
+	return 1;
+}
+
+//Replaces the table on top of the stack (and the tables in it) by a proxy that reads from it
+static void MakeDeviceRowProxy(lua_State *lua_state)
+{
+	const int targetIndex = lua_gettop(lua_state);
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, targetIndex) != 0)
+	{
+		if (lua_istable(lua_state, -1))
 		{
-			if (sitem.ID == itt->id && itt->reason == m_mainworker.m_eventsystem.REASON_DEVICE)
+			MakeDeviceRowProxy(lua_state);
+			lua_pushvalue(lua_state, -2);
+			lua_insert(lua_state, -2);
+			lua_rawset(lua_state, targetIndex);
+		}
+		else
+			lua_pop(lua_state, 1);
+	}
+	lua_newtable(lua_state);
+	lua_createtable(lua_state, 0, 4);
+	lua_pushvalue(lua_state, targetIndex);
+	lua_setfield(lua_state, -2, "__index");
+	lua_pushcfunction(lua_state, DeviceRowNewIndex);
+	lua_setfield(lua_state, -2, "__newindex");
+	lua_pushcfunction(lua_state, DeviceRowPairs);
+	lua_setfield(lua_state, -2, "__pairs");
+	lua_pushcfunction(lua_state, DeviceRowLen);
+	lua_setfield(lua_state, -2, "__len");
+	lua_setmetatable(lua_state, -2);
+	lua_replace(lua_state, targetIndex);
+}
+
+//Removes what scripts assigned to the proxies in the previous run (snapshot table on top of the stack)
+static void CleanDeviceRowProxies(lua_State *lua_state)
+{
+	lua_getfield(lua_state, -1, "dirty");
+	const int dirtyIndex = lua_gettop(lua_state);
+	if (IsDeviceRowWritten(lua_state, dirtyIndex))
+	{
+		lua_pushnil(lua_state);
+		while (lua_next(lua_state, dirtyIndex) != 0)
+		{
+			lua_pop(lua_state, 1);
+			const int proxyIndex = lua_gettop(lua_state);
+			lua_pushnil(lua_state);
+			while (lua_next(lua_state, proxyIndex) != 0)
 			{
-				triggerDevice = true;
-				sitem.lastUpdate = itt->lastUpdate;
-				sitem.lastLevel = itt->lastLevel;
-				sitem.sValue = itt->sValue;
-				sitem.nValueWording = itt->nValueWording;
-				sitem.nValue = itt->nValue;
-				if (itt->JsonMapString.size() > 0)
-					sitem.JsonMapString = itt->JsonMapString;
-				if (itt->JsonMapFloat.size() > 0)
-					sitem.JsonMapFloat = itt->JsonMapFloat;
-				if (itt->JsonMapInt.size() > 0)
-					sitem.JsonMapInt = itt->JsonMapInt;
-				if (itt->JsonMapBool.size() > 0)
-					sitem.JsonMapBool = itt->JsonMapBool;
+				lua_pop(lua_state, 1);
+				lua_pushnil(lua_state);
+				lua_rawset(lua_state, proxyIndex);
+				lua_pushnil(lua_state);
 			}
 		}
+		lua_newtable(lua_state);
+		lua_setfield(lua_state, dirtyIndex - 1, "dirty");
+	}
+	lua_pop(lua_state, 1);
+}
 
-		//_log.Log(LOG_STATUS, "Getting device with id: %s", rowid.c_str());
+void CdzVents::ExportDevice(lua_State *lua_state, const CEventSystem::_tDeviceStatus &sitem, const CEventSystem::_tEventQueue *pTrigger, const bool timed_out)
+{
+	//a triggered device is exported with the values it was triggered with
+	const std::string &lastUpdate = (pTrigger) ? pTrigger->lastUpdate : sitem.lastUpdate;
+	const int lastLevel = (pTrigger) ? pTrigger->lastLevel : sitem.lastLevel;
+	const std::string &sValue = (pTrigger) ? pTrigger->sValue : sitem.sValue;
+	const std::string &nValueWording = (pTrigger) ? pTrigger->nValueWording : sitem.nValueWording;
+	const int nValue = (pTrigger) ? pTrigger->nValue : sitem.nValue;
+	const std::map<uint8_t, std::string> &JsonMapString = ((pTrigger) && (!pTrigger->JsonMapString.empty())) ? pTrigger->JsonMapString : sitem.JsonMapString;
+	const std::map<uint8_t, float> &JsonMapFloat = ((pTrigger) && (!pTrigger->JsonMapFloat.empty())) ? pTrigger->JsonMapFloat : sitem.JsonMapFloat;
+	const std::map<uint8_t, int> &JsonMapInt = ((pTrigger) && (!pTrigger->JsonMapInt.empty())) ? pTrigger->JsonMapInt : sitem.JsonMapInt;
+	const std::map<uint8_t, bool> &JsonMapBool = ((pTrigger) && (!pTrigger->JsonMapBool.empty())) ? pTrigger->JsonMapBool : sitem.JsonMapBool;
+
+	const char *dev_type = RFX_Type_Desc(sitem.devType, 1);
+	const char *sub_type = RFX_Type_SubType_Desc(sitem.devType, sitem.subType);
+
+	CLuaTable luaTable(lua_state, "device", 1, 12);
+
+	luaTable.AddString("name", sitem.deviceName);
+	luaTable.AddBool("protected", (sitem.protection == 1) );
+	luaTable.AddInteger("id", sitem.ID);
+	luaTable.AddString("baseType","device");
+	luaTable.AddString("deviceType", dev_type);
+	luaTable.AddString("subType", sub_type);
+	luaTable.AddString("switchType", Switch_Type_Desc((_eSwitchType)sitem.switchtype));
+	luaTable.AddInteger("switchTypeValue", sitem.switchtype);
+	luaTable.AddString("lastUpdate", lastUpdate);
+	luaTable.AddInteger("lastLevel", lastLevel);
+	luaTable.AddBool("changed", (pTrigger != NULL));
+	luaTable.AddBool("timedOut", timed_out);
+
+	//get all svalues separate
+	std::vector<std::string> strarray;
+	StringSplit(sValue, ";", strarray);
+
+	luaTable.OpenSubTableEntry("rawData", 0, 0);
+	for (uint8_t i = 0; i < strarray.size(); i++)
+	{
+		luaTable.AddString(i + 1, strarray[i]);
+	}
+	luaTable.CloseSubTableEntry(); // rawData table
 
-		ParseSQLdatetime(checktime, ntime, sitem.lastUpdate, tm1.tm_isdst);
-		bool timed_out = (now - checktime >= SensorTimeOut * 60);
+	luaTable.AddString("deviceID", sitem.deviceID);
+	luaTable.AddString("description", sitem.description);
+	luaTable.AddInteger("batteryLevel", sitem.batteryLevel);
+	luaTable.AddInteger("signalLevel", sitem.signalLevel);
 
-		luaTable.OpenSubTableEntry(index, 1, 12);
-	
-		luaTable.AddString("name", sitem.deviceName);
-		luaTable.AddBool("protected", (sitem.protection == 1) );
-		luaTable.AddInteger("id", sitem.ID);
-		luaTable.AddString("baseType","device");
-		luaTable.AddString("deviceType", dev_type);
-		luaTable.AddString("subType", sub_type);
-		luaTable.AddString("switchType", Switch_Type_Desc((_eSwitchType)sitem.switchtype));
-		luaTable.AddInteger("switchTypeValue", sitem.switchtype);
-		luaTable.AddString("lastUpdate", sitem.lastUpdate);
-		luaTable.AddInteger("lastLevel", sitem.lastLevel);
-		luaTable.AddBool("changed", triggerDevice);
-		luaTable.AddBool("timedOut", timed_out);
-
-		//get all svalues separate
-		std::vector<std::string> strarray;
-		StringSplit(sitem.sValue, ";", strarray);
+	luaTable.OpenSubTableEntry("data", 0, 0);
+	luaTable.AddString("_state", nValueWording);
+	luaTable.AddInteger("_nValue", nValue);
+	luaTable.AddInteger("hardwareID", sitem.hardwareID);
 
-		luaTable.OpenSubTableEntry("rawData", 0, 0);
-		for (uint8_t i = 0; i < strarray.size(); i++)
-		{
-			luaTable.AddString(i + 1, strarray[i]);
-		}
-		luaTable.CloseSubTableEntry(); // rawData table
-	
-		luaTable.AddString("deviceID", sitem.deviceID);
-		luaTable.AddString("description", sitem.description);
-		luaTable.AddInteger("batteryLevel", sitem.batteryLevel);
-		luaTable.AddInteger("signalLevel", sitem.signalLevel);
+	// Lux does not have it's own field yet.
+	if (sitem.devType == pTypeLux && sitem.subType == sTypeLux)
+	{
+		int lux = 0;
+		if (strarray.size() > 0)
+			lux = atoi(strarray[0].c_str());
+		luaTable.AddNumber("lux", lux);
+	}
 
-		luaTable.OpenSubTableEntry("data", 0, 0);
-		luaTable.AddString("_state", sitem.nValueWording);
-		luaTable.AddInteger("_nValue", sitem.nValue);
-		luaTable.AddInteger("hardwareID", sitem.hardwareID);
+	if (sitem.devType == pTypeGeneral && sitem.subType == sTypeKwh)
+	{
+		long double value = 0.0f;
+		if (strarray.size() > 1)
+			value = atof(strarray[1].c_str());
+		luaTable.AddNumber("whTotal", value);
+		value = 0.0f;
+		if (strarray.size() > 0)
+			value = atof(strarray[0].c_str());
+		luaTable.AddNumber("whActual", value);
+	}
 
-		// Lux does not have it's own field yet.
-		if (sitem.devType == pTypeLux && sitem.subType == sTypeLux)
-		{
-			int lux = 0;
-			if (strarray.size() > 0)
-				lux = atoi(strarray[0].c_str());
-			luaTable.AddNumber("lux", lux);
-		}
+	// Now see if we have additional fields from the JSON data
+	for (const auto & itt : JsonMapString)
+	{
+		if (strcmp(m_mainworker.m_eventsystem.JsonMap[itt.first].szOriginal, "LevelNames") == 0 ||
+			strcmp(m_mainworker.m_eventsystem.JsonMap[itt.first].szOriginal, "LevelActions") == 0)
+			luaTable.AddString(
+				m_mainworker.m_eventsystem.JsonMap[itt.first].szNew,
+				base64_decode(itt.second));
+		else
+			luaTable.AddString(
+				m_mainworker.m_eventsystem.JsonMap[itt.first].szNew,
+				itt.second);
+	}
+
+	for (const auto & itt : JsonMapFloat)
+		luaTable.AddNumber(m_mainworker.m_eventsystem.JsonMap[itt.first].szNew, itt.second);
+
+	for (const auto & itt : JsonMapInt)
+		luaTable.AddInteger(m_mainworker.m_eventsystem.JsonMap[itt.first].szNew, itt.second);
+
+	for (const auto & itt : JsonMapBool)
+		luaTable.AddBool(m_mainworker.m_eventsystem.JsonMap[itt.first].szNew, itt.second);
+
+	luaTable.CloseSubTableEntry(); // data table
+	luaTable.PushTable();
+}
+
+void CdzVents::ExportDeviceData(lua_State *lua_state, int &index, const std::vector<CEventSystem::_tEventQueue> &items)
+{
+	const int dataIndex = lua_gettop(lua_state);
+	time_t now = mytime(NULL);
+	struct tm tm1;
+	localtime_r(&now, &tm1);
+	int SensorTimeOut = 60;
+	m_sql.GetPreferencesVar("SensorTimeout", SensorTimeOut);
+
+	struct tm ntime;
+	time_t checktime;
+
+	boost::shared_lock<boost::shared_mutex> devicestatesMutexLock(m_mainworker.m_eventsystem.m_devicestatesMutex);
+	const std::map<uint64_t, CEventSystem::_tDeviceStatus> &devicestates = m_mainworker.m_eventsystem.m_devicestates;
+
+	//start over when devices were reloaded or removed, the old snapshot would keep rows that are gone
+	lua_Integer generation = (lua_Integer)m_mainworker.m_eventsystem.m_deviceStatesGeneration;
+	lua_getfield(lua_state, LUA_REGISTRYINDEX, DZVENTS_DEVICE_SNAPSHOT);
+	bool bValid = false;
+	if (lua_istable(lua_state, -1))
+	{
+		lua_getfield(lua_state, -1, "generation");
+		bValid = (lua_tointeger(lua_state, -1) == generation);
+		lua_pop(lua_state, 1);
+	}
+	if (!bValid)
+	{
+		lua_pop(lua_state, 1);
+		lua_createtable(lua_state, 0, 4);
+		lua_pushinteger(lua_state, generation);
+		lua_setfield(lua_state, -2, "generation");
+		lua_createtable(lua_state, 0, (int)devicestates.size());
+		lua_setfield(lua_state, -2, "rows");
+		lua_createtable(lua_state, 0, (int)devicestates.size());
+		lua_setfield(lua_state, -2, "versions");
+		lua_newtable(lua_state);
+		lua_setfield(lua_state, -2, "dirty");
+		lua_pushvalue(lua_state, -1);
+		lua_setfield(lua_state, LUA_REGISTRYINDEX, DZVENTS_DEVICE_SNAPSHOT);
+	}
+	CleanDeviceRowProxies(lua_state);
+	lua_getfield(lua_state, -1, "rows");
+	const int rowsIndex = lua_gettop(lua_state);
+	lua_getfield(lua_state, -2, "versions");
+	const int versionsIndex = lua_gettop(lua_state);
+
+	for (const auto & itt : devicestates)
+	{
+		const CEventSystem::_tDeviceStatus &sitem = itt.second;
+		const lua_Integer ID = (lua_Integer)sitem.ID;
 
-		if (sitem.devType == pTypeGeneral && sitem.subType == sTypeKwh)
+		const CEventSystem::_tEventQueue *pTrigger = NULL;
+		for (const auto & itt2 : items)
 		{
-			long double value = 0.0f;
-			if (strarray.size() > 1)
-				value = atof(strarray[1].c_str());
-			luaTable.AddNumber("whTotal", value);
-			value = 0.0f;
-			if (strarray.size() > 0)
-				value = atof(strarray[0].c_str());
-			luaTable.AddNumber("whActual", value);
+			if (sitem.ID == itt2.id && itt2.reason == m_mainworker.m_eventsystem.REASON_DEVICE)
+				pTrigger = &itt2;
 		}
 
-		// Now see if we have additional fields from the JSON data
-		if (sitem.JsonMapString.size() > 0)
+		ParseSQLdatetime(checktime, ntime, (pTrigger) ? pTrigger->lastUpdate : sitem.lastUpdate, tm1.tm_isdst);
+		bool timed_out = (now - checktime >= SensorTimeOut * 60);
+
+		lua_Integer rowVersion = 0;
+		if (pTrigger == NULL)
 		{
-			std::map<uint8_t, std::string>::const_iterator itt;
-			for (itt = sitem.JsonMapString.begin(); itt != sitem.JsonMapString.end(); ++itt)
-			{
-				if (strcmp(m_mainworker.m_eventsystem.JsonMap[itt->first].szOriginal, "LevelNames") == 0 ||
-					strcmp(m_mainworker.m_eventsystem.JsonMap[itt->first].szOriginal, "LevelActions") == 0)
-					luaTable.AddString(
-						m_mainworker.m_eventsystem.JsonMap[itt->first].szNew,
-						base64_decode(itt->second));
-				else
-					luaTable.AddString(
-						m_mainworker.m_eventsystem.JsonMap[itt->first].szNew,
-						itt->second);
-			}
+			lua_rawgeti(lua_state, versionsIndex, ID);
+			rowVersion = lua_tointeger(lua_state, -1);
+			lua_pop(lua_state, 1);
 		}
-
-		if (sitem.JsonMapFloat.size() > 0)
+		//no kept row reads as version 0, a state without a version is always made again
+		if ((pTrigger == NULL) && (rowVersion != 0) && (rowVersion == (lua_Integer)sitem.version))
 		{
-			std::map<uint8_t, float>::const_iterator itt;
-			for (itt = sitem.JsonMapFloat.begin(); itt != sitem.JsonMapFloat.end(); ++itt)
-			{
-				luaTable.AddNumber(m_mainworker.m_eventsystem.JsonMap[itt->first].szNew, itt->second);
-			}
+			//unchanged, only the time out depends on the moment of the run
+			lua_rawgeti(lua_state, rowsIndex, ID);
+			PushDeviceRowTarget(lua_state, -1);
+			lua_pushboolean(lua_state, timed_out);
+			lua_setfield(lua_state, -2, "timedOut");
+			lua_pop(lua_state, 1);
 		}
-
-		if (sitem.JsonMapInt.size() > 0)
+		else if (pTrigger != NULL)
 		{
-			std::map<uint8_t, int>::const_iterator itt;
-			for (itt = sitem.JsonMapInt.begin(); itt != sitem.JsonMapInt.end(); ++itt)
-			{
-				luaTable.AddInteger(m_mainworker.m_eventsystem.JsonMap[itt->first].szNew, itt->second);
-			}
+			//a triggered row is marked changed and can have other values than the state, it is not kept
+			ExportDevice(lua_state, sitem, pTrigger, timed_out);
+			lua_pushnil(lua_state);
+			lua_rawseti(lua_state, rowsIndex, ID);
+			lua_pushinteger(lua_state, 0);
+			lua_rawseti(lua_state, versionsIndex, ID);
 		}
-
-		if (sitem.JsonMapBool.size() > 0)
+		else
 		{
-			std::map<uint8_t, bool>::const_iterator itt;
-			for (itt = sitem.JsonMapBool.begin(); itt != sitem.JsonMapBool.end(); ++itt)
-			{
-				luaTable.AddBool(m_mainworker.m_eventsystem.JsonMap[itt->first].szNew, itt->second);
-			}
+			ExportDevice(lua_state, sitem, pTrigger, timed_out);
+			MakeDeviceRowProxy(lua_state);
+			lua_pushvalue(lua_state, -1);
+			lua_rawseti(lua_state, rowsIndex, ID);
+			lua_pushinteger(lua_state, (lua_Integer)sitem.version);
+			lua_rawseti(lua_state, versionsIndex, ID);
 		}
-	
-		luaTable.CloseSubTableEntry(); // data table
-		luaTable.CloseSubTableEntry(); // device entry
+		lua_rawseti(lua_state, dataIndex, index);
 		index++;
 	}
-	devicestatesMutexLock.unlock();
+	lua_settop(lua_state, dataIndex);
+}
+
+void CdzVents::ExportDomoticzDataToLua(lua_State *lua_state, const std::vector<CEventSystem::_tEventQueue> &items)
+{
+	int index = 1;
+
+	lua_createtable(lua_state, 0, 0);
+
+	// First export all the devices.
+	ExportDeviceData(lua_state, index, items);
+
+	CLuaTable luaTable(lua_state, "domoticzData");
 
 	// Now do the scenes and groups.
 	const char *description = "";
@@ -1092,5 +1307,452 @@ void CdzVents::ExportDomoticzDataToLua(lua_State *lua_state, const std::vector<C
 	}
 	ExportHardwareData(luaTable, index, items);
 
-	luaTable.Publish();
+	luaTable.PublishInto(-1);
+	lua_setglobal(lua_state, "domoticzData");
+}
+
+//Skip spaces and Lua comments
+static size_t SkipLuaSpace(const std::string &script, size_t pos)
+{
+	const size_t len = script.length();
+	while (pos < len)
+	{
+		if (isspace((unsigned char)script[pos]))
+			pos++;
+		else if (script.compare(pos, 4, "--[[") == 0)
+		{
+			pos = script.find("]]", pos + 4);
+			pos = (pos == std::string::npos) ? len : pos + 2;
+		}
+		else if (script.compare(pos, 2, "--") == 0)
+		{
+			pos = script.find('\n', pos + 2);
+			pos = (pos == std::string::npos) ? len : pos + 1;
+		}
+		else
+			break;
+	}
+	return pos;
+}
+
+//Replace the comments in a script by spaces, strings are left alone
+static std::string StripLuaComments(const std::string &script)
+{
+	std::string code = script;
+	const size_t len = code.length();
+	size_t pos = 0;
+	while (pos < len)
+	{
+		const char c = code[pos];
+		if ((c == '\'') || (c == '"'))
+		{
+			for (pos++; (pos < len) && (code[pos] != c) && (code[pos] != '\n'); pos++)
+			{
+				if (code[pos] == '\\')
+					pos++;
+			}
+			pos++;
+		}
+		else if (code.compare(pos, 2, "[[") == 0)
+		{
+			pos = code.find("]]", pos + 2);
+			pos = (pos == std::string::npos) ? len : pos + 2;
+		}
+		else if (code.compare(pos, 2, "--") == 0)
+		{
+			size_t epos;
+			if (code.compare(pos, 4, "--[[") == 0)
+			{
+				epos = code.find("]]", pos + 4);
+				epos = (epos == std::string::npos) ? len : epos + 2;
+			}
+			else
+			{
+				epos = code.find('\n', pos + 2);
+				if (epos == std::string::npos)
+					epos = len;
+			}
+			for (; pos < epos; pos++)
+			{
+				if (code[pos] != '\n')
+					code[pos] = ' ';
+			}
+		}
+		else
+			pos++;
+	}
+	return code;
+}
+
+//Parse a string literal ('', "" or [[ ]]) starting at pos, returns the position after it or npos
+static size_t ParseLuaString(const std::string &script, size_t pos, std::string &value)
+{
+	const size_t len = script.length();
+	value.clear();
+	if (script.compare(pos, 2, "[[") == 0)
+	{
+		size_t epos = script.find("]]", pos + 2);
+		if (epos == std::string::npos)
+			return std::string::npos;
+		value = script.substr(pos + 2, epos - pos - 2);
+		return epos + 2;
+	}
+	const char quote = script[pos];
+	if ((quote != '\'') && (quote != '"'))
+		return std::string::npos;
+	for (pos++; pos < len; pos++)
+	{
+		if (script[pos] == quote)
+			return pos + 1;
+		if ((script[pos] == '\\') || (script[pos] == '\n'))
+			return std::string::npos; //escapes are not worth the trouble
+		value += script[pos];
+	}
+	return std::string::npos;
+}
+
+//Skip the value of a 'key = value' table entry (timer rules), returns npos when it is not a simple value
+static size_t SkipLuaValue(const std::string &script, size_t pos)
+{
+	const size_t len = script.length();
+	std::string value;
+	if (pos >= len)
+		return std::string::npos;
+	if (script[pos] == '{')
+	{
+		int depth = 0;
+		while (pos < len)
+		{
+			pos = SkipLuaSpace(script, pos);
+			if (pos >= len)
+				break;
+			const char c = script[pos];
+			if ((c == '\'') || (c == '"') || (script.compare(pos, 2, "[[") == 0))
+			{
+				pos = ParseLuaString(script, pos, value);
+				if (pos == std::string::npos)
+					return pos;
+				continue;
+			}
+			pos++;
+			if (c == '{')
+				depth++;
+			else if ((c == '}') && (--depth == 0))
+				return pos;
+		}
+		return std::string::npos;
+	}
+	if ((script[pos] == '\'') || (script[pos] == '"') || (script.compare(pos, 2, "[[") == 0))
+		return ParseLuaString(script, pos, value);
+	size_t epos = pos;
+	while ((epos < len) && (isalnum((unsigned char)script[epos]) || (script[epos] == '_') || (script[epos] == '.')))
+		epos++;
+	return (epos == pos) ? std::string::npos : epos;
+}
+
+static bool IsLuaIdentifierChar(const char c)
+{
+	return (isalnum((unsigned char)c) || (c == '_'));
+}
+
+//Find the next 'key = value' or ['key'] = value assignment starting at pos,
+//returns the position of the value (pos is moved past the key) or npos when there is none
+static size_t FindLuaTableKey(const std::string &script, const std::string &key, size_t &pos)
+{
+	const size_t len = script.length();
+	while ((pos = script.find(key, pos)) != std::string::npos)
+	{
+		const size_t start = pos;
+		pos += key.length();
+		if ((pos < len) && IsLuaIdentifierChar(script[pos]))
+			continue;
+		size_t tpos = pos;
+		if ((start > 0) && ((script[start - 1] == '\'') || (script[start - 1] == '"')))
+		{
+			//['key'] = ...
+			if ((pos >= len) || (script[pos] != script[start - 1]))
+				continue;
+			tpos = SkipLuaSpace(script, pos + 1);
+			if ((tpos >= len) || (script[tpos] != ']'))
+				continue;
+			tpos++;
+		}
+		else if (start > 0)
+		{
+			//skip domoticz.devices(...), mydevices, ...
+			const char c = script[start - 1];
+			if (IsLuaIdentifierChar(c) || (c == '.') || (c == ':'))
+				continue;
+		}
+		tpos = SkipLuaSpace(script, tpos);
+		if ((tpos >= len) || (script[tpos] != '=') || ((tpos + 1 < len) && (script[tpos + 1] == '=')))
+			continue;
+		return SkipLuaSpace(script, tpos + 1);
+	}
+	return std::string::npos;
+}
+
+//Collect the device names and idx from every 'devices = { ... }' table in the script.
+//Anything that is not a literal (variables, function calls, concatenations) marks the script as
+//triggered by all devices, as does a devices entry we can not parse.
+void CdzVents::ParseDeviceTriggers(const std::string &script, _tDeviceTriggers &triggers)
+{
+	triggers.bAll = false;
+	triggers.IDs.clear();
+	triggers.names.clear();
+	triggers.patterns.clear();
+
+	//only look at the 'on' sections, one that is not a table literal (on = require('triggers')) can trigger anything
+	std::string onSections;
+	const std::string code = StripLuaComments(script);
+	size_t pos = 0;
+	size_t tpos;
+	while ((tpos = FindLuaTableKey(code, "on", pos)) != std::string::npos)
+	{
+		size_t epos = ((tpos < code.length()) && (code[tpos] == '{')) ? SkipLuaValue(code, tpos) : std::string::npos;
+		if (epos == std::string::npos)
+		{
+			triggers.bAll = true;
+			return;
+		}
+		onSections += code.substr(tpos, epos - tpos) + "\n";
+		pos = epos;
+	}
+
+	const size_t len = onSections.length();
+	pos = 0;
+	while ((tpos = FindLuaTableKey(onSections, "devices", pos)) != std::string::npos)
+	{
+		if ((tpos >= len) || (onSections[tpos] != '{'))
+		{
+			triggers.bAll = true;
+			return;
+		}
+
+		//the devices table itself
+		tpos++;
+		while (true)
+		{
+			tpos = SkipLuaSpace(onSections, tpos);
+			if (tpos >= len)
+			{
+				triggers.bAll = true;
+				return;
+			}
+			if (onSections[tpos] == '}')
+				break;
+
+			std::string name;
+			uint64_t ID = 0;
+			bool bID = false;
+			bool bKey = false;
+			if (isdigit((unsigned char)onSections[tpos]))
+			{
+				size_t epos = tpos;
+				while ((epos < len) && isdigit((unsigned char)onSections[epos]))
+					epos++;
+				ID = std::strtoull(onSections.substr(tpos, epos - tpos).c_str(), NULL, 10);
+				bID = true;
+				tpos = epos;
+			}
+			else if ((onSections[tpos] == '\'') || (onSections[tpos] == '"') || (onSections.compare(tpos, 2, "[[") == 0))
+			{
+				tpos = ParseLuaString(onSections, tpos, name);
+			}
+			else if (onSections[tpos] == '[')
+			{
+				//['device'] = { timer rules } or [idx] = { timer rules }
+				tpos = SkipLuaSpace(onSections, tpos + 1);
+				if ((tpos < len) && isdigit((unsigned char)onSections[tpos]))
+				{
+					size_t epos = tpos;
+					while ((epos < len) && isdigit((unsigned char)onSections[epos]))
+						epos++;
+					ID = std::strtoull(onSections.substr(tpos, epos - tpos).c_str(), NULL, 10);
+					bID = true;
+					tpos = epos;
+				}
+				else if (tpos < len)
+					tpos = ParseLuaString(onSections, tpos, name);
+				if (tpos != std::string::npos)
+				{
+					tpos = SkipLuaSpace(onSections, tpos);
+					tpos = ((tpos < len) && (onSections[tpos] == ']')) ? tpos + 1 : std::string::npos;
+				}
+				bKey = true;
+			}
+			else if (IsLuaIdentifierChar(onSections[tpos]))
+			{
+				//myDevice = { timer rules }
+				size_t epos = tpos;
+				while ((epos < len) && IsLuaIdentifierChar(onSections[epos]))
+					epos++;
+				name = onSections.substr(tpos, epos - tpos);
+				tpos = epos;
+				bKey = true;
+			}
+			else
+				tpos = std::string::npos;
+
+			if (bKey && (tpos != std::string::npos))
+			{
+				tpos = SkipLuaSpace(onSections, tpos);
+				if ((tpos < len) && (onSections[tpos] == '='))
+					tpos = SkipLuaValue(onSections, SkipLuaSpace(onSections, tpos + 1));
+				else
+					tpos = std::string::npos;
+			}
+			if (tpos != std::string::npos)
+			{
+				tpos = SkipLuaSpace(onSections, tpos);
+				if ((tpos >= len) || ((onSections[tpos] != ',') && (onSections[tpos] != ';') && (onSections[tpos] != '}')))
+					tpos = std::string::npos;
+			}
+			if (tpos == std::string::npos)
+			{
+				triggers.bAll = true;
+				return;
+			}
+
+			if (bID)
+				triggers.IDs.insert(ID);
+			else if (name.find('*') != std::string::npos)
+				triggers.patterns.push_back(name);
+			else
+				triggers.names.insert(name);
+
+			if (onSections[tpos] != '}')
+				tpos++;
+		}
+		pos = tpos;
+	}
+}
+
+void CdzVents::MergeDeviceTriggers(_tDeviceTriggers &dst, const _tDeviceTriggers &src)
+{
+	dst.bAll |= src.bAll;
+	dst.IDs.insert(src.IDs.begin(), src.IDs.end());
+	dst.names.insert(src.names.begin(), src.names.end());
+	dst.patterns.insert(dst.patterns.end(), src.patterns.begin(), src.patterns.end());
+}
+
+//dzVents wildcard match, '*' matches anything, '.', '^' and '$' any single character
+static bool MatchDevicePattern(const char *pattern, const char *name)
+{
+	while (*pattern != 0)
+	{
+		if (*pattern == '*')
+		{
+			pattern++;
+			do
+			{
+				if (MatchDevicePattern(pattern, name))
+					return true;
+			} while (*name++ != 0);
+			return false;
+		}
+		if (*name == 0)
+			return false;
+		if ((*pattern != *name) && (*pattern != '.') && (*pattern != '^') && (*pattern != '$'))
+			return false;
+		pattern++;
+		name++;
+	}
+	return (*name == 0);
+}
+
+void CdzVents::ClearDatabaseTriggers()
+{
+	std::lock_guard<std::mutex> l(m_triggerMutex);
+	ParseDeviceTriggers("", m_databaseTriggers);
+	m_bTriggersChanged = true;
+}
+
+void CdzVents::AddDatabaseTriggers(const std::string &script)
+{
+	_tDeviceTriggers triggers;
+	ParseDeviceTriggers(script, triggers);
+	std::lock_guard<std::mutex> l(m_triggerMutex);
+	MergeDeviceTriggers(m_databaseTriggers, triggers);
+	m_bTriggersChanged = true;
+}
+
+//Re-read the triggers of the scripts on disk that were added or changed
+void CdzVents::UpdateScriptTriggers(const CScriptRegistry::TScriptList &scripts, const uint32_t generation)
+{
+	if ((generation != 0) && (generation == m_scriptsGeneration))
+		return;
+	m_scriptsGeneration = generation;
+
+	std::map<std::string, _tScriptTriggers> scriptTriggers;
+	for (const auto & itt : *scripts)
+	{
+		if (itt.filename[0] == '.')
+			continue;
+		std::string filename = m_scriptsDir + itt.filename;
+		struct stat st;
+		if (stat(filename.c_str(), &st) != 0)
+			continue;
+		std::map<std::string, _tScriptTriggers>::iterator ittTriggers = m_scriptTriggers.find(itt.filename);
+		if ((ittTriggers != m_scriptTriggers.end()) && (ittTriggers->second.mtime == st.st_mtime) && (ittTriggers->second.size == st.st_size))
+		{
+			scriptTriggers[itt.filename] = ittTriggers->second;
+			continue;
+		}
+		_tScriptTriggers striggers;
+		striggers.mtime = st.st_mtime;
+		striggers.size = st.st_size;
+		std::ifstream infile(filename.c_str(), std::ios::in | std::ios::binary);
+		if (infile.is_open())
+		{
+			std::string script((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+			ParseDeviceTriggers(script, striggers.triggers);
+		}
+		else
+		{
+			ParseDeviceTriggers("", striggers.triggers);
+			striggers.triggers.bAll = true;
+		}
+		scriptTriggers[itt.filename] = striggers;
+		m_bTriggersChanged = true;
+	}
+	if (scriptTriggers.size() != m_scriptTriggers.size())
+		m_bTriggersChanged = true;
+	m_scriptTriggers.swap(scriptTriggers);
+}
+
+bool CdzVents::IsDeviceTriggered(const std::vector<CEventSystem::_tEventQueue> &items, const CScriptRegistry::TScriptList &scripts, const uint32_t generation)
+{
+	std::vector<CEventSystem::_tEventQueue>::const_iterator itt;
+	for (itt = items.begin(); itt != items.end(); ++itt)
+	{
+		if (itt->reason != m_mainworker.m_eventsystem.REASON_DEVICE)
+			return true;
+	}
+
+	std::lock_guard<std::mutex> l(m_triggerMutex);
+	UpdateScriptTriggers(scripts, generation);
+	if (m_bTriggersChanged)
+	{
+		m_deviceTriggers = m_databaseTriggers;
+		for (const auto & ittScript : m_scriptTriggers)
+			MergeDeviceTriggers(m_deviceTriggers, ittScript.second.triggers);
+		m_bTriggersChanged = false;
+	}
+	if (m_deviceTriggers.bAll)
+		return true;
+
+	for (itt = items.begin(); itt != items.end(); ++itt)
+	{
+		if (m_deviceTriggers.IDs.find(itt->id) != m_deviceTriggers.IDs.end())
+			return true;
+		if (m_deviceTriggers.names.find(itt->devname) != m_deviceTriggers.names.end())
+			return true;
+		for (const auto & ittPattern : m_deviceTriggers.patterns)
+		{
+			if (MatchDevicePattern(ittPattern.c_str(), itt->devname.c_str()))
+				return true;
+		}
+	}
+	return false;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "EventSystem.h"
 #include "LuaTable.h"
+#include <set>
 
 class CdzVents
 {
@@ -12,6 +13,13 @@ public:
 	void LoadEvents();
 	bool processLuaCommand(lua_State *lua_state, const std::string &filename, const int tIndex);
 	void EvaluateDzVents(lua_State *lua_state, const std::vector<CEventSystem::_tEventQueue> &items, const int secStatus);
+	static void InitLuaState(lua_State *lua_state);
+
+	//Device triggers ('on = { devices = { ... } }') of the scripts, used to skip the runtime
+	//for device changes no script is listening to
+	void ClearDatabaseTriggers();
+	void AddDatabaseTriggers(const std::string &script);
+	bool IsDeviceTriggered(const std::vector<CEventSystem::_tEventQueue> &items, const CScriptRegistry::TScriptList &scripts, const uint32_t generation);
 
 	std::string m_scriptsDir, m_runtimeDir;
 	bool m_bdzVentsExist;
@@ -25,6 +33,19 @@ private:
 		TYPE_INTEGER,	// 2
 		TYPE_BOOLEAN    // 3
 	};
+	struct _tDeviceTriggers
+	{
+		bool bAll;							//triggers that can not be resolved without running the script
+		std::set<uint64_t> IDs;
+		std::set<std::string> names;
+		std::vector<std::string> patterns;	//names with a '*' wildcard
+	};
+	struct _tScriptTriggers
+	{
+		time_t mtime;
+		off_t size;
+		_tDeviceTriggers triggers;
+	};
 	struct _tLuaTableValues
 	{
 		_eType type;
@@ -43,6 +64,8 @@ private:
 	bool TriggerIFTTT(lua_State *lua_state, const std::vector<_tLuaTableValues> &vLuaTable);
 	bool TriggerCustomEvent(lua_State *lua_state, const std::vector<_tLuaTableValues>& vLuaTable);
 	void ExportHardwareData(CLuaTable &luaTable, int& index, const std::vector<CEventSystem::_tEventQueue>& items);
+	void ExportDevice(lua_State *lua_state, const CEventSystem::_tDeviceStatus &sitem, const CEventSystem::_tEventQueue *pTrigger, const bool timed_out);
+	void ExportDeviceData(lua_State *lua_state, int &index, const std::vector<CEventSystem::_tEventQueue> &items);
 	void ExportDomoticzDataToLua(lua_State *lua_state, const std::vector<CEventSystem::_tEventQueue> &items);
 	void IterateTable(lua_State *lua_state, const int tIndex, std::vector<_tLuaTableValues> &vLuaTable);
 	void SetGlobalVariables(lua_State *lua_state, const bool reasonTime, const int secStatus);
@@ -51,6 +74,16 @@ private:
 	void ProcessNotification(lua_State* lua_state, const std::vector<CEventSystem::_tEventQueue>& items);
 	void ProcessNotificationItem(CLuaTable &luaTable, int &index, const CEventSystem::_tEventQueue& item);
 	static int l_domoticz_print(lua_State* lua_state);
+	static void ParseDeviceTriggers(const std::string &script, _tDeviceTriggers &triggers);
+	static void MergeDeviceTriggers(_tDeviceTriggers &dst, const _tDeviceTriggers &src);
+	void UpdateScriptTriggers(const CScriptRegistry::TScriptList &scripts, const uint32_t generation);
 	static CdzVents m_dzvents;
 	std::string m_version;
+
+	std::mutex m_triggerMutex;
+	_tDeviceTriggers m_databaseTriggers;
+	std::map<std::string, _tScriptTriggers> m_scriptTriggers;
+	_tDeviceTriggers m_deviceTriggers;		//database and script triggers together
+	uint32_t m_scriptsGeneration;
+	bool m_bTriggersChanged;
 };
@@ -1126,6 +1126,7 @@ bool MainWorker::Start()
 	{
 		return false;
 	}
+	CreateRxWorkers();
 
 	HTTPClient::SetUserAgent(GenerateUserAgent());
 	m_notifications.Init();
@@ -1200,9 +1201,29 @@ bool MainWorker::Start()
 
 	m_thread = std::make_shared<std::thread>(&MainWorker::Do_Work, this);
 	SetThreadName(m_thread->native_handle(), "MainWorker");
-	m_rxMessageThread = std::make_shared<std::thread>(&MainWorker::Do_Work_On_Rx_Messages, this);
-	SetThreadName(m_rxMessageThread->native_handle(), "MainWorkerRxMsg");
-	return (m_thread != nullptr) && (m_rxMessageThread != NULL);
+	for (size_t ii = 0; ii < m_rxWorkers.size(); ii++)
+	{
+		m_rxWorkers[ii]->thread = std::make_shared<std::thread>(&MainWorker::Do_Work_On_Rx_Messages, this, ii);
+		char szThreadName[20];
+		sprintf(szThreadName, "MainWorkerRx%d", (int)ii);
+		SetThreadName(m_rxWorkers[ii]->thread->native_handle(), (ii == 0) ? "MainWorkerRxMsg" : szThreadName);
+	}
+	return (m_thread != nullptr);
+}
+
+void MainWorker::CreateRxWorkers()
+{
+	if (!m_rxWorkers.empty())
+		return;
+	//0 = one worker per core, at most 4
+	int nWorkers = 0;
+	m_sql.GetPreferencesVar("RxWorkerThreads", nWorkers);
+	if (nWorkers < 1)
+		nWorkers = std::min<int>(std::max<int>(std::thread::hardware_concurrency(), 1), 4);
+	nWorkers = std::min(nWorkers, 16);
+	for (int ii = 0; ii < nWorkers; ii++)
+		m_rxWorkers.push_back(std::make_shared<_tRxWorker>());
+	_log.Log(LOG_STATUS, "RxQueue: using %d worker(s)", nWorkers);
 }
 
 
@@ -1213,12 +1234,16 @@ bool MainWorker::Stop()
 		m_notificationsystem.NotifyWait(Notification::DZ_STOP, Notification::STATUS_INFO); // blocking call
 	}
 
-	if (m_rxMessageThread) {
-		// Stop RxMessage thread before hardware to avoid NULL pointer exception
-		m_TaskRXMessage.RequestStop();
-		UnlockRxMessageQueue();
-		m_rxMessageThread->join();
-		m_rxMessageThread.reset();
+	// Stop RxMessage threads before hardware to avoid NULL pointer exception
+	m_TaskRXMessage.RequestStop();
+	UnlockRxMessageQueue();
+	for (auto & itt : m_rxWorkers)
+	{
+		if (itt->thread)
+		{
+			itt->thread->join();
+			itt->thread.reset();
+		}
 	}
 	if (m_thread)
 	{
@@ -1229,6 +1254,7 @@ bool MainWorker::Stop()
 		m_scheduler.StopScheduler();
 		m_eventsystem.StopEventSystem();
 		m_notificationsystem.Stop();
+		m_notifications.Stop();
 		m_fibaropush.Stop();
 		m_httppush.Stop();
 		m_influxpush.Stop();
@@ -1412,6 +1438,11 @@ void MainWorker::HandleAutomaticBackups()
 		}
 	}
 
+	nValue = 0;
+	m_sql.GetPreferencesVar("BackupCompress", nValue);
+	bool bCompress = (nValue != 0);
+	std::string szExtension = (bCompress) ? ".db.gz" : ".db";
+
 	DIR* lDir;
 	Notification::_eStatus backupStatus;
 	//struct dirent *ent;
@@ -1423,11 +1454,11 @@ void MainWorker::HandleAutomaticBackups()
 		{
 			Json::Value backupInfo;
 			std::stringstream sTmp;
-			sTmp << "backup-hour-" << std::setw(2) << std::setfill('0') << hour << "-" << szInstanceName << ".db";
+			sTmp << "backup-hour-" << std::setw(2) << std::setfill('0') << hour << "-" << szInstanceName << szExtension;
 
 			backupInfo["type"] = "Hour";
 			backupInfo["location"] = sbackup_DirH + sTmp.str();
-			if (m_sql.BackupDatabase(backupInfo["location"].asString())) {
+			if (m_sql.BackupDatabase(backupInfo["location"].asString(), bCompress)) {
 				m_sql.SetLastBackupNo(backupInfo["type"].asString().c_str(), hour);
 
 				backupStatus=Notification::STATUS_OK;
@@ -1451,11 +1482,11 @@ void MainWorker::HandleAutomaticBackups()
 			now = mytime(NULL);
 			Json::Value backupInfo;
 			std::stringstream sTmp;
-			sTmp << "backup-day-" << std::setw(2) << std::setfill('0') << day << "-" << szInstanceName << ".db";
+			sTmp << "backup-day-" << std::setw(2) << std::setfill('0') << day << "-" << szInstanceName << szExtension;
 
 			backupInfo["type"] = "Day";
 			backupInfo["location"] = sbackup_DirD + sTmp.str();
-			if (m_sql.BackupDatabase(backupInfo["location"].asString())) {
+			if (m_sql.BackupDatabase(backupInfo["location"].asString(), bCompress)) {
 				m_sql.SetLastBackupNo(backupInfo["type"].asString().c_str(), day);
 				backupStatus = Notification::STATUS_OK;
 			}
@@ -1477,11 +1508,11 @@ void MainWorker::HandleAutomaticBackups()
 			now = mytime(NULL);
 			Json::Value backupInfo;
 			std::stringstream sTmp;
-			sTmp << "backup-month-" << std::setw(2) << std::setfill('0') << month + 1 << "-" << szInstanceName << ".db";
+			sTmp << "backup-month-" << std::setw(2) << std::setfill('0') << month + 1 << "-" << szInstanceName << szExtension;
 
 			backupInfo["type"] = "Month";
 			backupInfo["location"] = sbackup_DirM + sTmp.str();
-			if (m_sql.BackupDatabase(backupInfo["location"].asString())) {
+			if (m_sql.BackupDatabase(backupInfo["location"].asString(), bCompress)) {
 				m_sql.SetLastBackupNo(backupInfo["type"].asString().c_str(), month);
 				backupStatus = Notification::STATUS_OK;
 			}
@@ -2004,6 +2035,153 @@ void MainWorker::PushAndWaitRxMessage(const CDomoticzHardwareBase* pHardware, co
 	CheckAndPushRxMessage(pHardware, pRXCommand, defaultName, BatteryLevel, true);
 }
 
+//Switch, remote and security frames are handled before any queued sensor readings
+static bool IsPriorityRxMessage(const uint8_t *pRXCommand)
+{
+	switch (pRXCommand[1])
+	{
+	case pTypeLighting1:
+	case pTypeLighting2:
+	case pTypeLighting3:
+	case pTypeLighting4:
+	case pTypeLighting5:
+	case pTypeLighting6:
+	case pTypeChime:
+	case pTypeFan:
+	case pTypeCurtain:
+	case pTypeBlinds:
+	case pTypeRFY:
+	case pTypeHomeConfort:
+	case pTypeFunkbus:
+	case pTypeHunter:
+	case pTypeSecurity1:
+	case pTypeSecurity2:
+	case pTypeCamera:
+	case pTypeRemote:
+	case pTypeThermostat1:
+	case pTypeThermostat2:
+	case pTypeThermostat3:
+	case pTypeThermostat4:
+	case pTypeRadiator1:
+	case pTypeFS20:
+	case pTypeGeneralSwitch:
+	case pTypeColorSwitch:
+	case pTypeEvohomeRelay:
+		return true;
+	}
+	return false;
+}
+
+//Identification of a sensor whose readings replace each other (absolute values only),
+//so a waiting reading can be dropped in favour of a newer one. Returns 0 for anything else.
+//The key has to cover everything the decoder uses for the DeviceID and Unit, else two devices would share it
+static uint64_t GetRxCoalesceKey(const _eHardwareTypes HwdType, const uint8_t *pRXCommand)
+{
+	const size_t len = pRXCommand[0] + 1;
+	const uint8_t devType = pRXCommand[1];
+	const uint8_t subType = pRXCommand[2];
+	uint32_t id = 0;
+	uint8_t id2 = 0;
+	switch (devType)
+	{
+	case pTypeTEMP:
+		if (len < 6)
+			return 0;
+		id = (pRXCommand[4] << 8) | pRXCommand[5];
+		if ((HwdType == HTYPE_EnOceanESP2) || (HwdType == HTYPE_EnOceanESP3))
+		{
+			//EnOcean stores the unit in the rssi/battery byte
+			if (len < 9)
+				return 0;
+			id2 = pRXCommand[8];
+		}
+		break;
+	case pTypeHUM:
+	case pTypeTEMP_HUM:
+	case pTypeBARO:
+	case pTypeTEMP_HUM_BARO:
+	case pTypeTEMP_RAIN:
+	case pTypeRAIN:
+	case pTypeWIND:
+	case pTypeUV:
+	case pTypeCURRENT:
+	case pTypePOWER:
+	case pTypeWEIGHT:
+		if (len < 6)
+			return 0;
+		id = (pRXCommand[4] << 8) | pRXCommand[5];
+		break;
+	case pTypeRFXSensor:
+		if ((len < 5) || (subType == sTypeRFXSensorMessage))
+			return 0;
+		id = pRXCommand[4];
+		if ((HwdType == HTYPE_EnOceanESP2) || (HwdType == HTYPE_EnOceanESP3))
+		{
+			//EnOcean stores the unit in the rssi/filler byte
+			if (len < 8)
+				return 0;
+			id2 = pRXCommand[7];
+		}
+		break;
+	case pTypeUsage:
+	case pTypeLux:
+		if (len < 8)
+			return 0;
+		id = (pRXCommand[3] << 24) | (pRXCommand[4] << 16) | (pRXCommand[5] << 8) | pRXCommand[6];
+		id2 = pRXCommand[7]; //dunit, child sensors of one node share id1..id4
+		break;
+	case pTypeAirQuality:
+		if (len < 5)
+			return 0;
+		id = (pRXCommand[3] << 8) | pRXCommand[4];
+		break;
+	case pTypeP1Power:
+	{
+		if (len < sizeof(P1Power))
+			return 0;
+		const P1Power *pMeter = reinterpret_cast<const P1Power*>(pRXCommand);
+		id = (uint32_t)pMeter->ID;
+		break;
+	}
+	case pTypeP1Gas:
+	{
+		if (len < sizeof(P1Gas))
+			return 0;
+		const P1Gas *pMeter = reinterpret_cast<const P1Gas*>(pRXCommand);
+		id = (uint32_t)pMeter->ID;
+		break;
+	}
+	case pTypeGeneral:
+	{
+		//not kWh (can be computed from the usage) or counters/alerts/text
+		if (
+			(subType != sTypeVisibility) &&
+			(subType != sTypeSolarRadiation) &&
+			(subType != sTypeSoilMoisture) &&
+			(subType != sTypeLeafWetness) &&
+			(subType != sTypePercentage) &&
+			(subType != sTypeVoltage) &&
+			(subType != sTypeCurrent) &&
+			(subType != sTypePressure) &&
+			(subType != sTypeBaro) &&
+			(subType != sTypeWaterflow) &&
+			(subType != sTypeSoundLevel) &&
+			(subType != sTypeDistance)
+			)
+			return 0;
+		if (len < sizeof(_tGeneralDevice))
+			return 0;
+		const _tGeneralDevice *pMeter = reinterpret_cast<const _tGeneralDevice*>(pRXCommand);
+		id = (uint32_t)pMeter->intval1;
+		id2 = pMeter->id;
+		break;
+	}
+	default:
+		return 0;
+	}
+	return (1ULL << 63) | ((uint64_t)devType << 48) | ((uint64_t)subType << 40) | ((uint64_t)id2 << 32) | id;
+}
+
 void MainWorker::CheckAndPushRxMessage(const CDomoticzHardwareBase* pHardware, const uint8_t* pRXCommand, const char* defaultName, const int BatteryLevel, const bool wait)
 {
 	if ((pHardware == NULL) || (pRXCommand == NULL)) {
@@ -2020,19 +2198,19 @@ void MainWorker::CheckAndPushRxMessage(const CDomoticzHardwareBase* pHardware, c
 		return;
 	}
 
-	// Build queue item
+	// Build queue item (without allocations, the queue copies it into a preallocated slot)
 	_tRxQueueItem rxMessage;
-	if (defaultName != NULL)
-	{
-		rxMessage.Name = defaultName;
-	}
+	rxMessage.Name = m_rxNames.Intern(defaultName);
+	if (rxMessage.Name == NULL)
+		rxMessage.sName = defaultName;
 	rxMessage.BatteryLevel = BatteryLevel;
 	rxMessage.rxMessageIdx = m_rxMessageIdx++;
 	rxMessage.hardwareId = pHardware->m_HwdID;
 	// defensive copy of the command
-	rxMessage.vrxCommand.resize(pRXCommand[0] + 1);
-	rxMessage.vrxCommand.insert(rxMessage.vrxCommand.begin(), pRXCommand, pRXCommand + pRXCommand[0] + 1);
+	memcpy(rxMessage.rxCommand, pRXCommand, pRXCommand[0] + 1);
 	rxMessage.crc = 0x0;
+	rxMessage.bPriority = IsPriorityRxMessage(pRXCommand);
+	rxMessage.coalesceKey = GetRxCoalesceKey(pHardware->HwdType, pRXCommand);
 #ifdef DEBUG_RXQUEUE
 	// CRC
 	boost::crc_optimal<16, 0x1021, 0xFFFF, 0, false, false> crc_ccitt2;
@@ -2046,10 +2224,11 @@ void MainWorker::CheckAndPushRxMessage(const CDomoticzHardwareBase* pHardware, c
 	}
 
 	// Trigger
-	rxMessage.trigger = NULL; // Should be initialized to NULL if trigger is no used
+	queue_element_trigger* trigger = NULL; // Should be initialized to NULL if trigger is no used
 	if (wait) { // add trigger to wait for the message to be processed
-		rxMessage.trigger = new queue_element_trigger();
+		trigger = m_rxTriggers.Acquire();
 	}
+	rxMessage.trigger = trigger;
 
 #ifdef DEBUG_RXQUEUE
 	_log.Log(LOG_STATUS, "RxQueue: push a rxMessage(%lu) (hrdwId=%d, hrdwType=%d, hrdwName=%s, type=%02X, subtype=%02X)",
@@ -2061,16 +2240,27 @@ void MainWorker::CheckAndPushRxMessage(const CDomoticzHardwareBase* pHardware, c
 		pRXCommand[2]);
 #endif
 
-	// Push item to queue
-	m_rxMessageQueue.push(rxMessage);
+	if (m_rxWorkers.empty())
+	{
+		if (trigger != NULL)
+			m_rxTriggers.Release(trigger);
+		return;
+	}
+
+	// Push item to the queue of the worker handling this hardware
+#ifdef DEBUG_RXQUEUE
+	unsigned long rxMessageIdx = rxMessage.rxMessageIdx;
+#endif
+	m_rxWorkers[pHardware->m_HwdID % m_rxWorkers.size()]->queue.Push(rxMessage);
 
-	if (rxMessage.trigger != NULL) {
+	if (trigger != NULL) {
 #ifdef DEBUG_RXQUEUE
-		_log.Log(LOG_STATUS, "RxQueue: wait for rxMessage(%lu) to be processed...", rxMessage.rxMessageIdx);
+		_log.Log(LOG_STATUS, "RxQueue: wait for rxMessage(%lu) to be processed...", rxMessageIdx);
 #endif
-		while (!rxMessage.trigger->timed_wait(std::chrono::duration<int>(1))) {
+		bool bPopped = false;
+		while (!(bPopped = trigger->timed_wait(std::chrono::duration<int>(1)))) {
 #ifdef DEBUG_RXQUEUE
-			_log.Log(LOG_STATUS, "RxQueue: wait 1s for rxMessage(%lu) to be processed...", rxMessage.rxMessageIdx);
+			_log.Log(LOG_STATUS, "RxQueue: wait 1s for rxMessage(%lu) to be processed...", rxMessageIdx);
 #endif
 			if (m_TaskRXMessage.IsStopRequested(0)) {
 				// Server is stopping
@@ -2078,11 +2268,13 @@ void MainWorker::CheckAndPushRxMessage(const CDomoticzHardwareBase* pHardware, c
 			}
 		}
 #ifdef DEBUG_RXQUEUE
-		if (moreThanTimeout) {
-			_log.Log(LOG_STATUS, "RxQueue: rxMessage(%lu) processed", rxMessage.rxMessageIdx);
+		if (bPopped) {
+			_log.Log(LOG_STATUS, "RxQueue: rxMessage(%lu) processed", rxMessageIdx);
 		}
 #endif
-		delete rxMessage.trigger;
+		// A trigger that was not popped yet can still be signalled by a worker, it is not reused
+		if (bPopped)
+			m_rxTriggers.Release(trigger);
 	}
 }
 
@@ -2091,24 +2283,55 @@ void MainWorker::UnlockRxMessageQueue()
 #ifdef DEBUG_RXQUEUE
 	_log.Log(LOG_STATUS, "RxQueue: unlock queue using dummy message");
 #endif
-	// Push dummy message to unlock queue
-	_tRxQueueItem rxMessage;
-	rxMessage.rxMessageIdx = m_rxMessageIdx++;
-	rxMessage.hardwareId = -1;
-	rxMessage.trigger = NULL;
-	rxMessage.BatteryLevel = 0;
-	m_rxMessageQueue.push(rxMessage);
+	// Push dummy message to unlock the queue of every worker
+	for (auto & itt : m_rxWorkers)
+	{
+		_tRxQueueItem rxMessage;
+		rxMessage.rxMessageIdx = m_rxMessageIdx++;
+		rxMessage.hardwareId = -1;
+		rxMessage.Name = "";
+		rxMessage.rxCommand[0] = 0;
+		rxMessage.trigger = NULL;
+		rxMessage.BatteryLevel = 0;
+		rxMessage.crc = 0x0;
+		rxMessage.bPriority = true;
+		rxMessage.coalesceKey = 0;
+		itt->queue.Push(rxMessage);
+	}
 }
 
-void MainWorker::Do_Work_On_Rx_Messages()
+void MainWorker::GetRxQueueStats(_tRxQueueStats &stats)
 {
-	_log.Log(LOG_STATUS, "RxQueue: queue worker started...");
+	memset(&stats, 0, sizeof(stats));
+	double totalLatency = 0;
+	for (auto & itt : m_rxWorkers)
+	{
+		_tRxQueueStats wstats;
+		itt->queue.GetStats(wstats);
+		stats.depth += wstats.depth;
+		stats.priorityDepth += wstats.priorityDepth;
+		stats.maxDepth = std::max(stats.maxDepth, wstats.maxDepth);
+		stats.pushed += wstats.pushed;
+		stats.coalesced += wstats.coalesced;
+		stats.popped += wstats.popped;
+		totalLatency += wstats.avgLatency * wstats.popped;
+		stats.maxLatency = std::max(stats.maxLatency, wstats.maxLatency);
+	}
+	if (stats.popped != 0)
+		stats.avgLatency = totalLatency / stats.popped;
+	stats.workers = m_rxWorkers.size();
+}
+
+void MainWorker::Do_Work_On_Rx_Messages(const size_t workerIdx)
+{
+	CRxMessageQueue &rxQueue = m_rxWorkers[workerIdx]->queue;
+	_log.Log(LOG_STATUS, "RxQueue: queue worker %d started...", (int)workerIdx);
 
 	while (!m_TaskRXMessage.IsStopRequested(0))
 	{
 		// Wait and pop next message or timeout
 		_tRxQueueItem rxQItem;
-		bool hasPopped = m_rxMessageQueue.timed_wait_and_pop<std::chrono::duration<int> >(rxQItem, std::chrono::duration<int>(5));
+		bool hasPopped = rxQueue.TimedPop(rxQItem, std::chrono::seconds(5));
 		// (if no message for 5 seconds, returns anyway to check m_TaskRXMessage.IsStopRequested)
 
 		if (!hasPopped) {
@@ -2140,19 +2363,19 @@ void MainWorker::Do_Work_On_Rx_Messages()
 			if (rxQItem.trigger != NULL) rxQItem.trigger->popped();
 			continue;
 		}
-		if (rxQItem.vrxCommand.empty()) {
+		if (rxQItem.rxCommand[0] == 0) {
 			_log.Log(LOG_ERROR, "RxQueue: cannot retrieve command with id: %d", rxQItem.hardwareId);
 			if (rxQItem.trigger != NULL) rxQItem.trigger->popped();
 			continue;
 		}
 
-		const uint8_t* pRXCommand = &rxQItem.vrxCommand[0];
+		const uint8_t* pRXCommand = rxQItem.rxCommand;
 
 #ifdef DEBUG_RXQUEUE
 		// CRC
 		boost::uint16_t crc = rxQItem.crc;
 		boost::crc_optimal<16, 0x1021, 0xFFFF, 0, false, false> crc_ccitt2;
-		crc_ccitt2 = std::for_each(pRXCommand, pRXCommand + rxQItem.vrxCommand.size(), crc_ccitt2);
+		crc_ccitt2 = std::for_each(pRXCommand, pRXCommand + pRXCommand[0] + 1, crc_ccitt2);
 		if (crc != crc_ccitt2()) {
 			_log.Log(LOG_ERROR, "RxQueue: cannot process invalid rxMessage(%lu) from hardware with id=%d (type %d)",
 				rxQItem.rxMessageIdx,
@@ -2170,14 +2393,14 @@ void MainWorker::Do_Work_On_Rx_Messages()
 			pRXCommand[1],
 			pRXCommand[2]);
 #endif
-		ProcessRXMessage(pHardware, pRXCommand, rxQItem.Name.c_str(), rxQItem.BatteryLevel);
+		ProcessRXMessage(pHardware, pRXCommand, rxQItem.GetName(), rxQItem.BatteryLevel);
 		if (rxQItem.trigger != NULL)
 		{
 			rxQItem.trigger->popped();
 		}
 	}
 
-	_log.Log(LOG_STATUS, "RxQueue: queue worker stopped...");
+	_log.Log(LOG_STATUS, "RxQueue: queue worker %d stopped...", (int)workerIdx);
 }
 
 void MainWorker::ProcessRXMessage(const CDomoticzHardwareBase* pHardware, const uint8_t* pRXCommand, const char* defaultName, const int BatteryLevel)
@@ -3236,7 +3459,10 @@ void MainWorker::decode_Wind(const CDomoticzHardwareBase* pHardware, const tRBUF
 
 	double dDirection;
 	dDirection = (double)(pResponse->WIND.directionh * 256) + pResponse->WIND.directionl;
-	dDirection = m_wind_calculator[windID].AddValueAndReturnAvarage(dDirection);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		dDirection = m_wind_calculator[windID].AddValueAndReturnAvarage(dDirection);
+	}
 
 	std::string strDirection;
 	if (dDirection > 348.75 || dDirection < 11.26)
@@ -3286,7 +3512,10 @@ void MainWorker::decode_Wind(const CDomoticzHardwareBase* pHardware, const tRBUF
 		intSpeed = intGust;
 	}
 
-	m_wind_calculator[windID].SetSpeedGust(intSpeed, intGust);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		m_wind_calculator[windID].SetSpeedGust(intSpeed, intGust);
+	}
 
 	float temp = 0, chill = 0;
 	if (subType != sTypeWINDNoTempNoChill)
@@ -3358,7 +3587,10 @@ void MainWorker::decode_Wind(const CDomoticzHardwareBase* pHardware, const tRBUF
 	m_notifications.CheckAndHandleNotification(DevRowIdx, pHardware->m_HwdID, ID, procResult.DeviceName, Unit, devType, subType, cmnd, szTmp);
 
 	uint64_t tID = ((uint64_t)(pHardware->m_HwdID & 0x7FFFFFFF) << 32) | (DevRowIdx & 0x7FFFFFFF);
-	m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(chill), _tTrendCalculator::TAVERAGE_TEMP);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(chill), _tTrendCalculator::TAVERAGE_TEMP);
+	}
 
 	if (_log.IsDebugLevelEnabled(DEBUG_RECEIVED))
 	{
@@ -3493,7 +3725,10 @@ void MainWorker::decode_Temp(const CDomoticzHardwareBase* pHardware, const tRBUF
 		return;
 
 	uint64_t tID = ((uint64_t)(pHardware->m_HwdID & 0x7FFFFFFF) << 32) | (DevRowIdx & 0x7FFFFFFF);
-	m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	}
 
 	bool bHandledNotification = false;
 	uint8_t humidity = 0;
@@ -3804,7 +4039,10 @@ void MainWorker::decode_TempHum(const CDomoticzHardwareBase* pHardware, const tR
 		return;
 
 	uint64_t tID = ((uint64_t)(pHardware->m_HwdID & 0x7FFFFFFF) << 32) | (DevRowIdx & 0x7FFFFFFF);
-	m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	}
 
 	m_notifications.CheckAndHandleNotification(DevRowIdx, pHardware->m_HwdID, ID, procResult.DeviceName, Unit, devType, subType, cmnd, szTmp);
 
@@ -4014,7 +4252,10 @@ void MainWorker::decode_TempHumBaro(const CDomoticzHardwareBase* pHardware, cons
 		return;
 
 	uint64_t tID = ((uint64_t)(pHardware->m_HwdID & 0x7FFFFFFF) << 32) | (DevRowIdx & 0x7FFFFFFF);
-	m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	}
 
 	//calculate Altitude
 	//float seaLevelPressure=101325.0f;
@@ -4150,7 +4391,10 @@ void MainWorker::decode_TempBaro(const CDomoticzHardwareBase* pHardware, const t
 		return;
 
 	uint64_t tID = ((uint64_t)(pHardware->m_HwdID & 0x7FFFFFFF) << 32) | (DevRowIdx & 0x7FFFFFFF);
-	m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	}
 
 	m_notifications.CheckAndHandleNotification(DevRowIdx, pHardware->m_HwdID, ID, procResult.DeviceName, Unit, devType, subType, cmnd, szTmp);
 
@@ -4254,7 +4498,10 @@ void MainWorker::decode_TempRain(const CDomoticzHardwareBase* pHardware, const t
 		return;
 
 	uint64_t tID = ((uint64_t)(pHardware->m_HwdID & 0x7FFFFFFF) << 32) | (DevRowIdx & 0x7FFFFFFF);
-	m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	{
+		std::lock_guard<std::mutex> l(m_calculatorMutex);
+		m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+	}
 
 	sprintf(szTmp, "%.1f", temp);
 	uint64_t DevRowIdxTemp = m_sql.UpdateValue(pHardware->m_HwdID, ID.c_str(), Unit, pTypeTEMP, sTypeTEMP3, SignalLevel, BatteryLevel, cmnd, szTmp, procResult.DeviceName);
@@ -13675,7 +13922,10 @@ bool MainWorker::UpdateDevice(const int HardwareID, const std::string& DeviceID,
 	if (temp != 12345.0f)
 	{
 		uint64_t tID = ((uint64_t)(HardwareID & 0x7FFFFFFF) << 32) | (devidx & 0x7FFFFFFF);
-		m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+		{
+			std::lock_guard<std::mutex> l(m_calculatorMutex);
+			m_trend_calculator[tID].AddValueAndReturnTendency(static_cast<double>(temp), _tTrendCalculator::TAVERAGE_TEMP);
+		}
 	}
 
 #ifdef ENABLE_PYTHON
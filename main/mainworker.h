@@ -6,12 +6,14 @@
 #include "EventSystem.h"
 #include "NotificationSystem.h"
 #include "Camera.h"
+#include <atomic>
 #include <deque>
 #include "WindCalculation.h"
 #include "TrendCalculator.h"
 #include "StoppableTask.h"
 #include "../tcpserver/TCPServer.h"
 #include "concurrent_queue.h"
+#include "RxMessageQueue.h"
 #include "../webserver/server_settings.hpp"
 #ifdef ENABLE_PYTHON
 #	include "../hardware/plugins/PluginManager.h"
@@ -51,6 +53,7 @@ public:
 #endif
 	void DecodeRXMessage(const CDomoticzHardwareBase *pHardware, const uint8_t *pRXCommand, const char *defaultName, const int BatteryLevel);
 	void PushAndWaitRxMessage(const CDomoticzHardwareBase *pHardware, const uint8_t *pRXCommand, const char *defaultName, const int BatteryLevel);
+	void GetRxQueueStats(_tRxQueueStats &stats);
 
 	bool SwitchLight(const std::string &idx, const std::string &switchcmd, const std::string &level, const std::string &color, const std::string &ooc, const int ExtraDelay, const std::string& User);
 	bool SwitchLight(const uint64_t idx, const std::string &switchcmd, const int level, const _tColor color, const bool ooc, const int ExtraDelay, const std::string& User);
@@ -138,6 +141,7 @@ public:
 	std::vector<std::string> m_webthemes;
 	std::map<uint16_t, _tWindCalculator> m_wind_calculator;
 	std::map<uint64_t, _tTrendCalculator> m_trend_calculator;
+	std::mutex m_calculatorMutex;	//for both calculator maps, the RX workers run in parallel
 
 	time_t m_LastHeartbeat = 0;
 	std::string m_szLastSwitchUser;
@@ -199,20 +203,19 @@ private:
 	uint8_t get_BateryLevel(const _eHardwareTypes HwdType, bool bIsInPercentage, uint8_t level);
 
 	// RxMessage queue resources
-	volatile unsigned long m_rxMessageIdx;
-	std::shared_ptr<std::thread> m_rxMessageThread;
+	std::atomic<unsigned long> m_rxMessageIdx;
 	StoppableTask m_TaskRXMessage;
-	void Do_Work_On_Rx_Messages();
-	struct _tRxQueueItem {
-		std::string Name;
-		int BatteryLevel;
-		unsigned long rxMessageIdx;
-		int hardwareId;
-		std::vector<uint8_t> vrxCommand;
-		boost::uint16_t crc;
-		queue_element_trigger* trigger;
+	//Each hardware is handled by one worker (HardwareID modulo the number of workers),
+	//so messages of a device are processed in order while different hardware is decoded in parallel
+	struct _tRxWorker {
+		CRxMessageQueue queue;
+		std::shared_ptr<std::thread> thread;
 	};
-	concurrent_queue<_tRxQueueItem> m_rxMessageQueue;
+	std::vector<std::shared_ptr<_tRxWorker> > m_rxWorkers;
+	CRxNameTable m_rxNames;
+	CRxTriggerPool m_rxTriggers;
+	void CreateRxWorkers();
+	void Do_Work_On_Rx_Messages(const size_t workerIdx);
 	void UnlockRxMessageQueue();
 	void PushRxMessage(const CDomoticzHardwareBase *pHardware, const uint8_t *pRXCommand, const char *defaultName, const int BatteryLevel);
 	void CheckAndPushRxMessage(const CDomoticzHardwareBase *pHardware, const uint8_t *pRXCommand, const char *defaultName, const int BatteryLevel, const bool wait);
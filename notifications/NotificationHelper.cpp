@@ -29,6 +29,14 @@
 	#include "../msbuild/WindowsHelper.h"
 #endif
 
+// threads that send notifications
+#define NOTIFICATION_WORKERS 4
+// messages waiting per subsystem, the oldest is dropped when it is full
+#define NOTIFICATION_MAX_QUEUE 100
+#define NOTIFICATION_MAX_RETRIES 3
+// seconds before the first retry, doubled for every next retry
+#define NOTIFICATION_RETRY_DELAY 30
+
 typedef std::map<std::string, CNotificationBase*>::iterator it_noti_type;
 
 using namespace http::server;
@@ -37,6 +45,8 @@ CNotificationHelper::CNotificationHelper()
 {
 	m_NotificationSwitchInterval = 0;
 	m_NotificationSensorInterval = 12 * 3600;
+	m_bStopWorkers = false;
+	m_queueStats = _tNotificationQueueStats();
 
 	/* more notifiers can be added here */
 
@@ -57,6 +67,7 @@ CNotificationHelper::CNotificationHelper()
 
 CNotificationHelper::~CNotificationHelper()
 {
+	Stop();
 	for (it_noti_type iter = m_notifiers.begin(); iter != m_notifiers.end(); ++iter) {
 		delete iter->second;
 	}
@@ -65,16 +76,211 @@ CNotificationHelper::~CNotificationHelper()
 void CNotificationHelper::Init()
 {
 	ReloadNotifications();
+
+	std::lock_guard<std::mutex> l(m_queueMutex);
+	m_bStopWorkers = false;
+	while (m_workers.size() < NOTIFICATION_WORKERS)
+	{
+		std::shared_ptr<std::thread> worker = std::make_shared<std::thread>(&CNotificationHelper::Do_Work, this);
+		SetThreadName(worker->native_handle(), "Notification");
+		m_workers.push_back(worker);
+	}
+}
+
+void CNotificationHelper::Stop()
+{
+	std::vector<std::shared_ptr<std::thread> > workers;
+	{
+		std::lock_guard<std::mutex> l(m_queueMutex);
+		m_bStopWorkers = true;
+		if (m_workers.empty())
+			return;
+		workers.swap(m_workers);
+		size_t queued = 0;
+		for (const auto & itt : m_queues)
+			queued += itt.second.messages.size();
+		if (queued != 0)
+			_log.Log(LOG_STATUS, "Notification: %d message(s) not sent", (int)queued);
+	}
+	m_queueCondition.notify_all();
+	for (auto & itt : workers)
+		itt->join();
 }
 
 void CNotificationHelper::AddNotifier(CNotificationBase *notifier)
 {
+	std::lock_guard<std::mutex> l(m_queueMutex);
 	m_notifiers[notifier->GetSubsystemId()] = notifier;
 }
 
 void CNotificationHelper::RemoveNotifier(CNotificationBase *notifier)
 {
-	m_notifiers.erase(notifier->GetSubsystemId());
+	std::unique_lock<std::mutex> lock(m_queueMutex);
+	const std::string subsystem = notifier->GetSubsystemId();
+	//a worker can still be sending with it
+	m_queueCondition.wait(lock, [&] {
+		std::map<std::string, _tNotificationQueue>::const_iterator itt = m_queues.find(subsystem);
+		return ((itt == m_queues.end()) || (!itt->second.bBusy));
+	});
+	m_queues.erase(subsystem);
+	m_notifiers.erase(subsystem);
+}
+
+void CNotificationHelper::QueueMessage(const std::string &subsystem, const _tNotificationMessage &message)
+{
+	std::string szDropped;
+	{
+		std::lock_guard<std::mutex> l(m_queueMutex);
+		it_noti_type ittNotifier = m_notifiers.find(subsystem);
+		if ((ittNotifier == m_notifiers.end()) || (!ittNotifier->second->IsConfigured()))
+			return;
+		_tNotificationQueue &queue = m_queues[subsystem];
+
+		//Only device notifications (Idx != 0) are combined, other messages (scripts, system) all use Idx 0.
+		//How often a device may notify is up to the Switch/Sensor notification intervals, only a message
+		//that is still waiting is combined with the new one
+		if (message.Idx != 0)
+		{
+			//a flapping device gives the same message over and over, only its latest text is sent
+			for (auto & itt : queue.messages)
+			{
+				if ((itt.Idx == message.Idx) && (itt.Subject == message.Subject))
+				{
+					itt.Name = message.Name;
+					itt.Text = message.Text;
+					itt.ExtraData = message.ExtraData;
+					m_queueStats.coalesced++;
+					return;
+				}
+			}
+		}
+
+		if (queue.messages.size() >= NOTIFICATION_MAX_QUEUE)
+		{
+			szDropped = queue.messages.front().Subject;
+			queue.messages.pop_front();
+			m_queueStats.dropped++;
+		}
+		queue.messages.push_back(message);
+		//not notify_one, RemoveNotifier waits on the same condition
+		m_queueCondition.notify_all();
+	}
+	//logged without the queue lock, an error line can end up in the notification log
+	if (!szDropped.empty())
+		_log.Log(LOG_ERROR, "Notification: %s: queue full, '%s' dropped", subsystem.c_str(), szDropped.c_str());
+}
+
+bool CNotificationHelper::GetNextMessage(std::string &subsystem, CNotificationBase *&notifier, _tNotificationMessage &message, time_t &nextTry)
+{
+	//called with m_queueMutex locked, subsystems take turns (starting after the one served last)
+	time_t now = mytime(NULL);
+	nextTry = 0;
+	std::map<std::string, _tNotificationQueue>::iterator start = m_queues.upper_bound(m_lastServed);
+	std::map<std::string, _tNotificationQueue>::iterator itt = start;
+	for (size_t ii = 0; ii < m_queues.size(); ii++)
+	{
+		if (itt == m_queues.end())
+			itt = m_queues.begin();
+		_tNotificationQueue &queue = itt->second;
+		if (!queue.bBusy)
+		{
+			for (std::deque<_tNotificationMessage>::iterator ittMsg = queue.messages.begin(); ittMsg != queue.messages.end(); ++ittMsg)
+			{
+				if (ittMsg->nextTry > now)
+				{
+					//waiting for a retry
+					if ((nextTry == 0) || (ittMsg->nextTry < nextTry))
+						nextTry = ittMsg->nextTry;
+					continue;
+				}
+				it_noti_type ittNotifier = m_notifiers.find(itt->first);
+				if (ittNotifier == m_notifiers.end())
+				{
+					queue.messages.clear();
+					break;
+				}
+				subsystem = itt->first;
+				notifier = ittNotifier->second;
+				message = *ittMsg;
+				queue.messages.erase(ittMsg);
+				m_lastServed = subsystem;
+				return true;
+			}
+		}
+		++itt;
+	}
+	return false;
+}
+
+void CNotificationHelper::Do_Work()
+{
+	std::unique_lock<std::mutex> lock(m_queueMutex);
+	while (!m_bStopWorkers)
+	{
+		std::string subsystem;
+		CNotificationBase *notifier = NULL;
+		_tNotificationMessage message;
+		time_t nextTry;
+		if (!GetNextMessage(subsystem, notifier, message, nextTry))
+		{
+			if (nextTry != 0)
+				m_queueCondition.wait_for(lock, std::chrono::seconds(std::max<time_t>(nextTry - mytime(NULL), 1)));
+			else
+				m_queueCondition.wait(lock);
+			continue;
+		}
+		m_queues[subsystem].bBusy = true;
+		lock.unlock();
+
+		bool bRet = false;
+		try
+		{
+			bRet = notifier->SendMessageEx(message.Idx, message.Name, message.Subject, message.Text, message.ExtraData, message.Priority, message.Sound, message.bFromNotification);
+		}
+		catch (...)
+		{
+			_log.Log(LOG_ERROR, "Notification: Exception sending message (%s)", subsystem.c_str());
+		}
+
+		//a subsystem without (valid) settings fails every time, retrying does not help
+		bool bRetry = ((!bRet) && (message.retries < NOTIFICATION_MAX_RETRIES) && (notifier->IsConfigured()));
+
+		lock.lock();
+		_tNotificationQueue &queue = m_queues[subsystem];
+		queue.bBusy = false;
+		if (bRet)
+			m_queueStats.sent++;
+		else if ((bRetry) && (!m_bStopWorkers))
+		{
+			message.nextTry = mytime(NULL) + (NOTIFICATION_RETRY_DELAY << message.retries);
+			message.retries++;
+			queue.messages.push_back(message);
+			m_queueStats.retried++;
+		}
+		else
+		{
+			m_queueStats.failed++;
+			lock.unlock();
+			_log.Log(LOG_ERROR, "Notification: %s: could not send '%s'", subsystem.c_str(), message.Subject.c_str());
+			lock.lock();
+		}
+		//the subsystem is free again (for other workers and RemoveNotifier)
+		m_queueCondition.notify_all();
+	}
+}
+
+void CNotificationHelper::GetQueueStats(_tNotificationQueueStats &stats)
+{
+	std::lock_guard<std::mutex> l(m_queueMutex);
+	stats = m_queueStats;
+	stats.workers = m_workers.size();
+	stats.queued = 0;
+	stats.subsystems.clear();
+	for (const auto & itt : m_queues)
+	{
+		stats.queued += itt.second.messages.size();
+		stats.subsystems[itt.first] = itt.second.messages.size();
+	}
 }
 
 bool CNotificationHelper::SendMessage(
@@ -140,8 +346,18 @@ bool CNotificationHelper::SendMessageEx(
 			{
 				if (bThread)
 				{
-					boost::thread SendMessageEx(boost::bind(&CNotificationBase::SendMessageEx, iter->second, Idx, Name, Subject, Text, ExtraData, Priority, Sound, bFromNotification));
-					SetThreadName(SendMessageEx.native_handle(), "SendMessageEx");
+					_tNotificationMessage message;
+					message.Idx = Idx;
+					message.Name = Name;
+					message.Subject = Subject;
+					message.Text = Text;
+					message.ExtraData = ExtraData;
+					message.Priority = Priority;
+					message.Sound = Sound;
+					message.bFromNotification = bFromNotification;
+					message.retries = 0;
+					message.nextTry = 0;
+					QueueMessage(iter->first, message);
 				}
 				else
 					bRet |= iter->second->SendMessageEx(Idx, Name, Subject, Text, ExtraData, Priority, Sound, bFromNotification);
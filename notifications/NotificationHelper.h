@@ -2,7 +2,10 @@
 #include "NotificationBase.h"
 #include "../webserver/cWebem.h"
 
+#include <condition_variable>
+#include <deque>
 #include <string>
+#include <thread>
 
 #define NOTIFYALL std::string("")
 
@@ -21,9 +24,22 @@ struct _tNotification
 
 class CNotificationHelper {
 public:
+	struct _tNotificationQueueStats
+	{
+		size_t workers;
+		size_t queued;
+		uint64_t sent;
+		uint64_t failed;		//after all retries
+		uint64_t retried;
+		uint64_t coalesced;		//merged into a queued message for the same device/subject
+		uint64_t dropped;		//queue of the subsystem was full
+		std::map<std::string, size_t> subsystems;	//queued per subsystem
+	};
 	CNotificationHelper();
 	~CNotificationHelper();
 	void Init();
+	void Stop();
+	void GetQueueStats(_tNotificationQueueStats &stats);
 	bool SendMessage(
 		const uint64_t Idx,
 		const std::string &Name,
@@ -135,6 +151,28 @@ public:
 protected:
 	void SetConfigValue(const std::string &key, const std::string &value);
 private:
+	struct _tNotificationMessage
+	{
+		uint64_t Idx;
+		std::string Name;
+		std::string Subject;
+		std::string Text;
+		std::string ExtraData;
+		int Priority;
+		std::string Sound;
+		bool bFromNotification;
+		int retries;
+		time_t nextTry;
+	};
+	struct _tNotificationQueue
+	{
+		std::deque<_tNotificationMessage> messages;
+		bool bBusy;		//a worker is sending a message of this subsystem
+	};
+	void QueueMessage(const std::string &subsystem, const _tNotificationMessage &message);
+	bool GetNextMessage(std::string &subsystem, CNotificationBase *&notifier, _tNotificationMessage &message, time_t &nextTry);
+	void Do_Work();
+
 	bool CheckAndHandleNotification(
 		const uint64_t DevRowIdx,
 		const int HardwareID,
@@ -184,6 +222,15 @@ private:
 	std::map<uint64_t, std::vector<_tNotification> > m_notifications;
 	int m_NotificationSensorInterval;
 	int m_NotificationSwitchInterval;
+
+	//Messages are sent by a fixed number of workers, one message per subsystem at a time
+	std::mutex m_queueMutex;
+	std::condition_variable m_queueCondition;
+	std::map<std::string, _tNotificationQueue> m_queues;
+	std::string m_lastServed;
+	std::vector<std::shared_ptr<std::thread> > m_workers;
+	bool m_bStopWorkers;
+	_tNotificationQueueStats m_queueStats;
 };
 
 extern CNotificationHelper m_notifications;
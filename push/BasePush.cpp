@@ -464,8 +464,6 @@ std::vector<std::string> CBasePush::DropdownOptions(const uint64_t DeviceRowIdxI
 
 std::string CBasePush::DropdownOptionsValue(const uint64_t DeviceRowIdxIn, const int pos)
 {
-	std::string wording = "???";
-	int getpos = pos - 1; // 0 pos is always nvalue/status, 1 and higher goes to svalues
 	std::vector<std::vector<std::string> > result;
 
 	result = m_sql.safe_query("SELECT Type, SubType FROM DeviceStatus WHERE (ID== %" PRIu64 ")", DeviceRowIdxIn);
@@ -473,21 +471,29 @@ std::string CBasePush::DropdownOptionsValue(const uint64_t DeviceRowIdxIn, const
 	{
 		int dType = atoi(result[0][0].c_str());
 		int dSubType = atoi(result[0][1].c_str());
+		return DropdownOptionsValue(dType, dSubType, pos);
+	}
+	return "???";
+}
 
-		std::string sOptions = RFX_Type_SubType_Values(dType, dSubType);
-		std::vector<std::string> tmpV;
-		StringSplit(sOptions, ",", tmpV);
-		if (tmpV.size() > 1)
-		{
-			if ((int)tmpV.size() >= pos && getpos >= 0) {
-				wording = tmpV[getpos];
-			}
-		}
-		else if (tmpV.size() == 1)
-		{
-			wording = sOptions;
+std::string CBasePush::DropdownOptionsValue(const int devType, const int devSubType, const int pos)
+{
+	std::string wording = "???";
+	int getpos = pos - 1; // 0 pos is always nvalue/status, 1 and higher goes to svalues
+
+	std::string sOptions = RFX_Type_SubType_Values(devType, devSubType);
+	std::vector<std::string> tmpV;
+	StringSplit(sOptions, ",", tmpV);
+	if (tmpV.size() > 1)
+	{
+		if ((int)tmpV.size() >= pos && getpos >= 0) {
+			wording = tmpV[getpos];
 		}
 	}
+	else if (tmpV.size() == 1)
+	{
+		wording = sOptions;
+	}
 	return wording;
 }
 
@@ -497,7 +503,7 @@ std::string CBasePush::ProcessSendValue(const std::string &rawsendValue, const i
 	szData[0] = 0;
 	try
 	{
-		std::string vType = DropdownOptionsValue(m_DeviceRowIdx, delpos);
+		std::string vType = DropdownOptionsValue(devType, devSubType, delpos);
 		unsigned char tempsign = m_sql.m_tempsign[0];
 		_eMeterType metertype = (_eMeterType)metertypein;
 
@@ -19,6 +19,7 @@ public:
 
 	static std::vector<std::string> DropdownOptions(const uint64_t DeviceRowIdxIn);
 	static std::string DropdownOptionsValue(const uint64_t DeviceRowIdxIn, const int pos);
+	static std::string DropdownOptionsValue(const int devType, const int devSubType, const int pos);
 protected:
 	PushType m_PushType;
 	bool m_bLinkActive;
@@ -75,10 +75,10 @@ void CFibaroPush::DoFibaroPush()
 		)
 		return;
 	std::vector<std::vector<std::string> > result;
-	result = m_sql.safe_query(
+	result = m_sql.safe_bind_query(
 		"SELECT A.DeviceRowID, A.DelimitedValue, B.ID, B.Type, B.SubType, B.nValue, B.sValue, A.TargetType, A.TargetVariable, A.TargetDeviceID, A.TargetProperty, A.IncludeUnit, B.SwitchType FROM PushLink as A, DeviceStatus as B "
-		"WHERE (A.PushType==%d AND A.DeviceRowID == '%" PRIu64 "' AND A.Enabled = '1' AND A.DeviceRowID==B.ID)",
-		PushType::PUSHTYPE_FIBARO,
+		"WHERE (A.PushType==? AND A.DeviceRowID == ? AND A.Enabled = '1' AND A.DeviceRowID==B.ID)",
+		static_cast<int>(PushType::PUSHTYPE_FIBARO),
 		m_DeviceRowIdx);
 	if (!result.empty())
 	{
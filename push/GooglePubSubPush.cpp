@@ -115,10 +115,10 @@ void CGooglePubSubPush::DoGooglePubSubPush()
 	}
 #endif
 	std::vector<std::vector<std::string> > result;
-	result = m_sql.safe_query(
-		"SELECT A.DeviceRowID, A.DelimitedValue, B.ID, B.Type, B.SubType, B.nValue, B.sValue, A.TargetType, A.TargetVariable, A.TargetDeviceID, A.TargetProperty, A.IncludeUnit, B.SwitchType, strftime('%%s', B.LastUpdate), B.Name FROM PushLink as A, DeviceStatus as B "
-		"WHERE (A.PushType==%d AND A.DeviceRowID == '%" PRIu64 "' AND A.Enabled = '1' AND A.DeviceRowID==B.ID)",
-		PushType::PUSHTYPE_GOOGLE_PUB_SUB,
+	result = m_sql.safe_bind_query(
+		"SELECT A.DeviceRowID, A.DelimitedValue, B.ID, B.Type, B.SubType, B.nValue, B.sValue, A.TargetType, A.TargetVariable, A.TargetDeviceID, A.TargetProperty, A.IncludeUnit, B.SwitchType, strftime('%s', B.LastUpdate), B.Name FROM PushLink as A, DeviceStatus as B "
+		"WHERE (A.PushType==? AND A.DeviceRowID == ? AND A.Enabled = '1' AND A.DeviceRowID==B.ID)",
+		static_cast<int>(PushType::PUSHTYPE_GOOGLE_PUB_SUB),
 		m_DeviceRowIdx);
 	if (!result.empty())
 	{
@@ -15,7 +15,13 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
-CHttpPush::CHttpPush()
+// updates waiting for a slow server, the oldest are dropped
+#define HTTPPUSH_MAX_QUEUE 100
+
+CHttpPush::CHttpPush() :
+	m_bRequestActive(false),
+	m_bStopped(true),
+	m_dropped(0)
 {
 	m_PushType = PushType::PUSHTYPE_HTTP;
 	m_bLinkActive = false;
@@ -24,6 +30,10 @@ CHttpPush::CHttpPush()
 void CHttpPush::Start()
 {
 	UpdateActive();
+	{
+		std::lock_guard<std::mutex> l(m_background_task_mutex);
+		m_bStopped = false;
+	}
 	m_sConnection = m_mainworker.sOnDeviceReceived.connect(boost::bind(&CHttpPush::OnDeviceReceived, this, _1, _2, _3, _4));
 }
 
@@ -31,6 +41,85 @@ void CHttpPush::Stop()
 {
 	if (m_sConnection.connected())
 		m_sConnection.disconnect();
+
+	//the request that is running finishes (or times out), nothing is started after it
+	std::unique_lock<std::mutex> lock(m_background_task_mutex);
+	m_bStopped = true;
+	m_background_task_queue.clear();
+	m_background_task_cond.wait(lock, [this] { return !m_bRequestActive; });
+}
+
+void CHttpPush::QueueRequest(const _tHttpPushRequest &request)
+{
+	{
+		std::lock_guard<std::mutex> l(m_background_task_mutex);
+		if (m_bStopped)
+			return;
+		if (m_bRequestActive)
+		{
+			if (m_background_task_queue.size() >= HTTPPUSH_MAX_QUEUE)
+			{
+				m_background_task_queue.pop_front();
+				m_dropped++;
+			}
+			m_background_task_queue.push_back(request);
+			return;
+		}
+		m_bRequestActive = true;
+	}
+	SendRequest(request);
+}
+
+void CHttpPush::SendRequest(const _tHttpPushRequest &request)
+{
+	HTTPClient::_eHTTPmethod method = HTTPClient::HTTP_METHOD_GET;
+	if (request.method == 1)
+		method = HTTPClient::HTTP_METHOD_POST;
+	else if (request.method == 2)
+		method = HTTPClient::HTTP_METHOD_PUT;
+	HTTPClient::Request(method, request.url, request.data, request.headers,
+		[this, request](const bool bOK, const std::vector<unsigned char> &response, const std::vector<std::string> &/*vHeaderData*/) {
+			OnRequestDone(request, bOK, response);
+		});
+}
+
+void CHttpPush::OnRequestDone(const _tHttpPushRequest &request, const bool bOK, const std::vector<unsigned char> &response)
+{
+	//called on the HTTP client thread
+	if (!bOK)
+	{
+		if (request.method == 0)
+			_log.Log(LOG_ERROR, "HttpLink: Error sending data to http with GET!");
+		else if (request.method == 1)
+			_log.Log(LOG_ERROR, "HttpLink: Error sending data to http with POST!");
+		else
+			_log.Log(LOG_ERROR, "HttpLink: Error sending data to http with PUT!");
+	}
+
+	// debug
+	if (request.bDebug) {
+		std::string sResult(response.begin(), response.end());
+		_log.Log(LOG_NORM, "HttpLink: response %s", sResult.c_str());
+	}
+
+	_tHttpPushRequest next;
+	uint64_t dropped;
+	{
+		std::lock_guard<std::mutex> l(m_background_task_mutex);
+		if ((m_bStopped) || (m_background_task_queue.empty()))
+		{
+			m_bRequestActive = false;
+			m_background_task_cond.notify_all();
+			return;
+		}
+		next = m_background_task_queue.front();
+		m_background_task_queue.pop_front();
+		dropped = m_dropped;
+		m_dropped = 0;
+	}
+	if (dropped != 0)
+		_log.Log(LOG_ERROR, "HttpLink: Server too slow, %" PRIu64 " updates dropped!", dropped);
+	SendRequest(next);
 }
 
 
@@ -71,10 +160,10 @@ void CHttpPush::DoHttpPush()
 		httpDebugActive = true;
 	}
 	std::vector<std::vector<std::string> > result;
-	result = m_sql.safe_query(
-		"SELECT A.DeviceRowID, A.DelimitedValue, B.ID, B.Type, B.SubType, B.nValue, B.sValue, A.TargetType, A.TargetVariable, A.TargetDeviceID, A.TargetProperty, A.IncludeUnit, B.SwitchType, strftime('%%s', B.LastUpdate), B.Name FROM PushLink as A, DeviceStatus as B "
-		"WHERE (A.PushType==%d AND A.DeviceRowID == '%" PRIu64 "' AND A.Enabled = '1' AND A.DeviceRowID==B.ID)",
-		PushType::PUSHTYPE_HTTP,
+	result = m_sql.safe_bind_query(
+		"SELECT A.DeviceRowID, A.DelimitedValue, B.ID, B.Type, B.SubType, B.nValue, B.sValue, A.TargetType, A.TargetVariable, A.TargetDeviceID, A.TargetProperty, A.IncludeUnit, B.SwitchType, strftime('%s', B.LastUpdate), B.Name FROM PushLink as A, DeviceStatus as B "
+		"WHERE (A.PushType==? AND A.DeviceRowID == ? AND A.Enabled = '1' AND A.DeviceRowID==B.ID)",
+		static_cast<int>(PushType::PUSHTYPE_HTTP),
 		m_DeviceRowIdx);
 	if (!result.empty())
 	{
@@ -203,7 +292,6 @@ void CHttpPush::DoHttpPush()
 			replaceAll(httpData, "%idx", sdeviceId);
 
 			if (sendValue != "") {
-				std::string sResult;
 				std::vector<std::string> ExtraHeaders;
 				if (httpAuthInt == 1) {			// BASIC authentication
 					std::stringstream sstr;
@@ -218,13 +306,13 @@ void CHttpPush::DoHttpPush()
 					_log.Log(LOG_NORM, "HttpLink: sending global variable %s with value: %s", targetVariable.c_str(), sendValue.c_str());
 				}
 
-				if (httpMethodInt == 0) {			// GET
-					if (!HTTPClient::GET(httpUrl, ExtraHeaders, sResult, true))
-					{
-						_log.Log(LOG_ERROR, "HttpLink: Error sending data to http with GET!");
-					}
-				}
-				else if (httpMethodInt == 1) {		// POST
+				//sent in the order of the updates, this thread does not wait for the server
+				_tHttpPushRequest request;
+				request.method = httpMethodInt;
+				request.url = httpUrl;
+				request.data = httpData;
+				request.bDebug = httpDebugActive;
+				if (httpMethodInt == 1) {			// POST
 					if (httpHeaders.size() > 0)
 					{
 						// Add additional headers
@@ -235,22 +323,11 @@ void CHttpPush::DoHttpPush()
 							ExtraHeaders.push_back(ExtraHeaders2[i]);
 						}
 					}
-					if (!HTTPClient::POST(httpUrl, httpData, ExtraHeaders, sResult, true, true))
-					{
-						_log.Log(LOG_ERROR, "HttpLink: Error sending data to http with POST!");
-					}
-				}
-				else if (httpMethodInt == 2) {		// PUT
-					if (!HTTPClient::PUT(httpUrl, httpData, ExtraHeaders, sResult, true))
-					{
-						_log.Log(LOG_ERROR, "HttpLink: Error sending data to http with PUT!");
-					}
-				}
-
-				// debug
-				if (httpDebugActive) {
-					_log.Log(LOG_NORM, "HttpLink: response %s", sResult.c_str());
 				}
+				else if ((httpMethodInt != 0) && (httpMethodInt != 2))
+					continue;
+				request.headers = ExtraHeaders;
+				QueueRequest(request);
 			}
 		}
 	}
@@ -1,9 +1,20 @@
 #pragma once
 
 #include "BasePush.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 
 class CHttpPush : public CBasePush
 {
+	struct _tHttpPushRequest
+	{
+		int method;						//0 = GET, 1 = POST, 2 = PUT
+		std::string url;
+		std::string data;
+		std::vector<std::string> headers;
+		bool bDebug;
+	};
 public:
 	CHttpPush();
 	void Start();
@@ -14,5 +25,16 @@ private:
 
 	void OnDeviceReceived(const int m_HwdID, const uint64_t DeviceRowIdx, const std::string &DeviceName, const unsigned char *pRXCommand);
 	void DoHttpPush();
+	void QueueRequest(const _tHttpPushRequest &request);
+	void SendRequest(const _tHttpPushRequest &request);
+	void OnRequestDone(const _tHttpPushRequest &request, const bool bOK, const std::vector<unsigned char> &response);
+
+	//one request is sent at a time, the next one is started when it is finished, so the server gets the updates in order
+	std::mutex m_background_task_mutex;
+	std::condition_variable m_background_task_cond;
+	std::deque<_tHttpPushRequest> m_background_task_queue;
+	bool m_bRequestActive;
+	bool m_bStopped;
+	uint64_t m_dropped;
 };
 extern CHttpPush m_httppush;
@@ -11,16 +11,35 @@
 #include "../main/WebServer.h"
 #include "../webserver/Base64.h"
 #include "../webserver/cWebem.h"
+#include "../webserver/GZipHelper.h"
 #include "../main/localtime_r.h"
+#include <fstream>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
+// points waiting in memory, when InfluxDB can not be reached they are moved to the spool file
+#define INFLUX_MAX_QUEUE 10000
+#define INFLUX_MAX_SPOOL_SIZE (16 * 1024 * 1024)
+// seconds between retries grow up to
+#define INFLUX_MAX_BACKOFF 300
+#define INFLUX_POST_TIMEOUT 30
+
+extern std::string szUserDataFolder;
+
 CInfluxPush::CInfluxPush() :
+	m_bPushLinksLoaded(false),
+	m_spoolSize(0),
+	m_spoolReadPos(0),
+	m_spoolLines(0),
 	m_InfluxPort(8086),
+	m_InfluxBatchSize(500),
+	m_InfluxFlushInterval(500),
+	m_bInfluxCompress(true),
 	m_bInfluxDebugActive(false)
 {
 	m_PushType = PushType::PUSHTYPE_INFLUXDB;
 	m_bLinkActive = false;
+	memset(&m_stats, 0, sizeof(m_stats));
 }
 
 bool CInfluxPush::Start()
@@ -30,6 +49,8 @@ bool CInfluxPush::Start()
 	RequestStart();
 
 	UpdateSettings();
+	ReloadPushLinks();
+	OpenSpool();
 
 	m_thread = std::make_shared<std::thread>(&CInfluxPush::Do_Work, this);
 	SetThreadName(m_thread->native_handle(), "InfluxPush");
@@ -57,6 +78,8 @@ void CInfluxPush::UpdateSettings()
 	int fActive = 0;
 	m_sql.GetPreferencesVar("InfluxActive", fActive);
 	m_bLinkActive = (fActive == 1);
+
+	std::lock_guard<std::mutex> l(m_background_task_mutex);
 	m_InfluxPort = 8086;
 	m_sql.GetPreferencesVar("InfluxIP", m_InfluxIP);
 	m_sql.GetPreferencesVar("InfluxPort", m_InfluxPort);
@@ -65,6 +88,18 @@ void CInfluxPush::UpdateSettings()
 	m_sql.GetPreferencesVar("InfluxUsername", m_InfluxUsername);
 	m_sql.GetPreferencesVar("InfluxPassword", m_InfluxPassword);
 
+	m_InfluxBatchSize = 500;
+	m_sql.GetPreferencesVar("InfluxBatchSize", m_InfluxBatchSize);
+	if (m_InfluxBatchSize < 1)
+		m_InfluxBatchSize = 1;
+	m_InfluxFlushInterval = 500;
+	m_sql.GetPreferencesVar("InfluxFlushInterval", m_InfluxFlushInterval);
+	if (m_InfluxFlushInterval < 100)
+		m_InfluxFlushInterval = 100;
+	int InfluxCompressInt = 1;
+	m_sql.GetPreferencesVar("InfluxCompress", InfluxCompressInt);
+	m_bInfluxCompress = (InfluxCompressInt == 1);
+
 	int InfluxDebugActiveInt = 0;
 	m_bInfluxDebugActive = false;
 	m_sql.GetPreferencesVar("InfluxDebug", InfluxDebugActiveInt);
@@ -91,129 +126,351 @@ void CInfluxPush::UpdateSettings()
 	m_szURL = sURL.str();
 }
 
+void CInfluxPush::ReloadPushLinks()
+{
+	std::lock_guard<std::mutex> l(m_link_mutex);
+	m_bPushLinksLoaded = false;
+}
+
+void CInfluxPush::GetStatistics(_tInfluxStatistics &stats)
+{
+	std::lock_guard<std::mutex> l(m_background_task_mutex);
+	stats = m_stats;
+	stats.queued = m_background_task_queue.size() + m_spoolLines;
+}
+
 void CInfluxPush::OnDeviceReceived(const int m_HwdID, const uint64_t DeviceRowIdx, const std::string &DeviceName, const unsigned char *pRXCommand)
 {
-	m_DeviceRowIdx = DeviceRowIdx;
 	if (m_bLinkActive)
 	{
-		DoInfluxPush();
+		DoInfluxPush(DeviceRowIdx);
 	}
 }
 
-void CInfluxPush::DoInfluxPush()
+//Called with m_link_mutex locked
+void CInfluxPush::LoadPushLinks()
 {
+	m_PushLinks.clear();
 	std::vector<std::vector<std::string> > result;
 	result = m_sql.safe_query(
-		"SELECT A.DeviceRowID, A.DelimitedValue, B.ID, B.Type, B.SubType, B.nValue, B.sValue, A.TargetType, A.TargetVariable, A.TargetDeviceID, A.TargetProperty, A.IncludeUnit, B.Name, B.SwitchType FROM PushLink as A, DeviceStatus as B "
-		"WHERE (A.PushType==%d AND A.DeviceRowID == '%" PRIu64 "' AND A.Enabled==1 AND A.DeviceRowID==B.ID)",
-		PushType::PUSHTYPE_INFLUXDB,
-		m_DeviceRowIdx);
-	if (!result.empty())
+		"SELECT DeviceRowID, DelimitedValue, TargetType, IncludeUnit FROM PushLink WHERE (PushType==%d AND Enabled==1)",
+		static_cast<int>(PushType::PUSHTYPE_INFLUXDB));
+	for (const auto & sd : result)
 	{
-		time_t atime = mytime(NULL);
-		std::string sendValue;
-		std::vector<std::vector<std::string> >::const_iterator itt;
-		for (itt = result.begin(); itt != result.end(); ++itt)
-		{
-			std::vector<std::string> sd = *itt;
-			int delpos = atoi(sd[1].c_str());
-			int dType = atoi(sd[3].c_str());
-			int dSubType = atoi(sd[4].c_str());
-			int nValue = atoi(sd[5].c_str());
-			std::string sValue = sd[6].c_str();
-			int targetType = atoi(sd[7].c_str());
-			//std::string targetVariable = sd[8].c_str();
-			//int targetDeviceID = atoi(sd[9].c_str());
-			//std::string targetProperty = sd[10].c_str();
-			int includeUnit = atoi(sd[11].c_str());
-			std::string name = sd[12];
-			int metertype = atoi(sd[13].c_str());
-
-			std::vector<std::string> strarray;
-			if (sValue.find(";") != std::string::npos) {
-				StringSplit(sValue, ";", strarray);
-				if (int(strarray.size()) >= delpos)
-				{
-					std::string rawsendValue = strarray[delpos - 1].c_str();
-					sendValue = ProcessSendValue(rawsendValue, delpos, nValue, includeUnit, dType, dSubType, metertype);
-				}
+		_tPushLink link;
+		link.DelimitedValue = atoi(sd[1].c_str());
+		link.TargetType = atoi(sd[2].c_str());
+		link.IncludeUnit = atoi(sd[3].c_str());
+		m_PushLinks[std::stoull(sd[0])].push_back(link);
+	}
+	m_bPushLinksLoaded = true;
+}
+
+void CInfluxPush::DoInfluxPush(const uint64_t DeviceRowIdx)
+{
+	std::lock_guard<std::mutex> l(m_link_mutex);
+	if (!m_bPushLinksLoaded)
+		LoadPushLinks();
+	std::map<uint64_t, std::vector<_tPushLink> >::const_iterator itLinks = m_PushLinks.find(DeviceRowIdx);
+	if (itLinks == m_PushLinks.end())
+		return;
+
+	_tDeviceStatusRow devRow;
+	if (!m_sql.GetDeviceStatusRow(DeviceRowIdx, devRow))
+		return;
+	m_DeviceRowIdx = DeviceRowIdx;
+
+	time_t atime = mytime(NULL);
+	std::string sendValue;
+	std::string name = devRow.Name;
+	stdreplace(name, " ", "-");
+	for (const auto & link : itLinks->second)
+	{
+		int delpos = link.DelimitedValue;
+		int dType = devRow.Type;
+		int dSubType = devRow.SubType;
+		int nValue = devRow.nValue;
+		const std::string &sValue = devRow.sValue;
+		int metertype = devRow.SwitchType;
+
+		std::vector<std::string> strarray;
+		if (sValue.find(";") != std::string::npos) {
+			StringSplit(sValue, ";", strarray);
+			if (int(strarray.size()) >= delpos)
+			{
+				std::string rawsendValue = strarray[delpos - 1].c_str();
+				sendValue = ProcessSendValue(rawsendValue, delpos, nValue, link.IncludeUnit, dType, dSubType, metertype);
 			}
-			else
-				sendValue = ProcessSendValue(sValue, delpos, nValue, includeUnit, dType, dSubType, metertype);
+		}
+		else
+			sendValue = ProcessSendValue(sValue, delpos, nValue, link.IncludeUnit, dType, dSubType, metertype);
 
-			if (sendValue != "") {
-				std::string szKey;
-				std::string vType = CBasePush::DropdownOptionsValue(std::stoi(sd[0]), delpos);
-				stdreplace(vType, " ", "-");
-				stdreplace(name, " ", "-");
-				szKey = vType + ",idx=" + sd[0] + ",name=" + name;
+		if (sendValue != "") {
+			std::string vType = CBasePush::DropdownOptionsValue(dType, dSubType, delpos);
+			stdreplace(vType, " ", "-");
+			std::string szKey = vType + ",idx=" + std::to_string(DeviceRowIdx) + ",name=" + name;
 
+			if (link.TargetType == 0)
+			{
+				//Only send on change
+				std::map<std::string, _tPushItem>::iterator itt = m_PushedItems.find(szKey);
+				if (itt != m_PushedItems.end())
+				{
+					if (sendValue == itt->second.svalue)
+						continue;
+				}
 				_tPushItem pItem;
 				pItem.skey = szKey;
 				pItem.stimestamp = atime;
 				pItem.svalue = sendValue;
+				m_PushedItems[szKey] = pItem;
+			}
 
-				if (targetType == 0)
-				{
-					//Only send on change
-					std::map<std::string, _tPushItem>::iterator itt = m_PushedItems.find(szKey);
-					if (itt != m_PushedItems.end())
-					{
-						if (sendValue == itt->second.svalue)
-							continue;
-					}
-					m_PushedItems[szKey] = pItem;
-				}
-
-				std::lock_guard<std::mutex> l(m_background_task_mutex);
-				if (m_background_task_queue.size() < 50)
-					m_background_task_queue.push_back(pItem);
+			std::string szLine = szKey + " value=" + sendValue;
+			if (m_bInfluxDebugActive) {
+				_log.Log(LOG_NORM, "InfluxLink: value %s", szLine.c_str());
 			}
+			szLine += ' ';
+			szLine += std::to_string(atime);
+			QueueLine(szLine);
 		}
 	}
 }
 
-void CInfluxPush::Do_Work()
+void CInfluxPush::QueueLine(const std::string &line)
 {
-	std::vector<_tPushItem> _items2do;
+	std::lock_guard<std::mutex> l(m_background_task_mutex);
+	if (m_background_task_queue.size() >= INFLUX_MAX_QUEUE)
+	{
+		m_stats.dropped++;
+		return;
+	}
+	m_background_task_queue.push_back(line);
+}
 
-	while (!IsStopRequested(500))
+//The spool functions are called with m_background_task_mutex locked (or when the worker is not running)
+void CInfluxPush::OpenSpool()
+{
+	std::lock_guard<std::mutex> l(m_background_task_mutex);
+	m_szSpoolFile = szUserDataFolder + "influxdb_spool.txt";
+	m_spoolSize = 0;
+	m_spoolReadPos = 0;
+	m_spoolLines = 0;
+	std::ifstream infile(m_szSpoolFile.c_str(), std::ios::in | std::ios::binary);
+	if (!infile.is_open())
+		return;
+	std::string sLine;
+	while (std::getline(infile, sLine))
 	{
-		{ // additional scope for lock (accessing size should be within lock too)
-			std::lock_guard<std::mutex> l(m_background_task_mutex);
-			if (m_background_task_queue.empty())
-				continue;
-			_items2do = m_background_task_queue;
-			m_background_task_queue.clear();
-		}
+		m_spoolSize += sLine.size() + 1;
+		m_spoolLines++;
+	}
+	if (m_spoolLines != 0)
+		_log.Log(LOG_STATUS, "InfluxLink: %" PRIu64 " points waiting to be sent", m_spoolLines);
+}
 
-		if (m_szURL.empty())
+void CInfluxPush::WriteSpool(std::deque<std::string> &lines)
+{
+	if (lines.empty())
+		return;
+	//drop what was sent already, that counts for the size limit too
+	CompactSpool();
+	std::ofstream outfile(m_szSpoolFile.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+	if (!outfile.is_open())
+	{
+		_log.Log(LOG_ERROR, "InfluxLink: Could not write spool file (%s), %d points lost!", m_szSpoolFile.c_str(), (int)lines.size());
+		m_stats.dropped += lines.size();
+		lines.clear();
+		return;
+	}
+	for (const auto & itt : lines)
+	{
+		if (m_spoolSize + itt.size() + 1 > INFLUX_MAX_SPOOL_SIZE)
+		{
+			m_stats.dropped++;
 			continue;
+		}
+		outfile << itt << '\n';
+		m_spoolSize += itt.size() + 1;
+		m_spoolLines++;
+	}
+	lines.clear();
+}
 
-		std::string sSendData;
+void CInfluxPush::ReadSpool(std::vector<std::string> &lines, const size_t maxLines)
+{
+	if (m_spoolLines == 0)
+		return;
+	std::ifstream infile(m_szSpoolFile.c_str(), std::ios::in | std::ios::binary);
+	if (infile.is_open())
+	{
+		infile.seekg(m_spoolReadPos);
+		std::string sLine;
+		while ((lines.size() < maxLines) && (std::getline(infile, sLine)))
+		{
+			m_spoolReadPos += sLine.size() + 1;
+			if (m_spoolLines != 0)
+				m_spoolLines--;
+			if (!sLine.empty())
+				lines.push_back(sLine);
+		}
+		if ((m_spoolLines != 0) && (m_spoolReadPos < m_spoolSize) && (infile.good()))
+			return;
+		infile.close();
+	}
+	//everything is read (or the file is gone)
+	std::remove(m_szSpoolFile.c_str());
+	m_spoolSize = 0;
+	m_spoolReadPos = 0;
+	m_spoolLines = 0;
+}
+
+void CInfluxPush::CompactSpool()
+{
+	if (m_spoolReadPos == 0)
+		return;
+	std::string sRemaining;
+	{
+		std::ifstream infile(m_szSpoolFile.c_str(), std::ios::in | std::ios::binary);
+		if (infile.is_open())
+		{
+			infile.seekg(m_spoolReadPos);
+			sRemaining.assign((std::istreambuf_iterator<char>(infile)), (std::istreambuf_iterator<char>()));
+		}
+	}
+	if (sRemaining.empty())
+	{
+		std::remove(m_szSpoolFile.c_str());
+		m_spoolLines = 0;
+	}
+	else
+	{
+		std::ofstream outfile(m_szSpoolFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		outfile << sRemaining;
+	}
+	m_spoolSize = sRemaining.size();
+	m_spoolReadPos = 0;
+}
 
-		std::vector<_tPushItem>::iterator itt = _items2do.begin();
-		while (itt != _items2do.end())
+int CInfluxPush::SendLines(const std::vector<std::string> &lines, const std::string &szURL, const bool bCompress)
+{
+	std::string sSendData;
+	for (const auto & itt : lines)
+	{
+		sSendData += itt;
+		sSendData += '\n';
+	}
+	std::vector<std::string> ExtraHeaders;
+	if (bCompress)
+	{
+		CA2GZIPT<16 * 1024> gzip((char*)sSendData.c_str(), (int)sSendData.size());
+		if (gzip.Length > 0)
 		{
-			if (!sSendData.empty())
-				sSendData += '\n';
+			sSendData.assign((char*)gzip.pgzip, gzip.Length);
+			ExtraHeaders.push_back("Content-Encoding: gzip");
+		}
+	}
+	std::vector<unsigned char> vResponse;
+	std::vector<std::string> vHeaderData;
+	bool bCompleted = HTTPClient::POSTBinary(szURL, sSendData, ExtraHeaders, vResponse, vHeaderData, true, INFLUX_POST_TIMEOUT);
+	//status line of the (last) response, or the one HTTPClient made for a curl error.
+	//A completed transfer can still be an error reply (HTTPClient does not fail on HTTP errors)
+	int status = -1;
+	for (const auto & itt : vHeaderData)
+	{
+		if (itt.find("HTTP/") != 0)
+			continue;
+		size_t pos = itt.find(' ');
+		if (pos != std::string::npos)
+			status = atoi(itt.substr(pos + 1).c_str());
+	}
+	if ((bCompleted) && (status >= 200) && (status < 300))
+		return 0;
+	return (status > 0) ? status : -1;
+}
 
-			std::stringstream sziData;
-			sziData << itt->skey << " value=" << itt->svalue;
-			if (m_bInfluxDebugActive) {
-				_log.Log(LOG_NORM, "InfluxLink: value %s", sziData.str().c_str());
+void CInfluxPush::Do_Work()
+{
+	std::vector<std::string> _items2do;
+	int flushInterval = 500;
+	int backoff = 0;
+	time_t nextAttempt = 0;
+
+	while (!IsStopRequested(flushInterval))
+	{
+		std::string szURL;
+		size_t batchSize;
+		bool bCompress;
+		{
+			std::lock_guard<std::mutex> l(m_background_task_mutex);
+			szURL = m_szURL;
+			batchSize = (size_t)m_InfluxBatchSize;
+			bCompress = m_bInfluxCompress;
+			flushInterval = m_InfluxFlushInterval;
+			if ((szURL.empty()) || (mytime(NULL) < nextAttempt))
+			{
+				//InfluxDB can not be reached, keep the points on disk
+				if (m_background_task_queue.size() >= batchSize)
+					WriteSpool(m_background_task_queue);
+				continue;
 			}
-			sziData << " " << itt->stimestamp;
-			sSendData += sziData.str();
-			++itt;
 		}
-		std::vector<std::string> ExtraHeaders;
-		std::string sResult;
-		if (!HTTPClient::POST(m_szURL, sSendData, ExtraHeaders, sResult, true, true))
+
+		while (!IsStopRequested(0))
 		{
-			_log.Log(LOG_ERROR, "InfluxLink: Error sending data to InfluxDB server! (check address/port/database/username/password)");
+			if (_items2do.empty())
+			{
+				std::lock_guard<std::mutex> l(m_background_task_mutex);
+				if (m_background_task_queue.size() > INFLUX_MAX_QUEUE / 2)
+					WriteSpool(m_background_task_queue);
+				//the oldest points (from the spool) first
+				ReadSpool(_items2do, batchSize);
+				while ((_items2do.size() < batchSize) && (!m_background_task_queue.empty()))
+				{
+					_items2do.push_back(m_background_task_queue.front());
+					m_background_task_queue.pop_front();
+				}
+				if (_items2do.empty())
+					break;
+			}
+			else
+			{
+				std::lock_guard<std::mutex> l(m_background_task_mutex);
+				m_stats.retried += _items2do.size();
+			}
+
+			int status = SendLines(_items2do, szURL, bCompress);
+			if (status == 0)
+			{
+				if (backoff != 0)
+					_log.Log(LOG_STATUS, "InfluxLink: Connection to InfluxDB server restored");
+				backoff = 0;
+				std::lock_guard<std::mutex> l(m_background_task_mutex);
+				m_stats.sent += _items2do.size();
+				_items2do.clear();
+				continue;
+			}
+			if (status == 400)
+			{
+				//malformed points, sending them again will not help
+				_log.Log(LOG_ERROR, "InfluxLink: InfluxDB server did not accept %d points!", (int)_items2do.size());
+				std::lock_guard<std::mutex> l(m_background_task_mutex);
+				m_stats.dropped += _items2do.size();
+				_items2do.clear();
+				continue;
+			}
+			backoff = (backoff == 0) ? 1 : std::min(backoff * 2, INFLUX_MAX_BACKOFF);
+			nextAttempt = mytime(NULL) + backoff;
+			_log.Log(LOG_ERROR, "InfluxLink: Error sending data to InfluxDB server (%d)! Retry in %d seconds (check address/port/database/username/password)", status, backoff);
+			break;
 		}
 	}
+
+	//keep what was not sent for the next start
+	std::lock_guard<std::mutex> l(m_background_task_mutex);
+	m_background_task_queue.insert(m_background_task_queue.begin(), _items2do.begin(), _items2do.end());
+	WriteSpool(m_background_task_queue);
+	CompactSpool();
 }
 
 
@@ -236,6 +493,9 @@ namespace http {
 			std::string username = request::findValue(&req, "username");
 			std::string password = request::findValue(&req, "password");
 			std::string debugenabled = request::findValue(&req, "debugenabled");
+			std::string batchsize = request::findValue(&req, "batchsize");
+			std::string flushinterval = request::findValue(&req, "flushinterval");
+			std::string compress = request::findValue(&req, "compress");
 			if (
 				(linkactive == "") ||
 				(remote == "") ||
@@ -254,6 +514,12 @@ namespace http {
 			m_sql.UpdatePreferencesVar("InfluxUsername", username.c_str());
 			m_sql.UpdatePreferencesVar("InfluxPassword", base64_encode(password));
 			m_sql.UpdatePreferencesVar("InfluxDebug", idebugenabled);
+			if (!batchsize.empty())
+				m_sql.UpdatePreferencesVar("InfluxBatchSize", atoi(batchsize.c_str()));
+			if (!flushinterval.empty())
+				m_sql.UpdatePreferencesVar("InfluxFlushInterval", atoi(flushinterval.c_str()));
+			if (!compress.empty())
+				m_sql.UpdatePreferencesVar("InfluxCompress", atoi(compress.c_str()));
 			m_influxpush.UpdateSettings();
 			root["status"] = "OK";
 			root["title"] = "SaveInfluxLinkConfig";
@@ -304,6 +570,21 @@ namespace http {
 			else {
 				root["InfluxDebug"] = 0;
 			}
+			if (m_sql.GetPreferencesVar("InfluxBatchSize", nValue)) {
+				root["InfluxBatchSize"] = nValue;
+			}
+			if (m_sql.GetPreferencesVar("InfluxFlushInterval", nValue)) {
+				root["InfluxFlushInterval"] = nValue;
+			}
+			if (m_sql.GetPreferencesVar("InfluxCompress", nValue)) {
+				root["InfluxCompress"] = nValue;
+			}
+			CInfluxPush::_tInfluxStatistics stats;
+			m_influxpush.GetStatistics(stats);
+			root["PointsSent"] = (Json::UInt64)stats.sent;
+			root["PointsDropped"] = (Json::UInt64)stats.dropped;
+			root["PointsRetried"] = (Json::UInt64)stats.retried;
+			root["PointsQueued"] = (Json::UInt64)stats.queued;
 			root["status"] = "OK";
 			root["title"] = "GetInfluxLinkConfig";
 		}
@@ -380,6 +661,7 @@ namespace http {
 					idx.c_str()
 				);
 			}
+			m_influxpush.ReloadPushLinks();
 			root["status"] = "OK";
 			root["title"] = "SaveInfluxLink";
 		}
@@ -396,6 +678,7 @@ namespace http {
 			if (idx == "")
 				return;
 			m_sql.safe_query("DELETE FROM PushLink WHERE (ID=='%q')", idx.c_str());
+			m_influxpush.ReloadPushLinks();
 			root["status"] = "OK";
 			root["title"] = "DeleteInfluxLink";
 		}
@@ -1,5 +1,6 @@
 #pragma once
 #include "BasePush.h"
+#include <deque>
 
 class CInfluxPush : public CBasePush
 {
@@ -9,21 +10,57 @@ class CInfluxPush : public CBasePush
 		time_t stimestamp;
 		std::string svalue;
 	};
+	struct _tPushLink
+	{
+		int DelimitedValue;
+		int TargetType;
+		int IncludeUnit;
+	};
 public:
+	struct _tInfluxStatistics
+	{
+		uint64_t sent;
+		uint64_t dropped;
+		uint64_t retried;
+		uint64_t queued;		//in memory and in the spool file
+	};
 	CInfluxPush();
 	bool Start();
 	void Stop();
 	void UpdateSettings();
+	//PushLink rows were changed, they are read again on the next received device
+	void ReloadPushLinks();
+	void GetStatistics(_tInfluxStatistics &stats);
 private:
 	void OnDeviceReceived(const int m_HwdID, const uint64_t DeviceRowIdx, const std::string &DeviceName, const unsigned char *pRXCommand);
-	void DoInfluxPush();
+	void DoInfluxPush(const uint64_t DeviceRowIdx);
+	void LoadPushLinks();
+	void QueueLine(const std::string &line);
+
+	//Lines that could not be sent yet are kept in a spool file, so they survive an InfluxDB (or our own) restart
+	void OpenSpool();
+	void WriteSpool(std::deque<std::string> &lines);
+	void ReadSpool(std::vector<std::string> &lines, const size_t maxLines);
+	void CompactSpool();
+	//0 = sent (2xx), otherwise the HTTP status (or curl error)
+	int SendLines(const std::vector<std::string> &lines, const std::string &szURL, const bool bCompress);
 
 	std::shared_ptr<std::thread> m_thread;
 	std::mutex m_background_task_mutex;
 	void Do_Work();
 
+	std::mutex m_link_mutex;
+	std::map<uint64_t, std::vector<_tPushLink> > m_PushLinks;		//DeviceRowID -> enabled links
+	bool m_bPushLinksLoaded;
 	std::map<std::string,_tPushItem> m_PushedItems;
-	std::vector<_tPushItem> m_background_task_queue;
+
+	std::deque<std::string> m_background_task_queue;
+	_tInfluxStatistics m_stats;
+	std::string m_szSpoolFile;
+	uint64_t m_spoolSize;
+	uint64_t m_spoolReadPos;
+	uint64_t m_spoolLines;
+
 	std::string m_szURL;
 	std::string m_InfluxIP;
 	int m_InfluxPort;
@@ -31,6 +68,9 @@ private:
 	std::string m_InfluxDatabase;
 	std::string m_InfluxUsername;
 	std::string m_InfluxPassword;
+	int m_InfluxBatchSize;
+	int m_InfluxFlushInterval;
+	bool m_bInfluxCompress;
 	bool m_bInfluxDebugActive;
 };
 extern CInfluxPush m_influxpush;
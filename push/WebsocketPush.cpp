@@ -11,6 +11,7 @@ CWebSocketPush::CWebSocketPush(http::server::CWebsocketHandler *sock)
 	m_PushType = PushType::PUSHTYPE_WEBSOCKET;
 	listenRoomplan = false;
 	listenDeviceTable = false;
+	listenSubscribed = false;
 	m_sock = sock;
 	isStarted = false;
 }
@@ -43,7 +44,7 @@ void CWebSocketPush::Stop()
 		m_sSceneChanged.disconnect();
 
 	isStarted = false;
-	ClearListenTable();
+	Unsubscribe();
 }
 
 void CWebSocketPush::ListenTo(const unsigned long long DeviceRowIdx)
@@ -67,6 +68,28 @@ void CWebSocketPush::ClearListenTable()
 	listenIdxs.clear();
 }
 
+void CWebSocketPush::Subscribe(const std::vector<unsigned long long> &DeviceRowIdxs, const std::vector<unsigned long long> &SceneRowIdxs)
+{
+	std::unique_lock<std::mutex> lock(listenMutex);
+	listenIdxs = DeviceRowIdxs;
+	listenSceneIdxs = SceneRowIdxs;
+	listenSubscribed = true;
+}
+
+void CWebSocketPush::Unsubscribe()
+{
+	std::unique_lock<std::mutex> lock(listenMutex);
+	listenIdxs.clear();
+	listenSceneIdxs.clear();
+	listenSubscribed = false;
+}
+
+bool CWebSocketPush::IsSubscribed()
+{
+	std::unique_lock<std::mutex> lock(listenMutex);
+	return listenSubscribed;
+}
+
 void CWebSocketPush::ListenToRoomplan()
 {
 	listenRoomplan = true;
@@ -107,6 +130,12 @@ bool CWebSocketPush::WeListenTo(const unsigned long long DeviceRowIdx)
 	return std::find(listenIdxs.begin(), listenIdxs.end(), DeviceRowIdx) != listenIdxs.end();
 }
 
+bool CWebSocketPush::WeListenToScene(const unsigned long long SceneRowIdx)
+{
+	std::unique_lock<std::mutex> lock(listenMutex);
+	return std::find(listenSceneIdxs.begin(), listenSceneIdxs.end(), SceneRowIdx) != listenSceneIdxs.end();
+}
+
 void CWebSocketPush::OnDeviceReceived(const int m_HwdID, const unsigned long long DeviceRowIdx, const std::string &DeviceName, const unsigned char *pRXCommand)
 {
 	std::unique_lock<std::mutex> lock(handlerMutex);
@@ -114,9 +143,13 @@ void CWebSocketPush::OnDeviceReceived(const int m_HwdID, const unsigned long lon
 		return;
 	}
 
-	m_sock->OnDeviceChanged(DeviceRowIdx);
+	if (!IsSubscribed()) {
+		m_sock->OnDeviceChanged(DeviceRowIdx);
+		return;
+	}
 	if (WeListenTo(DeviceRowIdx)) {
-		// push notification to web socket
+		// sent with the next diff
+		m_sock->QueueChange(DeviceRowIdx, false);
 	}
 }
 
@@ -126,7 +159,13 @@ void CWebSocketPush::OnSceneChange(const unsigned long long SceneRowIdx, const s
 	if (!isStarted) {
 		return;
 	}
-	m_sock->OnSceneChanged(SceneRowIdx);
+	if (!IsSubscribed()) {
+		m_sock->OnSceneChanged(SceneRowIdx);
+		return;
+	}
+	if (WeListenToScene(SceneRowIdx)) {
+		m_sock->QueueChange(SceneRowIdx, true);
+	}
 }
 
 void CWebSocketPush::OnNotificationReceived(const std::string & Subject, const std::string & Text, const std::string & ExtraData, const int Priority, const std::string & Sound, const bool bFromNotification)
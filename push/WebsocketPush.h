@@ -24,13 +24,20 @@ public:
 	void onDeviceTableChanged(); // device added, or deleted
 	// etc, we need a notification of all changes that need to be reflected in the UI
 	bool WeListenTo(const unsigned long long DeviceRowIdx);
+	// subscriptions: only changes of these devices and scenes are sent (as diffs), instead of every device change
+	void Subscribe(const std::vector<unsigned long long> &DeviceRowIdxs, const std::vector<unsigned long long> &SceneRowIdxs);
+	void Unsubscribe();
+	bool IsSubscribed();
+	bool WeListenToScene(const unsigned long long SceneRowIdx);
 private:
 	void OnDeviceReceived(const int m_HwdID, const unsigned long long DeviceRowIdx, const std::string &DeviceName, const unsigned char *pRXCommand);
 	void OnNotificationReceived(const std::string &Subject, const std::string &Text, const std::string &ExtraData, const int Priority, const std::string & Sound, const bool bFromNotification);
 	void OnSceneChange(const unsigned long long SceneRowIdx, const std::string& SceneName);
 	bool listenRoomplan;
 	bool listenDeviceTable;
+	bool listenSubscribed;
 	std::vector<unsigned long long> listenIdxs;
+	std::vector<unsigned long long> listenSceneIdxs;
 	std::mutex listenMutex;
 	std::mutex handlerMutex;
 	http::server::CWebsocketHandler *m_sock;
@@ -6,8 +6,17 @@
 #include "../main/json_helper.h"
 #include "cWebem.h"
 #include "../main/Logger.h"
+#include "../main/SQLHelper.h"
+#include "../main/WebServerHelper.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
 
 #define WEBSOCKET_SESSION_TIMEOUT 86400 // 1 day
+// ms between diffs of subscribed devices/scenes (the client can ask for another interval)
+#define WEBSOCKET_DIFF_INTERVAL 500
+#define WEBSOCKET_IDLE_INTERVAL 1000
+
+extern http::server::CWebServerHelper m_webservers;
 
 namespace http {
 	namespace server {
@@ -16,7 +25,8 @@ namespace http {
 			m_Push(this),
 			sessionid(""),
 			MyWrite(_MyWrite),
-			myWebem(pWebem)
+			myWebem(pWebem),
+			m_diffInterval(WEBSOCKET_IDLE_INTERVAL)
 		{
 			
 		}
@@ -58,6 +68,16 @@ namespace http {
 					return true;
 				}
 				std::string szEvent = value["event"].asString();
+				if (szEvent == "subscribe")
+				{
+					Subscribe(session.username, value);
+					return true;
+				}
+				if (szEvent == "unsubscribe")
+				{
+					Unsubscribe();
+					return true;
+				}
 				if (szEvent.find("request") == std::string::npos)
 					return true;
 
@@ -117,14 +137,20 @@ namespace http {
 
 		void CWebsocketHandler::Do_Work()
 		{
-			while (!IsStopRequested(1000))
+			time_t lastDateTime = 0;
+			int interval = WEBSOCKET_IDLE_INTERVAL;
+			while (!IsStopRequested(interval))
 			{
 				time_t atime = mytime(NULL);
-				if (atime % 10 == 0)
+				if (atime - lastDateTime >= 10)
 				{
-					//Send Date/Time every 10 seconds
+					//Send Date/Time every 10 seconds (the loop does not wake up on every second)
+					lastDateTime = atime;
 					SendDateTime();
 				}
+				SendDiffs();
+				std::unique_lock<std::mutex> lock(m_mutex);
+				interval = m_diffInterval;
 			}
 		}
 
@@ -210,6 +236,162 @@ namespace http {
 			}
 		}
 
+		static void GetRowIdxs(const Json::Value &list, std::vector<unsigned long long> &idxs)
+		{
+			if (!list.isArray())
+				return;
+			for (const auto & itt : list)
+			{
+				if (itt.isString())
+					idxs.push_back(std::strtoull(itt.asCString(), NULL, 10));
+				else if (itt.isUInt64())
+					idxs.push_back(itt.asUInt64());
+			}
+		}
+
+		// {"event":"subscribe", "devices":[idx,..], "scenes":[idx,..], "plans":[idx,..], "interval":ms}
+		// Plans are resolved to their devices and scenes now, subscribe again when a plan is changed
+		void CWebsocketHandler::Subscribe(const std::string &username, const Json::Value &value)
+		{
+			std::vector<unsigned long long> devices, scenes, plans;
+			GetRowIdxs(value["devices"], devices);
+			GetRowIdxs(value["scenes"], scenes);
+			GetRowIdxs(value["plans"], plans);
+			for (const auto & itt : plans)
+			{
+				std::vector<std::vector<std::string> > result;
+				result = m_sql.safe_query("SELECT DeviceRowID, DevSceneType FROM DeviceToPlansMap WHERE (PlanID == %" PRIu64 ")", itt);
+				for (const auto & sd : result)
+				{
+					if (atoi(sd[1].c_str()) == 1)
+						scenes.push_back(std::stoull(sd[0]));
+					else
+						devices.push_back(std::stoull(sd[0]));
+				}
+			}
+			std::set<uint64_t> _devices(devices.begin(), devices.end());
+			std::set<uint64_t> _scenes(scenes.begin(), scenes.end());
+			devices.assign(_devices.begin(), _devices.end());
+			scenes.assign(_scenes.begin(), _scenes.end());
+
+			int interval = WEBSOCKET_DIFF_INTERVAL;
+			if (value["interval"].isIntegral())
+				interval = std::min(std::max(value["interval"].asInt(), 100), 60000);
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				//the first diff has the complete items
+				m_lastSent.clear();
+				m_pendingDevices.swap(_devices);
+				m_pendingScenes.swap(_scenes);
+				m_subscribedUser = username;
+				m_diffInterval = interval;
+			}
+			m_Push.Subscribe(devices, scenes);
+
+			Json::Value json;
+			json["event"] = "subscribed";
+			json["devices"] = static_cast<int>(devices.size());
+			json["scenes"] = static_cast<int>(scenes.size());
+			json["interval"] = interval;
+			MyWrite(JSonToRawString(json));
+		}
+
+		void CWebsocketHandler::Unsubscribe()
+		{
+			m_Push.Unsubscribe();
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_pendingDevices.clear();
+			m_pendingScenes.clear();
+			m_lastSent.clear();
+			m_diffInterval = WEBSOCKET_IDLE_INTERVAL;
+		}
+
+		void CWebsocketHandler::QueueChange(const uint64_t RowIdx, const bool bScene)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (bScene)
+				m_pendingScenes.insert(RowIdx);
+			else
+				m_pendingDevices.insert(RowIdx);
+		}
+
+		// {"event":"diff", "devices":{"idx":{changed fields}}, "scenes":{..}, "removed":{"devices":[idx,..], "scenes":[..]}}
+		// A field that is not there anymore is sent as null
+		void CWebsocketHandler::SendDiffs()
+		{
+			std::set<uint64_t> _devices, _scenes;
+			std::string username;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if ((m_pendingDevices.empty()) && (m_pendingScenes.empty()))
+					return;
+				_devices.swap(m_pendingDevices);
+				_scenes.swap(m_pendingScenes);
+				username = m_subscribedUser;
+			}
+			try
+			{
+				Json::Value root;
+				m_webservers.GetJSonDevices(root, "all", "all", "", "", "", "", true, false, false, 0, username, "", &_devices, &_scenes);
+
+				Json::Value json;
+				std::set<std::string> _found;
+				std::unique_lock<std::mutex> lock(m_mutex);
+				for (const auto & item : root["result"])
+				{
+					std::string szType = item["Type"].asString();
+					bool bScene = ((szType == "Scene") || (szType == "Group"));
+					std::string szIdx = item["idx"].asString();
+					std::string szKey = ((bScene) ? "s" : "d") + szIdx;
+					_found.insert(szKey);
+
+					Json::Value &last = m_lastSent[szKey];
+					Json::Value changed(Json::objectValue);
+					for (const auto & name : item.getMemberNames())
+					{
+						if ((!last.isMember(name)) || (last[name] != item[name]))
+							changed[name] = item[name];
+					}
+					if (last.isObject())
+					{
+						for (const auto & name : last.getMemberNames())
+						{
+							if (!item.isMember(name))
+								changed[name] = Json::Value();
+						}
+					}
+					last = item;
+					if (!changed.empty())
+						json[(bScene) ? "scenes" : "devices"][szIdx] = changed;
+				}
+				//deleted, disabled or not visible for this user
+				for (const auto & itt : _devices)
+				{
+					if (_found.find("d" + std::to_string(itt)) != _found.end())
+						continue;
+					json["removed"]["devices"].append(std::to_string(itt));
+					m_lastSent.erase("d" + std::to_string(itt));
+				}
+				for (const auto & itt : _scenes)
+				{
+					if (_found.find("s" + std::to_string(itt)) != _found.end())
+						continue;
+					json["removed"]["scenes"].append(std::to_string(itt));
+					m_lastSent.erase("s" + std::to_string(itt));
+				}
+				lock.unlock();
+
+				if (json.empty())
+					return;
+				json["event"] = "diff";
+				MyWrite(JSonToRawString(json));
+			}
+			catch (std::exception& e)
+			{
+				_log.Log(LOG_ERROR, "WebsocketHandler::%s Exception: %s", __func__, e.what());
+			}
+		}
+
 		void CWebsocketHandler::SendNotification(const std::string &Subject, const std::string &Text, const std::string &ExtraData, const int Priority, const std::string &Sound, const bool bFromNotification)
 		{
 			Json::Value json;
@@ -8,6 +8,9 @@
 #include <thread>
 #include <mutex>
 #include <memory>
+#include <map>
+#include <set>
+#include <json/json.h>
 
 namespace http {
 	namespace server {
@@ -24,6 +27,8 @@ namespace http {
 			virtual void Stop();
 			virtual void OnDeviceChanged(const uint64_t DeviceRowIdx);
 			virtual void OnSceneChanged(const uint64_t SceneRowIdx);
+			// a subscribed device or scene changed, it is part of the next diff
+			virtual void QueueChange(const uint64_t RowIdx, const bool bScene);
 			virtual void SendNotification(const std::string& Subject, const std::string& Text, const std::string& ExtraData, const int Priority, const std::string& Sound, const bool bFromNotification);
 			virtual void store_session_id(const request &req, const reply &rep);
 		protected:
@@ -33,9 +38,19 @@ namespace http {
 			CWebSocketPush m_Push;
 		private:
 			void SendDateTime();
+			void Subscribe(const std::string &username, const Json::Value &value);
+			void Unsubscribe();
+			void SendDiffs();
 			std::shared_ptr<std::thread> m_thread;
 			std::mutex m_mutex;
 			void Do_Work();
+
+			// subscription state, guarded by m_mutex
+			std::set<uint64_t> m_pendingDevices;
+			std::set<uint64_t> m_pendingScenes;
+			std::map<std::string, Json::Value> m_lastSent;		// "d<idx>" or "s<idx>" -> item as the client has it
+			std::string m_subscribedUser;
+			int m_diffInterval;									// ms changes are collected before a diff is sent
 		};
 
 	}
@@ -0,0 +1,129 @@
+#include "stdafx.h"
+#include "asset_cache.hpp"
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include "mime_types.hpp"
+#include "GZipHelper.h"
+
+#ifdef WIN32
+#define stat _stat
+#endif
+
+// larger files are sent from disk
+#define ASSET_MAX_FILE_SIZE (1024 * 1024)
+// all cached files (and their gzip variant) together
+#define ASSET_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
+namespace http {
+namespace server {
+
+asset_cache::asset_cache() :
+	total_size_(0)
+{
+}
+
+bool asset_cache::is_cacheable_size(const uint64_t size)
+{
+	return (size <= ASSET_MAX_FILE_SIZE);
+}
+
+static bool is_compressible(const std::string &full_path)
+{
+	std::string path = full_path;
+	if ((path.size() > 3) && (path.compare(path.size() - 3, 3, ".gz") == 0))
+		path = path.substr(0, path.size() - 3);
+	std::size_t last_dot_pos = path.find_last_of(".");
+	if (last_dot_pos == std::string::npos)
+		return false;
+	std::string mime_type = mime_types::extension_to_type(path.substr(last_dot_pos + 1));
+	return ((mime_type.find("text/") != std::string::npos) ||
+		(mime_type.find("/xml") != std::string::npos) ||
+		(mime_type.find("/javascript") != std::string::npos) ||
+		(mime_type.find("/json") != std::string::npos) ||
+		(mime_type.find("svg") != std::string::npos));
+}
+
+std::shared_ptr<const asset> asset_cache::load(const std::string &full_path, const time_t mtime, const uint64_t size)
+{
+	std::ifstream is(full_path.c_str(), std::ios::in | std::ios::binary);
+	if (!is.is_open())
+		return NULL;
+	std::string data((std::istreambuf_iterator<char>(is)), (std::istreambuf_iterator<char>()));
+
+	std::shared_ptr<asset> entry = std::make_shared<asset>();
+	entry->mtime = mtime;
+	entry->size = size;
+	if ((full_path.size() > 3) && (full_path.compare(full_path.size() - 3, 3, ".gz") == 0))
+	{
+		CGZIP2A decompress((LPGZIP)data.c_str(), (int)data.size());
+		entry->content.assign(decompress.psz, decompress.Length);
+		entry->gzip_content.swap(data);
+	}
+	else
+	{
+		entry->content.swap(data);
+		if ((!entry->content.empty()) && (is_compressible(full_path)))
+		{
+			//compressed once, so take the time for the best compression
+			CA2GZIPT<16 * 1024, Z_BEST_COMPRESSION> gzip((char*)entry->content.c_str(), (int)entry->content.size());
+			if ((gzip.Length > 0) && (gzip.Length < (int)entry->content.size()))
+				entry->gzip_content.assign((char*)gzip.pgzip, gzip.Length);
+		}
+	}
+	entry->has_includes = (entry->content.find("<!--#embed") != std::string::npos);
+
+	//FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (const auto & itt : entry->content)
+		hash = (hash ^ (uint8_t)itt) * 1099511628211ULL;
+	char szETag[40];
+	sprintf(szETag, "W/\"%08x%08x\"", (unsigned int)(hash >> 32), (unsigned int)(hash & 0xFFFFFFFF));
+	entry->etag = szETag;
+	return entry;
+}
+
+std::shared_ptr<const asset> asset_cache::get(const std::string &full_path)
+{
+	struct stat st;
+	if (stat(full_path.c_str(), &st) != 0)
+		return NULL;
+	if (!is_cacheable_size((uint64_t)st.st_size))
+		return NULL;
+	{
+		std::lock_guard<std::mutex> l(mutex_);
+		std::map<std::string, std::shared_ptr<const asset> >::iterator itt = assets_.find(full_path);
+		if ((itt != assets_.end()) && (itt->second->mtime == st.st_mtime) && (itt->second->size == (uint64_t)st.st_size))
+			return itt->second;
+	}
+
+	//loaded without the lock, two clients asking for the same new file both load it
+	std::shared_ptr<const asset> entry = load(full_path, st.st_mtime, (uint64_t)st.st_size);
+	if (!entry)
+		return NULL;
+
+	std::lock_guard<std::mutex> l(mutex_);
+	std::map<std::string, std::shared_ptr<const asset> >::iterator itt = assets_.find(full_path);
+	if (itt != assets_.end())
+	{
+		total_size_ -= itt->second->content.size() + itt->second->gzip_content.size();
+		assets_.erase(itt);
+	}
+	uint64_t entry_size = entry->content.size() + entry->gzip_content.size();
+	if (total_size_ + entry_size <= ASSET_CACHE_MAX_SIZE)
+	{
+		assets_[full_path] = entry;
+		total_size_ += entry_size;
+	}
+	return entry;
+}
+
+void asset_cache::clear()
+{
+	std::lock_guard<std::mutex> l(mutex_);
+	assets_.clear();
+	total_size_ = 0;
+}
+
+} // namespace server
+} // namespace http
@@ -0,0 +1,53 @@
+//
+// asset_cache.hpp
+// ~~~~~~~~~~~~~~~
+//
+// In-memory copies of the files in the web root, with a precompressed variant and an entity tag
+//
+#pragma once
+#ifndef HTTP_ASSET_CACHE_HPP
+#define HTTP_ASSET_CACHE_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace http {
+namespace server {
+
+/// A cached file
+struct asset
+{
+	std::string content;		// the file (decompressed when the file on disk is a .gz)
+	std::string gzip_content;	// gzip variant, empty when the file does not compress
+	std::string etag;			// weak entity tag, a hash of content
+	bool has_includes;			// contains <!--#embed, so it is generated per request
+	time_t mtime;
+	uint64_t size;				// size on disk
+};
+
+/// Files are loaded on their first request, and reloaded when they change on disk
+class asset_cache
+{
+public:
+	asset_cache();
+	/// The cached file, NULL when it can not be read or is too large to be cached
+	std::shared_ptr<const asset> get(const std::string &full_path);
+	void clear();
+	/// Files larger than this are sent from disk
+	static bool is_cacheable_size(const uint64_t size);
+private:
+	std::shared_ptr<const asset> load(const std::string &full_path, const time_t mtime, const uint64_t size);
+
+	std::mutex mutex_;
+	std::map<std::string, std::shared_ptr<const asset> > assets_;
+	uint64_t total_size_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_ASSET_CACHE_HPP
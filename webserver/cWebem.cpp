@@ -790,7 +790,10 @@ namespace http {
 					}
 				}
 
-				reply::add_header(&rep, "Content-Length", std::to_string(rep.content.size()));
+				if (rep.body_stream)
+					reply::add_header(&rep, "Transfer-Encoding", "chunked");
+				else
+					reply::add_header(&rep, "Content-Length", std::to_string(rep.content.size()));
 				if (!boost::algorithm::starts_with(strMimeType, "image"))
 				{
 					if (!strMimeType.empty())
@@ -1501,6 +1504,13 @@ namespace http {
 			{
 				//see if we support gzip
 				bool bHaveGZipSupport = (strstr(encoding_header, "gzip") != NULL);
+				if ((bHaveGZipSupport) && (rep.body_stream))
+				{
+					//compressed by the connection while it is sent
+					rep.bIsGZIP = true;
+					reply::add_header(&rep, "Content-Encoding", "gzip");
+					return true;
+				}
 				if (bHaveGZipSupport)
 				{
 					CA2GZIP gzip((char*)rep.content.c_str(), (int)rep.content.size());
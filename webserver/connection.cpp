@@ -16,6 +16,14 @@
 #include "mime_types.hpp"
 #include "../main/localtime_r.h"
 #include "../main/Logger.h"
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+
+// largest part handed to sendfile() at once
+#define FILE_SENDFILE_MAX (1024 * 1024)
 
 namespace http {
 	namespace server {
@@ -36,7 +44,10 @@ namespace http {
 			default_abandoned_timeout_(20 * 60), // 20mn before stopping abandoned connection
 			abandoned_timer_(io_service, boost::posix_time::seconds(default_abandoned_timeout_)),
 			default_max_requests_(20),
-			send_buffer_(NULL)
+			send_buffer_(NULL),
+			sendfile_fd_(-1),
+			sendfile_offset_(0),
+			sendfile_size_(0)
 		{
 			secure_ = false;
 			keepalive_ = false;
@@ -61,7 +72,10 @@ namespace http {
 			default_abandoned_timeout_(20 * 60), // 20mn before stopping abandoned connection
 			abandoned_timer_(io_service, boost::posix_time::seconds(default_abandoned_timeout_)),
 			default_max_requests_(20),
-			send_buffer_(NULL)
+			send_buffer_(NULL),
+			sendfile_fd_(-1),
+			sendfile_offset_(0),
+			sendfile_size_(0)
 		{
 			secure_ = true;
 			keepalive_ = false;
@@ -275,6 +289,17 @@ namespace http {
 
 		void connection::handle_write_file(const boost::system::error_code& error, size_t bytes_transferred)
 		{
+#if defined(__linux__)
+			if (sendfile_fd_ != -1)
+			{
+				if ((!error) && (send_file_zero_copy()))
+					return;
+				close(sendfile_fd_);
+				sendfile_fd_ = -1;
+				connection_manager_.stop(shared_from_this());
+				return;
+			}
+#endif
 			if (!error && sendfile_.is_open() && !sendfile_.eof())
 			{
 #define FILE_SEND_BUFFER_SIZE 16*1024
@@ -306,6 +331,36 @@ namespace http {
 			return;
 		}
 
+#if defined(__linux__)
+		// returns true while waiting for the socket to take more
+		bool connection::send_file_zero_copy()
+		{
+			boost::system::error_code ec;
+			socket_->native_non_blocking(true, ec);
+			while (sendfile_offset_ < sendfile_size_)
+			{
+				off_t offset = static_cast<off_t>(sendfile_offset_);
+				size_t count = static_cast<size_t>(std::min<uint64_t>(sendfile_size_ - sendfile_offset_, FILE_SENDFILE_MAX));
+				ssize_t sent = ::sendfile(socket_->native_handle(), sendfile_fd_, &offset, count);
+				if (sent > 0)
+				{
+					sendfile_offset_ = static_cast<uint64_t>(offset);
+					continue;
+				}
+				if ((sent < 0) && (errno == EINTR))
+					continue;
+				if ((sent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+				{
+					socket_->async_wait(boost::asio::ip::tcp::socket::wait_write, boost::bind(&connection::handle_write_file, shared_from_this(), boost::asio::placeholders::error, 0));
+					return true;
+				}
+				//error, or the file became shorter
+				break;
+			}
+			return false;
+		}
+#endif
+
 		bool connection::send_file(const std::string& filename, std::string& attachment_name, reply& rep)
 		{
 			boost::system::error_code write_error;
@@ -344,9 +399,24 @@ namespace http {
 				}
 				reply::add_header_content_type(&rep, mime_type);
 			}
-			reply::add_header_attachment(&rep, attachment_name);
+			if (!attachment_name.empty())
+				reply::add_header_attachment(&rep, attachment_name);
 			reply::add_header(&rep, "Content-Length", std::to_string(total_size));
 
+#if defined(__linux__)
+			if (!secure_)
+			{
+				// plain connections let the kernel copy the file to the socket
+				sendfile_fd_ = open(filename.c_str(), O_RDONLY);
+				if (sendfile_fd_ != -1)
+				{
+					sendfile_.close();
+					sendfile_offset_ = 0;
+					sendfile_size_ = static_cast<uint64_t>(total_size);
+				}
+			}
+#endif
+
 			//write headers
 			std::string headers = rep.to_string("GET");
 			write_buffer = headers;
@@ -406,6 +476,7 @@ namespace http {
 						const char* pConnection = request_.get_req_header(&request_, "Connection");
 						keepalive_ = pConnection != NULL && boost::iequals(pConnection, "Keep-Alive");
 						request_.keep_alive = keepalive_;
+						request_.stream_reply = ((request_.http_version_major > 1) || ((request_.http_version_major == 1) && (request_.http_version_minor >= 1))) && (request_.method != "HEAD");
 						request_.host_address = host_endpoint_address_;
 						request_.host_port = host_endpoint_port_;
 						if (request_.host_address.substr(0, 7) == "::ffff:") {
@@ -446,6 +517,25 @@ namespace http {
 							reply::add_header_if_absent(&reply_, "Keep-Alive", ss.str());
 						}
 
+						if (reply_.body_stream) {
+							std::shared_ptr<chunked_encoder> encoder = std::make_shared<chunked_encoder>(reply_.body_stream, reply_.bIsGZIP);
+							if (encoder->failed()) {
+								// the headers already announce a gzip body, a plain one can not be sent instead
+								_log.Log(LOG_ERROR, "Could not start the compression of a streamed reply");
+								reply_ = reply::stock_reply(reply::internal_server_error);
+							}
+							else {
+								// the chunks are produced in handle_write, the next request is read after the last one
+								{
+									std::unique_lock<std::mutex> lock(writeMutex);
+									stream_encoder_ = encoder;
+								}
+								MyWrite(reply_.header_to_string());
+								status_ = WAITING_WRITE;
+								break;
+							}
+						}
+
 						MyWrite(reply_.to_string(request_.method));
 						if (reply_.status == reply::switching_protocols) {
 							// this was an upgrade request, set this value after MyWrite to allow the 101 response to go out
@@ -530,6 +620,22 @@ This does not seem to print the correct request
 				}
 				return;
 			}
+			bool bStreamDone = false;
+			if (stream_encoder_)
+			{
+				std::string chunk;
+				if ((!error) && (stream_encoder_->next_chunk(chunk)))
+				{
+					SocketWrite(chunk);
+					if (keepalive_)
+					{
+						reset_abandoned_timeout();
+					}
+					return;
+				}
+				stream_encoder_.reset();
+				bStreamDone = true;
+			}
 
 			//Stop needs to be outside the lock. 
 			//There are flows it dead-locks in CWebSocketPush::Stop()
@@ -546,6 +652,10 @@ This does not seem to print the correct request
 			}
 			else if (keepalive_)
 			{
+				if (bStreamDone)
+				{
+					read_more();
+				}
 				status_ = ENDING_WRITE;
 				reset_abandoned_timeout();
 			}
@@ -564,6 +674,9 @@ This does not seem to print the correct request
 			if (sslsocket_) delete sslsocket_;
 #endif
 			if (send_buffer_) delete[] send_buffer_;
+#if defined(__linux__)
+			if (sendfile_fd_ != -1) close(sendfile_fd_);
+#endif
 		}
 
 		// schedule read timeout timer
@@ -19,6 +19,7 @@
 #include "request.hpp"
 #include "request_handler.hpp"
 #include "request_parser.hpp"
+#include "stream_body.hpp"
 #include "Websockets.hpp"
 #ifdef WWW_ENABLE_SSL
 #include <boost/asio/ssl.hpp>
@@ -89,6 +90,14 @@ namespace http {
 			std::ifstream sendfile_;
 			void handle_write_file(const boost::system::error_code& e, size_t bytes_transferred);
 			uint8_t* send_buffer_;
+			/// File sent with sendfile() (plain connections on Linux), instead of sendfile_
+			int sendfile_fd_;
+			uint64_t sendfile_offset_;
+			uint64_t sendfile_size_;
+			bool send_file_zero_copy();
+
+			/// Body of the current reply that is sent in chunks, is protected by writeMutex
+			std::shared_ptr<chunked_encoder> stream_encoder_;
 
 			/// Initialize read timeout timer
 			void set_read_timeout();
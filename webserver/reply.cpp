@@ -138,6 +138,7 @@ void reply::reset()
 	headers.clear();
 	content = "";
 	bIsGZIP = false;
+	body_stream.reset();
 }
 
 namespace stock_replies {
@@ -314,6 +315,11 @@ void reply::set_content(reply *rep, const std::wstring & content_w) {
 	rep->content.assign(utf.get8(), strlen(utf.get8()));
 }
 
+void reply::set_content_stream(reply *rep, const std::shared_ptr<body_source> &source) {
+	rep->content.clear();
+	rep->body_stream = source;
+}
+
 bool reply::set_content_from_file(reply *rep, const std::string & file_path) {
 	std::ifstream file(file_path.c_str(), std::ios::in | std::ios::binary);
 	if (!file.is_open())
@@ -361,6 +367,13 @@ bool reply::set_download_file(reply* rep, const std::string& file_path, const st
 	return true;
 }
 
+void reply::set_static_file(reply* rep, const std::string& file_path)
+{
+	rep->reset();
+	rep->status = reply::status_type::download_file;
+	rep->content = file_path + "\r\n";
+}
+
 void reply::add_header_attachment(reply *rep, const std::string & attachment) {
 	reply::add_header(rep, "Content-Disposition", "attachment; filename=" + attachment);
 }
@@ -13,6 +13,7 @@
 
 #include <string>
 #include <iterator>
+#include <memory>
 #include <boost/asio.hpp>
 #include "header.hpp"
 
@@ -20,6 +21,8 @@ namespace http {
 namespace server {
 
 /// A reply to be sent to a client.
+class body_source;
+
 struct reply
 {
   /// The status of the reply.
@@ -53,6 +56,10 @@ struct reply
   std::string content;
   bool bIsGZIP;
 
+  /// Body that is produced while it is sent (chunked transfer encoding), instead of content.
+  /// Only set when request.stream_reply allows it
+  std::shared_ptr<body_source> body_stream;
+
   /// Convert the reply into a vector of buffers. The buffers do not own the
   /// underlying memory blocks, therefore the reply object must remain valid and
   /// not be changed until the write operation has completed.
@@ -65,8 +72,11 @@ struct reply
   static bool set_content_from_file(reply *rep, const std::string & file_path);
   static bool set_content_from_file(reply *rep, const std::string & file_path, const std::string & attachment, bool set_content_type = false);
   static bool set_download_file(reply* rep, const std::string& file_path, const std::string& attachment);
+  /// Like a download, but shown by the browser (no attachment)
+  static void set_static_file(reply* rep, const std::string& file_path);
   static void add_header_attachment(reply *rep, const std::string & attachment);
   static void add_header_content_type(reply *rep, const std::string & content_type);
+  static void set_content_stream(reply *rep, const std::shared_ptr<body_source> &source);
 
   template <class InputIterator>
   static void set_content(reply *rep, InputIterator first, InputIterator last) {
@@ -31,6 +31,7 @@ public:
 	int content_length;				// the expected length of the contents
 	std::string content;				// the contents
 	bool keep_alive;					// send Keep-Alive header
+	bool stream_reply = false;			// the reply body can be sent with chunked transfer encoding
 
 	/// store map between pages and application functions (wide char)
 	std::multimap<std::string, std::string> parameters;
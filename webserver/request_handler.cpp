@@ -350,7 +350,46 @@ void request_handler::handle_request(const request &req, reply &rep, modify_info
 		}
 
 		// fill out the reply to be sent to the client.
-		if (bHaveLoadedgzip && (!bHaveGZipSupport))
+		is.seekg(0, std::ios::end);
+		uint64_t file_size = static_cast<uint64_t>(is.tellg());
+		is.seekg(0, std::ios::beg);
+		std::shared_ptr<const asset> cached = assets_.get(full_path);
+		if (cached)
+		{
+			is.close();
+			// files with includes are generated per request, they have no fixed content to tag
+			if (!cached->has_includes)
+			{
+				const char *if_none_match = request::get_req_header(&req, "If-None-Match");
+				// If-Modified-Since only counts without If-None-Match. cWebem would check it later,
+				// but not for a gzip reply, so the (delayed) result of not_modified is used here
+				bool bNotModified = (if_none_match != NULL) ?
+					(strstr(if_none_match, cached->etag.c_str()) != NULL) :
+					(mInfo.mtime_support && !mInfo.is_modified);
+				if (bNotModified)
+				{
+					rep = reply::stock_reply(reply::not_modified);
+					reply::add_header(&rep, "ETag", cached->etag);
+					return;
+				}
+				reply::add_header(&rep, "ETag", cached->etag);
+			}
+			bool bUseGZip = (bHaveGZipSupport) && (!cached->gzip_content.empty()) &&
+				((bHaveLoadedgzip) || ((!cached->has_includes) && (myWebem->m_gzipmode == WWW_USE_GZIP)));
+			rep.content = (bUseGZip) ? cached->gzip_content : cached->content;
+			rep.bIsGZIP = bUseGZip;
+			bHaveLoadedgzip = bUseGZip;
+			if (!cached->gzip_content.empty())
+				reply::add_header(&rep, "Vary", "Accept-Encoding");
+		}
+		else if ((req.stream_reply) && (!bHaveLoadedgzip) && (!asset_cache::is_cacheable_size(file_size)))
+		{
+			// too large for the cache, the connection sends it straight from the file
+			is.close();
+			reply::set_static_file(&rep, full_path);
+			return;
+		}
+		else if (bHaveLoadedgzip && (!bHaveGZipSupport))
 		{
 			std::string gzcontent((std::istreambuf_iterator<char>(is)),
 				(std::istreambuf_iterator<char>()));
@@ -13,6 +13,7 @@
 
 #include <string>
 #include "../main/Noncopyable.h"
+#include "asset_cache.hpp"
 #ifndef WEBSERVER_DONT_USE_ZIP
 	#include <minizip/unzip.h>
 	#define USEWIN32IOAPI
@@ -62,6 +63,8 @@ protected:
 
 private:
 	bool not_modified(const std::string &full_path, const request &req, reply &rep, modify_info &mInfo);
+	/// Files from doc_root_, with their gzip variant
+	asset_cache assets_;
 	//zip support
 #ifndef WEBSERVER_DONT_USE_ZIP
 	  zlib_filefunc_def m_ffunc;
@@ -0,0 +1,185 @@
+#include "stdafx.h"
+#include "stream_body.hpp"
+#include <cstdio>
+#include <cstring>
+
+// text that is serialized/compressed per chunk
+#define STREAM_CHUNK_SIZE 16*1024
+
+namespace http {
+namespace server {
+
+json_body_source::json_body_source(Json::Value &root, const std::string &prefix, const std::string &suffix) :
+	prefix_(prefix),
+	suffix_(suffix),
+	started_(false)
+{
+	root_.swap(root);
+}
+
+void json_body_source::write_value(std::string &buf, const Json::Value &value)
+{
+	switch (value.type())
+	{
+	case Json::nullValue:
+		buf += "null";
+		break;
+	case Json::intValue:
+		buf += Json::valueToString(value.asLargestInt());
+		break;
+	case Json::uintValue:
+		buf += Json::valueToString(value.asLargestUInt());
+		break;
+	case Json::realValue:
+		buf += Json::valueToString(value.asDouble());
+		break;
+	case Json::stringValue:
+		buf += Json::valueToQuotedString(value.asCString());
+		break;
+	case Json::booleanValue:
+		buf += Json::valueToString(value.asBool());
+		break;
+	case Json::arrayValue:
+	case Json::objectValue:
+		{
+			bool bArray = (value.type() == Json::arrayValue);
+			if (value.empty())
+			{
+				buf += (bArray) ? "[]" : "{}";
+				break;
+			}
+			buf += (bArray) ? '[' : '{';
+			_tFrame frame;
+			frame.value = &value;
+			frame.index = 0;
+			frame.itt = value.begin();
+			stack_.push_back(frame);
+		}
+		break;
+	}
+}
+
+void json_body_source::write_next(std::string &buf)
+{
+	//top is not used after write_value(), that can grow the stack
+	_tFrame &top = stack_.back();
+	const Json::Value *value = top.value;
+	if (value->type() == Json::arrayValue)
+	{
+		if (top.index == value->size())
+		{
+			buf += ']';
+			stack_.pop_back();
+			return;
+		}
+		Json::ArrayIndex index = top.index++;
+		if (index != 0)
+			buf += ',';
+		write_value(buf, (*value)[index]);
+		return;
+	}
+	if (top.itt == value->end())
+	{
+		buf += '}';
+		stack_.pop_back();
+		return;
+	}
+	Json::Value::const_iterator itt = top.itt++;
+	if (itt != value->begin())
+		buf += ',';
+	buf += Json::valueToQuotedString(itt.name().c_str());
+	buf += ':';
+	write_value(buf, *itt);
+}
+
+bool json_body_source::read(std::string &buf, const size_t max_size)
+{
+	if (!started_)
+	{
+		started_ = true;
+		buf += prefix_;
+		write_value(buf, root_);
+	}
+	while ((!stack_.empty()) && (buf.size() < max_size))
+		write_next(buf);
+	if (!stack_.empty())
+		return true;
+	buf += suffix_;
+	return false;
+}
+
+chunked_encoder::chunked_encoder(const std::shared_ptr<body_source> &source, const bool gzip) :
+	source_(source),
+	gzip_(gzip),
+	finished_(false),
+	done_(false),
+	failed_(false)
+{
+	if (gzip_)
+	{
+		memset(&zstream_, 0, sizeof(zstream_));
+		//15 + 16: zlib writes a gzip header and trailer
+		if (deflateInit2(&zstream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			//the reply says it is gzip compressed, do not send it plain
+			gzip_ = false;
+			failed_ = true;
+		}
+	}
+}
+
+chunked_encoder::~chunked_encoder()
+{
+	if (gzip_)
+		deflateEnd(&zstream_);
+}
+
+void chunked_encoder::compress(const std::string &text, const int flush, std::string &data)
+{
+	unsigned char out[STREAM_CHUNK_SIZE];
+	zstream_.next_in = (Bytef*)text.data();
+	zstream_.avail_in = (uInt)text.size();
+	do
+	{
+		zstream_.next_out = out;
+		zstream_.avail_out = sizeof(out);
+		deflate(&zstream_, flush);
+		data.append((const char*)out, sizeof(out) - zstream_.avail_out);
+	} while (zstream_.avail_out == 0);
+}
+
+bool chunked_encoder::next_chunk(std::string &chunk)
+{
+	chunk.clear();
+	if (done_)
+		return false;
+	std::string data;
+	//deflate keeps small parts until it has a block, do not send empty chunks (that is the end marker)
+	while ((data.empty()) && (!finished_))
+	{
+		std::string text;
+		finished_ = !source_->read(text, STREAM_CHUNK_SIZE);
+		if (gzip_)
+			compress(text, (finished_) ? Z_FINISH : Z_NO_FLUSH, data);
+		else
+			data.swap(text);
+	}
+	if (!data.empty())
+	{
+		char szSize[20];
+		sprintf(szSize, "%zx\r\n", data.size());
+		chunk = szSize;
+		chunk += data;
+		chunk += "\r\n";
+	}
+	if (finished_)
+	{
+		chunk += "0\r\n\r\n";
+		done_ = true;
+		source_.reset();
+	}
+	return true;
+}
+
+} // namespace server
+} // namespace http
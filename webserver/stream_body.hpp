@@ -0,0 +1,78 @@
+//
+// stream_body.hpp
+// ~~~~~~~~~~~~~~~
+//
+// Reply bodies that are produced while they are sent (chunked transfer encoding)
+//
+#pragma once
+#ifndef HTTP_STREAM_BODY_HPP
+#define HTTP_STREAM_BODY_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "zlib.h"
+
+namespace http {
+namespace server {
+
+/// Source of a reply body
+class body_source
+{
+public:
+	virtual ~body_source() {}
+	/// Append the next part of the body to buf (about max_size bytes),
+	/// returns false when this was the last part
+	virtual bool read(std::string &buf, const size_t max_size) = 0;
+};
+
+/// Serializes a json document part by part, so the text is never in memory as a whole
+class json_body_source : public body_source
+{
+public:
+	/// Takes over the contents of root, prefix and suffix are written around the document (jsonp)
+	json_body_source(Json::Value &root, const std::string &prefix = "", const std::string &suffix = "");
+	bool read(std::string &buf, const size_t max_size) override;
+private:
+	struct _tFrame
+	{
+		const Json::Value *value;
+		Json::ArrayIndex index;					// next array element
+		Json::Value::const_iterator itt;		// next object member
+	};
+	void write_value(std::string &buf, const Json::Value &value);
+	void write_next(std::string &buf);
+
+	Json::Value root_;
+	std::string prefix_;
+	std::string suffix_;
+	std::vector<_tFrame> stack_;
+	bool started_;
+};
+
+/// Turns a body source into chunks for chunked transfer encoding, optionally gzip compressed
+class chunked_encoder
+{
+public:
+	chunked_encoder(const std::shared_ptr<body_source> &source, const bool gzip);
+	~chunked_encoder();
+	/// Next chunk to send (including the chunk framing), false when the body was sent completely
+	bool next_chunk(std::string &chunk);
+	/// The compression could not be started, nothing can be sent
+	bool failed() const { return failed_; }
+private:
+	void compress(const std::string &text, const int flush, std::string &data);
+
+	std::shared_ptr<body_source> source_;
+	bool gzip_;
+	z_stream zstream_;
+	bool finished_;
+	bool done_;
+	bool failed_;
+};
+
+} // namespace server
+} // namespace http
+
+#endif // HTTP_STREAM_BODY_HPP